@@ -16,6 +16,7 @@
  * GNU General Public License for more details.
  */
 
+#include <zlib.h>
 #include "dream.h"
 #include "mem.h"
 #include "syscall.h"
@@ -387,7 +388,7 @@ void bios_install( void )
 #define MIN_ISO_SECTORS 32
 
 static gboolean bios_load_ipl( cdrom_disc_t disc, cdrom_track_t track, const char *program_name,
-                               unsigned char *buffer, gboolean unscramble )
+                               unsigned char *buffer, size_t *size, gboolean unscramble )
 {
     gboolean rv = TRUE;
 
@@ -406,7 +407,7 @@ static gboolean bios_load_ipl( cdrom_disc_t disc, cdrom_track_t track, const cha
 
     struct stat st;
     if( iso_file_source_stat(file, &st) == 1 ) {
-        if( st.st_size > (0x8D000000 - BINARY_LOAD_ADDR) ) {
+        if( st.st_size > BINARY_MAX_SIZE ) {
             ERROR( "Disc is not bootable (Initial program is too large to fit into memory)" );
             rv = FALSE;
         } else if( iso_file_source_open(file) == 1 ) {
@@ -423,6 +424,8 @@ static gboolean bios_load_ipl( cdrom_disc_t disc, cdrom_track_t track, const cha
             if( len != st.st_size ) {
                 ERROR( "Disc is not bootable (Unable to read initial program '%s')", program_name );
                 rv = FALSE;
+            } else if( size != NULL ) {
+                *size = len;
             }
             iso_file_source_close(file);
         }
@@ -436,58 +439,99 @@ static gboolean bios_load_ipl( cdrom_disc_t disc, cdrom_track_t track, const cha
     return rv;
 }
 
-gboolean bios_boot_gdrom_disc( void )
+/**
+ * Find the boot track of the disc, read the bootstrap (IP.BIN) from it into
+ * the given buffer (which must be BOOTSTRAP_SIZE bytes), and extract the name
+ * of the initial program.
+ * @param program_name buffer of at least 18 bytes for the program name
+ * @return the boot track, or NULL if the disc is not bootable.
+ */
+static cdrom_track_t bios_read_bootstrap( cdrom_disc_t disc, unsigned char *bootstrap, char *program_name )
 {
-    cdrom_disc_t disc = gdrom_get_current_disc();
-
-    int status = gdrom_get_drive_status();
-    if( status == CDROM_DISC_NONE ) {
-        ERROR( "No disc in drive" );
-        return FALSE;
-    }
-
     /* Find the bootable data track (if present) */
     cdrom_track_t track = gdrom_disc_get_boot_track(disc);
     if( track == NULL ) {
         ERROR( "Disc is not bootable" );
-        return FALSE;
+        return NULL;
     }
     uint32_t sectors = cdrom_disc_get_track_size(disc,track);
     if( sectors < MIN_ISO_SECTORS ) {
         ERROR( "Disc is not bootable" );
-        return FALSE;
+        return NULL;
     }
-    /* Load the initial bootstrap into DC ram at 8c008000 */
     size_t length = BOOTSTRAP_SIZE;
-    unsigned char *bootstrap = mem_get_region(BOOTSTRAP_LOAD_ADDR);
     if( cdrom_disc_read_sectors( disc, track->lba, BOOTSTRAP_SIZE/2048,
             CDROM_READ_DATA|CDROM_READ_MODE2_FORM1, bootstrap, &length ) !=
             CDROM_ERROR_OK ) {
         ERROR( "Disc is not bootable" );
-        return FALSE;
+        return NULL;
     }
 
     /* Check the magic just to be sure */
     dc_bootstrap_head_t metadata = (dc_bootstrap_head_t)bootstrap;
     if( memcmp( metadata->magic, BOOTSTRAP_MAGIC, BOOTSTRAP_MAGIC_SIZE ) != 0 ) {
         ERROR( "Disc is not bootable (missing dreamcast bootstrap)" );
-        return FALSE;
+        return NULL;
     }
 
     /* Get the initial program from the bootstrap (usually 1ST_READ.BIN) */
-    char program_name[18] = "/";
+    program_name[0] = '/';
     memcpy(program_name+1, metadata->boot_file, 16);
     program_name[17] = '\0';
     for( int i=16; i >= 0 && program_name[i] == ' '; i-- ) {
         program_name[i] = '\0';
     }
+    return track;
+}
+
+gboolean bios_boot_gdrom_disc( void )
+{
+    cdrom_disc_t disc = gdrom_get_current_disc();
+    char program_name[18];
+
+    int status = gdrom_get_drive_status();
+    if( status == CDROM_DISC_NONE ) {
+        ERROR( "No disc in drive" );
+        return FALSE;
+    }
+
+    /* Load the initial bootstrap into DC ram at 8c008000 */
+    unsigned char *bootstrap = mem_get_region(BOOTSTRAP_LOAD_ADDR);
+    cdrom_track_t track = bios_read_bootstrap( disc, bootstrap, program_name );
+    if( track == NULL )
+        return FALSE;
 
     /* Bootstrap is good. Now find the program in the actual filesystem... */
     unsigned char *program = mem_get_region(BINARY_LOAD_ADDR);
     gboolean isGDROM = (disc->disc_type == CDROM_DISC_GDROM );
-    if( !bios_load_ipl( disc, track, program_name, program, !isGDROM ) )
+    if( !bios_load_ipl( disc, track, program_name, program, NULL, !isGDROM ) )
         return FALSE;
     asic_enable_ide_interface(isGDROM);
     dreamcast_program_loaded( "", BOOTSTRAP_ENTRY_ADDR );
     return TRUE;
 }
+
+gboolean bios_get_gdrom_disc_hash( uint32_t *bootstrap_crc, uint32_t *program_crc )
+{
+    cdrom_disc_t disc = gdrom_get_current_disc();
+    char program_name[18];
+    size_t program_size = 0;
+    gboolean rv = FALSE;
+
+    if( disc == NULL || gdrom_get_drive_status() == CDROM_DISC_NONE )
+        return FALSE;
+
+    unsigned char *bootstrap = g_malloc(BOOTSTRAP_SIZE);
+    cdrom_track_t track = bios_read_bootstrap( disc, bootstrap, program_name );
+    if( track != NULL ) {
+        unsigned char *program = g_malloc(BINARY_MAX_SIZE);
+        if( bios_load_ipl( disc, track, program_name, program, &program_size, FALSE ) ) {
+            *bootstrap_crc = crc32( 0L, bootstrap, BOOTSTRAP_SIZE );
+            *program_crc = crc32( 0L, program, program_size );
+            rv = TRUE;
+        }
+        g_free(program);
+    }
+    g_free(bootstrap);
+    return rv;
+}
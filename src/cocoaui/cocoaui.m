@@ -31,6 +31,7 @@
 #include "gdrom/gdrom.h"
 #include "gdlist.h"
 #include "loader.h"
+#include "replay.h"
 #include "cocoaui/cocoaui.h"
 
 void cocoa_gui_update( void );
@@ -440,7 +441,7 @@ uint32_t cocoa_gui_run_slice( uint32_t nanosecs )
         gettimeofday(&tv,NULL);
         uint32_t ns = ((tv.tv_sec - cocoa_gui_lasttv.tv_sec) * 1000000000) + 
         (tv.tv_usec - cocoa_gui_lasttv.tv_usec)*1000;
-        if( (ns * 1.05) < current_period ) {
+        if( (ns * 1.05) < current_period && !replay_is_playing() ) {
             // We've gotten ahead - sleep for a little bit
             struct timespec tv;
             tv.tv_sec = 0;
@@ -51,6 +51,11 @@ static struct lxdream_config_group global_group =
         { "recent", NULL, CONFIG_TYPE_FILELIST, NULL },
         { "vmu", NULL, CONFIG_TYPE_FILELIST, NULL },
         { "quick state", NULL, CONFIG_TYPE_INTEGER, "0" },
+        { "disc cache", N_("Disc read cache (MB)"), CONFIG_TYPE_INTEGER, "0" },
+        { "rewind frames", N_("Rewind buffer (frames)"), CONFIG_TYPE_INTEGER, "0" },
+        { "packed vertexes", N_("Packed vertex buffer"), CONFIG_TYPE_BOOLEAN, "false" },
+        { "texture cache", N_("Texture cache (textures)"), CONFIG_TYPE_INTEGER, "256" },
+        { "texture memory", N_("Texture memory limit (MB)"), CONFIG_TYPE_INTEGER, "0" },
         { NULL, CONFIG_TYPE_NONE }} };
 
 /**
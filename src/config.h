@@ -80,7 +80,12 @@ typedef struct lxdream_config_group {
 #define CONFIG_RECENT 7
 #define CONFIG_VMU 8
 #define CONFIG_QUICK_STATE 9
-#define CONFIG_KEY_MAX CONFIG_QUICK_STATE
+#define CONFIG_DISC_CACHE 10
+#define CONFIG_REWIND_FRAMES 11
+#define CONFIG_PACKED_VERTEXES 12
+#define CONFIG_TEXTURE_CACHE 13
+#define CONFIG_TEXTURE_MEMORY 14
+#define CONFIG_KEY_MAX CONFIG_TEXTURE_MEMORY
 
 #define CONFIG_GROUP_GLOBAL 0
 #define CONFIG_GROUP_HOTKEYS 2
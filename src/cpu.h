@@ -89,6 +89,22 @@ typedef struct cpu_desc_struct {
     unsigned int num_gpr_regs; /* Number of general purpose registers */
     unsigned int num_gdb_regs; /* Total number of registers visible to gdb */
     uint32_t *pc; /* Pointer to PC register */
+    /* Optional debugger support - may be NULL if the CPU doesn't have it */
+    /**
+     * Set a breakpoint that only stops if the given condition (in a CPU-
+     * specific syntax) holds when it's reached.
+     * @return TRUE on success, FALSE if the condition can't be parsed.
+     */
+    gboolean (*set_conditional_breakpoint)(uint32_t, breakpoint_type_t, const char *);
+    /* Memory watchpoints, with flags a combination of WATCH_READ/WATCH_WRITE */
+    gboolean (*set_watchpoint)(uint32_t addr, size_t length, int flags);
+    gboolean (*clear_watchpoint)(uint32_t addr, size_t length, int flags);
+    /**
+     * Return (and clear) the watchpoint that stopped the CPU, if any.
+     * @return the access type (WATCH_READ/WATCH_WRITE), or 0 if the last stop
+     * wasn't due to a watchpoint.
+     */
+    int (*get_watchpoint_hit)(uint32_t *addr);
 } const *cpu_desc_t;
 
 #ifdef __cplusplus
@@ -36,6 +36,7 @@ display_driver_t display_driver_list[] = {
 #ifdef __ANDROID__
         &display_egl_driver,
 #endif
+        &display_soft_driver,
         &display_null_driver,
         NULL };
 
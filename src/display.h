@@ -91,6 +91,7 @@ struct render_buffer {
                        * The render buffer does not own the texture */
     unsigned int buf_id; /* driver-specific buffer id, if applicable */
     gboolean flushed; /* True if the buffer has been flushed to vram */
+    uint32_t *pixels; /* ARGB8888 pixels, top row first (software rendering only) */
 };
 
 /**
@@ -114,6 +115,7 @@ struct display_capabilities {
     gboolean has_bgra;
     int depth_bits;
     int stencil_bits; /* 0 = no stencil buffer */
+    gboolean soft_render; /* Scenes are rendered by pvr2_scene_render_soft */
 };
 
 struct vertex_buffer {
@@ -287,6 +289,7 @@ extern struct display_driver display_osx_driver;
 extern struct display_driver display_gl_driver;
 extern struct display_driver display_egl_driver;
 extern struct display_driver display_null_driver;
+extern struct display_driver display_soft_driver;
 
 /****************** Input methods **********************/
 
@@ -71,6 +71,18 @@ typedef struct dreamcast_module {
      * @return 0 on success, nonzero on failure.
      */
     int (*load)(FILE *);
+    /**
+     * Save the module state for an in-memory snapshot (see snapshot.h). This
+     * is called far more often than save(), and need not include anything
+     * that can be cheaply rebuilt. May be NULL, in which case save() is used.
+     */
+    void (*save_snapshot)(FILE *);
+    /**
+     * Load the module state from an in-memory snapshot. May be NULL, in which
+     * case load() is used.
+     * @return 0 on success, nonzero on failure.
+     */
+    int (*load_snapshot)(FILE *);
 } *dreamcast_module_t;
 
 void dreamcast_register_module( dreamcast_module_t );
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <glib.h>
 #include <unistd.h>
+#include <zlib.h>
 #include "lxdream.h"
 #include "lxpaths.h"
 #include "dream.h"
@@ -27,18 +28,32 @@
 #include "mem.h"
 #include "dreamcast.h"
 #include "asic.h"
+#include "bootstrap.h"
 #include "syscall.h"
 #include "gui.h"
 #include "aica/aica.h"
+#include "drivers/cdrom/cdrom.h"
+#include "snapshot.h"
+#include "zpool.h"
+#include "gdrom/gdrom.h"
 #include "gdrom/ide.h"
 #include "maple/maple.h"
 #include "pvr2/pvr2.h"
+#include "replay.h"
 #include "sh4/sh4.h"
 #include "sh4/sh4core.h"
 #include "vmu/vmulist.h"
 
 
 static gboolean dreamcast_load_bios( const gchar *filename );
+static void dreamcast_set_disc_cache( const gchar *size_mb );
+static void dreamcast_set_rewind_frames( const gchar *frames );
+static void dreamcast_set_texture_cache( const gchar *textures, const gchar *memory_mb );
+static void dreamcast_end_time_slice( uint32_t nanosecs );
+static void dreamcast_stop_replay( void );
+static void dreamcast_restore_rewind( unsigned int frames );
+static void dreamcast_check_boot_cache( void );
+static int dreamcast_write_state( const gchar *filename, int level );
 
 /**
  * Current state of the DC virtual machine
@@ -51,11 +66,20 @@ static gboolean dreamcast_use_bios = TRUE;
 static gboolean dreamcast_has_bios = FALSE;
 static gboolean dreamcast_has_flash = FALSE;
 static gboolean dreamcast_exit_on_stop = FALSE;
+static gboolean dreamcast_read_only = FALSE;
 static gchar *dreamcast_program_name = NULL;
 static sh4addr_t dreamcast_entry_point = 0xA0000000;
 static uint32_t timeslice_length = DEFAULT_TIMESLICE_LENGTH;
 static uint64_t run_time_nanosecs = 0;
 static unsigned int quick_save_state = -1;
+static volatile unsigned int rewind_pending = 0;
+static int rewind_last_frame = -1;
+
+/* Boot cache: while armed, the state file to be written for the current
+ * BIOS, flash and disc once the initial program is entered */
+typedef enum { BOOT_CACHE_IDLE=0, BOOT_CACHE_ARMED, BOOT_CACHE_BOOTSTRAP } boot_cache_state_t;
+static boot_cache_state_t boot_cache_state = BOOT_CACHE_IDLE;
+static gchar *boot_cache_filename = NULL;
 
 #define MAX_MODULES 32
 static int num_modules = 0;
@@ -126,6 +150,8 @@ void dreamcast_configure( gboolean use_bootrom )
     }
     dreamcast_has_flash = TRUE;
 
+    dreamcast_set_disc_cache( lxdream_get_global_config_value(CONFIG_DISC_CACHE) );
+
     /* Load in the rest of the core modules */
     dreamcast_register_module( &sh4_module );
     dreamcast_register_module( &asic_module );
@@ -135,6 +161,10 @@ void dreamcast_configure( gboolean use_bootrom )
     dreamcast_register_module( &ide_module );
     dreamcast_register_module( &eventq_module );
 
+    dreamcast_set_rewind_frames( lxdream_get_global_config_value(CONFIG_REWIND_FRAMES) );
+    dreamcast_set_texture_cache( lxdream_get_global_config_value(CONFIG_TEXTURE_CACHE),
+                                 lxdream_get_global_config_value(CONFIG_TEXTURE_MEMORY) );
+
     g_free(bios_path);
     g_free(flash_path);
 }
@@ -187,14 +217,65 @@ gboolean dreamcast_config_changed(void *data, struct lxdream_config_group *group
         dreamcast_load_flash(tmp);
         g_free(tmp);
         break;
+    case CONFIG_DISC_CACHE:
+        dreamcast_set_disc_cache(newval);
+        break;
+    case CONFIG_REWIND_FRAMES:
+        dreamcast_set_rewind_frames(newval);
+        break;
+    case CONFIG_TEXTURE_CACHE:
+        dreamcast_set_texture_cache(newval, lxdream_get_global_config_value(CONFIG_TEXTURE_MEMORY));
+        break;
+    case CONFIG_TEXTURE_MEMORY:
+        dreamcast_set_texture_cache(lxdream_get_global_config_value(CONFIG_TEXTURE_CACHE), newval);
+        break;
     }
     reset_gui_paths();
     return TRUE;
 }
 
+/**
+ * Set the size of the read-ahead cache used for disc images opened from now
+ * on. The value is given in MB, 0 to disable the cache.
+ */
+static void dreamcast_set_disc_cache( const gchar *size_mb )
+{
+    int size = size_mb == NULL ? 0 : atoi(size_mb);
+    if( size < 0 )
+        size = 0;
+    cdrom_disc_set_cache_size( (size_t)size MB );
+}
+
+/**
+ * Set the number of frames held in the rewind buffer, 0 to disable.
+ */
+static void dreamcast_set_rewind_frames( const gchar *frames )
+{
+    int count = frames == NULL ? 0 : atoi(frames);
+    if( count < 0 )
+        count = 0;
+    snapshot_set_size( count );
+    rewind_last_frame = -1;
+}
+
+/**
+ * Set the texture cache size (in textures) and texture memory limit (in
+ * MB, 0 for no limit).
+ */
+static void dreamcast_set_texture_cache( const gchar *textures, const gchar *memory_mb )
+{
+    int count = textures == NULL ? 0 : atoi(textures);
+    int size = memory_mb == NULL ? 0 : atoi(memory_mb);
+    if( count <= 0 )
+        count = 256;
+    if( size < 0 )
+        size = 0;
+    texcache_set_limits( count, (size_t)size MB );
+}
+
 void dreamcast_save_flash()
 {
-    if( dreamcast_has_flash ) {
+    if( dreamcast_has_flash && !dreamcast_read_only ) {
         char *file = lxdream_get_global_config_path_value(CONFIG_FLASH_PATH);
         mem_save_block( file, 0x00200000, 0x00020000 );
         g_free(file);
@@ -233,6 +314,11 @@ void dreamcast_set_exit_on_stop( gboolean flag )
     dreamcast_exit_on_stop = flag;
 }
 
+void dreamcast_set_read_only( gboolean flag )
+{
+    dreamcast_read_only = flag;
+}
+
 void dreamcast_init( gboolean use_bootrom )
 {
     dreamcast_configure( use_bootrom );
@@ -243,6 +329,9 @@ void dreamcast_reset( void )
 {
     sh4_core_exit(CORE_EXIT_SYSRESET);
     int i;
+    if( replay_is_recording() ) {
+        replay_record_reset();
+    }
     for( i=0; i<num_modules; i++ ) {
         if( modules[i]->reset != NULL )
             modules[i]->reset();
@@ -277,11 +366,17 @@ void dreamcast_run( void )
             if( run_time_nanosecs < time_to_run ) {
                 time_to_run = (uint32_t)run_time_nanosecs;
             }
+            if( replay_is_playing() ) {
+                time_to_run = replay_next_slice( time_to_run );
+                if( dreamcast_state != STATE_RUNNING )
+                    break;
+            }
 
             for( i=0; i<num_modules; i++ ) {
                 if( modules[i]->run_time_slice != NULL )
                     time_to_run = modules[i]->run_time_slice( time_to_run );
             }
+            dreamcast_end_time_slice( time_to_run );
 
             if( run_time_nanosecs > time_to_run ) {
                 run_time_nanosecs -= time_to_run;
@@ -293,11 +388,16 @@ void dreamcast_run( void )
     } else {
         while( dreamcast_state == STATE_RUNNING ) {
             int time_to_run = timeslice_length;
+            if( replay_is_playing() ) {
+                time_to_run = replay_next_slice( time_to_run );
+                if( dreamcast_state != STATE_RUNNING )
+                    break;
+            }
             for( i=0; i<num_modules; i++ ) {
                 if( modules[i]->run_time_slice != NULL )
                     time_to_run = modules[i]->run_time_slice( time_to_run );
             }
-
+            dreamcast_end_time_slice( time_to_run );
         }
     }
 
@@ -308,7 +408,8 @@ void dreamcast_run( void )
             modules[i]->stop();
     }
     
-    vmulist_save_all();
+    if( !dreamcast_read_only )
+        vmulist_save_all();
     dreamcast_state = STATE_STOPPED;
 
     if( dreamcast_exit_on_stop ) {
@@ -317,6 +418,151 @@ void dreamcast_run( void )
     }
 }
 
+/**
+ * Housekeeping between time slices, while the machine state is consistent:
+ * apply any pending rewind, and capture a snapshot once per frame if the
+ * rewind buffer is enabled.
+ */
+static void dreamcast_end_time_slice( uint32_t nanosecs )
+{
+    if( replay_is_recording() || replay_is_playing() ) {
+        replay_end_time_slice( nanosecs );
+    }
+    if( rewind_pending != 0 ) {
+        dreamcast_restore_rewind( rewind_pending );
+        rewind_pending = 0;
+    }
+    if( snapshot_get_size() != 0 && pvr2_get_frame_count() != rewind_last_frame ) {
+        snapshot_save();
+        rewind_last_frame = pvr2_get_frame_count();
+    }
+    if( boot_cache_state != BOOT_CACHE_IDLE ) {
+        dreamcast_check_boot_cache();
+    }
+    if( sh4_profiler_is_running() ) {
+        sh4_profiler_collect();
+    }
+}
+
+static void dreamcast_restore_rewind( unsigned int frames )
+{
+    unsigned int count = snapshot_get_count();
+    if( count == 0 )
+        return;
+    if( frames >= count )
+        frames = count-1;
+    dreamcast_stop_replay();
+    if( !snapshot_restore( frames ) ) {
+        ERROR( "Unable to rewind (snapshot could not be restored)" );
+    }
+    rewind_last_frame = pvr2_get_frame_count();
+}
+
+/**
+ * Input recording/replay only works from a continuous run of the machine,
+ * so stop it if the machine state is about to be replaced.
+ */
+static void dreamcast_stop_replay( void )
+{
+    if( replay_is_recording() ) {
+        WARN( "Input recording stopped, as the machine state was replaced" );
+        replay_stop();
+    } else if( replay_is_playing() ) {
+        WARN( "Input replay stopped, as the machine state was replaced" );
+        replay_stop();
+    }
+}
+
+void dreamcast_rewind( unsigned int frames )
+{
+    if( dreamcast_state == STATE_RUNNING ) {
+        /* Don't touch the machine mid-slice */
+        rewind_pending = frames;
+    } else {
+        dreamcast_restore_rewind( frames );
+    }
+}
+
+/******************************** Boot cache *********************************/
+
+#define BOOT_CACHE_FILENAME "%s/bootcache-%08x-%08x-%08x-%08x.dst"
+#define PHYS_ADDR(addr) ((addr) & 0x1FFFFFFF)
+#define MAIN_RAM_END 0x0D000000
+
+static void dreamcast_disarm_boot_cache( void )
+{
+    g_free( boot_cache_filename );
+    boot_cache_filename = NULL;
+    boot_cache_state = BOOT_CACHE_IDLE;
+}
+
+static gboolean dreamcast_boot_cache_disc_changed( cdrom_disc_t disc, const gchar *disc_name, void *user_data )
+{
+    dreamcast_disarm_boot_cache();
+    return TRUE;
+}
+
+gboolean dreamcast_boot_cached_disc( void )
+{
+    static gboolean hook_registered = FALSE;
+    uint32_t bootstrap_crc, program_crc;
+    gchar *filename;
+
+    dreamcast_disarm_boot_cache();
+    if( !bios_get_gdrom_disc_hash( &bootstrap_crc, &program_crc ) )
+        return FALSE;
+
+    /* Everything that goes into the boot is part of the name, so a change to
+     * any of it just means we won't find a matching state */
+    gchar *save_path = lxdream_get_global_config_path_value(CONFIG_SAVE_PATH);
+    filename = g_strdup_printf( BOOT_CACHE_FILENAME, save_path,
+            (uint32_t)crc32( 0L, dc_boot_rom, 2 MB ),
+            (uint32_t)crc32( 0L, dc_flash_ram, 128 KB ),
+            bootstrap_crc, program_crc );
+    g_free( save_path );
+
+    if( access( filename, R_OK ) == 0 && dreamcast_load_state( filename ) ) {
+        INFO( "Boot skipped (restored state from %s)", filename );
+        g_free( filename );
+        return TRUE;
+    }
+
+    if( !hook_registered ) {
+        register_gdrom_disc_change_hook( dreamcast_boot_cache_disc_changed, NULL );
+        hook_registered = TRUE;
+    }
+    boot_cache_filename = filename;
+    boot_cache_state = BOOT_CACHE_ARMED;
+    return FALSE;
+}
+
+/**
+ * Called between time slices while the boot cache is armed. The BIOS (real
+ * or otherwise) always runs the disc bootstrap at BOOTSTRAP_ENTRY_ADDR, which
+ * then jumps to the initial program at BINARY_LOAD_ADDR - the first time we
+ * find the PC in the program area after having seen it in the bootstrap, the
+ * game is running and the state can be written.
+ */
+static void dreamcast_check_boot_cache( void )
+{
+    uint32_t pc = PHYS_ADDR(sh4r.pc);
+    if( pc >= PHYS_ADDR(BOOTSTRAP_LOAD_ADDR) && pc < PHYS_ADDR(BINARY_LOAD_ADDR) ) {
+        boot_cache_state = BOOT_CACHE_BOOTSTRAP;
+    } else if( boot_cache_state == BOOT_CACHE_BOOTSTRAP &&
+            pc >= PHYS_ADDR(BINARY_LOAD_ADDR) && pc < MAIN_RAM_END ) {
+        /* Write to a temporary file first so that a concurrent run never
+         * sees a partial state */
+        gchar *tmpname = g_strdup_printf( "%s.%d", boot_cache_filename, (int)getpid() );
+        if( dreamcast_write_state( tmpname, ZPOOL_LEVEL_FAST ) != 0 ||
+                rename( tmpname, boot_cache_filename ) != 0 ) {
+            WARN( "Unable to write boot state to %s", boot_cache_filename );
+            unlink( tmpname );
+        }
+        g_free( tmpname );
+        dreamcast_disarm_boot_cache();
+    }
+}
+
 void dreamcast_stop( void )
 {
     sh4_core_exit(CORE_EXIT_HALT); // returns only if not inside SH4 core
@@ -331,7 +577,11 @@ void dreamcast_shutdown()
     if( dreamcast_state == STATE_RUNNING )
         dreamcast_state = STATE_STOPPING;
     dreamcast_save_flash();
-    vmulist_save_all();
+    if( !dreamcast_read_only )
+        vmulist_save_all();
+    sh4_profiler_stop();
+    sh4_trace_stop();
+    replay_stop();
 #ifdef ENABLE_SH4STATS
     sh4_stats_print(stdout);
 #endif
@@ -391,7 +641,7 @@ int dreamcast_read_save_state_header( FILE *f, char *error, int errorlen )
     		snprintf( error, errorlen, _("File is not a %s save state"), APP_NAME );
         return 0;
     }
-    if( header.version != DREAMCAST_SAVE_VERSION ) {
+    if( header.version < DREAMCAST_SAVE_MIN_VERSION || header.version > DREAMCAST_SAVE_VERSION ) {
     	if( error != NULL )
     		snprintf( error, errorlen, _("Unsupported %s save state version"), APP_NAME );
         return 0;
@@ -466,6 +716,10 @@ gboolean dreamcast_load_state( const gchar *filename )
     FILE *f = fopen( filename, "r" );
     if( f == NULL ) return FALSE;
 
+    /* The machine is no longer on its way through the boot sequence */
+    dreamcast_disarm_boot_cache();
+    dreamcast_stop_replay();
+
     module_count = dreamcast_read_save_state_header(f, error, sizeof(error));
     if( module_count <= 0 ) {
     	ERROR( error );
@@ -473,6 +727,9 @@ gboolean dreamcast_load_state( const gchar *filename )
         return FALSE;
     }
 
+    /* Rewind history belongs to the previous session */
+    snapshot_clear();
+
     for( i=0; i<MAX_MODULES; i++ ) {
         have_read[i] = 0;
     }
@@ -523,7 +780,10 @@ gboolean dreamcast_load_state( const gchar *filename )
     return TRUE;
 }
 
-int dreamcast_save_state( const gchar *filename )
+/**
+ * Write a save state, compressing the RAM blocks at the given level.
+ */
+static int dreamcast_write_state( const gchar *filename, int level )
 {
     int i;
     FILE *f;
@@ -541,6 +801,7 @@ int dreamcast_save_state( const gchar *filename )
             header.module_count++;
     }
     fwrite( &header, sizeof(header), 1, f );
+    zpool_set_level( level );
     for( i=0; i<num_modules; i++ ) {
         if( modules[i]->save != NULL ) {
             uint32_t blocklen, posn1, posn2;
@@ -554,11 +815,52 @@ int dreamcast_save_state( const gchar *filename )
             fseek( f, posn2, SEEK_SET );
         }
     }
+    zpool_set_level( ZPOOL_LEVEL_DEFAULT );
     fclose( f );
     INFO( "Save state written to %s", filename );
     return 0;
 }
 
+int dreamcast_save_state( const gchar *filename )
+{
+    return dreamcast_write_state( filename, ZPOOL_LEVEL_DEFAULT );
+}
+
+void dreamcast_save_snapshot_state( FILE *f )
+{
+    int i;
+    for( i=0; i<num_modules; i++ ) {
+        if( modules[i]->save_snapshot != NULL ) {
+            modules[i]->save_snapshot(f);
+        } else if( modules[i]->save != NULL ) {
+            modules[i]->save(f);
+        }
+    }
+}
+
+gboolean dreamcast_load_snapshot_state( FILE *f )
+{
+    int i;
+    for( i=0; i<num_modules; i++ ) {
+        if( modules[i]->save_snapshot == NULL && modules[i]->save == NULL ) {
+            continue;
+        } else if( modules[i]->load_snapshot != NULL ) {
+            if( modules[i]->load_snapshot(f) != 0 ) {
+                ERROR( "Snapshot load failed for %s", modules[i]->name );
+                return FALSE;
+            }
+        } else if( modules[i]->load != NULL ) {
+            if( modules[i]->load(f) != 0 ) {
+                ERROR( "Snapshot load failed for %s", modules[i]->name );
+                return FALSE;
+            }
+        } else if( modules[i]->reset != NULL ) {
+            modules[i]->reset();
+        }
+    }
+    return TRUE;
+}
+
 /********************** Quick save state support ***********************/
 /* This section doesn't necessarily belong here, but it probably makes the
  * most sense here next to the regular save/load functions
@@ -591,7 +893,8 @@ void dreamcast_quick_save()
     if( quick_save_state == -1 ) 
         dreamcast_quick_state_init();
     gchar *str = get_quick_state_filename(quick_save_state);
-    dreamcast_save_state(str);
+    /* Favour speed over size here, to keep the pause short */
+    dreamcast_write_state(str, ZPOOL_LEVEL_FAST);
     g_free(str);
 }
 
@@ -44,6 +44,11 @@ void dreamcast_reset(void);
 void dreamcast_run(void);
 void dreamcast_set_run_time( unsigned int seconds, unsigned int nanosecs );
 void dreamcast_set_exit_on_stop( gboolean flag );
+/**
+ * If set, the flash and VMU images are never written back to disk (eg for
+ * throwaway test runs).
+ */
+void dreamcast_set_read_only( gboolean flag );
 void dreamcast_stop(void);
 void dreamcast_shutdown(void);
 gboolean dreamcast_is_running(void);
@@ -63,7 +68,9 @@ gboolean dreamcast_can_run(void);
 void dreamcast_program_loaded( const gchar *name, sh4addr_t entry_point );
 
 #define DREAMCAST_SAVE_MAGIC "%!-lxDream!Save\0"
-#define DREAMCAST_SAVE_VERSION 0x00010006
+#define DREAMCAST_SAVE_VERSION 0x00010007
+/* Oldest version we can still load (differs only in the RAM block encoding) */
+#define DREAMCAST_SAVE_MIN_VERSION 0x00010006
 
 int dreamcast_save_state( const gchar *filename );
 int dreamcast_load_state( const gchar *filename );
@@ -78,6 +85,29 @@ unsigned int dreamcast_get_quick_state();
 void dreamcast_set_quick_state( unsigned int state );
 gboolean dreamcast_has_quick_state( unsigned int state );
 
+/**
+ * Write/read the state of all modules for an in-memory snapshot (see
+ * snapshot.h). RAM regions are not included.
+ */
+void dreamcast_save_snapshot_state( FILE *f );
+gboolean dreamcast_load_snapshot_state( FILE *f );
+
+/**
+ * Rewind the machine by the given number of frames, or as far as the
+ * rewind buffer allows. If the machine is running, this takes effect at the
+ * end of the current time slice.
+ */
+void dreamcast_rewind( unsigned int frames );
+
+/**
+ * Boot the current disc from a cached save state, if there is one matching
+ * the current BIOS, flash and disc (checked by hash). Otherwise arm the
+ * cache, so that the state is written as soon as the disc's initial program
+ * has been entered, for use by later runs.
+ * @return TRUE if the cached state was loaded.
+ */
+gboolean dreamcast_boot_cached_disc( void );
+
 /**
  * Load the front-buffer image from the specified file.
  * If the file is not a valid save state, returns NULL. Otherwise,
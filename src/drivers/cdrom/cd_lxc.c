@@ -0,0 +1,419 @@
+/**
+ * $Id$
+ *
+ * lxdream compressed disc image format. Each track's sectors are stored in
+ * fixed-size hunks, individually compressed with zlib, with a per-track
+ * index of hunk offsets so that any sector can be located without reading
+ * the rest of the file.
+ *
+ * File layout (all values little-endian):
+ *   struct lxc_header
+ *   struct lxc_track[track_count]
+ *   For each track: compressed hunks, followed by the hunk index
+ *     (hunk_count+1 64-bit file offsets - hunk i occupies [idx[i], idx[i+1]).
+ *     A hunk whose stored size equals its uncompressed size is not compressed.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "drivers/cdrom/cdimpl.h"
+
+#define LXC_MAGIC "LXDCDIMG"
+#define LXC_VERSION 1
+#define LXC_HUNK_SECTORS 16
+/* Number of decompressed hunks cached per track */
+#define LXC_CACHE_HUNKS 8
+
+struct lxc_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t hunk_sectors;
+    uint32_t leadout;
+    uint8_t disc_type;
+    uint8_t track_count;
+    uint8_t session_count;
+    uint8_t reserved;
+    char mcn[14];
+    uint8_t reserved2[2];
+} __attribute__((packed));
+
+struct lxc_track {
+    uint8_t trackno;
+    uint8_t sessionno;
+    uint8_t flags;
+    uint8_t mode;
+    uint32_t lba;
+    uint32_t sector_count;
+    uint32_t hunk_count;
+    uint64_t index_offset;
+} __attribute__((packed));
+
+static gboolean lxc_image_is_valid( FILE *f );
+static gboolean lxc_image_read_toc( cdrom_disc_t disc, ERROR *err );
+
+struct cdrom_disc_factory lxc_disc_factory = { "lxdream Compressed Image", "lxc",
+        lxc_image_is_valid, NULL, lxc_image_read_toc };
+
+/************************ Compressed sector source *************************/
+
+struct lxc_hunk_cache {
+    uint32_t hunk;     /* Hunk number held, or (uint32_t)-1 if empty */
+    uint32_t last_use; /* LRU stamp */
+    unsigned char *data;
+};
+
+typedef struct lxc_sector_source {
+    struct sector_source dev;
+    sector_source_t file;  /* Base file source (holds the FILE open) */
+    int fd;
+    size_t hunk_size;      /* Uncompressed size of a full hunk in bytes */
+    uint32_t hunk_count;
+    uint64_t *index;       /* hunk_count+1 file offsets */
+    unsigned char *inbuf;  /* Compressed data buffer */
+    size_t inbuf_size;
+    uint32_t use_counter;
+    struct lxc_hunk_cache cache[LXC_CACHE_HUNKS];
+} *lxc_sector_source_t;
+
+static void lxc_sector_source_destroy( sector_source_t dev )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(dev,COMPRESSED_SECTOR_SOURCE) );
+    lxc_sector_source_t ldev = (lxc_sector_source_t)dev;
+    int i;
+
+    for( i=0; i<LXC_CACHE_HUNKS; i++ ) {
+        g_free( ldev->cache[i].data );
+    }
+    g_free( ldev->index );
+    g_free( ldev->inbuf );
+    sector_source_unref( ldev->file );
+    default_sector_source_destroy(dev);
+}
+
+/**
+ * Return the decompressed data for the given hunk, loading it into the
+ * least-recently used cache slot if it isn't already cached.
+ */
+static unsigned char *lxc_get_hunk( lxc_sector_source_t ldev, uint32_t hunk )
+{
+    struct lxc_hunk_cache *slot = &ldev->cache[0];
+    int i;
+
+    for( i=0; i<LXC_CACHE_HUNKS; i++ ) {
+        if( ldev->cache[i].hunk == hunk ) {
+            ldev->cache[i].last_use = ++ldev->use_counter;
+            return ldev->cache[i].data;
+        }
+        if( ldev->cache[i].last_use < slot->last_use ) {
+            slot = &ldev->cache[i];
+        }
+    }
+
+    uint64_t offset = ldev->index[hunk];
+    size_t stored = ldev->index[hunk+1] - offset;
+    size_t hunk_size = ldev->hunk_size;
+    if( hunk == ldev->hunk_count-1 && (ldev->dev.size % LXC_HUNK_SECTORS) != 0 )
+        hunk_size = (ldev->dev.size % LXC_HUNK_SECTORS) * CDROM_SECTOR_SIZE(ldev->dev.mode);
+    if( stored > ldev->inbuf_size )
+        return NULL;
+
+    if( slot->data == NULL )
+        slot->data = g_malloc( ldev->hunk_size );
+    slot->hunk = (uint32_t)-1;
+
+    if( stored == hunk_size ) {
+        /* Stored uncompressed */
+        if( pread( ldev->fd, slot->data, stored, offset ) != stored )
+            return NULL;
+    } else {
+        uLongf len = hunk_size;
+        if( pread( ldev->fd, ldev->inbuf, stored, offset ) != stored ||
+                uncompress( slot->data, &len, ldev->inbuf, stored ) != Z_OK ||
+                len != hunk_size )
+            return NULL;
+    }
+    slot->hunk = hunk;
+    slot->last_use = ++ldev->use_counter;
+    return slot->data;
+}
+
+static cdrom_error_t lxc_sector_source_read( sector_source_t dev, cdrom_lba_t lba, cdrom_count_t block_count, unsigned char *buf )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(dev,COMPRESSED_SECTOR_SOURCE) );
+    lxc_sector_source_t ldev = (lxc_sector_source_t)dev;
+    size_t sector_size = CDROM_SECTOR_SIZE(dev->mode);
+
+    while( block_count > 0 ) {
+        uint32_t hunk = lba / LXC_HUNK_SECTORS;
+        cdrom_count_t offset = lba % LXC_HUNK_SECTORS;
+        cdrom_count_t count = LXC_HUNK_SECTORS - offset;
+        if( count > block_count )
+            count = block_count;
+
+        unsigned char *data = lxc_get_hunk( ldev, hunk );
+        if( data == NULL )
+            return CDROM_ERROR_READERROR;
+        memcpy( buf, data + offset * sector_size, count * sector_size );
+        buf += count * sector_size;
+        lba += count;
+        block_count -= count;
+    }
+    return CDROM_ERROR_OK;
+}
+
+static sector_source_t lxc_sector_source_new( sector_source_t file, sector_mode_t mode, cdrom_count_t sector_count,
+                                              uint32_t hunk_count, uint64_t index_offset, ERROR *err )
+{
+    size_t hunk_size = LXC_HUNK_SECTORS * CDROM_SECTOR_SIZE(mode);
+    int fd = file_sector_source_get_fd(file);
+    uint32_t i;
+
+    if( hunk_count != (sector_count + LXC_HUNK_SECTORS - 1) / LXC_HUNK_SECTORS ) {
+        SET_ERROR( err, LX_ERR_FILE_INVALID, "Invalid compressed image - bad hunk count" );
+        return NULL;
+    }
+
+    uint64_t *index = g_malloc( (hunk_count+1) * sizeof(uint64_t) );
+    if( pread( fd, index, (hunk_count+1) * sizeof(uint64_t), index_offset ) != (hunk_count+1) * sizeof(uint64_t) ) {
+        SET_ERROR( err, LX_ERR_FILE_IOERROR, "Unable to read compressed image index" );
+        g_free(index);
+        return NULL;
+    }
+    for( i=0; i<=hunk_count; i++ ) {
+        index[i] = GUINT64_FROM_LE(index[i]);
+    }
+    for( i=0; i<hunk_count; i++ ) {
+        if( index[i+1] < index[i] || index[i+1] - index[i] > compressBound(hunk_size) ) {
+            SET_ERROR( err, LX_ERR_FILE_INVALID, "Invalid compressed image - bad hunk index" );
+            g_free(index);
+            return NULL;
+        }
+    }
+
+    lxc_sector_source_t ldev = g_malloc0( sizeof(struct lxc_sector_source) );
+    ldev->file = file;
+    ldev->fd = fd;
+    ldev->hunk_size = hunk_size;
+    ldev->hunk_count = hunk_count;
+    ldev->index = index;
+    ldev->inbuf_size = compressBound(hunk_size);
+    ldev->inbuf = g_malloc( ldev->inbuf_size );
+    for( i=0; i<LXC_CACHE_HUNKS; i++ ) {
+        ldev->cache[i].hunk = (uint32_t)-1;
+    }
+    sector_source_ref( file );
+    return sector_source_init( &ldev->dev, COMPRESSED_SECTOR_SOURCE, mode, sector_count,
+                               lxc_sector_source_read, lxc_sector_source_destroy );
+}
+
+/************************ Image reader *************************/
+
+static gboolean lxc_image_is_valid( FILE *f )
+{
+    struct lxc_header head;
+
+    fseek( f, 0, SEEK_SET );
+    if( fread( &head, sizeof(head), 1, f ) != 1 )
+        return FALSE;
+    return memcmp( head.magic, LXC_MAGIC, sizeof(head.magic) ) == 0;
+}
+
+#define RETURN_PARSE_ERROR( ... ) do { SET_ERROR(err, LX_ERR_FILE_INVALID, __VA_ARGS__); return FALSE; } while(0)
+
+static gboolean lxc_image_read_toc( cdrom_disc_t disc, ERROR *err )
+{
+    struct lxc_header head;
+    struct lxc_track trk;
+    int i;
+
+    FILE *f = cdrom_disc_get_base_file(disc);
+    fseek( f, 0, SEEK_SET );
+    if( fread( &head, sizeof(head), 1, f ) != 1 ||
+            memcmp( head.magic, LXC_MAGIC, sizeof(head.magic) ) != 0 ) {
+        RETURN_PARSE_ERROR( "Invalid compressed image" );
+    }
+    if( GUINT32_FROM_LE(head.version) != LXC_VERSION ) {
+        SET_ERROR( err, LX_ERR_FILE_UNSUP, "Unsupported compressed image version %d", GUINT32_FROM_LE(head.version) );
+        return FALSE;
+    }
+    if( GUINT32_FROM_LE(head.hunk_sectors) != LXC_HUNK_SECTORS ) {
+        SET_ERROR( err, LX_ERR_FILE_UNSUP, "Unsupported compressed image hunk size %d", GUINT32_FROM_LE(head.hunk_sectors) );
+        return FALSE;
+    }
+    if( head.track_count == 0 || head.track_count > 99 ) {
+        RETURN_PARSE_ERROR( "Invalid number of tracks (%d), bad compressed image", head.track_count );
+    }
+
+    disc->disc_type = head.disc_type;
+    disc->session_count = head.session_count;
+    disc->leadout = GUINT32_FROM_LE(head.leadout);
+    memcpy( disc->mcn, head.mcn, sizeof(head.mcn) );
+    disc->mcn[13] = '\0';
+
+    for( i=0; i<head.track_count; i++ ) {
+        fseek( f, sizeof(head) + i*sizeof(trk), SEEK_SET );
+        if( fread( &trk, sizeof(trk), 1, f ) != 1 ) {
+            RETURN_PARSE_ERROR( "Invalid compressed image - unexpected end of file" );
+        }
+        if( trk.mode == SECTOR_UNKNOWN || trk.mode > SECTOR_CDDA_SUBCHANNEL ) {
+            RETURN_PARSE_ERROR( "Unsupported track mode %d", trk.mode );
+        }
+        disc->track[i].trackno = trk.trackno;
+        disc->track[i].sessionno = trk.sessionno;
+        disc->track[i].flags = trk.flags;
+        disc->track[i].lba = GUINT32_FROM_LE(trk.lba);
+        disc->track[i].source = lxc_sector_source_new( disc->base_source, trk.mode,
+                GUINT32_FROM_LE(trk.sector_count), GUINT32_FROM_LE(trk.hunk_count),
+                GUINT64_FROM_LE(trk.index_offset), err );
+        if( disc->track[i].source == NULL ) {
+            disc->track_count = i;
+            return FALSE;
+        }
+        sector_source_ref( disc->track[i].source );
+    }
+    disc->track_count = head.track_count;
+    return TRUE;
+}
+
+/************************ Image writer *************************/
+
+/**
+ * Write a single track's hunks and index at the current position of f,
+ * filling in the track header accordingly.
+ */
+static gboolean lxc_write_track( FILE *f, cdrom_track_t track, struct lxc_track *trk, ERROR *err )
+{
+    sector_source_t source = track->source;
+    sector_mode_t mode = source->mode;
+    size_t sector_size = CDROM_SECTOR_SIZE(mode);
+    cdrom_count_t sector_count = source->size;
+    uint32_t hunk_count = (sector_count + LXC_HUNK_SECTORS - 1) / LXC_HUNK_SECTORS;
+    uLong outbuf_size = compressBound( LXC_HUNK_SECTORS * sector_size );
+    unsigned char *inbuf = g_malloc( LXC_HUNK_SECTORS * sector_size );
+    unsigned char *outbuf = g_malloc( outbuf_size );
+    uint64_t *index = g_malloc( (hunk_count+1) * sizeof(uint64_t) );
+    gboolean result = TRUE;
+    uint32_t i;
+
+    for( i=0; i<hunk_count; i++ ) {
+        cdrom_count_t count = LXC_HUNK_SECTORS;
+        if( i*LXC_HUNK_SECTORS + count > sector_count )
+            count = sector_count - i*LXC_HUNK_SECTORS;
+        size_t len = count * sector_size;
+        uLongf outlen = outbuf_size;
+
+        index[i] = GUINT64_TO_LE( ftello(f) );
+        if( sector_source_read( source, i*LXC_HUNK_SECTORS, count, inbuf ) != CDROM_ERROR_OK ) {
+            SET_ERROR( err, LX_ERR_FILE_IOERROR, "Unable to read sectors %d-%d of track %d",
+                       i*LXC_HUNK_SECTORS, i*LXC_HUNK_SECTORS + count - 1, track->trackno );
+            result = FALSE;
+            break;
+        }
+        if( compress2( outbuf, &outlen, inbuf, len, Z_BEST_COMPRESSION ) == Z_OK && outlen < len ) {
+            result = fwrite( outbuf, outlen, 1, f ) == 1;
+        } else {
+            result = fwrite( inbuf, len, 1, f ) == 1;
+        }
+        if( !result ) {
+            SET_ERROR( err, LX_ERR_FILE_IOERROR, "Unable to write compressed image: %s", strerror(errno) );
+            break;
+        }
+    }
+
+    if( result ) {
+        index[hunk_count] = GUINT64_TO_LE( ftello(f) );
+        trk->trackno = track->trackno;
+        trk->sessionno = track->sessionno;
+        trk->flags = track->flags;
+        trk->mode = mode;
+        trk->lba = GUINT32_TO_LE(track->lba);
+        trk->sector_count = GUINT32_TO_LE(sector_count);
+        trk->hunk_count = GUINT32_TO_LE(hunk_count);
+        trk->index_offset = GUINT64_TO_LE( ftello(f) );
+        if( fwrite( index, sizeof(uint64_t), hunk_count+1, f ) != hunk_count+1 ) {
+            SET_ERROR( err, LX_ERR_FILE_IOERROR, "Unable to write compressed image: %s", strerror(errno) );
+            result = FALSE;
+        }
+    }
+
+    g_free( index );
+    g_free( outbuf );
+    g_free( inbuf );
+    return result;
+}
+
+gboolean cdrom_disc_write_compressed( cdrom_disc_t disc, const gchar *filename, ERROR *err )
+{
+    struct lxc_header head;
+    struct lxc_track trk[99];
+    int i;
+
+    if( disc->track_count == 0 ) {
+        SET_ERROR( err, LX_ERR_FILE_INVALID, "Disc has no tracks" );
+        return FALSE;
+    }
+    for( i=0; i<disc->track_count; i++ ) {
+        if( disc->track[i].source == NULL || disc->track[i].source->mode == SECTOR_UNKNOWN ||
+                CDROM_SECTOR_SIZE(disc->track[i].source->mode) == 0 ) {
+            SET_ERROR( err, LX_ERR_FILE_UNSUP, "Track %d has an unknown sector mode", i+1 );
+            return FALSE;
+        }
+    }
+
+    FILE *f = fopen( filename, "wb" );
+    if( f == NULL ) {
+        SET_ERROR( err, LX_ERR_FILE_NOOPEN, "Unable to open '%s' for writing: %s", filename, strerror(errno) );
+        return FALSE;
+    }
+
+    memset( &head, 0, sizeof(head) );
+    memset( trk, 0, sizeof(trk) );
+    memcpy( head.magic, LXC_MAGIC, sizeof(head.magic) );
+    head.version = GUINT32_TO_LE(LXC_VERSION);
+    head.hunk_sectors = GUINT32_TO_LE(LXC_HUNK_SECTORS);
+    head.leadout = GUINT32_TO_LE(disc->leadout);
+    head.disc_type = disc->disc_type;
+    head.track_count = disc->track_count;
+    head.session_count = disc->session_count;
+    memcpy( head.mcn, disc->mcn, sizeof(head.mcn) );
+
+    /* Headers are rewritten once the track offsets are known */
+    fseeko( f, sizeof(head) + disc->track_count * sizeof(struct lxc_track), SEEK_SET );
+    for( i=0; i<disc->track_count; i++ ) {
+        if( !lxc_write_track( f, &disc->track[i], &trk[i], err ) ) {
+            fclose(f);
+            unlink(filename);
+            return FALSE;
+        }
+    }
+
+    fseeko( f, 0, SEEK_SET );
+    gboolean ok = fwrite( &head, sizeof(head), 1, f ) == 1 &&
+            fwrite( trk, sizeof(struct lxc_track), disc->track_count, f ) == disc->track_count;
+    if( fclose(f) != 0 )
+        ok = FALSE;
+    if( !ok ) {
+        SET_ERROR( err, LX_ERR_FILE_IOERROR, "Unable to write compressed image: %s", strerror(errno) );
+        unlink(filename);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -29,6 +29,7 @@ extern struct cdrom_disc_factory linux_cdrom_drive_factory;
 extern struct cdrom_disc_factory nrg_disc_factory;
 extern struct cdrom_disc_factory cdi_disc_factory;
 extern struct cdrom_disc_factory gdi_disc_factory;
+extern struct cdrom_disc_factory lxc_disc_factory;
 
 cdrom_disc_factory_t cdrom_disc_factories[] = {
 #ifdef HAVE_LINUX_CDROM
@@ -37,8 +38,12 @@ cdrom_disc_factory_t cdrom_disc_factories[] = {
         &nrg_disc_factory,
         &cdi_disc_factory,
         &gdi_disc_factory,
+        &lxc_disc_factory,
         NULL };
 
+/* Total memory to use for read-ahead caching of image tracks (0 = disabled) */
+static size_t cdrom_disc_cache_size = 0;
+
 /********************* Implementation Support functions ************************/
 
 cdrom_error_t default_image_read_blocks( sector_source_t source, cdrom_lba_t lba, cdrom_count_t count,
@@ -191,6 +196,54 @@ void cdrom_disc_clear_toc( cdrom_disc_t disc )
     }
 }
 
+/* Memory-mapped sources are left alone - they're already served from the
+ * page cache (with read-ahead requested via madvise), and wrapping them would
+ * hide map_blocks from the IDE path */
+#define IS_CACHEABLE_SOURCE(source) ((source)->map_blocks == NULL && \
+        (IS_SECTOR_SOURCE_TYPE(source, FILE_SECTOR_SOURCE) || \
+         IS_SECTOR_SOURCE_TYPE(source, COMPRESSED_SECTOR_SOURCE)))
+
+/**
+ * Wrap each file-backed track that isn't memory-mapped in a read-ahead
+ * cache. The cache memory is divided between tracks in proportion to their
+ * size; tracks too small to get a useful cache are left as is.
+ */
+static void cdrom_disc_cache_tracks( cdrom_disc_t disc )
+{
+    uint64_t total = 0;
+    int i;
+
+    if( cdrom_disc_cache_size == 0 )
+        return;
+
+    for( i=0; i<disc->track_count; i++ ) {
+        sector_source_t source = disc->track[i].source;
+        if( IS_CACHEABLE_SOURCE(source) )
+            total += (uint64_t)source->size * CDROM_SECTOR_SIZE(source->mode);
+    }
+    if( total == 0 )
+        return;
+
+    for( i=0; i<disc->track_count; i++ ) {
+        sector_source_t source = disc->track[i].source;
+        if( IS_CACHEABLE_SOURCE(source) ) {
+            uint64_t track_bytes = (uint64_t)source->size * CDROM_SECTOR_SIZE(source->mode);
+            sector_source_t cache = cache_sector_source_new( source,
+                    (size_t)(cdrom_disc_cache_size * track_bytes / total) );
+            if( cache != NULL ) {
+                sector_source_ref( cache );
+                sector_source_unref( source );
+                disc->track[i].source = cache;
+            }
+        }
+    }
+}
+
+void cdrom_disc_set_cache_size( size_t size )
+{
+    cdrom_disc_cache_size = size;
+}
+
 gboolean cdrom_disc_read_toc( cdrom_disc_t disc, ERROR *err )
 {
     if( disc->read_toc != NULL ) {
@@ -202,6 +255,7 @@ gboolean cdrom_disc_read_toc( cdrom_disc_t disc, ERROR *err )
             if( disc->disc_type == CDROM_DISC_NONE )
                 cdrom_disc_set_default_disc_type(disc);
             cdrom_disc_compute_leadout(disc);
+            cdrom_disc_cache_tracks(disc);
             return TRUE;
         } else {
             /* Reset to an empty disc in case the reader left things in an
@@ -425,6 +479,18 @@ cdrom_error_t cdrom_disc_read_sectors( cdrom_disc_t disc, cdrom_lba_t lba, cdrom
     return disc->source.read_sectors( &disc->source, lba, count, mode, buf, length );
 }
 
+unsigned char *cdrom_disc_map_sector( cdrom_disc_t disc, cdrom_lba_t lba, cdrom_read_mode_t mode,
+                                      size_t *length )
+{
+    /* Only image discs read straight through their track sources */
+    if( disc->source.read_sectors != default_image_read_sectors )
+        return NULL;
+    cdrom_track_t track = cdrom_disc_get_track_by_lba( disc, lba );
+    if( track == NULL || track->source == NULL )
+        return NULL;
+    return sector_source_map_sector( track->source, lba - track->lba, mode, length );
+}
+
 /**
  * Check if the disc contains valid media.
  * @return CDROM_ERROR_OK if disc is present, otherwise CDROM_ERROR_NODISC
@@ -152,6 +152,29 @@ cdrom_error_t cdrom_disc_check_media( cdrom_disc_t disc );
 cdrom_error_t cdrom_disc_read_sectors( cdrom_disc_t disc, cdrom_lba_t lba, cdrom_count_t count, cdrom_read_mode_t mode,
                                        unsigned char *buf, size_t *length );
 
+/**
+ * Return a pointer directly to a single sector on the disc, if the disc
+ * supports direct access and the sector can be returned as-is for the read
+ * mode (see sector_source_map_sector). Otherwise returns NULL, and the caller
+ * should use cdrom_disc_read_sectors instead. The pointer is valid until
+ * the disc is destroyed.
+ */
+unsigned char *cdrom_disc_map_sector( cdrom_disc_t disc, cdrom_lba_t lba, cdrom_read_mode_t mode,
+                                      size_t *length );
+
+/**
+ * Set the total amount of memory (in bytes) used for read-ahead caching of
+ * each subsequently opened image file. 0 disables caching.
+ */
+void cdrom_disc_set_cache_size( size_t size );
+
+/**
+ * Write the disc out as an lxdream compressed image (.lxc), which stores
+ * the TOC and each track's sectors in individually compressed hunks.
+ * @return TRUE on success, otherwise FALSE with err set.
+ */
+gboolean cdrom_disc_write_compressed( cdrom_disc_t disc, const gchar *filename, ERROR *err );
+
 /**
  * Print the disc's table of contents to the given output stream.
  */
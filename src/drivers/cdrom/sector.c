@@ -17,8 +17,10 @@
  */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <glib.h>
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -294,6 +296,62 @@ cdrom_error_t sector_extract_from_raw( unsigned char *raw_sector, cdrom_read_mod
     return extract_sector_fields( raw_sector, sector_mode, CDROM_READ_FIELDS(mode), buf, length );
 }
 
+/**
+ * Map a single sector directly if the read mode can be satisfied by returning
+ * the source's native block unchanged - ie data-only reads from data-only
+ * sources, and full raw reads from raw sources.
+ */
+static unsigned char *sector_map_native_block( sector_source_t device, cdrom_lba_t lba,
+                                               cdrom_read_mode_t mode, size_t *length )
+{
+    int read_sector_type = CDROM_READ_TYPE(mode);
+    int read_sector_fields = CDROM_READ_FIELDS(mode);
+    unsigned char *block;
+
+    switch( device->mode ) {
+    case SECTOR_CDDA:
+        if( (read_sector_type != CDROM_READ_ANY && read_sector_type != CDROM_READ_CDDA) ||
+                read_sector_fields == 0 )
+            return NULL;
+        break;
+    case SECTOR_RAW_XA:
+    case SECTOR_RAW_NONXA:
+        if( read_sector_fields != CDROM_READ_RAW )
+            return NULL;
+        break;
+    case SECTOR_MODE1:
+    case SECTOR_MODE2_FORMLESS:
+    case SECTOR_MODE2_FORM1:
+    case SECTOR_MODE2_FORM2:
+        if( read_sector_fields != CDROM_READ_DATA ||
+                is_legal_read( device->mode, mode ) != CDROM_ERROR_OK )
+            return NULL;
+        break;
+    default:
+        return NULL;
+    }
+
+    block = device->map_blocks( device, lba, 1 );
+    if( block != NULL && (device->mode == SECTOR_RAW_XA || device->mode == SECTOR_RAW_NONXA) ) {
+        /* Still need to check the actual sector type against the read type */
+        sector_mode_t sector_mode = identify_sector( device->mode, block );
+        if( sector_mode == SECTOR_UNKNOWN || is_legal_read( sector_mode, mode ) != CDROM_ERROR_OK )
+            return NULL;
+    }
+    if( block != NULL && length != NULL )
+        *length = CDROM_SECTOR_SIZE(device->mode);
+    return block;
+}
+
+unsigned char *sector_source_map_sector( sector_source_t device, cdrom_lba_t lba, cdrom_read_mode_t mode,
+                                         size_t *length )
+{
+    if( !IS_SECTOR_SOURCE(device) || device->map_blocks == NULL ||
+            (device->size != 0 && lba >= device->size) )
+        return NULL;
+    return sector_map_native_block( device, lba, mode, length );
+}
+
 /**
  * This is horribly complicated by the need to handle mapping between all possible
  * sector modes + read modes, but fortunately most sources can just supply
@@ -410,6 +468,7 @@ sector_source_t sector_source_init( sector_source_t device, sector_source_type_t
     device->size = size;
     device->read_blocks = readfn;
     device->read_sectors = default_sector_source_read_sectors;
+    device->map_blocks = NULL;
     if( destroyfn == NULL )
         device->destroy = default_sector_source_destroy;
     else
@@ -437,13 +496,30 @@ typedef struct file_sector_source {
     uint32_t offset; /* offset in file where source begins */
     sector_source_t ref; /* Parent source reference */
     gboolean closeOnDestroy;
+    unsigned char *map; /* Memory-mapped file contents, or NULL if not mapped */
+    size_t map_size;
+    size_t advised_start, advised_end; /* Range last passed to madvise */
 } *file_sector_source_t;
 
+/** Bytes of a mapped file to read ahead of the current position */
+#define FILE_MAP_READAHEAD (1024*1024)
+
+/**
+ * File sources created from the same image share a single FILE, and may be
+ * read from both the emulation thread and the cache prefetch thread, so all
+ * stdio reads go through this lock to keep the fseek/fread pairs together.
+ */
+static pthread_mutex_t file_sector_io_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void file_sector_source_destroy( sector_source_t dev )
 {
     assert( IS_SECTOR_SOURCE_TYPE(dev,FILE_SECTOR_SOURCE) );
     file_sector_source_t fdev = (file_sector_source_t)dev;
 
+    if( fdev->map != NULL && fdev->ref == NULL ) {
+        munmap( fdev->map, fdev->map_size );
+    }
+    fdev->map = NULL;
     if( fdev->closeOnDestroy && fdev->file != NULL ) {
         fclose( fdev->file );
     }
@@ -452,6 +528,32 @@ void file_sector_source_destroy( sector_source_t dev )
     default_sector_source_destroy(dev);
 }
 
+/**
+ * Mapped files bypass the sector cache, so ask the kernel to read ahead of
+ * the accessed range instead. The advice is renewed once access moves outside
+ * the advised range or gets within half a window of its end.
+ */
+static void file_sector_source_advise( file_sector_source_t fdev, size_t off, size_t size )
+{
+#ifdef MADV_WILLNEED
+    static size_t page_mask = 0;
+    size_t end = off + size, start;
+
+    if( off >= fdev->advised_start && off < fdev->advised_end &&
+            (fdev->advised_end == fdev->map_size || end + FILE_MAP_READAHEAD/2 <= fdev->advised_end) )
+        return;
+    if( page_mask == 0 )
+        page_mask = sysconf(_SC_PAGESIZE) - 1;
+    start = off & ~page_mask;
+    end += FILE_MAP_READAHEAD;
+    if( end > fdev->map_size )
+        end = fdev->map_size;
+    madvise( fdev->map + start, end - start, MADV_WILLNEED );
+    fdev->advised_start = off;
+    fdev->advised_end = end;
+#endif
+}
+
 cdrom_error_t file_sector_source_read( sector_source_t dev, cdrom_lba_t lba, cdrom_count_t block_count, unsigned char *buf )
 {
     assert( IS_SECTOR_SOURCE_TYPE(dev,FILE_SECTOR_SOURCE) );
@@ -459,9 +561,27 @@ cdrom_error_t file_sector_source_read( sector_source_t dev, cdrom_lba_t lba, cdr
 
     uint32_t off = fdev->offset + lba * CDROM_SECTOR_SIZE(dev->mode);
     uint32_t size = block_count * CDROM_SECTOR_SIZE(dev->mode);
-    fseek( fdev->file, off, SEEK_SET );
 
+    if( fdev->map != NULL ) {
+        size_t len = 0;
+        if( off < fdev->map_size ) {
+            len = fdev->map_size - off;
+            if( len > size )
+                len = size;
+            file_sector_source_advise( fdev, off, len );
+            memcpy( buf, fdev->map + off, len );
+        }
+        if( len < size ) {
+            /* zero-fill */
+            memset( buf + len, 0, size-len );
+        }
+        return CDROM_ERROR_OK;
+    }
+
+    pthread_mutex_lock( &file_sector_io_lock );
+    fseek( fdev->file, off, SEEK_SET );
     size_t len = fread( buf, 1, size, fdev->file );
+    pthread_mutex_unlock( &file_sector_io_lock );
     if( len == -1 ) {
         return CDROM_ERROR_READERROR;
     } else if( len < size ) {
@@ -471,6 +591,40 @@ cdrom_error_t file_sector_source_read( sector_source_t dev, cdrom_lba_t lba, cdr
     return CDROM_ERROR_OK;
 }
 
+static unsigned char *file_sector_source_map( sector_source_t dev, cdrom_lba_t lba, cdrom_count_t block_count )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(dev,FILE_SECTOR_SOURCE) );
+    file_sector_source_t fdev = (file_sector_source_t)dev;
+
+    size_t off = fdev->offset + (size_t)lba * CDROM_SECTOR_SIZE(dev->mode);
+    size_t size = (size_t)block_count * CDROM_SECTOR_SIZE(dev->mode);
+    if( fdev->map == NULL || off + size > fdev->map_size )
+        return NULL; /* Not mapped, or the range is (partially) past EOF */
+    file_sector_source_advise( fdev, off, size );
+    return fdev->map + off;
+}
+
+/**
+ * Memory-map the source's file, if it's a regular file. If this fails the
+ * source just continues to read via stdio.
+ */
+static void file_sector_source_map_file( file_sector_source_t fdev )
+{
+    struct stat st;
+    int fd = fileno(fdev->file);
+
+    if( fstat( fd, &st ) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+            (uint64_t)st.st_size > (size_t)-1 )
+        return;
+
+    void *map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if( map != MAP_FAILED ) {
+        fdev->map = map;
+        fdev->map_size = st.st_size;
+        fdev->dev.map_blocks = file_sector_source_map;
+    }
+}
+
 sector_source_t file_sector_source_new( FILE *f, sector_mode_t mode, uint32_t offset,
                                         cdrom_count_t sector_count, gboolean closeOnDestroy )
 {
@@ -493,6 +647,9 @@ sector_source_t file_sector_source_new( FILE *f, sector_mode_t mode, uint32_t of
     dev->offset = offset;
     dev->closeOnDestroy = closeOnDestroy;
     dev->ref = NULL;
+    dev->map = NULL;
+    dev->map_size = 0;
+    dev->advised_start = dev->advised_end = 0;
     return sector_source_init( &dev->dev, FILE_SECTOR_SOURCE, mode,  sector_count, file_sector_source_read, file_sector_source_destroy );
 }
 
@@ -512,9 +669,13 @@ sector_source_t file_sector_source_new_filename( const gchar *filename, sector_m
     if( f == NULL ) {
         close(fd);
         return NULL;
-    } else {
-        return file_sector_source_new( f, mode, offset, sector_count, TRUE );
     }
+
+    sector_source_t source = file_sector_source_new( f, mode, offset, sector_count, TRUE );
+    if( source != NULL ) {
+        file_sector_source_map_file( (file_sector_source_t)source );
+    }
+    return source;
 }
 
 sector_source_t file_sector_source_new_source( sector_source_t ref, sector_mode_t mode, uint32_t offset,
@@ -524,7 +685,14 @@ sector_source_t file_sector_source_new_source( sector_source_t ref, sector_mode_
     file_sector_source_t fref = (file_sector_source_t)ref;
 
     sector_source_t source = file_sector_source_new( fref->file, mode, offset, sector_count, FALSE );
-    ((file_sector_source_t)source)->ref = ref;
+    file_sector_source_t fdev = (file_sector_source_t)source;
+    fdev->ref = ref;
+    if( fref->map != NULL ) {
+        /* Share the parent's mapping */
+        fdev->map = fref->map;
+        fdev->map_size = fref->map_size;
+        source->map_blocks = file_sector_source_map;
+    }
     sector_source_ref(ref);
     return source;
 }
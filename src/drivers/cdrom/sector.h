@@ -35,12 +35,15 @@ typedef enum {
     FILE_SECTOR_SOURCE,
     MEM_SECTOR_SOURCE,
     DISC_SECTOR_SOURCE,
-    TRACK_SECTOR_SOURCE
+    TRACK_SECTOR_SOURCE,
+    CACHE_SECTOR_SOURCE,
+    COMPRESSED_SECTOR_SOURCE
 } sector_source_type_t;
 
 typedef cdrom_error_t (*sector_source_read_fn_t)(sector_source_t, cdrom_lba_t, cdrom_count_t, unsigned char *outbuf);
 typedef cdrom_error_t (*sector_source_read_sectors_fn_t)(sector_source_t, cdrom_lba_t, cdrom_count_t, cdrom_read_mode_t mode,
         unsigned char *outbuf, size_t *length);
+typedef unsigned char *(*sector_source_map_fn_t)(sector_source_t, cdrom_lba_t, cdrom_count_t);
 typedef void (*sector_source_destroy_fn_t)(sector_source_t);
 
 /**
@@ -74,6 +77,14 @@ struct sector_source {
      */
     sector_source_read_sectors_fn_t read_sectors;
 
+    /**
+     * Return a pointer directly to the blocks in the device's native block size,
+     * if the source supports it (ie memory-mapped files), otherwise NULL. The
+     * pointer remains valid for the lifetime of the source. May be NULL if the
+     * source never supports direct access.
+     */
+    sector_source_map_fn_t map_blocks;
+
     /**
      * Release all resources and memory used by the device (note should never
      * be called directly
@@ -90,7 +101,9 @@ sector_source_t null_sector_source_new( sector_mode_t mode, cdrom_count_t size )
 #define FILE_SECTOR_FULL_FILE ((cdrom_count_t)-1)
 
 /**
- * File reader. Last block is 0-padded.
+ * File reader. Last block is 0-padded. When opened by filename, regular files
+ * are memory-mapped if possible, which allows direct access to the sectors
+ * (see sector_source_map_sector); otherwise reads go through stdio.
  */
 sector_source_t file_sector_source_new_filename( const gchar *filename, sector_mode_t mode,
                                                  uint32_t offset, cdrom_count_t sector_count );
@@ -145,6 +158,22 @@ sector_source_t mem_sector_source_new_buffer( unsigned char *buffer, sector_mode
  */
 unsigned char *mem_sector_source_get_buffer( sector_source_t source );
 
+/**
+ * Construct a read-ahead cache over the given source. Sectors read through
+ * the cache are retained in memory, and a background thread prefetches
+ * sequentially following the last sector read.
+ * @param base The source to cache. It must have a known mode and size.
+ * @param cache_size Amount of memory to use for the cache, in bytes.
+ * @return the new source, or NULL if the base source can't be cached (or
+ * the cache size is too small to be useful).
+ */
+sector_source_t cache_sector_source_new( sector_source_t base, size_t cache_size );
+
+/**
+ * Retrieve the source underlying a cache source
+ */
+sector_source_t cache_sector_source_get_base( sector_source_t source );
+
 /**
  * Increment the reference count for a block device.
  */
@@ -167,6 +196,16 @@ cdrom_error_t sector_source_read( sector_source_t device, cdrom_lba_t lba, cdrom
 cdrom_error_t sector_source_read_sectors( sector_source_t device, cdrom_lba_t lba, cdrom_count_t block_count,
                                           cdrom_read_mode_t mode, unsigned char *buf, size_t *length );
 
+/**
+ * Return a pointer directly to the given sector in the source, if the
+ * requested read mode is satisfied by the source's native block (and the
+ * source supports direct access), otherwise NULL. In this case the caller
+ * should fall back to sector_source_read_sectors.
+ * @param length output length of the sector data at the returned pointer.
+ */
+unsigned char *sector_source_map_sector( sector_source_t device, cdrom_lba_t lba, cdrom_read_mode_t mode,
+                                         size_t *length );
+
 /***** Internals for sector source implementations *****/
 
 /**
@@ -0,0 +1,336 @@
+/**
+ * $Id$
+ *
+ * Read-ahead sector cache. The cache source sits on top of another sector
+ * source (normally a file), and keeps recently read sectors in memory. A
+ * single background thread reads ahead sequentially from the last position
+ * read on whichever cache source was accessed most recently, so that
+ * streaming reads are normally satisfied without blocking on the host file
+ * system.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <glib.h>
+
+#include "lxdream.h"
+#include "drivers/cdrom/sector.h"
+
+/** Number of sectors held by each cache line */
+#define CACHE_LINE_SECTORS 16
+
+typedef enum { LINE_EMPTY, LINE_LOADING, LINE_VALID } cache_line_state_t;
+
+struct cache_line {
+    cdrom_lba_t lba;   /* First sector held by the line */
+    cache_line_state_t state;
+};
+
+typedef struct cache_sector_source {
+    struct sector_source dev;
+    sector_source_t base;
+    size_t line_size;       /* Size of a cache line in bytes */
+    unsigned int line_count;
+    unsigned int readahead; /* Maximum number of lines to prefetch */
+    struct cache_line *lines;
+    unsigned char *data;
+    cdrom_lba_t next_lba;   /* Sector following the last one read */
+    uint64_t hits;          /* Sectors read from the cache */
+    uint64_t misses;        /* Sectors read from the base source */
+    uint64_t prefetched;    /* Lines loaded by the prefetch thread */
+} *cache_sector_source_t;
+
+/**
+ * Shared prefetch state. The cache metadata for all cache sources is
+ * protected by lock. Reads from the base sources are serialized by io_lock,
+ * as the base sources (eg compressed sources) aren't necessarily safe to
+ * read from two threads at once.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_mutex_t io_lock;
+    pthread_cond_t work_wait;  /* Signalled when there is something to prefetch */
+    pthread_cond_t load_wait;  /* Signalled when a line load completes */
+    cache_sector_source_t target; /* Source to prefetch from, or NULL */
+    cache_sector_source_t busy;   /* Source the prefetcher is reading from, or NULL */
+    GList *sources;               /* All live cache sources */
+    gboolean started;
+    gboolean atfork_registered;
+    pthread_t thread;
+} cache_prefetch = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+        PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, NULL, FALSE, FALSE };
+
+/**
+ * Load the given line from the base source. Must be called with the cache
+ * lock held and the line already marked LINE_LOADING - the lock is released
+ * for the duration of the read.
+ */
+static cdrom_error_t cache_load_line( cache_sector_source_t cdev, unsigned int idx, cdrom_lba_t lba )
+{
+    struct cache_line *line = &cdev->lines[idx];
+    unsigned char *data = cdev->data + idx * cdev->line_size;
+    cdrom_count_t count = CACHE_LINE_SECTORS;
+    cdrom_error_t err;
+
+    if( lba + count > cdev->dev.size )
+        count = cdev->dev.size - lba;
+
+    pthread_mutex_unlock( &cache_prefetch.lock );
+    pthread_mutex_lock( &cache_prefetch.io_lock );
+    err = sector_source_read( cdev->base, lba, count, data );
+    pthread_mutex_unlock( &cache_prefetch.io_lock );
+    pthread_mutex_lock( &cache_prefetch.lock );
+
+    line->state = (err == CDROM_ERROR_OK ? LINE_VALID : LINE_EMPTY);
+    pthread_cond_broadcast( &cache_prefetch.load_wait );
+    return err;
+}
+
+/**
+ * Find the next line within the read-ahead window that isn't already in the
+ * cache (or being loaded).
+ * @return TRUE if a line was found, with *idx and *lba set accordingly.
+ */
+static gboolean cache_find_prefetch_line( cache_sector_source_t cdev, unsigned int *idx, cdrom_lba_t *lba )
+{
+    cdrom_lba_t line_no = (cdev->next_lba + CACHE_LINE_SECTORS - 1) / CACHE_LINE_SECTORS;
+    unsigned int i;
+
+    for( i=0; i<cdev->readahead; i++, line_no++ ) {
+        cdrom_lba_t line_lba = line_no * CACHE_LINE_SECTORS;
+        if( line_lba >= cdev->dev.size )
+            break;
+        struct cache_line *line = &cdev->lines[line_no % cdev->line_count];
+        if( line->state == LINE_LOADING )
+            continue;
+        if( line->state == LINE_VALID && line->lba == line_lba )
+            continue;
+        *idx = line_no % cdev->line_count;
+        *lba = line_lba;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void *cache_prefetch_thread( void *arg )
+{
+    pthread_mutex_lock( &cache_prefetch.lock );
+    for(;;) {
+        cache_sector_source_t cdev = cache_prefetch.target;
+        unsigned int idx;
+        cdrom_lba_t lba;
+
+        if( cdev == NULL || !cache_find_prefetch_line( cdev, &idx, &lba ) ) {
+            /* Nothing left to do until the next read */
+            cache_prefetch.target = NULL;
+            pthread_cond_wait( &cache_prefetch.work_wait, &cache_prefetch.lock );
+            continue;
+        }
+
+        cdev->lines[idx].lba = lba;
+        cdev->lines[idx].state = LINE_LOADING;
+        cache_prefetch.busy = cdev;
+        if( cache_load_line( cdev, idx, lba ) == CDROM_ERROR_OK ) {
+            cdev->prefetched++;
+        } else {
+            /* Don't keep hammering on a failing source */
+            if( cache_prefetch.target == cdev )
+                cache_prefetch.target = NULL;
+        }
+        cache_prefetch.busy = NULL;
+        pthread_cond_broadcast( &cache_prefetch.load_wait );
+    }
+    return NULL;
+}
+
+/**
+ * Fork handlers. The locks are held across the fork so that the child
+ * doesn't inherit them mid-update; the child then has no prefetch thread, so
+ * any line that was being loaded by another thread is discarded and the
+ * prefetcher is restarted on the next read.
+ */
+static void cache_prefetch_atfork_prepare( void )
+{
+    pthread_mutex_lock( &cache_prefetch.lock );
+    pthread_mutex_lock( &cache_prefetch.io_lock );
+}
+
+static void cache_prefetch_atfork_parent( void )
+{
+    pthread_mutex_unlock( &cache_prefetch.io_lock );
+    pthread_mutex_unlock( &cache_prefetch.lock );
+}
+
+static void cache_prefetch_atfork_child( void )
+{
+    GList *ptr;
+    unsigned int i;
+
+    for( ptr = cache_prefetch.sources; ptr != NULL; ptr = ptr->next ) {
+        cache_sector_source_t cdev = (cache_sector_source_t)ptr->data;
+        for( i=0; i<cdev->line_count; i++ ) {
+            if( cdev->lines[i].state == LINE_LOADING )
+                cdev->lines[i].state = LINE_EMPTY;
+        }
+    }
+    cache_prefetch.target = NULL;
+    cache_prefetch.busy = NULL;
+    cache_prefetch.started = FALSE;
+    pthread_cond_init( &cache_prefetch.work_wait, NULL );
+    pthread_cond_init( &cache_prefetch.load_wait, NULL );
+    pthread_mutex_unlock( &cache_prefetch.io_lock );
+    pthread_mutex_unlock( &cache_prefetch.lock );
+}
+
+/**
+ * Start the prefetch thread if it isn't already running. Called with the
+ * lock held.
+ * @return TRUE if the thread is running.
+ */
+static gboolean cache_prefetch_start( void )
+{
+    if( !cache_prefetch.started ) {
+        if( !cache_prefetch.atfork_registered ) {
+            pthread_atfork( cache_prefetch_atfork_prepare, cache_prefetch_atfork_parent,
+                            cache_prefetch_atfork_child );
+            cache_prefetch.atfork_registered = TRUE;
+        }
+        if( pthread_create( &cache_prefetch.thread, NULL, cache_prefetch_thread, NULL ) != 0 )
+            return FALSE;
+        pthread_detach( cache_prefetch.thread );
+        cache_prefetch.started = TRUE;
+    }
+    return TRUE;
+}
+
+static cdrom_error_t cache_sector_source_read( sector_source_t dev, cdrom_lba_t lba, cdrom_count_t block_count, unsigned char *buf )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(dev,CACHE_SECTOR_SOURCE) );
+    cache_sector_source_t cdev = (cache_sector_source_t)dev;
+    size_t sector_size = CDROM_SECTOR_SIZE(dev->mode);
+    cdrom_error_t err = CDROM_ERROR_OK;
+
+    pthread_mutex_lock( &cache_prefetch.lock );
+    while( block_count > 0 ) {
+        cdrom_lba_t line_lba = lba - (lba % CACHE_LINE_SECTORS);
+        unsigned int idx = (lba / CACHE_LINE_SECTORS) % cdev->line_count;
+        struct cache_line *line = &cdev->lines[idx];
+        cdrom_count_t offset = lba - line_lba;
+        cdrom_count_t count = CACHE_LINE_SECTORS - offset;
+        if( count > block_count )
+            count = block_count;
+
+        while( line->state == LINE_LOADING ) {
+            pthread_cond_wait( &cache_prefetch.load_wait, &cache_prefetch.lock );
+        }
+        if( line->state == LINE_VALID && line->lba == line_lba ) {
+            cdev->hits += count;
+        } else {
+            cdev->misses += count;
+            line->lba = line_lba;
+            line->state = LINE_LOADING;
+            err = cache_load_line( cdev, idx, line_lba );
+            if( err != CDROM_ERROR_OK )
+                break;
+        }
+        memcpy( buf, cdev->data + idx * cdev->line_size + offset * sector_size, count * sector_size );
+        buf += count * sector_size;
+        lba += count;
+        block_count -= count;
+    }
+
+    cdev->next_lba = lba;
+    if( cache_prefetch_start() ) {
+        cache_prefetch.target = cdev;
+        pthread_cond_signal( &cache_prefetch.work_wait );
+    }
+    pthread_mutex_unlock( &cache_prefetch.lock );
+    return err;
+}
+
+static void cache_sector_source_destroy( sector_source_t dev )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(dev,CACHE_SECTOR_SOURCE) );
+    cache_sector_source_t cdev = (cache_sector_source_t)dev;
+
+    /* Make sure the prefetcher has let go of the source before freeing it */
+    pthread_mutex_lock( &cache_prefetch.lock );
+    if( cache_prefetch.target == cdev )
+        cache_prefetch.target = NULL;
+    while( cache_prefetch.busy == cdev ) {
+        pthread_cond_wait( &cache_prefetch.load_wait, &cache_prefetch.lock );
+    }
+    cache_prefetch.sources = g_list_remove( cache_prefetch.sources, cdev );
+    pthread_mutex_unlock( &cache_prefetch.lock );
+
+    DEBUG( "Sector cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, %"
+           G_GUINT64_FORMAT " lines prefetched", cdev->hits, cdev->misses, cdev->prefetched );
+    sector_source_unref( cdev->base );
+    g_free( cdev->lines );
+    g_free( cdev->data );
+    cdev->lines = NULL;
+    cdev->data = NULL;
+    default_sector_source_destroy(dev);
+}
+
+sector_source_t cache_sector_source_new( sector_source_t base, size_t cache_size )
+{
+    assert( IS_SECTOR_SOURCE(base) );
+    size_t sector_size = CDROM_SECTOR_SIZE(base->mode);
+    if( sector_size == 0 || base->size == 0 )
+        return NULL;
+
+    size_t line_size = CACHE_LINE_SECTORS * sector_size;
+    unsigned int line_count = cache_size / line_size;
+    unsigned int max_lines = (base->size + CACHE_LINE_SECTORS - 1) / CACHE_LINE_SECTORS;
+    if( line_count > max_lines )
+        line_count = max_lines;
+    if( line_count < 2 )
+        return NULL;
+
+    unsigned char *data = g_try_malloc( line_count * line_size );
+    if( data == NULL )
+        return NULL;
+
+    pthread_mutex_lock( &cache_prefetch.lock );
+    gboolean started = cache_prefetch_start();
+    pthread_mutex_unlock( &cache_prefetch.lock );
+    if( !started ) {
+        g_free( data );
+        return NULL;
+    }
+
+    cache_sector_source_t cdev = g_malloc0( sizeof(struct cache_sector_source) );
+    cdev->base = base;
+    cdev->line_size = line_size;
+    cdev->line_count = line_count;
+    cdev->readahead = line_count / 2;
+    cdev->lines = g_malloc0( line_count * sizeof(struct cache_line) );
+    cdev->data = data;
+    cdev->next_lba = 0;
+    sector_source_ref( base );
+    pthread_mutex_lock( &cache_prefetch.lock );
+    cache_prefetch.sources = g_list_prepend( cache_prefetch.sources, cdev );
+    pthread_mutex_unlock( &cache_prefetch.lock );
+    return sector_source_init( &cdev->dev, CACHE_SECTOR_SOURCE, base->mode, base->size,
+                               cache_sector_source_read, cache_sector_source_destroy );
+}
+
+sector_source_t cache_sector_source_get_base( sector_source_t source )
+{
+    assert( IS_SECTOR_SOURCE_TYPE(source,CACHE_SECTOR_SOURCE) );
+    return ((cache_sector_source_t)source)->base;
+}
@@ -165,6 +165,8 @@ static inline GLint glsl_get_attrib_location(gl_program_t program, const char *n
 #define glsl_set_attrib_vec2(id,stride,v) glVertexAttribPointerARB(id, 2, GL_FLOAT, GL_FALSE, stride, v)
 #define glsl_set_attrib_vec3(id,stride,v) glVertexAttribPointerARB(id, 3, GL_FLOAT, GL_FALSE, stride, v)
 #define glsl_set_attrib_vec4(id,stride,v) glVertexAttribPointerARB(id, 4, GL_FLOAT, GL_FALSE, stride, v)
+#define glsl_set_attrib_unorm8(id,stride,v) glVertexAttribPointerARB(id, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, v)
+#define glsl_set_attrib_ubyte(id,stride,v) glVertexAttribPointerARB(id, 4, GL_UNSIGNED_BYTE, GL_FALSE, stride, v)
 #define glsl_enable_attrib(id) glEnableVertexAttribArrayARB(id)
 #define glsl_disable_attrib(id) glDisableVertexAttribArrayARB(id)
 
@@ -283,6 +285,8 @@ static inline GLint glsl_get_attrib_location(gl_program_t program, const char *n
 #define glsl_set_attrib_vec2(id,stride,v) glVertexAttribPointer(id, 2, GL_FLOAT, GL_FALSE, stride, v)
 #define glsl_set_attrib_vec3(id,stride,v) glVertexAttribPointer(id, 3, GL_FLOAT, GL_FALSE, stride, v)
 #define glsl_set_attrib_vec4(id,stride,v) glVertexAttribPointer(id, 4, GL_FLOAT, GL_FALSE, stride, v)
+#define glsl_set_attrib_unorm8(id,stride,v) glVertexAttribPointer(id, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, v)
+#define glsl_set_attrib_ubyte(id,stride,v) glVertexAttribPointer(id, 4, GL_UNSIGNED_BYTE, GL_FALSE, stride, v)
 #define glsl_enable_attrib(id) glEnableVertexAttribArray(id)
 #define glsl_disable_attrib(id) glDisableVertexAttribArray(id)
 
@@ -336,6 +340,8 @@ static inline GLint glsl_get_attrib_location(gl_program_t program, const char *n
 #define glsl_set_attrib_vec2(id,stride,v)
 #define glsl_set_attrib_vec3(id,stride,v)
 #define glsl_set_attrib_vec4(id,stride,v)
+#define glsl_set_attrib_unorm8(id,stride,v)
+#define glsl_set_attrib_ubyte(id,stride,v)
 #define glsl_enable_attrib(id)
 #define glsl_disable_attrib(id)
 
@@ -0,0 +1,189 @@
+/**
+ * $Id$
+ *
+ * Software rendering video driver. Scenes are rendered on the CPU by
+ * pvr2_scene_render_soft into ordinary memory, so no display (or GL) is
+ * required. Nothing is ever displayed - this is for headless use, where the
+ * rendered frames are still needed (eg for render-to-texture, screenshots
+ * and save states).
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "display.h"
+#include "drivers/video_gl.h"
+
+static gboolean video_soft_init( void );
+
+static render_buffer_t video_soft_create_render_buffer( uint32_t hres, uint32_t vres, GLuint tex_id )
+{
+    render_buffer_t buffer = g_malloc0( sizeof(struct render_buffer) + hres*vres*sizeof(uint32_t) );
+    buffer->width = hres;
+    buffer->height = vres;
+    buffer->tex_id = tex_id;
+    buffer->pixels = (uint32_t *)(buffer+1);
+    return buffer;
+}
+
+static void video_soft_destroy_render_buffer( render_buffer_t buffer )
+{
+    g_free( buffer );
+}
+
+static gboolean video_soft_set_render_target( render_buffer_t buffer )
+{
+    return TRUE;
+}
+
+static void video_soft_finish_render( render_buffer_t buffer )
+{
+}
+
+static void video_soft_display_render_buffer( render_buffer_t buffer )
+{
+}
+
+/**
+ * @return the row of pixels corresponding to row y of the buffer as seen by
+ * the rest of the system, ie counting from the bottom if the buffer is
+ * inverted (as GL buffers are).
+ */
+static uint32_t *video_soft_row( render_buffer_t buffer, int y )
+{
+    if( buffer->inverted ) {
+        y = buffer->height - 1 - y;
+    }
+    return buffer->pixels + y*buffer->width;
+}
+
+static gboolean video_soft_read_render_buffer( unsigned char *target,
+                                               render_buffer_t buffer,
+                                               int rowstride, int format )
+{
+    int x, y, bpp = colour_formats[format].bpp;
+
+    if( rowstride == 0 ) {
+        rowstride = buffer->width * bpp;
+    }
+    for( y=0; y<buffer->height; y++ ) {
+        uint32_t *src = video_soft_row( buffer, y );
+        unsigned char *dest = target + y*rowstride;
+        for( x=0; x<buffer->width; x++ ) {
+            uint32_t p = *src++;
+            uint32_t a = p >> 24, r = (p >> 16) & 0xFF, g = (p >> 8) & 0xFF, b = p & 0xFF;
+            switch( format ) {
+            case COLFMT_BGRA1555:
+                *(uint16_t *)dest = ((a >> 7) << 15) | ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+                break;
+            case COLFMT_RGB565:
+                *(uint16_t *)dest = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                break;
+            case COLFMT_BGRA4444:
+                *(uint16_t *)dest = ((a >> 4) << 12) | ((r >> 4) << 8) | (g & 0xF0) | (b >> 4);
+                break;
+            case COLFMT_BGR888:
+                dest[0] = b; dest[1] = g; dest[2] = r;
+                break;
+            case COLFMT_RGB888:
+                dest[0] = r; dest[1] = g; dest[2] = b;
+                break;
+            case COLFMT_BGR0888:
+                *(uint32_t *)dest = p & 0x00FFFFFF;
+                break;
+            default:
+                *(uint32_t *)dest = p;
+                break;
+            }
+            dest += bpp;
+        }
+    }
+    return TRUE;
+}
+
+static void video_soft_load_frame_buffer( frame_buffer_t frame,
+                                          render_buffer_t buffer )
+{
+    int x, y, bpp = colour_formats[frame->colour_format].bpp;
+    int width = MIN(frame->width, buffer->width), height = MIN(frame->height, buffer->height);
+
+    for( y=0; y<height; y++ ) {
+        uint32_t *dest = video_soft_row( buffer, y );
+        unsigned char *src = frame->data + y*frame->rowstride;
+        for( x=0; x<width; x++ ) {
+            uint32_t v;
+            switch( frame->colour_format ) {
+            case COLFMT_BGRA1555:
+                v = *(uint16_t *)src;
+                *dest++ = ((v & 0x8000) ? 0xFF000000 : 0) | ((v & 0x7C00) << 9) |
+                          ((v & 0x03E0) << 6) | ((v & 0x001F) << 3);
+                break;
+            case COLFMT_RGB565:
+                v = *(uint16_t *)src;
+                *dest++ = 0xFF000000 | ((v & 0xF800) << 8) | ((v & 0x07E0) << 5) | ((v & 0x001F) << 3);
+                break;
+            case COLFMT_BGRA4444:
+                v = *(uint16_t *)src;
+                *dest++ = ((v & 0xF000) << 16) | ((v & 0x0F00) << 12) | ((v & 0x00F0) << 8) | ((v & 0x000F) << 4);
+                break;
+            case COLFMT_BGR888:
+                *dest++ = 0xFF000000 | (src[2] << 16) | (src[1] << 8) | src[0];
+                break;
+            case COLFMT_RGB888:
+                *dest++ = 0xFF000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+                break;
+            case COLFMT_BGR0888:
+                *dest++ = 0xFF000000 | *(uint32_t *)src;
+                break;
+            default:
+                *dest++ = *(uint32_t *)src;
+                break;
+            }
+            src += bpp;
+        }
+    }
+}
+
+static void video_soft_display_blank( uint32_t colour )
+{
+}
+
+static void video_soft_swap_buffers(void)
+{
+}
+
+struct display_driver display_soft_driver = {
+        "soft",
+        N_("Software renderer (no display)"),
+        video_soft_init,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        video_soft_create_render_buffer,
+        video_soft_destroy_render_buffer,
+        video_soft_set_render_target,
+        video_soft_finish_render,
+        video_soft_load_frame_buffer,
+        video_soft_display_render_buffer,
+        video_soft_display_blank,
+        video_soft_swap_buffers,
+        video_soft_read_render_buffer,
+        NULL };
+
+static gboolean video_soft_init( void )
+{
+    gl_vbo_fallback_init(&display_soft_driver);
+    display_soft_driver.capabilities.soft_render = TRUE;
+    return TRUE;
+}
@@ -84,6 +84,10 @@ void event_init();
 #define EVENT_TMU1 98
 #define EVENT_TMU2 99
 #define EVENT_GUNPOS 100
+#define EVENT_DMAC0 101
+#define EVENT_DMAC1 102
+#define EVENT_DMAC2 103
+#define EVENT_DMAC3 104
 
 #define EVENT_ENDTIMESLICE 127
 #ifdef __cplusplus
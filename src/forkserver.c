@@ -0,0 +1,270 @@
+/**
+ * $Id$
+ *
+ * Fork server - initialize once, then fork a copy-on-write child to run each
+ * job that arrives on the socket.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "dreamcast.h"
+#include "loader.h"
+#include "forkserver.h"
+
+#define MAX_JOB_LENGTH 4096
+#define JOB_SEPARATORS " \t\r\n"
+
+struct fork_server_job {
+    pid_t pid;
+    int fd; /* Client connection, for the result */
+};
+
+/* Self-pipe written by the SIGCHLD handler, so that finished jobs wake up
+ * the poll loop */
+static int fork_server_child_pipe[2] = { -1, -1 };
+
+static void fork_server_sigchld( int sig )
+{
+    int saved_errno = errno;
+    char c = 0;
+    if( write( fork_server_child_pipe[1], &c, 1 ) == -1 ) {
+        /* Pipe is full - the loop will be woken anyway */
+    }
+    errno = saved_errno;
+}
+
+static gboolean fork_server_init_sigchld( void )
+{
+    struct sigaction act;
+    int i;
+
+    if( pipe( fork_server_child_pipe ) == -1 ) {
+        ERROR( "Unable to create fork server pipe: %s", strerror(errno) );
+        return FALSE;
+    }
+    for( i=0; i<2; i++ ) {
+        fcntl( fork_server_child_pipe[i], F_SETFL, O_NONBLOCK );
+        fcntl( fork_server_child_pipe[i], F_SETFD, FD_CLOEXEC );
+    }
+    memset( &act, 0, sizeof(act) );
+    act.sa_handler = fork_server_sigchld;
+    act.sa_flags = SA_RESTART|SA_NOCLDSTOP;
+    sigemptyset( &act.sa_mask );
+    sigaction( SIGCHLD, &act, NULL );
+    return TRUE;
+}
+
+static int fork_server_listen( const char *path )
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if( strlen(path) >= sizeof(addr.sun_path) ) {
+        ERROR( "Fork server socket path is too long: %s", path );
+        return -1;
+    }
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, path );
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd == -1 ) {
+        ERROR( "Unable to create fork server socket: %s", strerror(errno) );
+        return -1;
+    }
+    unlink( path );
+    if( bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) == -1 ||
+            listen( fd, SOMAXCONN ) == -1 ) {
+        ERROR( "Unable to listen on %s: %s", path, strerror(errno) );
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Read the job line from a new connection.
+ * @return TRUE if a complete line was read.
+ */
+static gboolean fork_server_read_job( int fd, char *buf, size_t buflen )
+{
+    size_t len = 0;
+    while( len < buflen-1 ) {
+        ssize_t n = read( fd, buf+len, buflen-1-len );
+        if( n <= 0 ) {
+            if( n == -1 && errno == EINTR )
+                continue;
+            break;
+        }
+        len += n;
+        if( memchr( buf+len-n, '\n', n ) != NULL ) {
+            buf[len] = '\0';
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Run a job in the child process. Doesn't return.
+ */
+static void fork_server_run_job( char *job )
+{
+    char *save = NULL;
+    char *time_str = strtok_r( job, JOB_SEPARATORS, &save );
+    char *program = strtok_r( NULL, JOB_SEPARATORS, &save );
+    char *output = strtok_r( NULL, JOB_SEPARATORS, &save );
+    double t = time_str == NULL ? 0 : strtod( time_str, NULL );
+    uint32_t secs;
+
+    if( program == NULL || t <= 0 ) {
+        ERROR( "Invalid fork server job (expected <run-time> <program> [<output-file>])" );
+        _exit(2);
+    }
+    if( output != NULL ) {
+        int fd = open( output, O_WRONLY|O_CREAT|O_TRUNC, 0644 );
+        if( fd == -1 ) {
+            ERROR( "Unable to open job output %s: %s", output, strerror(errno) );
+            _exit(2);
+        }
+        dup2( fd, 1 );
+        dup2( fd, 2 );
+        close( fd );
+    }
+    if( strcmp( program, "-" ) != 0 ) {
+        ERROR err;
+        if( !file_load_exec( program, &err ) ) {
+            ERROR( err.msg );
+            _exit(2);
+        }
+    }
+
+    /* Children share the parent's flash and VMU files, so leave them alone */
+    dreamcast_set_read_only( TRUE );
+    secs = (uint32_t)t;
+    dreamcast_set_run_time( secs, (uint32_t)((t - secs) * 1000000000) );
+    dreamcast_set_exit_on_stop( TRUE );
+    dreamcast_run(); /* Exits on completion */
+    _exit(2);
+}
+
+static void fork_server_job_done( struct fork_server_job *jobs, int max_jobs, pid_t pid, int status )
+{
+    int i;
+    for( i=0; i<max_jobs; i++ ) {
+        if( jobs[i].pid == pid ) {
+            char result[32];
+            int code = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+            int len = snprintf( result, sizeof(result), "%d\n", code );
+            if( write( jobs[i].fd, result, len ) != len ) {
+                DEBUG( "Unable to send result of job %d", (int)pid );
+            }
+            close( jobs[i].fd );
+            jobs[i].pid = 0;
+            return;
+        }
+    }
+}
+
+int fork_server_run( const char *path, int max_jobs )
+{
+    struct fork_server_job *jobs;
+    char job[MAX_JOB_LENGTH];
+    int listen_fd, running = 0, i;
+
+    listen_fd = fork_server_listen( path );
+    if( listen_fd == -1 )
+        return 2;
+    if( !fork_server_init_sigchld() ) {
+        close( listen_fd );
+        return 2;
+    }
+    if( max_jobs <= 0 ) {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        max_jobs = cpus > 0 ? cpus : 1;
+    }
+    jobs = g_malloc0( max_jobs * sizeof(struct fork_server_job) );
+    /* Clients may go away before their job finishes */
+    signal( SIGPIPE, SIG_IGN );
+    INFO( "Fork server listening on %s (%d jobs at once)", path, max_jobs );
+
+    for(;;) {
+        struct pollfd pfd[2];
+        char drain[64];
+        pid_t pid;
+        int status, conn_fd;
+
+        /* Collect finished jobs. Any that finish after this point will
+         * write to the pipe, and so wake up the poll below */
+        while( running > 0 && (pid = waitpid( -1, &status, WNOHANG )) > 0 ) {
+            fork_server_job_done( jobs, max_jobs, pid, status );
+            running--;
+        }
+
+        /* Only accept new work while we're under the limit */
+        pfd[0].fd = fork_server_child_pipe[0];
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = listen_fd;
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        if( poll( pfd, running < max_jobs ? 2 : 1, -1 ) <= 0 )
+            continue;
+        if( pfd[0].revents & POLLIN ) {
+            while( read( fork_server_child_pipe[0], drain, sizeof(drain) ) > 0 );
+        }
+        if( !(pfd[1].revents & POLLIN) )
+            continue;
+        conn_fd = accept( listen_fd, NULL, NULL );
+        if( conn_fd == -1 )
+            continue;
+        if( !fork_server_read_job( conn_fd, job, sizeof(job) ) ) {
+            close( conn_fd );
+            continue;
+        }
+
+        fflush( stdout );
+        fflush( stderr );
+        pid = fork();
+        if( pid == 0 ) {
+            signal( SIGCHLD, SIG_DFL );
+            close( fork_server_child_pipe[0] );
+            close( fork_server_child_pipe[1] );
+            close( listen_fd );
+            close( conn_fd );
+            fork_server_run_job( job );
+        } else if( pid == -1 ) {
+            ERROR( "Unable to fork job: %s", strerror(errno) );
+            close( conn_fd );
+        } else {
+            for( i=0; jobs[i].pid != 0; i++ );
+            jobs[i].pid = pid;
+            jobs[i].fd = conn_fd;
+            running++;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * $Id$
+ *
+ * Fork server for running large batches of short headless jobs (eg test
+ * programs) without paying the emulator startup cost for each one.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_forkserver_H
+#define lxdream_forkserver_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Serve jobs on the unix socket at the given path, forever. The machine
+ * must already be fully initialized - each job runs in a forked (copy-on-
+ * write) copy of it.
+ *
+ * A job is a single line sent on a new connection:
+ *     <run-time-seconds> <program> [<output-file>]
+ * The program is loaded as for --execute ("-" to run the machine as-is), and
+ * run as for --run-time. The program's stdout and stderr go to output-file
+ * if given. The server replies with a single line holding the exit status of
+ * the job (the dcload exit code, 0 if the time ran out, or -N if it died from
+ * signal N) and closes the connection.
+ *
+ * @param max_jobs the maximum number of jobs to run at once, or 0 for one per
+ * processor.
+ * @return only on failure to create the socket, with a non-zero status.
+ */
+int fork_server_run( const char *path, int max_jobs );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_forkserver_H */
@@ -42,6 +42,9 @@
 #define GDB_ERROR_FORMAT 1 /* Badly formatted command */
 #define GDB_ERROR_INVAL  2 /* Invalid data */
 #define GDB_ERROR_FAIL   3 /* Command failed */
+
+/* Watch flags for each Z/z packet type (2 = write, 3 = read, 4 = access) */
+static const int gdb_watch_flags[] = { 0, 0, WATCH_WRITE, WATCH_READ, WATCH_READ|WATCH_WRITE };
 struct gdb_server {
     cpu_desc_t cpu;
     gboolean mmu;
@@ -201,6 +204,44 @@ void gdb_send_error( struct gdb_server *server, int error )
     gdb_send_frame( server, out, 3 );
 }
 
+/**
+ * Send text to be displayed on the gdb console.
+ */
+void gdb_send_console_output( struct gdb_server *server, const char *text )
+{
+    gdb_send_hex_data( server, "O", (unsigned char *)text, strlen(text) );
+}
+
+/**
+ * Handle a "monitor" command. Supported commands are
+ *   break-if <address> <condition>   Set a conditional breakpoint
+ *   break-clear <address>            Clear a breakpoint
+ */
+void gdb_server_monitor_command( struct gdb_server *server, char *cmd )
+{
+    unsigned int addr;
+    int n;
+
+    if( sscanf( cmd, "break-if %x %n", &addr, &n ) == 1 ) {
+        if( server->cpu->set_conditional_breakpoint == NULL ) {
+            gdb_send_console_output( server, "Conditional breakpoints are not supported\n" );
+            gdb_send_error( server, GDB_ERROR_FAIL );
+        } else if( !server->cpu->set_conditional_breakpoint( addr, BREAK_KEEP, cmd+n ) ) {
+            gdb_send_console_output( server, "Invalid breakpoint condition\n" );
+            gdb_send_error( server, GDB_ERROR_INVAL );
+        } else {
+            gdb_send_frame( server, "OK", 2 );
+        }
+    } else if( sscanf( cmd, "break-clear %x", &addr ) == 1 ) {
+        while( server->cpu->clear_breakpoint( addr, BREAK_KEEP ) );
+        gdb_send_frame( server, "OK", 2 );
+    } else {
+        gdb_send_console_output( server, "Commands: break-if <address> <condition>, break-clear <address>\n"
+                "Condition: <register|[address]> [& <mask>] <==|!=|<|<=|>|>=> <value>\n" );
+        gdb_send_frame( server, "OK", 2 );
+    }
+}
+
 void gdb_server_handle_frame( struct gdb_server *server, int command, char *data, int length )
 {
     unsigned int tmp, tmp2, tmp3;
@@ -318,6 +359,11 @@ void gdb_server_handle_frame( struct gdb_server *server, int command, char *data
             gdb_send_frame( server, "PacketSize=4000", 15 );
         } else if( strcmp( data, "Symbol::" ) == 0 ) {
             gdb_send_frame( server, "OK", 2 );
+        } else if( strncmp( data, "Rcmd,", 5 ) == 0 ) {
+            unsigned char cmd[(length-5)/2 + 1];
+            size_t len = gdb_read_hex_data( server, cmd, data+5, length-5 );
+            cmd[len] = '\0';
+            gdb_server_monitor_command( server, (char *)cmd );
         } else {
             gdb_send_frame( server, "", 0 );
         }
@@ -376,6 +422,12 @@ void gdb_server_handle_frame( struct gdb_server *server, int command, char *data
             if( tmp == 0 || tmp == 1 ) { /* soft break or hard break */
                 server->cpu->clear_breakpoint( tmp2, BREAK_KEEP );
                 gdb_send_frame( server, "OK", 2 );
+            } else if( tmp <= 4 && server->cpu->clear_watchpoint != NULL ) {
+                if( server->cpu->clear_watchpoint( tmp2, tmp3, gdb_watch_flags[tmp] ) ) {
+                    gdb_send_frame( server, "OK", 2 );
+                } else {
+                    gdb_send_error( server, GDB_ERROR_INVAL );
+                }
             } else {
                 gdb_send_frame( server, "", 0 );
             }
@@ -388,6 +440,12 @@ void gdb_server_handle_frame( struct gdb_server *server, int command, char *data
             if( tmp == 0 || tmp == 1 ) { /* soft break or hard break */
                 server->cpu->set_breakpoint( tmp2, BREAK_KEEP );
                 gdb_send_frame( server, "OK", 2 );
+            } else if( tmp <= 4 && server->cpu->set_watchpoint != NULL ) {
+                if( tmp3 != 0 && server->cpu->set_watchpoint( tmp2, tmp3, gdb_watch_flags[tmp] ) ) {
+                    gdb_send_frame( server, "OK", 2 );
+                } else {
+                    gdb_send_error( server, GDB_ERROR_FAIL );
+                }
             } else {
                 gdb_send_frame( server, "", 0 );
             }
@@ -512,7 +570,18 @@ gboolean gdb_server_connect_callback( int fd, gpointer data )
 
 void gdb_server_notify_stopped( struct gdb_server *server )
 {
-    gdb_send_frame( server, "S05", 3 );
+    uint32_t addr;
+    int op = 0;
+    if( server->cpu->get_watchpoint_hit != NULL ) {
+        op = server->cpu->get_watchpoint_hit( &addr );
+    }
+    if( op != 0 ) {
+        char buf[32];
+        snprintf( buf, sizeof(buf), "T05%s:%08x;", op == WATCH_WRITE ? "watch" : "rwatch", addr );
+        gdb_send_frame( server, buf, strlen(buf) );
+    } else {
+        gdb_send_frame( server, "S05", 3 );
+    }
 }
 
 /**
@@ -51,6 +51,7 @@ struct gdrom_drive {
 void gdrom_mount_disc( cdrom_disc_t disc )
 {
     if( disc != gdrom_drive.disc ) {
+        ide_unmap_buffer();
         cdrom_disc_unref(gdrom_drive.disc);
         gdrom_drive.disc = disc;
         cdrom_disc_ref(disc);
@@ -75,6 +76,7 @@ gboolean gdrom_mount_image( const gchar *filename,  ERROR *err )
 void gdrom_unmount_disc( ) 
 {
     if( gdrom_drive.disc != NULL ) {
+        ide_unmap_buffer();
         cdrom_disc_unref(gdrom_drive.disc);
         gdrom_fire_disc_changed(NULL);
         gdrom_drive.disc = NULL;
@@ -228,15 +230,13 @@ cdrom_error_t gdrom_play_audio( cdrom_lba_t lba, cdrom_count_t count )
 #define READ_CD_RAW(x)     ((x)&0x10)
 
 
-cdrom_error_t gdrom_read_cd( cdrom_lba_t lba, cdrom_count_t count,
-                             unsigned mode, unsigned char *buf, size_t *length )
+/**
+ * Translate GDROM read mode into standard MMC read mode
+ */
+static cdrom_read_mode_t gdrom_get_read_mode( unsigned mode )
 {
-    cdrom_lba_t real_lba = lba - 150;
     cdrom_read_mode_t real_mode = 0;
 
-    CHECK_DISC();
-
-    /* Translate GDROM read mode into standard MMC read mode */
     if( READ_CD_RAW(mode) ) {
         real_mode = CDROM_READ_RAW;
     } else {
@@ -255,8 +255,22 @@ cdrom_error_t gdrom_read_cd( cdrom_lba_t lba, cdrom_count_t count,
         real_mode |= CDROM_READ_MODE2;
     else
         real_mode |= (READ_CD_MODE(mode)<<1);
+    return real_mode;
+}
+
+cdrom_error_t gdrom_read_cd( cdrom_lba_t lba, cdrom_count_t count,
+                             unsigned mode, unsigned char *buf, size_t *length )
+{
+    CHECK_DISC();
 
-    return cdrom_disc_read_sectors( gdrom_drive.disc, real_lba, count, real_mode, buf, length );
+    return cdrom_disc_read_sectors( gdrom_drive.disc, lba - 150, count, gdrom_get_read_mode(mode), buf, length );
+}
+
+unsigned char *gdrom_map_cd( cdrom_lba_t lba, unsigned mode, size_t *length )
+{
+    if( gdrom_drive.disc == NULL || gdrom_drive.disc->disc_type == CDROM_DISC_NONE || lba < 150 )
+        return NULL;
+    return cdrom_disc_map_sector( gdrom_drive.disc, lba - 150, gdrom_get_read_mode(mode), length );
 }
 
 void gdrom_run_slice( uint32_t nanosecs )
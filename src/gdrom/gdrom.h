@@ -121,6 +121,13 @@ cdrom_error_t gdrom_read_short_status( uint32_t lba, unsigned char *buf );
 cdrom_error_t gdrom_read_cd( cdrom_lba_t lba, cdrom_count_t count,
                              unsigned read_mode, unsigned char *buf, size_t *length );
 
+/**
+ * Return a pointer directly to a single sector of the current disc in the
+ * given read mode, if the disc image supports it (see cdrom_disc_map_sector).
+ * @return the sector pointer, or NULL if gdrom_read_cd must be used instead.
+ */
+unsigned char *gdrom_map_cd( cdrom_lba_t lba, unsigned read_mode, size_t *length );
+
 cdrom_error_t gdrom_play_audio( cdrom_lba_t lba, cdrom_count_t count );
 
 /**
@@ -52,8 +52,12 @@ struct ide_registers idereg;
 
 unsigned char data_buffer[MAX_SECTOR_SIZE];
 
+/* Source of the current read transfer - either data_buffer, or a sector
+ * mapped directly from the disc image */
+static unsigned char *read_buffer = data_buffer;
+
 #define WRITE_BUFFER(x16) *((uint16_t *)(data_buffer + idereg.data_offset)) = x16
-#define READ_BUFFER() *((uint16_t *)(data_buffer + idereg.data_offset))
+#define READ_BUFFER() *((uint16_t *)(read_buffer + idereg.data_offset))
 
 /* 10 bytes followed by "SE      REV 6.42990316" */
 unsigned char default_gdrom_mode[GDROM_MODE_LENGTH] = 
@@ -155,6 +159,7 @@ static void ide_reset( void )
     idereg.current_mode = 0x28;
     idereg.sectors_left = 0;
     idereg.was_reset = TRUE;
+    read_buffer = data_buffer;
 }
 
 static uint32_t ide_run_slice( uint32_t nanosecs )
@@ -165,6 +170,7 @@ static uint32_t ide_run_slice( uint32_t nanosecs )
 
 static void ide_save_state( FILE *f )
 {
+    ide_unmap_buffer();
     fwrite( &idereg, sizeof(idereg), 1, f );
     fwrite( data_buffer, MAX_SECTOR_SIZE, 1, f );
 }
@@ -175,9 +181,19 @@ static int ide_load_state( FILE *f )
         fread( data_buffer, MAX_SECTOR_SIZE, 1, f ) != 1 ) {
         return -1;
     }
+    read_buffer = data_buffer;
     return 0;
 }
 
+void ide_unmap_buffer( void )
+{
+    if( read_buffer != data_buffer ) {
+        if( idereg.data_length > 0 && idereg.data_length <= MAX_SECTOR_SIZE )
+            memcpy( data_buffer, read_buffer, idereg.data_length );
+        read_buffer = data_buffer;
+    }
+}
+
 /************************ State transitions *************************/
 
 void ide_set_packet_result( uint16_t result )
@@ -215,6 +231,7 @@ static void ide_start_command_packet_write( )
  */
 static void ide_start_read( int length, gboolean dma ) 
 {
+    read_buffer = data_buffer;
     idereg.count = IDE_COUNT_IO;
     idereg.data_length = length;
     idereg.data_offset = 0;
@@ -331,7 +348,7 @@ uint32_t ide_read_data_dma( uint32_t addr, uint32_t length )
         if( xferlen > remaining ) {
             xferlen = remaining;
         }
-        mem_copy_to_sh4( addr, (data_buffer + idereg.data_offset), xferlen );
+        mem_copy_to_sh4( addr, (read_buffer + idereg.data_offset), xferlen );
         xfercount += xferlen;
         addr += xferlen;
         idereg.data_offset += xferlen;
@@ -451,7 +468,19 @@ uint8_t ide_get_drive_status( void )
 static void ide_read_next_sector( void )
 {
     size_t sector_size;
-    cdrom_error_t status = gdrom_read_cd( idereg.current_lba, 1, idereg.current_mode, data_buffer, &sector_size );
+    cdrom_error_t status;
+
+    /* Transfer straight from the disc image where possible */
+    unsigned char *sector = gdrom_map_cd( idereg.current_lba, idereg.current_mode, &sector_size );
+    if( sector != NULL ) {
+        idereg.current_lba++;
+        idereg.sectors_left--;
+        ide_start_read( sector_size, (idereg.feature & IDE_FEAT_DMA) ? TRUE : FALSE );
+        read_buffer = sector;
+        return;
+    }
+
+    status = gdrom_read_cd( idereg.current_lba, 1, idereg.current_mode, data_buffer, &sector_size );
     if( status != PKT_ERR_OK ) {
         ide_set_packet_result( status );
         idereg.gdrom_sense[5] = (idereg.current_lba >> 16) & 0xFF;
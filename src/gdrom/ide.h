@@ -131,6 +131,13 @@ uint8_t ide_read_status(void);
 uint8_t ide_get_drive_status(void);
 void ide_write_buffer( unsigned char *data, uint32_t length ); 
 
+/**
+ * If the current read transfer refers directly to the disc image, copy the
+ * data into the IDE buffer instead. Must be called before the disc is
+ * released.
+ */
+void ide_unmap_buffer( void );
+
 void ide_write_command( uint8_t command );
 void ide_write_control( uint8_t value );
 
@@ -26,6 +26,7 @@
 #include "dream.h"
 #include "display.h"
 #include "gdrom/gdrom.h"
+#include "replay.h"
 #include "gtkui/gtkui.h"
 
 void gtk_gui_start( void );
@@ -465,7 +466,7 @@ uint32_t gtk_gui_run_slice( uint32_t nanosecs )
         gettimeofday(&tv,NULL);
         uint32_t ns = ((tv.tv_sec - gtk_gui_lasttv.tv_sec) * 1000000000) + 
         (tv.tv_usec - gtk_gui_lasttv.tv_usec)*1000;
-        if( (ns * 1.05) < current_period ) {
+        if( (ns * 1.05) < current_period && !replay_is_playing() ) {
             // We've gotten ahead - sleep for a little bit
             struct timespec tv;
             tv.tv_sec = 0;
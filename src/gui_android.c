@@ -29,6 +29,7 @@
 #include "gui.h"
 #include "config.h"
 #include "lxpaths.h"
+#include "replay.h"
 #include "tqueue.h"
 #include "display.h"
 #include "gdlist.h"
@@ -162,7 +163,7 @@ uint32_t android_gui_run_slice( uint32_t nanosecs )
         gettimeofday(&tv,NULL);
         uint32_t ns = ((tv.tv_sec - android_gui_lasttv.tv_sec) * 1000000000) +
         (tv.tv_usec - android_gui_lasttv.tv_usec)*1000;
-        if( (ns * 1.05) < current_period ) {
+        if( (ns * 1.05) < current_period && !replay_is_playing() ) {
             // We've gotten ahead - sleep for a little bit
             struct timespec tv;
             tv.tv_sec = 0;
@@ -36,6 +36,10 @@ static void hotkey_key_callback( void *data, uint32_t value, uint32_t pressure,
 #define TAG_SAVE 4
 #define TAG_LOAD 5
 #define TAG_SELECT(i) (6+(i))
+#define TAG_REWIND 16
+
+/* Frames to rewind per press of the rewind key */
+#define REWIND_STEP_FRAMES 60
 
 struct lxdream_config_group hotkeys_group = {
     "hotkeys", input_keygroup_changed, hotkey_key_callback, NULL, {
@@ -55,6 +59,7 @@ struct lxdream_config_group hotkeys_group = {
         {"state7", N_("Select quick save state 7"), CONFIG_TYPE_KEY, NULL, TAG_SELECT(7) },
         {"state8", N_("Select quick save state 8"), CONFIG_TYPE_KEY, NULL, TAG_SELECT(8) },
         {"state9", N_("Select quick save state 9"), CONFIG_TYPE_KEY, NULL, TAG_SELECT(9) },
+        {"rewind", N_("Rewind emulation"), CONFIG_TYPE_KEY, NULL, TAG_REWIND },
         {NULL, CONFIG_TYPE_NONE}} };
 
 void hotkeys_init() 
@@ -102,6 +107,9 @@ static void hotkey_key_callback( void *data, uint32_t value, uint32_t pressure,
         case TAG_LOAD:
             dreamcast_quick_load();
             break;
+        case TAG_REWIND:
+            dreamcast_rewind( REWIND_STEP_FRAMES );
+            break;
         default:
             dreamcast_set_quick_state(value- TAG_SELECT(0) );
             break;
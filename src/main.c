@@ -33,10 +33,13 @@
 #include "loader.h"
 #include "mem.h"
 #include "plugin.h"
+#include "replay.h"
 #include "serial.h"
 #include "syscall.h"
 #include "aica/audio.h"
 #include "aica/armdasm.h"
+#include "drivers/cdrom/cdrom.h"
+#include "forkserver.h"
 #include "gdrom/gdrom.h"
 #include "maple/maple.h"
 #include "pvr2/glutil.h"
@@ -44,15 +47,26 @@
 #include "vmu/vmulist.h"
 
 #define GL_INFO_OPT 1
+#define COMPRESS_DISC_OPT 2
+#define BOOT_CACHE_OPT 3
+#define FORK_SERVER_OPT 4
+#define PROFILE_OPT 5
+#define RECORD_TRACE_OPT 6
+#define TRACE_MEMORY_OPT 7
+#define RECORD_INPUT_OPT 8
+#define REPLAY_INPUT_OPT 9
 
 char *option_list = "a:A:bc:e:dfg:G:hHl:m:npPt:T:uvV:xX?";
 struct option longopts[] = {
         { "aica", required_argument, NULL, 'a' },
         { "audio", required_argument, NULL, 'A' },
         { "biosless", no_argument, NULL, 'b' },
+        { "boot-cache", no_argument, NULL, BOOT_CACHE_OPT },
+        { "compress-disc", required_argument, NULL, COMPRESS_DISC_OPT },
         { "config", required_argument, NULL, 'c' },
         { "debugger", no_argument, NULL, 'd' },
         { "execute", required_argument, NULL, 'e' },
+        { "fork-server", required_argument, NULL, FORK_SERVER_OPT },
         { "fullscreen", no_argument, NULL, 'f' },
         { "gdb-sh4", required_argument, NULL, 'g' },  
         { "gdb-arm", required_argument, NULL, 'G' },
@@ -61,9 +75,14 @@ struct option longopts[] = {
         { "headless", no_argument, NULL, 'H' },
         { "log", required_argument, NULL,'l' }, 
         { "multiplier", required_argument, NULL, 'm' },
+        { "profile", required_argument, NULL, PROFILE_OPT },
+        { "record-input", required_argument, NULL, RECORD_INPUT_OPT },
+        { "record-trace", required_argument, NULL, RECORD_TRACE_OPT },
+        { "replay-input", required_argument, NULL, REPLAY_INPUT_OPT },
         { "run-time", required_argument, NULL, 't' },
         { "shadow", no_argument, NULL, 'X' },
         { "trace", required_argument, NULL, 'T' },
+        { "trace-memory", no_argument, NULL, TRACE_MEMORY_OPT },
         { "unsafe", no_argument, NULL, 'u' },
         { "video", no_argument, NULL, 'V' },
         { "version", no_argument, NULL, 'v' }, 
@@ -82,6 +101,7 @@ sh4core_t sh4_core = SH4_TRANSLATE;
 gboolean show_debugger = FALSE;
 gboolean show_fullscreen = FALSE;
 gboolean use_bootrom = TRUE;
+gboolean boot_cache = FALSE;
 extern uint32_t sh4_cpu_multiplier;
 
 static void print_version()
@@ -98,9 +118,12 @@ static void print_usage()
     printf( "   -a, --aica=PROGFILE    %s\n", _("Run the AICA SPU only, with the supplied program") );
     printf( "   -A, --audio=DRIVER     %s\n", _("Use the specified audio driver (? to list)") );
     printf( "   -b, --biosless         %s\n", _("Run without the BIOS boot rom even if available") );
+    printf( "       --boot-cache       %s\n", _("Skip the disc boot sequence using a cached save state") );
     printf( "   -c, --config=CONFFILE  %s\n", _("Load configuration from CONFFILE") );
+    printf( "       --compress-disc=FILE %s\n", _("Convert the disc-file to a compressed image and exit") );
     printf( "   -e, --execute=PROGRAM  %s\n", _("Load and execute the given SH4 program") );
     printf( "   -d, --debugger         %s\n", _("Start in debugger mode") );
+    printf( "       --fork-server=SOCKET %s\n", _("Serve headless jobs on SOCKET, forking for each one") );
     printf( "   -f, --fullscreen       %s\n", _("Start in fullscreen mode") );
     printf( "   -g, --gdb-sh4=PORT     %s\n", _("Start GDB remote server on PORT for SH4") );
     printf( "   -G, --gdb-arm=PORT     %s\n", _("Start GDB remote server on PORT for ARM") );
@@ -110,8 +133,13 @@ static void print_usage()
     printf( "   -m, --multiplier=SCALE %s\n", _("Set the SH4 multiplier (1.0 = fullspeed)") );
     printf( "   -n                     %s\n", _("Don't start running immediately") );
     printf( "   -p                     %s\n", _("Start running immediately on startup") );
+    printf( "       --profile=FILE     %s\n", _("Sample the running SH4 code, and write a profile to FILE on exit") );
+    printf( "       --record-input=FILE %s\n", _("Record all input to FILE, for later replay") );
+    printf( "       --record-trace=FILE %s\n", _("Record a binary trace of the SH4 code executed to FILE") );
+    printf( "       --replay-input=FILE %s\n", _("Replay the input recorded in FILE, as fast as possible") );
     printf( "   -t, --run-time=SECONDS %s\n", _("Run for the specified number of seconds") );
     printf( "   -T, --trace=REGIONS    %s\n", _("Output trace information for the named regions") );
+    printf( "       --trace-memory     %s\n", _("Include memory operations in the recorded trace") );
     printf( "   -u, --unsafe           %s\n", _("Allow unsafe dcload syscalls") );
     printf( "   -v, --version          %s\n", _("Print the lxdream version string") );
     printf( "   -V, --video=DRIVER     %s\n", _("Use the specified video driver (? to list)") );
@@ -132,9 +160,16 @@ int main (int argc, char *argv[])
     int opt;
     double t;
     gboolean display_ok, have_disc = FALSE, have_save = FALSE, have_exec = FALSE;
-    gboolean print_glinfo = FALSE, sh4_profile_blocks = FALSE;
+    gboolean print_glinfo = FALSE, sh4_profile_blocks = FALSE, have_run_time = FALSE;
     uint32_t time_secs, time_nanos;
     const char *exec_name = NULL;
+    const char *compress_disc_file = NULL;
+    const char *fork_server_path = NULL;
+    const char *profile_file = NULL;
+    const char *record_trace_file = NULL;
+    int record_trace_flags = 0;
+    const char *record_input_file = NULL;
+    const char *replay_input_file = NULL;
 
     install_crash_handler();
     bind_gettext_domain();
@@ -202,6 +237,7 @@ int main (int argc, char *argv[])
             time_nanos = (int)((t - time_secs) * 1000000000);
             dreamcast_set_run_time( time_secs, time_nanos );
             dreamcast_set_exit_on_stop( TRUE );
+            have_run_time = TRUE;
             break;
         case 'T': /* trace regions */
             trace_regions = optarg;
@@ -226,6 +262,30 @@ int main (int argc, char *argv[])
         case GL_INFO_OPT:
             print_glinfo = TRUE;
             break;
+        case COMPRESS_DISC_OPT:
+            compress_disc_file = optarg;
+            break;
+        case BOOT_CACHE_OPT:
+            boot_cache = TRUE;
+            break;
+        case FORK_SERVER_OPT:
+            fork_server_path = optarg;
+            break;
+        case PROFILE_OPT:
+            profile_file = optarg;
+            break;
+        case RECORD_TRACE_OPT:
+            record_trace_file = optarg;
+            break;
+        case TRACE_MEMORY_OPT:
+            record_trace_flags |= SH4_TRACE_MEMORY;
+            break;
+        case RECORD_INPUT_OPT:
+            record_input_file = optarg;
+            break;
+        case REPLAY_INPUT_OPT:
+            replay_input_file = optarg;
+            break;
         }
     }
 
@@ -269,6 +329,25 @@ int main (int argc, char *argv[])
 
 
     iso_init();
+
+    if( compress_disc_file != NULL ) {
+        ERROR err;
+        if( optind >= argc ) {
+            ERROR( "No disc-file given to compress" );
+            exit(2);
+        }
+        cdrom_disc_t disc = cdrom_disc_open( argv[optind], &err );
+        if( disc == NULL && err.code == LX_ERR_FILE_UNKNOWN ) {
+            disc = cdrom_wrap_magic( CDROM_DISC_XA, argv[optind], &err );
+        }
+        if( disc == NULL || !cdrom_disc_write_compressed( disc, compress_disc_file, &err ) ) {
+            ERROR( err.msg );
+            exit(2);
+        }
+        cdrom_disc_unref( disc );
+        exit(0);
+    }
+
     gdrom_list_init();
     vmulist_init();
 
@@ -280,11 +359,18 @@ int main (int argc, char *argv[])
     }
     mem_set_trace( trace_regions, TRUE );
 
+    if( replay_input_file != NULL ) {
+        /* Replay doesn't pace itself to the audio output, and mustn't
+         * change any of the VMU or flash images */
+        audio_driver_name = "null";
+        dreamcast_set_read_only( TRUE );
+    }
     audio_init_driver( audio_driver_name );
 
-    headless = display_driver_name != NULL && strcasecmp( display_driver_name, "null" ) == 0;
+    headless = display_driver_name != NULL && (strcasecmp( display_driver_name, "null" ) == 0 ||
+            strcasecmp( display_driver_name, "soft" ) == 0);
     if( headless ) {
-        display_set_driver( &display_null_driver );
+        display_set_driver( get_display_driver_by_name( display_driver_name ) );
     } else {
         gui_init(show_debugger, show_fullscreen);
 
@@ -358,8 +444,30 @@ int main (int argc, char *argv[])
         }
     }
 
+    /* Boot the disc from the cached state if we can - otherwise the state
+     * is captured on the way through this time */
+    if( boot_cache && !have_save && !have_exec && gdrom_get_current_disc() != NULL ) {
+        dreamcast_boot_cached_disc();
+    }
+
     sh4_set_core( sh4_core );
     sh4_set_profile_blocks( sh4_profile_blocks );
+    if( profile_file != NULL ) {
+        sh4_profiler_start( profile_file, SH4_PROFILE_DEFAULT_RATE );
+    }
+    if( record_trace_file != NULL ) {
+        sh4_trace_start( record_trace_file, record_trace_flags, SH4_TRACE_DEFAULT_LIMIT );
+    }
+    if( record_input_file != NULL && replay_input_file != NULL ) {
+        ERROR( "Can't record and replay input at the same time" );
+        exit(2);
+    } else if( record_input_file != NULL ) {
+        if( !replay_record_start( record_input_file ) )
+            exit(2);
+    } else if( replay_input_file != NULL ) {
+        if( !replay_play_start( replay_input_file ) )
+            exit(2);
+    }
 
     /* If requested, start the gdb server immediately before we go into the main
      * loop.
@@ -371,12 +479,24 @@ int main (int argc, char *argv[])
         gdb_init_server( NULL, strtol(arm_gdb_port,NULL,0), &arm_cpu_desc, TRUE );
     }
     
-    if( headless ) {
+    if( fork_server_path != NULL ) {
+        if( !headless ) {
+            ERROR( "The fork server can only be run headless (-H)" );
+            exit(2);
+        }
+        /* Given something to run and a run-time, get the machine to the
+         * ready state (eg through the boot) before taking any jobs */
+        if( start_immediately && have_run_time ) {
+            dreamcast_set_exit_on_stop( FALSE );
+            dreamcast_run();
+        }
+        return fork_server_run( fork_server_path, 0 );
+    } else if( headless ) {
         dreamcast_run();
     } else {
         gui_main_loop( start_immediately && dreamcast_can_run() );
     }
     dreamcast_shutdown();
-    return 0;
+    return replay_diverged() ? 1 : 0;
 }
 
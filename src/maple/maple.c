@@ -24,6 +24,7 @@
 #include "mem.h"
 #include "asic.h"
 #include "maple.h"
+#include "replay.h"
 
 void maple_init( void );
 
@@ -117,6 +118,9 @@ void maple_handle_buffer( uint32_t address ) {
     unsigned char *buf = (unsigned char *)mem_get_region(address);
     if( buf == NULL ) {
         ERROR( "Invalid or unmapped buffer passed to maple (0x%08X)", address );
+    } else if( replay_is_playing() && replay_maple_apply() ) {
+        /* Responses come from the recording rather than the devices */
+        event_schedule( EVENT_MAPLE_DMA, 200000 );
     } else {
         unsigned int last = 0;
         int i = 0, count;
@@ -188,6 +192,7 @@ void maple_handle_buffer( uint32_t address ) {
             if( dev == NULL ) {
                 /* no device attached */
                 *((uint32_t *)return_buf) = -1;
+                out_length = 0;
             } else {
                 int status, func;
                 unsigned int pt, phase, block, blkid;
@@ -310,9 +315,15 @@ void maple_handle_buffer( uint32_t address ) {
                     return_buf[2] |= maple_periph_mask[port];
                 return_buf[3] = out_length;
             }
+            if( replay_is_recording() ) {
+                replay_maple_response( return_addr, return_buf, 4 + (out_length<<2) );
+            }
             buf += 12 + (length<<2);
             address += 12 + (length<<2);
         }
+        if( replay_is_recording() ) {
+            replay_maple_end();
+        }
         event_schedule( EVENT_MAPLE_DMA, 200000 );
     }
 }
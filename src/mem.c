@@ -35,6 +35,7 @@
 #include "mem.h"
 #include "mmio.h"
 #include "dreamcast.h"
+#include "zpool.h"
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE 4096
@@ -47,8 +48,11 @@ extern struct mem_region_fn mem_region_unmapped;
 
 static int mem_load(FILE *f);
 static void mem_save(FILE *f);
+static int mem_load_snapshot(FILE *f);
+static void mem_save_snapshot(FILE *f);
 struct dreamcast_module mem_module =
-{ "MEM", mem_init, mem_reset, NULL, NULL, NULL, mem_save, mem_load };
+{ "MEM", mem_init, mem_reset, NULL, NULL, NULL, mem_save, mem_load,
+  mem_save_snapshot, mem_load_snapshot };
 
 struct mem_region mem_rgn[MAX_MEM_REGIONS];
 struct mmio_region *io_rgn[MAX_IO_REGIONS];
@@ -196,7 +200,7 @@ static void mem_save( FILE *f )
             fwrite( &mem_rgn[i].base, sizeof(uint32_t), 1, f );
             fwrite( &mem_rgn[i].flags, sizeof(uint32_t), 1, f );
             fwrite( &mem_rgn[i].size, sizeof(uint32_t), 1, f );
-            fwrite_gzip( mem_rgn[i].mem, mem_rgn[i].size, 1, f );
+            fwrite_zpool( mem_rgn[i].mem, mem_rgn[i].size, 1, f );
         }
     }
 
@@ -241,7 +245,10 @@ static int mem_load( FILE *f )
                     ERROR( "Unexpected memory block %d %s (Not a RAM region)", i, tmp );
                     return -1;
                 }
-                fread_gzip( mem_rgn[j].mem, size, 1, f );
+                if( fread_zpool( mem_rgn[j].mem, size, 1, f ) != 1 ) {
+                    ERROR( "Bad memory block %d %s (corrupt data)", i, tmp );
+                    return -1;
+                }
                 mem_region_loaded[j] = 1;
                 break;
             }
@@ -278,6 +285,28 @@ static int mem_load( FILE *f )
     return 0;
 }
 
+/**
+ * Snapshots only need the MMIO registers - the RAM regions are captured
+ * separately, page by page (see snapshot.c)
+ */
+static void mem_save_snapshot( FILE *f )
+{
+    int i;
+    for( i=0; i<num_io_rgns; i++ ) {
+        fwrite( io_rgn[i]->mem, 4096, 1, f );
+    }
+}
+
+static int mem_load_snapshot( FILE *f )
+{
+    int i;
+    for( i=0; i<num_io_rgns; i++ ) {
+        if( fread( io_rgn[i]->mem, 4096, 1, f ) != 1 )
+            return -1;
+    }
+    return 0;
+}
+
 int mem_save_block( const gchar *file, uint32_t start, uint32_t length )
 {
     sh4ptr_t region;
@@ -369,6 +398,13 @@ struct mem_region *mem_map_region( void *mem, uint32_t base, uint32_t size,
     return &mem_rgn[num_mem_rgns-1];
 }
 
+void mem_set_page_fn( sh4addr_t page, mem_region_fn_t fn )
+{
+    page &= (0x1FFFFFFF & ~(LXDREAM_PAGE_SIZE-1));
+    ext_address_space[page>>LXDREAM_PAGE_BITS] = fn;
+    mem_page_remapped( page, fn );
+}
+
 gboolean mem_load_rom( void *output, const gchar *file, uint32_t size, uint32_t crc )
 {
     if( file != NULL && file[0] != '\0' ) {
@@ -81,6 +81,9 @@ typedef struct mem_region {
 #define MAX_IO_REGIONS 24
 #define MAX_MEM_REGIONS 16
 
+extern struct mem_region mem_rgn[];
+extern uint32_t num_mem_rgns;
+
 #define MEM_REGION_BIOS "Bios ROM"
 #define MEM_REGION_MAIN "System RAM"
 #define MEM_REGION_VIDEO "Video RAM"
@@ -100,6 +103,12 @@ struct mem_region *mem_map_region( void *mem, uint32_t base, uint32_t size,
                                    const char *name, mem_region_fn_t fn, int flags, uint32_t repeat_offset,
                                    uint32_t repeat_until );
 
+/**
+ * Replace the vtable of a single page of the external address space (eg to
+ * interpose on accesses to it), and notify the address space users.
+ */
+void mem_set_page_fn( sh4addr_t page, mem_region_fn_t fn );
+
 /**
  * Load a ROM image from the specified filename. If the memory region has not
  * been allocated, it is created now, otherwise the existing region is reused.
@@ -147,9 +156,26 @@ struct breakpoint_struct {
 
 typedef struct watch_point *watch_point_t;
 
+/**
+ * Memory watch points. Read and write watches are implemented by swapping
+ * the vtables of the watched pages for checking wrappers, so the rest of
+ * memory runs at full speed. A hit stops the machine before the accessing
+ * instruction completes. Only SH4 accesses are watched (not DMA), and
+ * addresses are physical - with the TLB on, only pages mapped by TLB entries
+ * loaded after the watch was set are covered.
+ * @param end the last watched address (inclusive)
+ */
 watch_point_t mem_new_watch( uint32_t start, uint32_t end, int flags );
 void mem_delete_watch( watch_point_t watch );
 watch_point_t mem_is_watched( uint32_t addr, int size, int op );
+watch_point_t mem_find_watch( uint32_t start, uint32_t end, int flags );
+
+/**
+ * Return (and clear) the details of the watch point hit that last stopped
+ * the machine.
+ * @return the type of access (WATCH_READ or WATCH_WRITE), or 0 if none.
+ */
+int mem_get_watch_hit( uint32_t *addr );
 
 extern mem_region_fn_t *ext_address_space;
 
@@ -33,8 +33,6 @@
 static CGLContextObj CGL_MACRO_CONTEXT;
 #endif
 
-#define IS_NONEMPTY_TILE_LIST(p) (IS_TILE_PTR(p) && ((*((uint32_t *)(pvr2_main_ram+(p))) >> 28) != 0x0F))
-
 int pvr2_poly_depthmode[8] = { GL_NEVER, GL_LESS, GL_EQUAL, GL_LEQUAL,
         GL_GREATER, GL_NOTEQUAL, GL_GEQUAL, 
         GL_ALWAYS };
@@ -50,6 +48,10 @@ int pvr2_poly_dstblend[8] = {
 static gboolean have_shaders = FALSE;
 static int currentTexId = -1;
 
+/* Translucent tile lists to be depth-sorted in the current scene */
+static pvraddr_t *autosort_tiles = NULL;
+static unsigned int autosort_tiles_alloc = 0;
+
 static inline void bind_texture(int texid)
 {
     if( currentTexId != texid ) {
@@ -86,10 +88,34 @@ static void drawrect2d( uint32_t tile_bounds[], float z )
 
 static void pvr2_scene_load_textures()
 {
-    int i;
+    static uint32_t *tex_words = NULL;
+    static unsigned int tex_words_size = 0;
+    int i, count = 0;
     
     texcache_begin_scene( MMIO_READ( PVR2, RENDER_PALETTE ) & 0x03,
                          (MMIO_READ( PVR2, RENDER_TEXSIZE ) & 0x003F) << 5 );
+
+    /* Decode any new textures up front, across the worker pool. This waits
+     * for the decode to finish; it runs after scene extraction but doesn't
+     * overlap with it (or with rendering) */
+    if( tex_words_size < pvr2_scene.poly_count * 4 ) {
+        g_free( tex_words );
+        tex_words_size = pvr2_scene.poly_count * 4;
+        tex_words = g_malloc( tex_words_size * sizeof(uint32_t) );
+    }
+    for( i=0; i < pvr2_scene.poly_count; i++ ) {
+        uint32_t *context = pvr2_scene.poly_array[i].context;
+        if( POLY1_TEXTURED(context[0]) ) {
+            tex_words[count++] = context[1];
+            tex_words[count++] = context[2];
+            if( pvr2_scene.poly_array[i].mod_vertex_index != -1 &&
+                    pvr2_scene.shadow_mode == SHADOW_FULL ) {
+                tex_words[count++] = context[3];
+                tex_words[count++] = context[4];
+            }
+        }
+    }
+    texcache_prefetch_textures( tex_words, count >> 1 );
     
     for( i=0; i < pvr2_scene.poly_count; i++ ) {
         struct polygon_struct *poly = &pvr2_scene.poly_array[i];
@@ -457,10 +483,34 @@ void pvr2_scene_cleanup_fixed()
 }
 #endif
 
+static void pvr2_scene_setup_packed_shader( GLfloat *viewMatrix )
+{
+    struct packed_vertex_struct *vert = pvr2_scene.packed_vertex_array;
+    GLsizei stride = sizeof(struct packed_vertex_struct);
+
+    glsl_use_pvr2_packed_shader();
+    glsl_set_pvr2_packed_shader_view_matrix(viewMatrix);
+    glsl_set_pvr2_packed_shader_fog_colour1(pvr2_scene.fog_vert_colour);
+    glsl_set_pvr2_packed_shader_fog_colour2(pvr2_scene.fog_lut_colour);
+    glsl_set_pvr2_packed_shader_in_vertex_vec3_pointer(&vert[0].x, stride);
+    glsl_set_pvr2_packed_shader_in_colour_unorm8_pointer(&vert[0].rgba[0], stride);
+    glsl_set_pvr2_packed_shader_in_colour2_unorm8_pointer(&vert[0].offset_rgba[0], stride);
+    glsl_set_pvr2_packed_shader_in_texcoord_pointer(&vert[0].u, stride);
+    glsl_set_pvr2_packed_shader_in_params_ubyte_pointer(&vert[0].params[0], stride);
+    glsl_set_pvr2_packed_shader_alpha_ref(0.0);
+    glsl_set_pvr2_packed_shader_primary_texture(0);
+    glsl_set_pvr2_packed_shader_palette_texture(1);
+}
+
 void pvr2_scene_setup_shader( GLfloat *viewMatrix )
 {
     glEnable( GL_DEPTH_TEST );
 
+    if( pvr2_scene.packed_vertexes ) {
+        pvr2_scene_setup_packed_shader(viewMatrix);
+        return;
+    }
+
     glsl_use_pvr2_shader();
     glsl_set_pvr2_shader_view_matrix(viewMatrix);
     glsl_set_pvr2_shader_fog_colour1(pvr2_scene.fog_vert_colour);
@@ -483,7 +533,11 @@ void pvr2_scene_cleanup_shader( )
 
 void pvr2_scene_set_alpha_shader( float alphaRef )
 {
-    glsl_set_pvr2_shader_alpha_ref(alphaRef);
+    if( pvr2_scene.packed_vertexes ) {
+        glsl_set_pvr2_packed_shader_alpha_ref(alphaRef);
+    } else {
+        glsl_set_pvr2_shader_alpha_ref(alphaRef);
+    }
 }
 
 /**
@@ -556,6 +610,9 @@ void pvr2_scene_render( render_buffer_t buffer )
         }
 #define END_FOREACH_SEGMENT() \
     } while( !IS_LAST_SEGMENT(segment++) );
+#define IS_AUTOSORT_SEGMENT(segment) \
+    (IS_NONEMPTY_TILE_LIST(segment->trans_ptr) && pvr2_scene.sort_mode != SORT_NEVER && \
+     !(pvr2_scene.sort_mode == SORT_TILEFLAG && (segment->control&SEGMENT_SORT_TRANS)))
 #define CLIP_TO_SEGMENT() \
     glScissor( tile_bounds[0], pvr2_scene.buffer_height-tile_bounds[3], tile_bounds[1]-tile_bounds[0], tile_bounds[3] - tile_bounds[2] )
 
@@ -611,15 +668,28 @@ void pvr2_scene_render( render_buffer_t buffer )
     else
         pvr2_scene_set_alpha_fixed(0.0);
 
-    /* Render the translucent polygons */
+    /* Sort the translucent polygons (all tiles at once, so that the work can
+     * be spread over the workpool), then render them */
+    unsigned int autosort_count = 0;
+    FOREACH_SEGMENT(segment)
+        if( IS_AUTOSORT_SEGMENT(segment) ) {
+            if( autosort_count == autosort_tiles_alloc ) {
+                autosort_tiles_alloc = MAX( 64, autosort_tiles_alloc * 2 );
+                autosort_tiles = g_realloc( autosort_tiles, autosort_tiles_alloc * sizeof(pvraddr_t) );
+            }
+            autosort_tiles[autosort_count++] = segment->trans_ptr;
+        }
+    END_FOREACH_SEGMENT()
+    render_sort_tiles( autosort_tiles, autosort_count );
+
+    autosort_count = 0;
     FOREACH_SEGMENT(segment)
         if( IS_NONEMPTY_TILE_LIST(segment->trans_ptr) ) {
             CLIP_TO_SEGMENT();
-            if( pvr2_scene.sort_mode == SORT_NEVER || 
-                    (pvr2_scene.sort_mode == SORT_TILEFLAG && (segment->control&SEGMENT_SORT_TRANS))) {
-                gl_render_tilelist(segment->trans_ptr, TRUE);
+            if( IS_AUTOSORT_SEGMENT(segment) ) {
+                render_autosort_tile( autosort_count++, RENDER_NORMAL );
             } else {
-                render_autosort_tile(segment->trans_ptr, RENDER_NORMAL );
+                gl_render_tilelist(segment->trans_ptr, TRUE);
             }
         }
     END_FOREACH_SEGMENT()
@@ -27,6 +27,7 @@
 #include "pvr2/pvr2.h"
 #include "pvr2/pvr2mmio.h"
 #include "pvr2/scene.h"
+#include "pvr2/texdec.h"
 #include "sh4/sh4.h"
 #define MMIO_IMPL
 #include "pvr2/pvr2mmio.h"
@@ -41,6 +42,8 @@ static void pvr2_reset( void );
 static uint32_t pvr2_run_slice( uint32_t );
 static void pvr2_save_state( FILE *f );
 static int pvr2_load_state( FILE *f );
+static void pvr2_save_snapshot( FILE *f );
+static int pvr2_load_snapshot( FILE *f );
 static void pvr2_update_raster_posn( uint32_t nanosecs );
 static void pvr2_schedule_scanline_event( int eventid, int line, int minimum_lines, int line_time_ns );
 static render_buffer_t pvr2_get_render_buffer( frame_buffer_t frame );
@@ -56,7 +59,7 @@ static int render_colour_formats[8] = {
 
 struct dreamcast_module pvr2_module = { "PVR2", pvr2_init, pvr2_reset, NULL, 
         pvr2_run_slice, NULL,
-        pvr2_save_state, pvr2_load_state };
+        pvr2_save_state, pvr2_load_state, pvr2_save_snapshot, pvr2_load_snapshot };
 
 
 display_driver_t display_driver = NULL;
@@ -88,6 +91,10 @@ struct pvr2_state {
     int32_t interlaced;
 } pvr2_state;
 
+/* Palette banks (of 16 entries) changed since the last render. Not part of
+ * the saved state - the whole palette is treated as changed after a load */
+static uint64_t pvr2_palette_changed_banks = 0;
+
 static gchar *save_next_render_filename;
 static render_buffer_t render_buffers[MAX_RENDER_BUFFERS];
 static uint32_t render_buffer_count = 0;
@@ -142,6 +149,8 @@ static void pvr2_init( void )
     register_event_callback( EVENT_SCANLINE1, pvr2_scanline_callback );
     register_event_callback( EVENT_SCANLINE2, pvr2_scanline_callback );
     register_event_callback( EVENT_GUNPOS, pvr2_gunpos_callback );
+    pvr2_texture_decoder = texture_decoder_select();
+    DEBUG( "Using %s texture decoder", pvr2_texture_decoder->name );
     texcache_init();
     pvr2_reset();
     pvr2_ta_reset();
@@ -165,6 +174,7 @@ static void pvr2_reset( void )
     pvr2_state.dot_clock = PVR2_DOT_CLOCK;
     pvr2_state.back_porch_ns = 4000;
     pvr2_state.palette_changed = FALSE;
+    pvr2_palette_changed_banks = 0;
     mmio_region_PVR2_write( DISP_TOTAL, 0x0270035F );
     mmio_region_PVR2_write( DISP_SYNCTIME, 0x07D6A53F );
     mmio_region_PVR2_write( YUV_ADDR, 0 );
@@ -304,6 +314,50 @@ static int pvr2_load_state( FILE *f )
         return 1;
     if( fread( &pvr2_state, sizeof(pvr2_state), 1, f ) != 1 )
         return 1;
+    pvr2_state.palette_changed = TRUE;
+    pvr2_palette_changed_banks = PVR2_PALETTE_ALL_BANKS;
+    if( pvr2_ta_load_state(f) ) {
+        return 1;
+    }
+    return pvr2_yuv_load_state(f);
+}
+
+/**
+ * Snapshots don't carry the render buffers - instead any buffers that
+ * haven't reached VRAM yet are flushed before the snapshot is taken, and
+ * the buffers are simply discarded again on restore.
+ */
+static void pvr2_save_snapshot( FILE *f )
+{
+    int i;
+    for( i=0; i<render_buffer_count; i++ ) {
+        if( render_buffers[i] != NULL && !render_buffers[i]->flushed &&
+                render_buffers[i]->address != -1 ) {
+            pvr2_render_buffer_copy_to_sh4( render_buffers[i] );
+        }
+    }
+    fwrite( &pvr2_state, sizeof(pvr2_state), 1, f );
+    pvr2_ta_save_state( f );
+    pvr2_yuv_save_state( f );
+}
+
+static int pvr2_load_snapshot( FILE *f )
+{
+    int i;
+    if( display_driver != NULL ) {
+        for( i=0; i<render_buffer_count; i++ ) {
+            if( render_buffers[i] != NULL ) {
+                display_driver->destroy_render_buffer(render_buffers[i]);
+                render_buffers[i] = NULL;
+            }
+        }
+        render_buffer_count = 0;
+        displayed_render_buffer = NULL;
+    }
+    if( fread( &pvr2_state, sizeof(pvr2_state), 1, f ) != 1 )
+        return 1;
+    pvr2_state.palette_changed = TRUE;
+    pvr2_palette_changed_banks = PVR2_PALETTE_ALL_BANKS;
     if( pvr2_ta_load_state(f) ) {
         return 1;
     }
@@ -361,7 +415,8 @@ int pvr2_get_frame_count()
 
 void pvr2_draw_frame()
 {
-    if( display_driver != NULL && display_driver != &display_null_driver ) {
+    if( display_driver != NULL && display_driver != &display_null_driver &&
+            display_driver != &display_soft_driver ) {
         if( displayed_render_buffer == NULL ) {
             display_driver->display_blank(displayed_border_colour);
         } else {
@@ -481,7 +536,11 @@ MMIO_REGION_WRITE_FN( PVR2, reg, val )
         pvr2_scene_read();
         render_buffer_t buffer = pvr2_next_render_buffer();
         if( buffer != NULL ) {
-            pvr2_scene_render( buffer );
+            if( display_driver->capabilities.soft_render ) {
+                pvr2_scene_render_soft( buffer );
+            } else {
+                pvr2_scene_render( buffer );
+            }
             if( buffer->address < PVR2_RAM_BASE ) {
                 // Flush immediately - optimize this later. Otherwise this gets
                 // complicated very quickly trying to second-guess how it's
@@ -829,17 +888,25 @@ MMIO_REGION_READ_FN( PVR2, reg )
 MMIO_REGION_READ_DEFSUBFNS(PVR2)
 MMIO_REGION_READ_DEFSUBFNS(PVR2PAL)
 
+/**
+ * Rewriting an entry with the value it already holds (which games commonly
+ * do by reloading the whole palette every frame) doesn't count as a change.
+ */
 MMIO_REGION_WRITE_FN( PVR2PAL, reg, val )
 {
     reg &= 0xFFF;
-    MMIO_WRITE( PVR2PAL, reg, val );
-    pvr2_state.palette_changed = TRUE;
+    if( (uint32_t)MMIO_READ( PVR2PAL, reg ) != (uint32_t)val ) {
+        MMIO_WRITE( PVR2PAL, reg, val );
+        pvr2_palette_changed_banks |= ((uint64_t)1) << (reg >> 6);
+        pvr2_state.palette_changed = TRUE;
+    }
 }
 
 void pvr2_check_palette_changed()
 {
     if( pvr2_state.palette_changed ) {
-        texcache_invalidate_palette();
+        texcache_invalidate_palette( pvr2_palette_changed_banks );
+        pvr2_palette_changed_banks = 0;
         pvr2_state.palette_changed = FALSE;
     }
 }
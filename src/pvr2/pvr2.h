@@ -153,6 +153,12 @@ void pvr2_dma_write( sh4addr_t dest, unsigned char *src, uint32_t length );
  */
 void pvr2_vram32_write( sh4addr_t dest, unsigned char *src, uint32_t length );
 
+/**
+ * Mark any textures overlapping a range of the linear (32-bit) address space
+ * as modified. Used by writers that bypass pvr2_vram32_write.
+ */
+void pvr2_vram32_invalidate_textures( sh4addr_t dest, uint32_t length );
+
 /**
  * Write to the interleaved memory address space (aka 64-bit address space).
  */
@@ -278,6 +284,12 @@ int pvr2_yuv_load_state( FILE *f );
  */
 void pvr2_scene_render( render_buffer_t buffer );
 
+/**
+ * Render the current scene stored in PVR ram directly into the memory of
+ * the given buffer, without using GL (see swrender.c).
+ */
+void pvr2_scene_render_soft( render_buffer_t buffer );
+
 /**
  * Perform the initial once-off GL setup, usually immediately after the GL
  * context is first bound.
@@ -288,9 +300,31 @@ void pvr2_shutdown_gl_context();
 
 void render_backplane( uint32_t *polygon, uint32_t width, uint32_t height, uint32_t mode );
 
-void render_autosort_tile( pvraddr_t tile_entry, int render_mode );
+/**
+ * Depth-sort the triangles of each of the given tile lists, spreading the
+ * tiles over the workpool. The results (and tile_entries) are kept until the
+ * next call, for render_autosort_tile.
+ */
+void render_sort_tiles( const pvraddr_t *tile_entries, unsigned int count );
+
+/**
+ * Render the sorted triangles of the index'th tile of the last
+ * render_sort_tiles batch.
+ */
+void render_autosort_tile( unsigned int index, int render_mode );
 
 struct polygon_struct;
+
+typedef void (*sort_triangle_fn_t)( struct polygon_struct *poly, int triangle, void *data );
+
+/**
+ * Depth-sort the triangles of the given tile list, and call fn for each one
+ * in turn, back to front.
+ * @param thread selects the sort's scratch space - callers running at the same
+ * time must pass different values (eg the workpool thread index).
+ */
+void render_sort_tile_triangles( pvraddr_t tile_entry, unsigned int thread, sort_triangle_fn_t fn, void *data );
+
 void gl_render_triangle( struct polygon_struct *poly, int index );
 
 void gl_render_tilelist( pvraddr_t tile_entry, gboolean set_depth );
@@ -352,9 +386,20 @@ void texcache_gl_shutdown( void );
 void texcache_flush( void );
 
 /**
- * Flush all palette-based textures (if any)
+ * Set the maximum number of textures held in the cache, and the maximum
+ * texture memory (in bytes, or 0 for no limit) they may use.
+ */
+void texcache_set_limits( unsigned int max_textures, size_t max_bytes );
+
+/** Palette RAM as a bitmask of 64 banks of 16 entries */
+#define PVR2_PALETTE_ALL_BANKS 0xFFFFFFFFFFFFFFFFULL
+
+/**
+ * Flush palette-based textures that use any of the given palette banks (if
+ * any), or mark the banks for re-upload when using the palette shader.
+ * @param banks bitmask of changed 16-entry banks (bit n = entries 16n..16n+15)
  */
-void texcache_invalidate_palette(void);
+void texcache_invalidate_palette( uint64_t banks );
 
 /**
  * Evict all textures contained in the page identified by a texture address.
@@ -367,6 +412,16 @@ void texcache_invalidate_page( uint32_t texture_addr );
  */
 void texcache_begin_scene( uint32_t palette_mode, uint32_t stride_width );
 
+/**
+ * Decode (in parallel on the worker pool) all textures in the list that
+ * aren't already in the cache, so that texcache_get_texture only needs to
+ * upload them. Returns once all the textures have been decoded. Must be
+ * called after texcache_begin_scene. The prefetched textures are discarded
+ * at the start of the next scene.
+ * @param words count pairs of poly2 word, texture word
+ */
+void texcache_prefetch_textures( const uint32_t *words, unsigned int count );
+
 /**
  * Return a texture ID for the texture specified at the supplied address
  * and given parameters (the same sequence of bytes could in theory have
@@ -379,6 +434,13 @@ void texcache_begin_scene( uint32_t palette_mode, uint32_t stride_width );
  */
 GLuint texcache_get_texture( uint32_t poly2_word, uint32_t texture_word );
 
+/**
+ * Decode the texture specified by the texture word into 32-bit ARGB texels,
+ * for rendering without GL. Only the top level of a mipmapped texture is
+ * decoded (and mipmapped textures are always square).
+ */
+void texcache_decode_texture( uint32_t *dest, uint32_t texture_word, int width, int height );
+
 render_buffer_t texcache_get_render_buffer( uint32_t texture_addr, int mode, int width, int height );
 
 void pvr2_check_palette_changed(void);
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include "sh4/sh4core.h"
 #include "pvr2.h"
+#include "pvr2/texdec.h"
 #include "asic.h"
 #include "dream.h"
 
@@ -217,10 +218,29 @@ void pvr2_dma_write( sh4addr_t destaddr, unsigned char *src, uint32_t count )
     }
 }
 
+void pvr2_vram32_invalidate_textures( sh4addr_t destaddr, uint32_t length )
+{
+    uint32_t i, end;
+
+    destaddr &= PVR2_RAM_MASK;
+    if( length == 0 )
+        return;
+    if( PVR2_RAM_SIZE - destaddr < length ) {
+        length = PVR2_RAM_SIZE - destaddr;
+    }
+    /* Each 4K texture page covers 2K of each 32-bit bank; the bank only
+     * selects bit 2 of the texture address, so it doesn't change the page. */
+    end = destaddr + length;
+    for( i=destaddr & 0xFFFFF800; i < end; i+= (LXDREAM_PAGE_SIZE>>1) ) {
+        texcache_invalidate_page( (i & 0x003FFFFC) << 1 );
+    }
+}
+
 void pvr2_vram32_write( sh4addr_t destaddr, unsigned char *src, uint32_t length )
 {
     destaddr &= PVR2_RAM_MASK;
     pvr2_render_buffer_invalidate( PVR2_RAM_BASE + destaddr, TRUE );
+    pvr2_vram32_invalidate_textures( destaddr, length );
     unsigned char *dest = pvr2_main_ram + destaddr;
     if( PVR2_RAM_SIZE - destaddr < length ) {
         length = PVR2_RAM_SIZE - destaddr;
@@ -361,97 +381,6 @@ void pvr2_vram64_read_stride( unsigned char *dest, uint32_t dest_line_bytes, sh4
 }
 
 
-/**
- * @param dest Destination image buffer
- * @param banks Source data expressed as two bank pointers
- * @param offset Offset into banks[0] specifying where the next byte
- *  to read is (0..3)
- * @param x1,y1 Destination coordinates
- * @param width Width of current destination block
- * @param stride Total width of image (ie stride) in bytes
- */
-
-static void pvr2_vram64_detwiddle_4( uint8_t *dest, uint8_t *banks[2], int offset,
-                                     int x1, int y1, int width, int stride )
-{
-    if( width == 2 ) {
-        x1 = x1 >> 1;
-        uint8_t t1 = *banks[offset<4?0:1]++;
-        uint8_t t2 = *banks[offset<3?0:1]++;
-        dest[y1*stride + x1] = (t1 & 0x0F) | (t2<<4);
-        dest[(y1+1)*stride + x1] = (t1>>4) | (t2&0xF0);
-    } else if( width == 4 ) {
-        pvr2_vram64_detwiddle_4( dest, banks, offset, x1, y1, 2, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset+2, x1, y1+2, 2, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset+4, x1+2, y1, 2, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset+6, x1+2, y1+2, 2, stride );
-
-    } else {
-        int subdivide = width >> 1;
-        pvr2_vram64_detwiddle_4( dest, banks, offset, x1, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_4( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
-    }
-}
-
-/**
- * @param dest Destination image buffer
- * @param banks Source data expressed as two bank pointers
- * @param offset Offset into banks[0] specifying where the next byte
- *  to read is (0..3)
- * @param x1,y1 Destination coordinates
- * @param width Width of current destination block
- * @param stride Total width of image (ie stride)
- */
-
-static void pvr2_vram64_detwiddle_8( uint8_t *dest, uint8_t *banks[2], int offset,
-                                     int x1, int y1, int width, int stride )
-{
-    if( width == 2 ) {
-        dest[y1*stride + x1] = *banks[0]++;
-        dest[(y1+1)*stride + x1] = *banks[offset<3?0:1]++;
-        dest[y1*stride + x1 + 1] = *banks[offset<2?0:1]++;
-        dest[(y1+1)*stride + x1 + 1] = *banks[offset==0?0:1]++;
-        uint8_t *tmp = banks[0]; /* swap banks */
-        banks[0] = banks[1];
-        banks[1] = tmp;
-    } else {
-        int subdivide = width >> 1;
-        pvr2_vram64_detwiddle_8( dest, banks, offset, x1, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_8( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
-        pvr2_vram64_detwiddle_8( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_8( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
-    }
-}
-
-/**
- * @param dest Destination image buffer
- * @param banks Source data expressed as two bank pointers
- * @param offset Offset into banks[0] specifying where the next word
- *  to read is (0 or 1)
- * @param x1,y1 Destination coordinates
- * @param width Width of current destination block
- * @param stride Total width of image (ie stride)
- */
-
-static void pvr2_vram64_detwiddle_16( uint16_t *dest, uint16_t *banks[2], int offset,
-                                      int x1, int y1, int width, int stride )
-{
-    if( width == 2 ) {
-        dest[y1*stride + x1] = *banks[0]++;
-        dest[(y1+1)*stride + x1] = *banks[offset]++;
-        dest[y1*stride + x1 + 1] = *banks[1]++;
-        dest[(y1+1)*stride + x1 + 1] = *banks[offset^1]++;
-    } else {
-        int subdivide = width >> 1;
-        pvr2_vram64_detwiddle_16( dest, banks, offset, x1, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_16( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
-        pvr2_vram64_detwiddle_16( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
-        pvr2_vram64_detwiddle_16( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
-    }
-}
-
 /**
  * Read an image from 64-bit vram stored as twiddled 4-bit pixels. The
  * image is written out to the destination in detwiddled form.
@@ -462,37 +391,7 @@ static void pvr2_vram64_detwiddle_16( uint16_t *dest, uint16_t *banks[2], int of
  */
 void pvr2_vram64_read_twiddled_4( unsigned char *dest, sh4addr_t srcaddr, uint32_t width, uint32_t height )
 {
-    int offset_flag = (srcaddr & 0x07);
-    uint8_t *banks[2];
-    uint8_t *wdest = (uint8_t*)dest;
-    uint32_t stride = width >> 1;
-    int i;
-
-    srcaddr = srcaddr & 0x7FFFF8;
-
-    banks[0] = (uint8_t *)(pvr2_main_ram + (srcaddr>>1));
-    banks[1] = banks[0] + 0x400000;
-    if( offset_flag & 0x04 ) { // If source is not 64-bit aligned, swap the banks
-        uint8_t *tmp = banks[0];
-        banks[0] = banks[1];
-        banks[1] = tmp + 4;
-        offset_flag &= 0x03;
-    }
-    banks[0] += offset_flag;
-
-    if( width > height ) {
-        for( i=0; i<width; i+=height ) {
-            pvr2_vram64_detwiddle_4( wdest, banks, offset_flag, i, 0, height, stride );
-        }
-    } else if( height > width ) {
-        for( i=0; i<height; i+=width ) {
-            pvr2_vram64_detwiddle_4( wdest, banks, offset_flag, 0, i, width, stride );
-        }
-    } else if( width == 1 ) {
-        *wdest = *banks[0];
-    } else {
-        pvr2_vram64_detwiddle_4( wdest, banks, offset_flag, 0, 0, width, stride );
-    }
+    pvr2_texture_decoder->read_twiddled_4( dest, pvr2_main_ram, srcaddr, width, height );
 }
 
 /**
@@ -505,36 +404,7 @@ void pvr2_vram64_read_twiddled_4( unsigned char *dest, sh4addr_t srcaddr, uint32
  */
 void pvr2_vram64_read_twiddled_8( unsigned char *dest, sh4addr_t srcaddr, uint32_t width, uint32_t height )
 {
-    int offset_flag = (srcaddr & 0x07);
-    uint8_t *banks[2];
-    uint8_t *wdest = (uint8_t*)dest;
-    int i;
-
-    srcaddr = srcaddr & 0x7FFFF8;
-
-    banks[0] = (uint8_t *)(pvr2_main_ram + (srcaddr>>1));
-    banks[1] = banks[0] + 0x400000;
-    if( offset_flag & 0x04 ) { // If source is not 64-bit aligned, swap the banks
-        uint8_t *tmp = banks[0];
-        banks[0] = banks[1];
-        banks[1] = tmp + 4;
-        offset_flag &= 0x03;
-    }
-    banks[0] += offset_flag;
-
-    if( width > height ) {
-        for( i=0; i<width; i+=height ) {
-            pvr2_vram64_detwiddle_8( wdest, banks, offset_flag, i, 0, height, width );
-        }
-    } else if( height > width ) {
-        for( i=0; i<height; i+=width ) {
-            pvr2_vram64_detwiddle_8( wdest, banks, offset_flag, 0, i, width, width );
-        }
-    } else if( width == 1 ) {
-        *wdest = *banks[0];
-    } else {
-        pvr2_vram64_detwiddle_8( wdest, banks, offset_flag, 0, 0, width, width );
-    }
+    pvr2_texture_decoder->read_twiddled_8( dest, pvr2_main_ram, srcaddr, width, height );
 }
 
 /**
@@ -545,38 +415,9 @@ void pvr2_vram64_read_twiddled_8( unsigned char *dest, sh4addr_t srcaddr, uint32
  * @param width image width (must be a power of 2)
  * @param height image height (must be a power of 2)
  */
-void pvr2_vram64_read_twiddled_16( unsigned char *dest, sh4addr_t srcaddr, uint32_t width, uint32_t height ) {
-    int offset_flag = (srcaddr & 0x06) >> 1;
-    uint16_t *banks[2];
-    uint16_t *wdest = (uint16_t*)dest;
-    int i;
-
-    srcaddr = srcaddr & 0x7FFFF8;
-
-    banks[0] = (uint16_t *)(pvr2_main_ram + (srcaddr>>1));
-    banks[1] = banks[0] + 0x200000;
-    if( offset_flag & 0x02 ) { // If source is not 64-bit aligned, swap the banks
-        uint16_t *tmp = banks[0];
-        banks[0] = banks[1];
-        banks[1] = tmp + 2;
-        offset_flag &= 0x01;
-    }
-    banks[0] += offset_flag;
-
-
-    if( width > height ) {
-        for( i=0; i<width; i+=height ) {
-            pvr2_vram64_detwiddle_16( wdest, banks, offset_flag, i, 0, height, width );
-        }
-    } else if( height > width ) {
-        for( i=0; i<height; i+=width ) {
-            pvr2_vram64_detwiddle_16( wdest, banks, offset_flag, 0, i, width, width );
-        }
-    } else if( width == 1 ) {
-        *wdest = *banks[0];
-    } else {
-        pvr2_vram64_detwiddle_16( wdest, banks, offset_flag, 0, 0, width, width );
-    }
+void pvr2_vram64_read_twiddled_16( unsigned char *dest, sh4addr_t srcaddr, uint32_t width, uint32_t height )
+{
+    pvr2_texture_decoder->read_twiddled_16( dest, pvr2_main_ram, srcaddr, width, height );
 }
 
 static void pvr2_vram_write_invert( sh4addr_t destaddr, unsigned char *src, uint32_t src_size, 
@@ -21,20 +21,71 @@
 #include "pvr2/pvr2.h"
 #include "pvr2/scene.h"
 #include "asic.h"
+#include "workpool.h"
 
-#define MIN3( a,b,c ) ((a) < (b) ? ( (a) < (c) ? (a) : (c) ) : ((b) < (c) ? (b) : (c)) )
 #define MAX3( a,b,c ) ((a) > (b) ? ( (a) > (c) ? (a) : (c) ) : ((b) > (c) ? (b) : (c)) )
-#define EPSILON 0.0001
+
+/* Only the top 24 bits of the depth key are sorted on. Triangles with keys
+ * that differ only in the low bits (ie depths within about 1 part in 2^15)
+ * are left in list order, the same as exactly equal depths. */
+#define SORT_KEY_MASK 0xFFFFFF00
+#define SORT_KEY_FIRST_PASS 1 /* Byte 0 of the key is masked off */
+#define SORT_KEY_PASSES 4
+
+/* Below this, an insertion sort beats setting up the radix sort */
+#define SORT_INSERTION_MAX 32
+
+/* Batches with fewer triangles than this aren't worth spreading over the workpool */
+#define SORT_PARALLEL_MIN 512
 
 struct sort_triangle {
     struct polygon_struct *poly;
     int triangle_num; // triangle number in the poly, from 0
-    /* plane equation */
-    float mx, my, mz, d;
-    float bounds[6]; /* x1,x2,y1,y2,z1,z2 */
 };
 
-#define SENTINEL 0xDEADBEEF
+/**
+ * Per-thread scratch space for the sort, kept from one tile to the next so
+ * that it only needs to be (re)allocated when a tile has more triangles than
+ * any previous one.
+ */
+struct sort_arena {
+    struct sort_triangle *triangles;
+    /* Sort items, each the depth key in the high word and the triangle's index in
+     * the low word, so that items with the same key sort in list order. items[1]
+     * is the radix sort's second buffer. */
+    uint64_t *items[2];
+    unsigned int size;
+};
+
+static struct sort_arena sort_arenas[WORKPOOL_MAX_THREADS];
+
+/**
+ * Result of render_sort_tiles, the sorted triangles of each tile stored
+ * consecutively in order.
+ */
+static struct {
+    const pvraddr_t *tile_entries;
+    unsigned int *first;       /* Index of each tile's first triangle in order, or SORT_UNSORTED */
+    unsigned int *count;       /* Number of triangles in each tile */
+    struct sort_triangle *order;
+    unsigned int tiles_alloc, order_alloc;
+} sort_batch;
+
+/* Tiles with at most one triangle don't need sorting, and are drawn as is */
+#define SORT_UNSORTED 0xFFFFFFFF
+
+static void sort_arena_reserve( struct sort_arena *arena, unsigned int count )
+{
+    if( count > arena->size ) {
+        unsigned int size = MAX( count, arena->size * 2 );
+        arena->triangles = g_realloc( arena->triangles, size * sizeof(struct sort_triangle) );
+        g_free( arena->items[0] );
+        g_free( arena->items[1] );
+        arena->items[0] = g_malloc( size * sizeof(uint64_t) );
+        arena->items[1] = g_malloc( size * sizeof(uint64_t) );
+        arena->size = size;
+    }
+}
 
 /**
  * Count the number of triangles in the list starting at the given 
@@ -66,42 +117,38 @@ static int sort_count_triangles( pvraddr_t tile_entry ) {
     return count;
 }
 
-static void sort_add_triangle( struct sort_triangle *triangle, struct polygon_struct *poly, int index )
+/**
+ * @return the depth key for a triangle with the given maximum depth. Keys
+ * increase with decreasing depth (ie decreasing w), so that sorting into
+ * ascending key order draws back to front.
+ */
+static inline uint32_t sort_depth_key( float z )
+{
+    union { float f; uint32_t i; } value;
+    value.f = z;
+    /* Map the float to an unsigned integer with the same ordering */
+    if( value.i & 0x80000000 ) {
+        value.i = ~value.i;
+    } else {
+        value.i |= 0x80000000;
+    }
+    return (~value.i) & SORT_KEY_MASK;
+}
+
+static void sort_add_triangle( struct sort_arena *arena, int count, struct polygon_struct *poly, int index )
 {
     struct vertex_struct *vertexes = &pvr2_scene.vertex_array[poly->vertex_index+index];
-    triangle->poly = poly;
-    triangle->triangle_num = index;
-
-    /* Compute triangle bounding-box */
-    triangle->bounds[0] = MIN3(vertexes[0].x,vertexes[1].x,vertexes[2].x);
-    triangle->bounds[1] = MAX3(vertexes[0].x,vertexes[1].x,vertexes[2].x);
-    triangle->bounds[2] = MIN3(vertexes[0].y,vertexes[1].y,vertexes[2].y);
-    triangle->bounds[3] = MAX3(vertexes[0].y,vertexes[1].y,vertexes[2].y);
-    triangle->bounds[4] = MIN3(vertexes[0].z,vertexes[1].z,vertexes[2].z);
-    triangle->bounds[5] = MAX3(vertexes[0].z,vertexes[1].z,vertexes[2].z);
-
-    /* Compute plane equation */
-    float sx = vertexes[1].x - vertexes[0].x;
-    float sy = vertexes[1].y - vertexes[0].y;
-    float sz = vertexes[1].z - vertexes[0].z;
-    float tx = vertexes[2].x - vertexes[0].x;
-    float ty = vertexes[2].y - vertexes[0].y;
-    float tz = vertexes[2].z - vertexes[0].z;
-    triangle->mx = sy*tz - sz*ty;
-    triangle->my = sz*tx - sx*tz;
-    triangle->mz = sx*ty - sy*tx;
-    triangle->d = -vertexes[0].x*triangle->mx - 
-                  vertexes[0].y*triangle->my - 
-                  vertexes[0].z*triangle->mz;
+    float maxz = MAX3(vertexes[0].z,vertexes[1].z,vertexes[2].z);
+    arena->triangles[count].poly = poly;
+    arena->triangles[count].triangle_num = index;
+    arena->items[0][count] = (((uint64_t)sort_depth_key(maxz)) << 32) | count;
 }
 
-
-
 /**
  * Extract a triangle list from the tile (basically indexes into the polygon list, plus
- * computing maxz while we go through it
+ * computing the sort key while we go through it)
  */
-int sort_extract_triangles( pvraddr_t tile_entry, struct sort_triangle *triangles )
+static int sort_extract_triangles( pvraddr_t tile_entry, struct sort_arena *arena )
 {
     uint32_t *tile_list = (uint32_t *)(pvr2_main_ram+tile_entry);
     int strip_count;
@@ -125,7 +172,7 @@ int sort_extract_triangles( pvraddr_t tile_entry, struct sort_triangle *triangle
                     /* Triangle could point to a strip, but we only want
                      * the first one in this case
                      */
-                    sort_add_triangle( &triangles[count], poly, 0 );
+                    sort_add_triangle( arena, count, poly, 0 );
                     count++;
                 }
                 poly = poly->next;
@@ -139,7 +186,7 @@ int sort_extract_triangles( pvraddr_t tile_entry, struct sort_triangle *triangle
                 assert( poly != NULL );
                 for( i=0; i+2<poly->vertex_count && i < 2; i++ ) {
                     /* Note: quads can't have sub-polys */
-                    sort_add_triangle( &triangles[count], poly, i );
+                    sort_add_triangle( arena, count, poly, i );
                     count++;
                 }
                 poly = poly->next;
@@ -156,7 +203,7 @@ int sort_extract_triangles( pvraddr_t tile_entry, struct sort_triangle *triangle
                  */
                 while( poly != NULL ) {
                     for( i=0; i+2<poly->vertex_count; i++ ) {
-                        sort_add_triangle( &triangles[count], poly, i );
+                        sort_add_triangle( arena, count, poly, i );
                         count++;
                     }
                     poly = poly->sub_next;
@@ -167,121 +214,159 @@ int sort_extract_triangles( pvraddr_t tile_entry, struct sort_triangle *triangle
 
 }
 
-void sort_render_triangles( struct sort_triangle **triangles, int num_triangles )
+/**
+ * Sort the arena's items into ascending order. This is an LSD radix sort on
+ * the depth key (which is stable, so triangles at the same depth stay in list
+ * order), skipping any pass where all keys have the same digit. Small lists
+ * get an insertion sort instead, which comes to the same thing since the
+ * items are unique.
+ * @return the buffer holding the sorted items
+ */
+static uint64_t *sort_items( struct sort_arena *arena, unsigned int count )
 {
-    int i;
-    for( i=0; i<num_triangles; i++ ) {
-        gl_render_triangle(triangles[i]->poly, triangles[i]->triangle_num);
+    uint64_t *in = arena->items[0], *out = arena->items[1];
+    unsigned int histogram[SORT_KEY_PASSES][256];
+    unsigned int i, pass;
+
+    if( count <= SORT_INSERTION_MAX ) {
+        for( i=1; i<count; i++ ) {
+            uint64_t item = in[i];
+            int j = i-1;
+            while( j >= 0 && in[j] > item ) {
+                in[j+1] = in[j];
+                j--;
+            }
+            in[j+1] = item;
+        }
+        return in;
     }
-}
 
-static int sort_triangle_compare( const void *a, const void *b ) 
-{
-    const struct sort_triangle *tri1 = a;
-    const struct sort_triangle *tri2 = b;
-    if( tri1->bounds[5] <= tri2->bounds[4] ) 
-        return 1; /* tri1 is entirely under tri2 */
-    else if( tri2->bounds[5] <= tri1->bounds[4] )
-        return -1;  /* tri2 is entirely under tri1 */
-    else if( tri1->bounds[1] <= tri2->bounds[0] ||
-             tri2->bounds[1] <= tri1->bounds[0] ||
-             tri1->bounds[3] <= tri2->bounds[2] ||
-             tri2->bounds[3] <= tri1->bounds[2] )
-        return 0; /* tri1 and tri2 don't actually overlap at all */
-    else { 
-        struct vertex_struct *tri2v = &pvr2_scene.vertex_array[tri2->poly->vertex_index + tri2->triangle_num];
-        float v[3];
-        int i;
-        for( i=0; i<3; i++ ) {
-            v[i] = tri1->mx * tri2v[i].x + tri1->my * tri2v[i].y + tri1->mz * tri2v[i].z + tri1->d;
-            if( v[i] > -EPSILON && v[i] < EPSILON ) v[i] = 0;
+    memset( histogram, 0, sizeof(histogram) );
+    for( i=0; i<count; i++ ) {
+        uint32_t key = (uint32_t)(in[i] >> 32);
+        for( pass = SORT_KEY_FIRST_PASS; pass < SORT_KEY_PASSES; pass++ ) {
+            histogram[pass][(key >> (pass*8)) & 0xFF]++;
+        }
+    }
+
+    for( pass = SORT_KEY_FIRST_PASS; pass < SORT_KEY_PASSES; pass++ ) {
+        unsigned int *offset = histogram[pass], shift = 32 + pass*8, total = 0;
+        uint64_t *tmp;
+        if( offset[(in[0] >> shift) & 0xFF] == count ) {
+            continue; /* Every item has the same digit */
         }
-        if( v[0] == 0 && v[1] == 0 && v[2] == 0 ) {
-            return 0; /* coplanar */
+        for( i=0; i<256; i++ ) {
+            unsigned int n = offset[i];
+            offset[i] = total;
+            total += n;
         }
-        if( (v[0] >=0 && v[1] >= 0 && v[2] >= 0) ||
-            (v[0] <= 0 && v[1] <= 0 && v[2] <= 0) ) {
-            /* Tri is on one side of the plane. Pick an arbitrary point to determine which side */
-            float t1z = -(tri1->mx * tri2v[0].x + tri1->my * tri2v[0].y + tri1->d) / tri1->mz;
-            return tri2v[0].z - t1z;
+        for( i=0; i<count; i++ ) {
+            out[offset[(in[i] >> shift) & 0xFF]++] = in[i];
         }
-        
-        /* If the above test failed, then tri2 intersects tri1's plane. This
-         * doesn't necessarily mean the triangles intersect (although they may).
-         * For now just return 0, and come back to this later as it's a fairly
-         * uncommon case in practice. 
-         */
-        return 0;
+        tmp = in; in = out; out = tmp;
     }
+    return in;
 }
 
 /**
- * This is pretty much a standard merge sort (Unfortunately can't depend on
- * the system to provide one. Note we can't use quicksort here - the sort
- * must be stable to preserve the order of coplanar triangles.
+ * Extract and sort the triangles of the tile.
+ * @param num_triangles sort_count_triangles(tile_entry)
+ * @param items set to the sorted items, which index arena->triangles
+ * @return the number of triangles
  */
-static void sort_triangles( struct sort_triangle **triangles, int num_triangles, struct sort_triangle **out )
+static unsigned int sort_tile( struct sort_arena *arena, pvraddr_t tile_entry,
+                               unsigned int num_triangles, uint64_t **items )
 {
-    if( num_triangles > 2 ) {
-        int l = num_triangles>>1, r=num_triangles-l, i=0,j=0;
-        struct sort_triangle *left[l];
-        struct sort_triangle *right[r];
-        sort_triangles( triangles, l, left );
-        sort_triangles( triangles+l, r, right );
-        
-        /* Merge */
-        while(1) {
-            if( sort_triangle_compare(left[i], right[j]) <= 0 ) {
-                *out++ = left[i++];
-                if( i == l ) {
-                    memcpy( out, &right[j], (r-j)*sizeof(struct sort_triangle *) );        
-                    break;
-                }
-            } else {
-                *out++ = right[j++];
-                if( j == r ) {
-                    memcpy( out, &left[i], (l-i)*sizeof(struct sort_triangle *) );
-                    break;
-                }
-            }
+    unsigned int count;
+    sort_arena_reserve( arena, num_triangles );
+    count = sort_extract_triangles( tile_entry, arena );
+    assert( count <= num_triangles );
+    *items = sort_items( arena, count );
+    return count;
+}
+
+void render_sort_tile_triangles( pvraddr_t tile_entry, unsigned int thread, sort_triangle_fn_t fn, void *data )
+{
+    struct sort_arena *arena = &sort_arenas[thread];
+    unsigned int num_triangles = sort_count_triangles(tile_entry), i, count;
+    uint64_t *items;
+
+    if( num_triangles == 0 ) {
+        return; /* nothing to do */
+    }
+    count = sort_tile( arena, tile_entry, num_triangles, &items );
+    for( i=0; i<count; i++ ) {
+        struct sort_triangle *triangle = &arena->triangles[(uint32_t)items[i]];
+        fn( triangle->poly, triangle->triangle_num, data );
+    }
+}
+
+static void sort_batch_tile( void *data, unsigned int item, unsigned int thread )
+{
+    if( sort_batch.first[item] != SORT_UNSORTED ) {
+        struct sort_arena *arena = &sort_arenas[thread];
+        struct sort_triangle *order = &sort_batch.order[sort_batch.first[item]];
+        unsigned int i, count;
+        uint64_t *items;
+
+        count = sort_tile( arena, sort_batch.tile_entries[item], sort_batch.count[item], &items );
+        for( i=0; i<count; i++ ) {
+            order[i] = arena->triangles[(uint32_t)items[i]];
         }
-    } else if( num_triangles == 2 ) {
-        if( sort_triangle_compare(triangles[0], triangles[1]) <= 0 ) {
-            out[0] = triangles[0];
-            out[1] = triangles[1];
+        sort_batch.count[item] = count;
+    }
+}
+
+void render_sort_tiles( const pvraddr_t *tile_entries, unsigned int count )
+{
+    unsigned int i, total = 0;
+
+    if( count > sort_batch.tiles_alloc ) {
+        sort_batch.first = g_realloc( sort_batch.first, count * sizeof(unsigned int) );
+        sort_batch.count = g_realloc( sort_batch.count, count * sizeof(unsigned int) );
+        sort_batch.tiles_alloc = count;
+    }
+    sort_batch.tile_entries = tile_entries;
+    for( i=0; i<count; i++ ) {
+        unsigned int num_triangles = sort_count_triangles( tile_entries[i] );
+        sort_batch.count[i] = num_triangles;
+        if( num_triangles > 1 ) {
+            sort_batch.first[i] = total;
+            total += num_triangles;
         } else {
-            struct sort_triangle *tmp = triangles[0];
-            out[0] = triangles[1];
-            out[1] = tmp;
+            sort_batch.first[i] = SORT_UNSORTED;
         }
+    }
+    if( total > sort_batch.order_alloc ) {
+        sort_batch.order_alloc = MAX( total, sort_batch.order_alloc * 2 );
+        sort_batch.order = g_realloc( sort_batch.order, sort_batch.order_alloc * sizeof(struct sort_triangle) );
+    }
+
+    if( total >= SORT_PARALLEL_MIN ) {
+        workpool_run( sort_batch_tile, NULL, count );
     } else {
-        out[0] = triangles[0];
+        for( i=0; i<count; i++ ) {
+            sort_batch_tile( NULL, i, 0 );
+        }
     }
-} 
+}
 
-void render_autosort_tile( pvraddr_t tile_entry, int render_mode ) 
+void render_autosort_tile( unsigned int index, int render_mode ) 
 {
-    int num_triangles = sort_count_triangles(tile_entry);
-    if( num_triangles == 0 ) {
+    unsigned int i, count = sort_batch.count[index];
+
+    if( count == 0 ) {
         return; /* nothing to do */
-    } else if( num_triangles == 1 ) { /* Triangle can hardly overlap with itself */
+    } else if( sort_batch.first[index] == SORT_UNSORTED ) { /* Triangle can hardly overlap with itself */
         glDepthMask(GL_FALSE);
         glDepthFunc(GL_GEQUAL);
-        gl_render_tilelist(tile_entry, FALSE);
-    } else { /* Ooh boy here we go... */
-        int i;
-        struct sort_triangle triangles[num_triangles+1];
-        struct sort_triangle *triangle_order[num_triangles+1];
-        triangles[num_triangles].poly = (void *)SENTINEL;
-        for( i=0; i<num_triangles; i++ ) {
-            triangle_order[i] = &triangles[i];
-        }
-        int extracted_triangles = sort_extract_triangles(tile_entry, triangles);
-        assert( extracted_triangles <= num_triangles );
-        sort_triangles( triangle_order, extracted_triangles, triangle_order );
+        gl_render_tilelist(sort_batch.tile_entries[index], FALSE);
+    } else {
+        struct sort_triangle *order = &sort_batch.order[sort_batch.first[index]];
         glDepthMask(GL_FALSE);
         glDepthFunc(GL_GEQUAL);
-        sort_render_triangles(triangle_order, extracted_triangles);
-        assert( triangles[num_triangles].poly == (void *)SENTINEL );
+        for( i=0; i<count; i++ ) {
+            gl_render_triangle( order[i].poly, order[i].triangle_num );
+        }
     }
 }
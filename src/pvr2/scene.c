@@ -20,15 +20,24 @@
 #include <string.h>
 #include <math.h>
 #include "lxdream.h"
+#include "config.h"
 #include "display.h"
+#include "workpool.h"
 #include "pvr2/pvr2.h"
 #include "pvr2/pvr2mmio.h"
 #include "pvr2/glutil.h"
 #include "pvr2/scene.h"
+#include "pvr2/vertexdec.h"
 
 #define U8TOFLOAT(n)  (((float)((n)+1))/256.0)
 #define POLY_IDX(addr) ( ((uint32_t *)addr) - ((uint32_t *)pvr2_scene.pvr2_pbuf))
 
+/* Number of polygons decoded by each work item in the vertex pass */
+#define SCENE_DECODE_CHUNK 256
+#define SCENE_DECODE_MAX_CHUNKS ((MAX_POLYGONS+SCENE_DECODE_CHUNK-1)/SCENE_DECODE_CHUNK)
+/* Number of vertexes converted by each work item when packing vertexes */
+#define SCENE_PACK_CHUNK 4096
+
 static void unpack_bgra(uint32_t bgra, float *rgba)
 {
     rgba[0] = ((float)(((bgra&0x00FF0000)>>16) + 1)) / 256.0;
@@ -37,21 +46,6 @@ static void unpack_bgra(uint32_t bgra, float *rgba)
     rgba[3] = ((float)(((bgra&0xFF000000)>>24) + 1)) / 256.0;
 }
 
-/**
- * Convert a half-float (16-bit) FP number to a regular 32-bit float.
- * Source is 1-bit sign, 5-bit exponent, 10-bit mantissa.
- * TODO: Check the correctness of this.
- */
-static float halftofloat( uint16_t half )
-{
-    union {
-        float f;
-        uint32_t i;
-    } temp;
-    temp.i = ((uint32_t)half)<<16;
-    return temp.f;
-}
-
 static float parse_fog_density( uint32_t value )
 {
     union {
@@ -65,17 +59,96 @@ static float parse_fog_density( uint32_t value )
 struct pvr2_scene_struct pvr2_scene;
 static float scene_shadow_intensity = 0.0;
 static vertex_buffer_t vbuf = NULL;
+static vertex_decoder_t scene_decoder = NULL;
+/* Tile list entry that each polygon was first found in (by poly_array index),
+ * which determines its vertex format */
+static uint32_t *scene_poly_entry = NULL;
+/* Near/far z bounds found by each work item in the vertex pass */
+static float scene_chunk_bounds[SCENE_DECODE_MAX_CHUNKS][2];
+/* System RAM working copy of the vertexes when the vertex buffer is packed */
+static struct vertex_struct *scene_host_vertexes = NULL;
+static uint32_t scene_host_vertexes_size = 0;
 
 static void vertex_buffer_map()
 {
     // Allow 8 vertexes for the background (4+4)
-    uint32_t size = (pvr2_scene.vertex_count + 8) * sizeof(struct vertex_struct);
-    pvr2_scene.vertex_array = vbuf->map(vbuf, size);
+    uint32_t count = pvr2_scene.vertex_count + 8;
+
+    /* The packed format is only understood by the shader path, and is
+     * re-checked each scene so that changing the option takes effect on the
+     * next frame */
+    pvr2_scene.packed_vertexes = display_driver->capabilities.has_sl &&
+        lxdream_get_config_boolean_value( lxdream_get_config_group(CONFIG_GROUP_GLOBAL), CONFIG_PACKED_VERTEXES );
+    if( pvr2_scene.packed_vertexes ) {
+        if( count > scene_host_vertexes_size ) {
+            g_free( scene_host_vertexes );
+            scene_host_vertexes = g_malloc( count * sizeof(struct vertex_struct) );
+            scene_host_vertexes_size = count;
+        }
+        pvr2_scene.vertex_array = scene_host_vertexes;
+        pvr2_scene.packed_vertex_array = vbuf->map(vbuf, count * sizeof(struct packed_vertex_struct));
+    } else {
+        pvr2_scene.vertex_array = vbuf->map(vbuf, count * sizeof(struct vertex_struct));
+        pvr2_scene.packed_vertex_array = NULL;
+    }
+}
+
+static uint8_t scene_pack_unorm8( float f )
+{
+    if( !(f > 0.0) ) { /* Including NaN */
+        return 0;
+    } else if( f >= 1.0 ) {
+        return 255;
+    } else {
+        return (uint8_t)(f * 255.0f + 0.5f);
+    }
+}
+
+/**
+ * Work item for packing: convert one chunk of the vertex_array into the
+ * (mapped) packed_vertex_array.
+ */
+static void scene_pack_vertexes( void *data, unsigned int chunk, unsigned int thread )
+{
+    unsigned int i, first = chunk * SCENE_PACK_CHUNK;
+    unsigned int last = MIN( first + SCENE_PACK_CHUNK, pvr2_scene.vertex_count );
+
+    for( i=first; i<last; i++ ) {
+        struct vertex_struct *src = &pvr2_scene.vertex_array[i];
+        struct packed_vertex_struct vert;
+        float fog = src->offset_rgba[3];
+        vert.x = src->x;
+        vert.y = src->y;
+        vert.z = src->z;
+        vert.u = src->u;
+        vert.v = src->v;
+        vert.rgba[0] = scene_pack_unorm8( src->rgba[0] );
+        vert.rgba[1] = scene_pack_unorm8( src->rgba[1] );
+        vert.rgba[2] = scene_pack_unorm8( src->rgba[2] );
+        vert.rgba[3] = scene_pack_unorm8( src->rgba[3] );
+        vert.offset_rgba[0] = scene_pack_unorm8( src->offset_rgba[0] );
+        vert.offset_rgba[1] = scene_pack_unorm8( src->offset_rgba[1] );
+        vert.offset_rgba[2] = scene_pack_unorm8( src->offset_rgba[2] );
+        vert.offset_rgba[3] = scene_pack_unorm8( fog < 0 ? -fog : fog );
+        vert.params[0] = (uint8_t)src->tex_mode;
+        vert.params[1] = fog < 0 ? 1 : 0;
+        /* Palette offsets are k/64 + 0.0002 for k in 0..63 (see vertex_format_init) */
+        vert.params[2] = src->r < 0 ? PACKED_VERTEX_NO_PALETTE : (uint8_t)((src->r - 0.0002) * 64 + 0.5);
+        vert.params[3] = 0;
+        /* Write the whole vertex in one go, as the target may be write-combined */
+        pvr2_scene.packed_vertex_array[i] = vert;
+    }
 }
 
 static void vertex_buffer_unmap()
 {
-    pvr2_scene.vertex_array = vbuf->unmap(vbuf);
+    if( pvr2_scene.packed_vertexes ) {
+        workpool_run( scene_pack_vertexes, NULL,
+                      (pvr2_scene.vertex_count + SCENE_PACK_CHUNK - 1) / SCENE_PACK_CHUNK );
+        pvr2_scene.packed_vertex_array = vbuf->unmap(vbuf);
+    } else {
+        pvr2_scene.vertex_array = vbuf->unmap(vbuf);
+    }
 }
 
 /**
@@ -90,6 +163,9 @@ void pvr2_scene_init()
         pvr2_scene.vertex_array_size = 0;
         pvr2_scene.poly_array = g_malloc( MAX_POLY_BUFFER_SIZE );
         pvr2_scene.buf_to_poly_map = g_malloc0( BUF_POLY_MAP_SIZE );
+        scene_poly_entry = g_malloc( MAX_POLYGONS * sizeof(uint32_t) );
+        scene_decoder = vertex_decoder_select();
+        DEBUG( "Using %s vertex decoder", scene_decoder->name );
     }
 }
 
@@ -114,21 +190,30 @@ void pvr2_scene_shutdown()
     pvr2_scene.poly_array = NULL;
     g_free( pvr2_scene.buf_to_poly_map );
     pvr2_scene.buf_to_poly_map = NULL;
+    g_free( scene_poly_entry );
+    scene_poly_entry = NULL;
+    g_free( scene_host_vertexes );
+    scene_host_vertexes = NULL;
+    scene_host_vertexes_size = 0;
 }
 
 static struct polygon_struct *scene_add_polygon( pvraddr_t poly_idx, int vertex_count,
-                                                 shadow_mode_t is_modified )
+                                                 shadow_mode_t is_modified, uint32_t entry )
 {
     int vert_mul = is_modified != SHADOW_NONE ? 2 : 1;
 
     if( pvr2_scene.buf_to_poly_map[poly_idx] != NULL ) {
-        if( vertex_count > pvr2_scene.buf_to_poly_map[poly_idx]->vertex_count ) {
-            pvr2_scene.vertex_count += (vertex_count - pvr2_scene.buf_to_poly_map[poly_idx]->vertex_count) * vert_mul;
-            pvr2_scene.buf_to_poly_map[poly_idx]->vertex_count = vertex_count;
+        struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[poly_idx];
+        if( vertex_count > poly->vertex_count ) {
+            /* The layout follows the entry the polygon was first found in */
+            vert_mul = (scene_poly_entry[poly - pvr2_scene.poly_array] & 0x01000000) ? 2 : 1;
+            pvr2_scene.vertex_count += (vertex_count - poly->vertex_count) * vert_mul;
+            poly->vertex_count = vertex_count;
         }
-        return pvr2_scene.buf_to_poly_map[poly_idx];
+        return poly;
     } else {
-        struct polygon_struct *poly = &pvr2_scene.poly_array[pvr2_scene.poly_count++];
+        struct polygon_struct *poly = &pvr2_scene.poly_array[pvr2_scene.poly_count];
+        scene_poly_entry[pvr2_scene.poly_count++] = entry;
         poly->context = &pvr2_scene.pvr2_pbuf[poly_idx];
         poly->vertex_count = vertex_count;
         poly->vertex_index = -1;
@@ -168,179 +253,6 @@ static struct polygon_struct *scene_split_subpolygon( struct polygon_struct *par
     return poly;
 }
 
-static float scene_get_palette_offset( uint32_t tex )
-{
-    uint32_t fmt = (tex & PVR2_TEX_FORMAT_MASK);
-    if( fmt == PVR2_TEX_FORMAT_IDX4 ) {
-        return ((float)((tex & 0x07E00000) >> 17))/1024.0 + 0.0002;
-    } else if( fmt == PVR2_TEX_FORMAT_IDX8 ) {
-        return ((float)((tex & 0x06000000) >> 17))/1024.0 + 0.0002;
-    } else {
-        return -1.0;
-    }
-}
-
-/**
- * Decode a single PVR2 renderable vertex (opaque/trans/punch-out, but not shadow
- * volume)
- * @param vert Pointer to output vertex structure
- * @param poly1 First word of polygon context (needed to understand vertex)
- * @param poly2 Second word of polygon context
- * @param pvr2_data Pointer to raw pvr2 vertex data (in VRAM)
- * @param modify_offset Offset in 32-bit words to the tex/color data. 0 for
- *        the normal vertex, half the vertex length for the modified vertex.
- */
-static void scene_decode_vertex( struct vertex_struct *vert, uint32_t poly1,
-                                       uint32_t poly2, uint32_t tex, uint32_t *pvr2_data,
-                                       int modify_offset )
-{
-    gboolean force_alpha = !POLY2_ALPHA_ENABLE(poly2);
-    union pvr2_data_type {
-        uint32_t *ival;
-        float *fval;
-    } data;
-
-    data.ival = pvr2_data;
-
-    vert->x = *data.fval++;
-    vert->y = *data.fval++;
-
-    float z = *data.fval++;
-    if( !isfinite(z) ) {
-        z = 0;
-    } else if( z != 0 ) {
-        z = 1/z;
-    }
-    if( z > pvr2_scene.bounds[5] ) {
-        pvr2_scene.bounds[5] = z;
-    } else if( z < pvr2_scene.bounds[4] && z != 0 ) {
-        pvr2_scene.bounds[4] = z;
-    }
-    vert->z = z;
-    data.ival += modify_offset;
-
-
-    if( POLY1_TEXTURED(poly1) ) {
-        if( POLY1_UV16(poly1) ) {
-            vert->u = halftofloat( *data.ival>>16 );
-            vert->v = halftofloat( *data.ival );
-            data.ival++;
-        } else {
-            vert->u = *data.fval++;
-            vert->v = *data.fval++;
-        }
-
-        switch( POLY2_TEX_BLEND(poly2) ) {
-        case 0:/* Convert replace => modulate by setting colour values to 1.0 */
-            vert->rgba[0] = vert->rgba[1] = vert->rgba[2] = vert->rgba[3] = 1.0;
-            vert->tex_mode = 0.0;
-            data.ival++; /* Skip the colour word */
-            break;
-        case 2: /* Decal */
-            vert->tex_mode = 1.0;
-            unpack_bgra(*data.ival++, vert->rgba);
-            break;
-        case 1:
-            force_alpha = TRUE;
-            /* fall-through */
-        default:
-            vert->tex_mode = 0.0;
-            unpack_bgra(*data.ival++, vert->rgba);
-            break;
-        }
-        vert->r = scene_get_palette_offset(tex);
-    } else {
-        vert->tex_mode = 2.0;
-        vert->r = -1.0;
-        unpack_bgra(*data.ival++, vert->rgba);
-    }
-
-    if( POLY1_SPECULAR(poly1) ) {
-        unpack_bgra(*data.ival++, vert->offset_rgba);
-    } else {
-        vert->offset_rgba[0] = 0.0;
-        vert->offset_rgba[1] = 0.0;
-        vert->offset_rgba[2] = 0.0;
-        vert->offset_rgba[3] = 0.0;
-    }
-
-    if( force_alpha ) {
-        vert->rgba[3] = 1.0;
-    }
-}
-
-/**
- * Compute texture, colour, and z values for 1 or more result points by interpolating from
- * a set of 3 input points. The result point(s) must define their x,y.
- */
-static void scene_compute_vertexes( struct vertex_struct *result,
-                                    int result_count,
-                                    struct vertex_struct *input,
-                                    gboolean is_solid_shaded )
-{
-    int i,j;
-    float sx = input[2].x - input[1].x;
-    float sy = input[2].y - input[1].y;
-    float tx = input[0].x - input[1].x;
-    float ty = input[0].y - input[1].y;
-
-    float detxy = ((sy) * (tx)) - ((ty) * (sx));
-    if( detxy == 0 ) {
-        // If the input points fall on a line, they don't define a usable
-        // polygon - the PVR2 takes the last input point as the result in
-        // this case.
-        for( i=0; i<result_count; i++ ) {
-            float x = result[i].x;
-            float y = result[i].y;
-            memcpy( &result[i], &input[2], sizeof(struct vertex_struct) );
-            result[i].x = x;
-            result[i].y = y;
-        }
-        return;
-    }
-    float sz = input[2].z - input[1].z;
-    float tz = input[0].z - input[1].z;
-    float su = input[2].u - input[1].u;
-    float tu = input[0].u - input[1].u;
-    float sv = input[2].v - input[1].v;
-    float tv = input[0].v - input[1].v;
-
-    for( i=0; i<result_count; i++ ) {
-        float t = ((result[i].x - input[1].x) * sy -
-                (result[i].y - input[1].y) * sx) / detxy;
-        float s = ((result[i].y - input[1].y) * tx -
-                (result[i].x - input[1].x) * ty) / detxy;
-
-        float rz = input[1].z + (t*tz) + (s*sz);
-        if( rz > pvr2_scene.bounds[5] ) {
-            pvr2_scene.bounds[5] = rz;
-        } else if( rz < pvr2_scene.bounds[4] ) {
-            pvr2_scene.bounds[4] = rz;
-        }
-        result[i].z = rz;
-        result[i].u = input[1].u + (t*tu) + (s*su);
-        result[i].v = input[1].v + (t*tv) + (s*sv);
-        result[i].r = input[1].r; /* Last two components are flat */
-        result[i].tex_mode = input[1].tex_mode;
-
-        if( is_solid_shaded ) {
-            memcpy( result->rgba, input[2].rgba, sizeof(result->rgba) );
-            memcpy( result->offset_rgba, input[2].offset_rgba, sizeof(result->offset_rgba) );
-        } else {
-            float *rgba0 = input[0].rgba;
-            float *rgba1 = input[1].rgba;
-            float *rgba2 = input[2].rgba;
-            float *rgba3 = result[i].rgba;
-            for( j=0; j<8; j++ ) {
-                float tc = *rgba0++ - *rgba1;
-                float sc = *rgba2++ - *rgba1;
-                float rc = *rgba1++ + (t*tc) + (s*sc);
-                *rgba3++ = rc;
-            }
-        }
-    }
-}
-
 static float scene_compute_lut_fog_vertex( float z, float fog_density, float fog_table[][2] )
 {
     union {
@@ -486,105 +398,101 @@ static void scene_add_cheap_shadow_vertexes( struct vertex_struct *src, struct v
     }
 }
 
-static void scene_add_vertexes( pvraddr_t poly_idx, int vertex_length,
-                                shadow_mode_t is_modified )
+/**
+ * Decode the vertexes of a triangle strip into the space allocated for them
+ * by scene_layout_vertexes.
+ */
+static void scene_add_vertexes( struct polygon_struct *poly, int vertex_length,
+                                shadow_mode_t is_modified, float *zbounds )
 {
-    struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[poly_idx];
-    uint32_t *ptr = &pvr2_scene.pvr2_pbuf[poly_idx];
+    uint32_t *ptr = poly->context;
     uint32_t *context = ptr;
-    unsigned int i;
-
-    if( poly->vertex_index == -1 ) {
-        ptr += (is_modified == SHADOW_FULL ? 5 : 3 );
-        poly->vertex_index = pvr2_scene.vertex_index;
-
-        assert( poly != NULL );
-        assert( pvr2_scene.vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
-        for( i=0; i<poly->vertex_count; i++ ) {
-            scene_decode_vertex( &pvr2_scene.vertex_array[pvr2_scene.vertex_index++], context[0], context[1], context[2], ptr, 0 );
-            ptr += vertex_length;
-        }
-        if( is_modified ) {
-            assert( pvr2_scene.vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
-            poly->mod_vertex_index = pvr2_scene.vertex_index;
-            if( is_modified == SHADOW_FULL ) {
-                int mod_offset = (vertex_length - 3)>>1;
-                ptr = &pvr2_scene.pvr2_pbuf[poly_idx] + 5;
-                for( i=0; i<poly->vertex_count; i++ ) {
-                    scene_decode_vertex( &pvr2_scene.vertex_array[pvr2_scene.vertex_index++], context[0], context[3], context[4], ptr, mod_offset );
-                    ptr += vertex_length;
-                }
-            } else {
-                scene_add_cheap_shadow_vertexes( &pvr2_scene.vertex_array[poly->vertex_index], 
-                        &pvr2_scene.vertex_array[poly->mod_vertex_index], poly->vertex_count );
-                pvr2_scene.vertex_index += poly->vertex_count;
-            }
+    struct vertex_format fmt;
+
+    ptr += (is_modified == SHADOW_FULL ? 5 : 3 );
+    assert( poly->vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
+    vertex_format_init( &fmt, context[0], context[1], context[2], 0 );
+    scene_decoder->decode( &pvr2_scene.vertex_array[poly->vertex_index], ptr,
+            poly->vertex_count, vertex_length, &fmt, zbounds );
+    if( is_modified ) {
+        assert( poly->mod_vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
+        if( is_modified == SHADOW_FULL ) {
+            vertex_format_init( &fmt, context[0], context[3], context[4], (vertex_length - 3)>>1 );
+            scene_decoder->decode( &pvr2_scene.vertex_array[poly->mod_vertex_index], ptr,
+                    poly->vertex_count, vertex_length, &fmt, zbounds );
+        } else {
+            scene_add_cheap_shadow_vertexes( &pvr2_scene.vertex_array[poly->vertex_index], 
+                    &pvr2_scene.vertex_array[poly->mod_vertex_index], poly->vertex_count );
         }
     }
 }
 
-static void scene_add_quad_vertexes( pvraddr_t poly_idx, int vertex_length,
-                                     shadow_mode_t is_modified )
+/**
+ * Decode the vertexes of a quad (sprite), computing the 4th vertex, into the
+ * space allocated for them by scene_layout_vertexes.
+ */
+static void scene_add_quad_vertexes( struct polygon_struct *poly, int vertex_length,
+                                     shadow_mode_t is_modified, float *zbounds )
 {
-    struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[poly_idx];
-    uint32_t *ptr = &pvr2_scene.pvr2_pbuf[poly_idx];
+    uint32_t *ptr = poly->context;
     uint32_t *context = ptr;
-    unsigned int i;
-
-    if( poly->vertex_index == -1 ) {
-        // Construct it locally and copy to the vertex buffer, as the VBO is
-        // allowed to be horribly slow for reads (ie it could be direct-mapped
-        // vram).
-        struct vertex_struct quad[4];
-
-        assert( poly != NULL );
-        assert( pvr2_scene.vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
-        ptr += (is_modified == SHADOW_FULL ? 5 : 3 );
-        poly->vertex_index = pvr2_scene.vertex_index;
-        for( i=0; i<4; i++ ) {
-            scene_decode_vertex( &quad[i], context[0], context[1], context[2], ptr, 0 );
-            ptr += vertex_length;
-        }
-        scene_compute_vertexes( &quad[3], 1, &quad[0], !POLY1_GOURAUD_SHADED(context[0]) );
-        // Swap last two vertexes (quad arrangement => tri strip arrangement)
-        memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index], quad, sizeof(struct vertex_struct)*2 );
-        memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+2], &quad[3], sizeof(struct vertex_struct) );
-        memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3], &quad[2], sizeof(struct vertex_struct) );
-        if( !POLY1_GOURAUD_SHADED(context[0]) ) {
-            memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index].rgba, &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3].rgba, sizeof(float)*8 );
-            memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+1].rgba, &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3].rgba, sizeof(float)*8 );
-        }
-
-        pvr2_scene.vertex_index += 4;
+    uint32_t vertex_index = poly->vertex_index;
+    struct vertex_format fmt;
+
+    // Construct it locally and copy to the vertex buffer, as the VBO is
+    // allowed to be horribly slow for reads (ie it could be direct-mapped
+    // vram).
+    struct vertex_struct quad[4];
+
+    assert( vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
+    ptr += (is_modified == SHADOW_FULL ? 5 : 3 );
+    vertex_format_init( &fmt, context[0], context[1], context[2], 0 );
+    scene_decoder->decode( quad, ptr, 4, vertex_length, &fmt, zbounds );
+    scene_decoder->compute( &quad[3], 1, &quad[0], !POLY1_GOURAUD_SHADED(context[0]), zbounds );
+    // Swap last two vertexes (quad arrangement => tri strip arrangement)
+    memcpy( &pvr2_scene.vertex_array[vertex_index], quad, sizeof(struct vertex_struct)*2 );
+    memcpy( &pvr2_scene.vertex_array[vertex_index+2], &quad[3], sizeof(struct vertex_struct) );
+    memcpy( &pvr2_scene.vertex_array[vertex_index+3], &quad[2], sizeof(struct vertex_struct) );
+    if( !POLY1_GOURAUD_SHADED(context[0]) ) {
+        memcpy( &pvr2_scene.vertex_array[vertex_index].rgba, &pvr2_scene.vertex_array[vertex_index+3].rgba, sizeof(float)*8 );
+        memcpy( &pvr2_scene.vertex_array[vertex_index+1].rgba, &pvr2_scene.vertex_array[vertex_index+3].rgba, sizeof(float)*8 );
+    }
 
-        if( is_modified ) {
-            assert( pvr2_scene.vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
-            poly->mod_vertex_index = pvr2_scene.vertex_index;
-            if( is_modified == SHADOW_FULL ) {
-                int mod_offset = (vertex_length - 3)>>1;
-                ptr = &pvr2_scene.pvr2_pbuf[poly_idx] + 5;
-                for( i=0; i<4; i++ ) {
-                    scene_decode_vertex( &quad[4], context[0], context[3], context[4], ptr, mod_offset );
-                    ptr += vertex_length;
-                }
-                scene_compute_vertexes( &quad[3], 1, &quad[0], !POLY1_GOURAUD_SHADED(context[0]) );
-                memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index], quad, sizeof(struct vertex_struct)*2 );
-                memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+2], &quad[3], sizeof(struct vertex_struct) );
-                memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3], &quad[2], sizeof(struct vertex_struct) );
-                if( !POLY1_GOURAUD_SHADED(context[0]) ) {
-                    memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index].rgba, &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3].rgba, sizeof(float)*8 );
-                    memcpy( &pvr2_scene.vertex_array[pvr2_scene.vertex_index+1].rgba, &pvr2_scene.vertex_array[pvr2_scene.vertex_index+3].rgba, sizeof(float)*8 );
-                }
-            } else {
-                scene_add_cheap_shadow_vertexes( &pvr2_scene.vertex_array[poly->vertex_index], 
-                        &pvr2_scene.vertex_array[poly->mod_vertex_index], poly->vertex_count );
-                pvr2_scene.vertex_index += poly->vertex_count;
+    if( is_modified ) {
+        vertex_index = poly->mod_vertex_index;
+        assert( vertex_index + poly->vertex_count <= pvr2_scene.vertex_count );
+        if( is_modified == SHADOW_FULL ) {
+            vertex_format_init( &fmt, context[0], context[3], context[4], (vertex_length - 3)>>1 );
+            scene_decoder->decode( quad, ptr, 4, vertex_length, &fmt, zbounds );
+            scene_decoder->compute( &quad[3], 1, &quad[0], !POLY1_GOURAUD_SHADED(context[0]), zbounds );
+            memcpy( &pvr2_scene.vertex_array[vertex_index], quad, sizeof(struct vertex_struct)*2 );
+            memcpy( &pvr2_scene.vertex_array[vertex_index+2], &quad[3], sizeof(struct vertex_struct) );
+            memcpy( &pvr2_scene.vertex_array[vertex_index+3], &quad[2], sizeof(struct vertex_struct) );
+            if( !POLY1_GOURAUD_SHADED(context[0]) ) {
+                memcpy( &pvr2_scene.vertex_array[vertex_index].rgba, &pvr2_scene.vertex_array[vertex_index+3].rgba, sizeof(float)*8 );
+                memcpy( &pvr2_scene.vertex_array[vertex_index+1].rgba, &pvr2_scene.vertex_array[vertex_index+3].rgba, sizeof(float)*8 );
             }
-            pvr2_scene.vertex_index += 4;
+        } else {
+            scene_add_cheap_shadow_vertexes( &pvr2_scene.vertex_array[poly->vertex_index], 
+                    &pvr2_scene.vertex_array[poly->mod_vertex_index], poly->vertex_count );
         }
     }
 }
 
+/**
+ * Decode the vertex format from a tile list entry.
+ * @return the vertex length in 32-bit words
+ */
+static int scene_entry_vertex_length( uint32_t entry, shadow_mode_t *is_modified )
+{
+    int vertex_length = (entry >> 21) & 0x07;
+    *is_modified = (entry & 0x01000000) ? pvr2_scene.shadow_mode : SHADOW_NONE;
+    if( *is_modified == SHADOW_FULL ) {
+        vertex_length <<= 1;
+    }
+    return vertex_length + 3;
+}
+
 static void scene_extract_polygons( pvraddr_t tile_entry )
 {
     uint32_t *tile_list = (uint32_t *)(pvr2_main_ram+tile_entry);
@@ -612,7 +520,7 @@ static void scene_extract_polygons( pvraddr_t tile_entry )
                 int i;
                 struct polygon_struct *last_poly = NULL;
                 for( i=0; i<strip_count; i++ ) {
-                    struct polygon_struct *poly = scene_add_polygon( polyaddr, 3, is_modified );
+                    struct polygon_struct *poly = scene_add_polygon( polyaddr, 3, is_modified, entry );
                     polyaddr += polygon_length;
                     if( last_poly != NULL && last_poly->next == NULL ) {
                         last_poly->next = poly;
@@ -626,7 +534,7 @@ static void scene_extract_polygons( pvraddr_t tile_entry )
                 int i;
                 struct polygon_struct *last_poly = NULL;
                 for( i=0; i<strip_count; i++ ) {
-                    struct polygon_struct *poly = scene_add_polygon( polyaddr, 4, is_modified );
+                    struct polygon_struct *poly = scene_add_polygon( polyaddr, 4, is_modified, entry );
                     polyaddr += polygon_length;
                     if( last_poly != NULL && last_poly->next == NULL ) {
                         last_poly->next = poly;
@@ -643,73 +551,103 @@ static void scene_extract_polygons( pvraddr_t tile_entry )
                     }
                 }
                 if( last != -1 ) {
-                    scene_add_polygon( polyaddr, last+3, is_modified );
+                    scene_add_polygon( polyaddr, last+3, is_modified, entry );
                 }
             }
         }
     } while( 1 );
 }
 
-static void scene_extract_vertexes( pvraddr_t tile_entry )
+/**
+ * Allocate the vertex buffer space for each polygon, in poly_array order.
+ * This is the order in which the polygons are first found in the tile lists,
+ * so the layout is the same as if the vertexes were decoded during a second
+ * walk over the tile lists, and uses exactly the vertex_count counted by
+ * scene_add_polygon.
+ *
+ * The one difference from the old serial walk is modified quads with cheap
+ * shadows, which now take 8 vertexes rather than 12. The serial walk skipped
+ * 4 unused vertexes after each one, without counting them, and so could
+ * write past the end of the vertex buffer. pvr2_scene_print output is
+ * otherwise the same; scenes with cheap-shadow quads get different
+ * vertex_index and mod_vertex_index values after the first such quad.
+ */
+static void scene_layout_vertexes( void )
 {
-    uint32_t *tile_list = (uint32_t *)(pvr2_main_ram+tile_entry);
-    do {
-        uint32_t entry = *tile_list++;
-        if( entry >> 28 == 0x0F ) {
-            break;
-        } else if( entry >> 28 == 0x0E ) {
-            tile_list = (uint32_t *)(pvr2_main_ram + (entry&0x007FFFFF));
+    uint32_t vertex_index = 0;
+    int i;
+
+    for( i=0; i<pvr2_scene.poly_count; i++ ) {
+        struct polygon_struct *poly = &pvr2_scene.poly_array[i];
+        uint32_t entry = scene_poly_entry[i];
+        shadow_mode_t is_modified;
+        scene_entry_vertex_length( entry, &is_modified );
+
+        poly->vertex_index = vertex_index;
+        vertex_index += poly->vertex_count;
+        if( is_modified ) {
+            poly->mod_vertex_index = vertex_index;
+            vertex_index += poly->vertex_count;
+        }
+    }
+    assert( vertex_index == pvr2_scene.vertex_count );
+    pvr2_scene.vertex_index = vertex_index;
+}
+
+/**
+ * Work item for the vertex pass: decode the vertexes of one chunk of
+ * poly_array. The chunks write to disjoint ranges of the vertex buffer, and
+ * track their own z bounds.
+ */
+static void scene_decode_polygons( void *data, unsigned int chunk, unsigned int thread )
+{
+    int i, first = chunk * SCENE_DECODE_CHUNK;
+    int last = MIN( first + SCENE_DECODE_CHUNK, pvr2_scene.poly_count );
+    float *zbounds = scene_chunk_bounds[chunk];
+
+    zbounds[0] = pvr2_scene.bounds[4];
+    zbounds[1] = pvr2_scene.bounds[5];
+    for( i=first; i<last; i++ ) {
+        struct polygon_struct *poly = &pvr2_scene.poly_array[i];
+        uint32_t entry = scene_poly_entry[i];
+        shadow_mode_t is_modified;
+        int vertex_length = scene_entry_vertex_length( entry, &is_modified );
+        if( (entry & 0xE0000000) == 0xA0000000 ) {
+            scene_add_quad_vertexes( poly, vertex_length, is_modified, zbounds );
         } else {
-            pvraddr_t polyaddr = entry&0x000FFFFF;
-            shadow_mode_t is_modified = (entry & 0x01000000) ? pvr2_scene.shadow_mode : SHADOW_NONE;
-            int vertex_length = (entry >> 21) & 0x07;
-            int context_length = 3;
-            if( is_modified == SHADOW_FULL ) {
-                context_length = 5;
-                vertex_length <<=1 ;
-            }
-            vertex_length += 3;
+            scene_add_vertexes( poly, vertex_length, is_modified, zbounds );
+        }
+    }
+}
 
-            if( (entry & 0xE0000000) == 0x80000000 ) {
-                /* Triangle(s) */
-                int strip_count = ((entry >> 25) & 0x0F)+1;
-                int polygon_length = 3 * vertex_length + context_length;
-                int i;
-                for( i=0; i<strip_count; i++ ) {
-                    scene_add_vertexes( polyaddr, vertex_length, is_modified );
-                    polyaddr += polygon_length;
-                }
-            } else if( (entry & 0xE0000000) == 0xA0000000 ) {
-                /* Sprite(s) */
-                int strip_count = ((entry >> 25) & 0x0F)+1;
-                int polygon_length = 4 * vertex_length + context_length;
-                int i;
-                for( i=0; i<strip_count; i++ ) {
-                    scene_add_quad_vertexes( polyaddr, vertex_length, is_modified );
-                    polyaddr += polygon_length;
-                }
-            } else {
-                /* Polygon */
-                int i, last = -1;
-                for( i=5; i>=0; i-- ) {
-                    if( entry & (0x40000000>>i) ) {
-                        last = i;
-                        break;
-                    }
-                }
-                if( last != -1 ) {
-                    scene_add_vertexes( polyaddr, vertex_length, is_modified );
-                }
-            }
+/**
+ * Decode the vertexes of all polygons found by scene_extract_polygons,
+ * splitting the work across the worker pool.
+ */
+static void scene_extract_vertexes( void )
+{
+    unsigned int chunks = (pvr2_scene.poly_count + SCENE_DECODE_CHUNK - 1) / SCENE_DECODE_CHUNK;
+    int i;
+
+    scene_layout_vertexes();
+    workpool_run( scene_decode_polygons, NULL, chunks );
+
+    /* Merge the z bounds (which don't depend on the order) */
+    for( i=0; i<chunks; i++ ) {
+        if( scene_chunk_bounds[i][1] > pvr2_scene.bounds[5] ) {
+            pvr2_scene.bounds[5] = scene_chunk_bounds[i][1];
         }
-    } while( 1 );
+        if( scene_chunk_bounds[i][0] < pvr2_scene.bounds[4] ) {
+            pvr2_scene.bounds[4] = scene_chunk_bounds[i][0];
+        }
+    }
 }
 
 static void scene_extract_background( void )
 {
     uint32_t bgplane = MMIO_READ(PVR2, RENDER_BGPLANE);
     int vertex_length = (bgplane >> 24) & 0x07;
-    int context_length = 3, i;
+    int context_length = 3;
     shadow_mode_t is_modified = (bgplane & 0x08000000) ? pvr2_scene.shadow_mode : SHADOW_NONE;
 
     struct polygon_struct *poly = &pvr2_scene.poly_array[pvr2_scene.poly_count++];
@@ -736,39 +674,31 @@ static void scene_extract_background( void )
     pvr2_scene.bkgnd_poly = poly;
 
     struct vertex_struct base_vertexes[3];
+    struct vertex_format fmt;
     uint32_t *ptr = context + context_length;
-    for( i=0; i<3; i++ ) {
-        scene_decode_vertex( &base_vertexes[i], context[0], context[1], context[2],
-                ptr, 0 );
-        ptr += vertex_length;
-    }
+    vertex_format_init( &fmt, context[0], context[1], context[2], 0 );
+    scene_decoder->decode( base_vertexes, ptr, 3, vertex_length, &fmt, &pvr2_scene.bounds[4] );
     struct vertex_struct *result_vertexes = &pvr2_scene.vertex_array[poly->vertex_index];
     result_vertexes[0].x = result_vertexes[0].y = 0;
     result_vertexes[1].x = result_vertexes[3].x = pvr2_scene.buffer_width;
     result_vertexes[1].y = result_vertexes[2].x = 0;
     result_vertexes[2].y = result_vertexes[3].y  = pvr2_scene.buffer_height;
-    scene_compute_vertexes( result_vertexes, 4, base_vertexes, !POLY1_GOURAUD_SHADED(context[0]) );
+    scene_decoder->compute( result_vertexes, 4, base_vertexes, !POLY1_GOURAUD_SHADED(context[0]), &pvr2_scene.bounds[4] );
 
     if( is_modified == SHADOW_FULL ) {
-        int mod_offset = (vertex_length - 3)>>1;
-        ptr = context + context_length;
-        for( i=0; i<3; i++ ) {
-            scene_decode_vertex( &base_vertexes[i], context[0], context[3], context[4],
-                    ptr, mod_offset );
-            ptr += vertex_length;
-        }
+        vertex_format_init( &fmt, context[0], context[3], context[4], (vertex_length - 3)>>1 );
+        scene_decoder->decode( base_vertexes, ptr, 3, vertex_length, &fmt, &pvr2_scene.bounds[4] );
         result_vertexes = &pvr2_scene.vertex_array[poly->mod_vertex_index];
         result_vertexes[0].x = result_vertexes[0].y = 0;
         result_vertexes[1].x = result_vertexes[3].x = pvr2_scene.buffer_width;
         result_vertexes[1].y = result_vertexes[2].x = 0;
         result_vertexes[2].y = result_vertexes[3].y  = pvr2_scene.buffer_height;
-        scene_compute_vertexes( result_vertexes, 4, base_vertexes, !POLY1_GOURAUD_SHADED(context[0]) );
+        scene_decoder->compute( result_vertexes, 4, base_vertexes, !POLY1_GOURAUD_SHADED(context[0]), &pvr2_scene.bounds[4] );
     } else if( is_modified == SHADOW_CHEAP ) {
         scene_add_cheap_shadow_vertexes( &pvr2_scene.vertex_array[poly->vertex_index], 
                 &pvr2_scene.vertex_array[poly->mod_vertex_index], poly->vertex_count );
-        pvr2_scene.vertex_index += poly->vertex_count;
     }
-
+    pvr2_scene.vertex_index = pvr2_scene.vertex_count;
 }
 
 
@@ -785,7 +715,9 @@ uint32_t pvr2_scene_buffer_height()
 /**
  * Extract the current scene into the rendering structures. We run two passes
  * - first pass extracts the polygons into pvr2_scene.poly_array (finding vertex counts),
- * second pass extracts the vertex data into the VBO/vertex array.
+ * second pass extracts the vertex data into the VBO/vertex array. The second
+ * pass works from poly_array rather than the tile lists, so that it can be
+ * split up across threads.
  *
  * Difficult to do in single pass as we don't generally know the size of a
  * polygon for certain until we've seen all tiles containing it. It also means we
@@ -868,17 +800,7 @@ void pvr2_scene_read( void )
 
     // Pass 2: Extract vertex data
     vertex_buffer_map();
-    pvr2_scene.vertex_index = 0;
-    segment = tilebuffer;
-    do {
-        control = *segment++;
-        for( i=0; i<5; i++ ) {
-            if( (*segment & NO_POINTER) == 0 ) {
-                scene_extract_vertexes( *segment );
-            }
-            segment++;
-        }
-    } while( (control & SEGMENT_END) == 0 );
+    scene_extract_vertexes();
 
     scene_extract_background();
     scene_compute_lut_fog();
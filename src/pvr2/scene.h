@@ -41,6 +41,22 @@ struct vertex_struct {
     float offset_rgba[4];
 };
 
+/**
+ * Compact (32 byte) form of vertex_struct, as uploaded to the GL when packed
+ * vertexes are enabled. Colours are clamped to [0,1] and stored as normalised
+ * bytes - the fog amount (offset alpha) is stored as its magnitude, with the
+ * sign (ie which fog colour to use) moved to params[1].
+ */
+struct packed_vertex_struct {
+    float x,y,z;
+    float u,v;
+    uint8_t rgba[4];
+    uint8_t offset_rgba[4];
+    uint8_t params[4]; /* tex_mode, fog colour (0/1), palette offset*64 (or 255 for none), unused */
+};
+
+#define PACKED_VERTEX_NO_PALETTE 255
+
 struct polygon_struct {
     uint32_t *context;
     uint32_t vertex_count; // number of vertexes in polygon
@@ -100,6 +116,11 @@ struct pvr2_scene_struct {
     GLuint vbo_id;
     /** Pointer to the vertex array data, or NULL for unmapped VBOs */
     struct vertex_struct *vertex_array;
+    /** TRUE if the scene is uploaded as packed_vertex_structs, in which case
+     * vertex_array is in system RAM and packed_vertex_array is the GL copy
+     * (NULL or an offset for VBOs, as above) */
+    gboolean packed_vertexes;
+    struct packed_vertex_struct *packed_vertex_array;
     /** Current allocated size (in bytes) of the vertex array */
     uint32_t vertex_array_size;
     /** Total number of vertexes in the scene (note modified vertexes
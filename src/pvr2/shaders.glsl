@@ -132,6 +132,34 @@ void main()
 
 #program pvr2_shader = DEFAULT_VERTEX_SHADER DEFAULT_FRAGMENT_SHADER
 
+/* Vertex shader for the packed vertex layout (struct packed_vertex_struct).
+ * Colours arrive as normalised bytes, and the texture mode, fog colour
+ * selection and palette index as plain bytes in in_params - these are
+ * expanded back out to the same varyings as DEFAULT_VERTEX_SHADER produces.
+ */
+#vertex PACKED_VERTEX_SHADER
+uniform mat4 view_matrix;
+attribute vec4 in_vertex;
+attribute vec4 in_colour;
+attribute vec4 in_colour2; /* rgb = colour, a = fog amount */
+attribute vec2 in_texcoord;
+attribute vec4 in_params; /* x = mode, y = fog colour (0 or 1), z = palette (255 = none) */
+
+varying vec4 frag_colour;
+varying vec4 frag_colour2;
+varying vec4 frag_texcoord;
+void main()
+{
+    vec4 tmp = view_matrix * in_vertex;
+    float w = in_vertex.z;
+    gl_Position  = tmp * w;
+    frag_colour = in_colour;
+    frag_colour2 = vec4( in_colour2.rgb, in_params.y > 0.5 ? -in_colour2.a : in_colour2.a );
+    frag_texcoord = vec4( in_texcoord, in_params.z < 254.5 ? in_params.z/64.0 + 0.0002 : -1.0, in_params.x );
+}
+
+#program pvr2_packed_shader = PACKED_VERTEX_SHADER DEFAULT_FRAGMENT_SHADER
+
 #ifndef HAVE_OPENGL_FIXEDFUNC
 /* In this case we also need a basic shader to actually display the output */
 #vertex BASIC_VERTEX_SHADER
@@ -0,0 +1,913 @@
+/**
+ * $Id$
+ *
+ * Software PVR2 renderer. Renders the current scene directly into the memory
+ * of a render buffer, without GL, for headless use (see video_soft.c).
+ *
+ * The buffer is split into the PVR2's own 32x32 tiles, which are rendered in
+ * parallel by the worker pool, each one into a small local colour/depth/
+ * stencil buffer. Within a tile the passes are the same as the GL renderer
+ * (glrender.c) makes over the whole buffer - background, modifier volumes,
+ * opaque, punch-through and translucent - with the same depth, blend and
+ * stencil behaviour, so the results should be near enough identical.
+ *
+ * Depth is stored as 1/w (the PVR2's native depth value), and attributes are
+ * interpolated perspective-correctly. Triangle coverage is computed from the
+ * edge functions 4 pixels at a time, using SSE where it's available.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include "lxdream.h"
+#include "display.h"
+#include "workpool.h"
+#include "pvr2/pvr2.h"
+#include "pvr2/pvr2mmio.h"
+#include "pvr2/scene.h"
+#include "pvr2/tileiter.h"
+
+#define SW_TILE_SIZE 32
+#define SW_TILE_PIXELS (SW_TILE_SIZE*SW_TILE_SIZE)
+
+/* Interpolated attributes, in the same order as struct vertex_struct */
+#define SW_ATTR_U      0
+#define SW_ATTR_V      1
+#define SW_ATTR_RGBA   2
+#define SW_ATTR_OFFSET 6
+#define SW_ATTR_FOG    9
+#define SW_ATTR_COUNT  10
+
+#define SW_WRAP_REPEAT 0
+#define SW_WRAP_MIRROR 1
+#define SW_WRAP_CLAMP  2
+
+/* Depth compare mode used for modifier volumes (LEQUAL) */
+#define SW_DEPTH_LEQUAL 3
+/* Depth compare mode forced for punch-through and sorted polygons (GEQUAL) */
+#define SW_DEPTH_GEQUAL 6
+
+/* Stencil requirement for a draw */
+#define SW_STENCIL_ANY       -1
+#define SW_STENCIL_UNSHADOWED 0
+#define SW_STENCIL_SHADOWED   2
+
+typedef enum { SW_DRAW_COLOUR, SW_DRAW_DEPTH, SW_DRAW_VOLUME } sw_draw_mode_t;
+
+struct sw_texture {
+    uint32_t texture_word;
+    int width, height;
+    uint32_t *texels;   /* ARGB8888 */
+};
+
+/**
+ * Everything needed to draw one polygon in one pass.
+ */
+struct sw_context {
+    sw_draw_mode_t mode;
+    int depth_mode;          /* PVR2 depth compare mode 0..7 */
+    gboolean depth_write;
+    gboolean depth_test;     /* FALSE for the background */
+    int stencil;             /* SW_STENCIL_* */
+    int src_blend, dest_blend;
+    gboolean gouraud;
+    struct sw_texture *texture;
+    int wrap_u, wrap_v;
+    gboolean bilinear;
+    gboolean texture_alpha;
+    const float *fog_colour;
+    float alpha_ref;
+};
+
+struct sw_triangle {
+    float edge[3][3];        /* a, b, c: inside when a*x + b*y + c >= 0 */
+    gboolean inclusive[3];   /* Whether pixels exactly on the edge are drawn */
+    float invw[3];           /* 1/w plane: d/dx, d/dy, constant */
+    float attr[SW_ATTR_COUNT][3]; /* attr/w planes (attr planes if affine) */
+    gboolean affine;
+    float flat[SW_ATTR_FOG-SW_ATTR_RGBA]; /* Colours of the last vertex, for flat shading */
+    float tex_mode;
+    int x1, x2, y1, y2;      /* Pixel bounds, x2/y2 exclusive */
+};
+
+struct sw_tile {
+    int x, y;                /* Top-left of the tile */
+    uint32_t bounds[4];      /* x1,x2,y1,y2 clipped to the scene bounds */
+    gboolean clipped;        /* TRUE if the tile is entirely outside the bounds */
+    float colour[SW_TILE_PIXELS][4];
+    float depth[SW_TILE_PIXELS];
+    uint8_t stencil[SW_TILE_PIXELS];
+};
+
+/* Tile buffers, one per worker thread (indexed by the workpool thread) */
+static struct sw_tile sw_tiles[WORKPOOL_MAX_THREADS];
+
+static struct {
+    render_buffer_t buffer;
+    uint32_t clip_bounds[4];
+    float alpha_ref;
+    unsigned int width, height; /* Area of the buffer covered by the scene */
+    unsigned int tiles_x, tiles_y;
+    /* Segments of each tile, in list order */
+    int *tile_segment;
+    int *next_segment;
+    unsigned int tiles_alloc, segments_alloc;
+    /* Textures used by the current scene, indexed by tex_id-1 */
+    GHashTable *texture_map;
+    struct sw_texture **textures;
+    unsigned int texture_count, textures_alloc;
+} swr;
+
+/****************************** Textures *******************************/
+
+static guint sw_texture_hash( gconstpointer key )
+{
+    const struct sw_texture *tex = key;
+    return tex->texture_word ^ (tex->width << 4) ^ tex->height;
+}
+
+static gboolean sw_texture_equal( gconstpointer a, gconstpointer b )
+{
+    const struct sw_texture *t1 = a, *t2 = b;
+    return t1->texture_word == t2->texture_word && t1->width == t2->width &&
+           t1->height == t2->height;
+}
+
+/**
+ * @return the tex_id (index+1) of the texture for the given poly2 and
+ * texture words, adding it to the scene's texture list if it's not already
+ * present. Textures aren't decoded until the list is complete.
+ */
+static uint32_t sw_get_texture( uint32_t poly2, uint32_t texture_word )
+{
+    struct sw_texture key, *tex;
+    uint32_t tex_id;
+    key.texture_word = texture_word;
+    key.width = POLY2_TEX_WIDTH(poly2);
+    key.height = PVR2_TEX_IS_MIPMAPPED(texture_word) ? key.width : POLY2_TEX_HEIGHT(poly2);
+
+    tex_id = GPOINTER_TO_UINT(g_hash_table_lookup( swr.texture_map, &key ));
+    if( tex_id == 0 ) {
+        if( swr.texture_count == swr.textures_alloc ) {
+            swr.textures_alloc = swr.textures_alloc == 0 ? 64 : swr.textures_alloc*2;
+            swr.textures = g_realloc( swr.textures, swr.textures_alloc * sizeof(struct sw_texture *) );
+        }
+        tex = g_malloc( sizeof(struct sw_texture) );
+        *tex = key;
+        tex->texels = NULL;
+        swr.textures[swr.texture_count++] = tex;
+        tex_id = swr.texture_count;
+        g_hash_table_insert( swr.texture_map, tex, GUINT_TO_POINTER(tex_id) );
+    }
+    return tex_id;
+}
+
+static void sw_decode_texture( void *data, unsigned int item, unsigned int thread )
+{
+    struct sw_texture *tex = swr.textures[item];
+    tex->texels = g_malloc( tex->width * tex->height * sizeof(uint32_t) );
+    texcache_decode_texture( tex->texels, tex->texture_word, tex->width, tex->height );
+}
+
+/**
+ * Find and decode all the textures used by the scene, and set each polygon's
+ * tex_id/mod_tex_id to match.
+ */
+static void sw_load_textures( void )
+{
+    int i;
+
+    texcache_begin_scene( MMIO_READ( PVR2, RENDER_PALETTE ) & 0x03,
+                          (MMIO_READ( PVR2, RENDER_TEXSIZE ) & 0x003F) << 5 );
+    if( swr.texture_map == NULL ) {
+        swr.texture_map = g_hash_table_new( sw_texture_hash, sw_texture_equal );
+    }
+
+    for( i=0; i < pvr2_scene.poly_count; i++ ) {
+        struct polygon_struct *poly = &pvr2_scene.poly_array[i];
+        if( POLY1_TEXTURED(poly->context[0]) ) {
+            poly->tex_id = sw_get_texture( poly->context[1], poly->context[2] );
+            if( poly->mod_vertex_index != -1 ) {
+                if( pvr2_scene.shadow_mode == SHADOW_FULL ) {
+                    poly->mod_tex_id = sw_get_texture( poly->context[3], poly->context[4] );
+                } else {
+                    poly->mod_tex_id = poly->tex_id;
+                }
+            }
+        } else {
+            poly->tex_id = 0;
+            poly->mod_tex_id = 0;
+        }
+    }
+
+    workpool_run( sw_decode_texture, NULL, swr.texture_count );
+}
+
+static void sw_free_textures( void )
+{
+    int i;
+    for( i=0; i<swr.texture_count; i++ ) {
+        g_hash_table_remove( swr.texture_map, swr.textures[i] );
+        g_free( swr.textures[i]->texels );
+        g_free( swr.textures[i] );
+    }
+    swr.texture_count = 0;
+}
+
+static inline int sw_wrap( int i, int size, int mode )
+{
+    switch( mode ) {
+    case SW_WRAP_CLAMP:
+        return i < 0 ? 0 : (i >= size ? size-1 : i);
+    case SW_WRAP_MIRROR:
+        i &= (size<<1)-1;
+        return i >= size ? (size<<1)-1-i : i;
+    default:
+        return i & (size-1);
+    }
+}
+
+static inline void sw_fetch_texel( const struct sw_context *ctx, int s, int t, float *out )
+{
+    const struct sw_texture *tex = ctx->texture;
+    uint32_t texel = tex->texels[sw_wrap(t, tex->height, ctx->wrap_v)*tex->width +
+                                 sw_wrap(s, tex->width, ctx->wrap_u)];
+    out[0] = ((texel >> 16) & 0xFF) * (1.0f/255.0f);
+    out[1] = ((texel >> 8) & 0xFF) * (1.0f/255.0f);
+    out[2] = (texel & 0xFF) * (1.0f/255.0f);
+    out[3] = ctx->texture_alpha ? (texel >> 24) * (1.0f/255.0f) : 1.0f;
+}
+
+/**
+ * Sample the context's texture at (u,v) into rgba
+ */
+static void sw_sample_texture( const struct sw_context *ctx, float u, float v, float *rgba )
+{
+    const struct sw_texture *tex = ctx->texture;
+    float s = u * tex->width, t = v * tex->height;
+
+    /* Keep the coordinates in a sane integer range */
+    if( !(s > -65536.0f) ) s = -65536.0f; else if( s > 65536.0f ) s = 65536.0f;
+    if( !(t > -65536.0f) ) t = -65536.0f; else if( t > 65536.0f ) t = 65536.0f;
+
+    if( ctx->bilinear ) {
+        float s0 = floorf(s - 0.5f), t0 = floorf(t - 0.5f);
+        float fs = s - 0.5f - s0, ft = t - 0.5f - t0;
+        int is = (int)s0, it = (int)t0, i;
+        float a[4], b[4], c[4], d[4];
+        sw_fetch_texel( ctx, is, it, a );
+        sw_fetch_texel( ctx, is+1, it, b );
+        sw_fetch_texel( ctx, is, it+1, c );
+        sw_fetch_texel( ctx, is+1, it+1, d );
+        for( i=0; i<4; i++ ) {
+            float top = a[i] + (b[i]-a[i])*fs;
+            float bottom = c[i] + (d[i]-c[i])*fs;
+            rgba[i] = top + (bottom-top)*ft;
+        }
+    } else {
+        sw_fetch_texel( ctx, (int)floorf(s), (int)floorf(t), rgba );
+    }
+}
+
+/******************************* Contexts ******************************/
+
+/**
+ * Setup the context for drawing with the given polygon words.
+ * @param depth_mode the depth compare mode, or -1 to use the polygon's mode
+ */
+static void sw_set_context( struct sw_context *ctx, sw_draw_mode_t mode, uint32_t poly1,
+                            uint32_t poly2, uint32_t tex_id, int depth_mode, int stencil )
+{
+    ctx->mode = mode;
+    ctx->depth_mode = depth_mode == -1 ? (poly1 >> 29) : depth_mode;
+    ctx->depth_write = POLY1_DEPTH_WRITE(poly1);
+    ctx->depth_test = TRUE;
+    ctx->stencil = stencil;
+    ctx->src_blend = poly2 >> 29;
+    ctx->dest_blend = (poly2 >> 26) & 0x07;
+    ctx->gouraud = (poly1 & 0x00800000) != 0;
+    ctx->texture = tex_id == 0 ? NULL : swr.textures[tex_id-1];
+    ctx->wrap_u = POLY2_TEX_CLAMP_U(poly2) ? SW_WRAP_CLAMP :
+                  (POLY2_TEX_MIRROR_U(poly2) ? SW_WRAP_MIRROR : SW_WRAP_REPEAT);
+    ctx->wrap_v = POLY2_TEX_CLAMP_V(poly2) ? SW_WRAP_CLAMP :
+                  (POLY2_TEX_MIRROR_V(poly2) ? SW_WRAP_MIRROR : SW_WRAP_REPEAT);
+    ctx->bilinear = ((poly2 >> 13) & 0x03) != 0;
+    ctx->texture_alpha = POLY2_TEX_ALPHA_ENABLE(poly2) ? TRUE : FALSE;
+    ctx->fog_colour = POLY2_FOG_MODE(poly2) == PVR2_POLY_FOG_LOOKUP ?
+                      pvr2_scene.fog_lut_colour : pvr2_scene.fog_vert_colour;
+    ctx->alpha_ref = 0;
+}
+
+/**************************** Rasterization ****************************/
+
+/**
+ * Compute the plane p(x,y) = dx*x + dy*y + c through the three values.
+ */
+static inline void sw_setup_plane( float *plane, const float *x, const float *y,
+                                   float p0, float p1, float p2, float inv_det )
+{
+    float d1 = p1 - p0, d2 = p2 - p0;
+    plane[0] = (d1*(y[2]-y[0]) - d2*(y[1]-y[0])) * inv_det;
+    plane[1] = (d2*(x[1]-x[0]) - d1*(x[2]-x[0])) * inv_det;
+    plane[2] = p0 - plane[0]*x[0] - plane[1]*y[0];
+}
+
+/**
+ * Setup a triangle for rasterizing within the given bounds.
+ * @return FALSE if the triangle is degenerate or doesn't cover any pixels
+ * within the bounds.
+ */
+static gboolean sw_setup_triangle( struct sw_triangle *tri, const struct vertex_struct *v,
+                                   const uint32_t *bounds )
+{
+    float x[3] = { v[0].x, v[1].x, v[2].x };
+    float y[3] = { v[0].y, v[1].y, v[2].y };
+    float iw[3];
+    float det = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    float minx, maxx, miny, maxy, sign, inv_det;
+    int i, j;
+
+    if( det == 0 || !isfinite(det) )
+        return FALSE;
+
+    minx = MIN(x[0], MIN(x[1], x[2]));
+    maxx = MAX(x[0], MAX(x[1], x[2]));
+    miny = MIN(y[0], MIN(y[1], y[2]));
+    maxy = MAX(y[0], MAX(y[1], y[2]));
+    /* Pixels are covered if their centre (+0.5) is inside */
+    tri->x1 = minx - 0.5f < bounds[0] ? bounds[0] : (int)ceilf(minx - 0.5f);
+    tri->x2 = maxx - 0.5f >= bounds[1] ? bounds[1] : (int)floorf(maxx - 0.5f) + 1;
+    tri->y1 = miny - 0.5f < bounds[2] ? bounds[2] : (int)ceilf(miny - 0.5f);
+    tri->y2 = maxy - 0.5f >= bounds[3] ? bounds[3] : (int)floorf(maxy - 0.5f) + 1;
+    if( tri->x1 >= tri->x2 || tri->y1 >= tri->y2 )
+        return FALSE;
+
+    /* Edge functions, oriented so that the inside is positive. Edges on the
+     * top or left of the triangle include the pixels exactly on them, so that
+     * pixels on an edge shared by two triangles are drawn exactly once.
+     */
+    sign = det > 0 ? 1.0f : -1.0f;
+    for( i=0; i<3; i++ ) {
+        int j1 = (i+1)%3, j2 = (i+2)%3;
+        float a = (y[j1] - y[j2]) * sign;
+        float b = (x[j2] - x[j1]) * sign;
+        tri->edge[i][0] = a;
+        tri->edge[i][1] = b;
+        tri->edge[i][2] = -(a*x[j1] + b*y[j1]);
+        tri->inclusive[i] = a > 0 || (a == 0 && b > 0);
+    }
+
+    inv_det = 1.0f / det;
+    tri->affine = FALSE;
+    for( i=0; i<3; i++ ) {
+        iw[i] = v[i].z == 0 ? 0 : 1.0f/v[i].z;
+        if( !(iw[i] > 0) || !isfinite(iw[i]) )
+            tri->affine = TRUE;
+    }
+    if( tri->affine ) {
+        /* Can't do perspective correction with a w <= 0 - fall back to
+         * linear interpolation */
+        for( i=0; i<3; i++ ) {
+            if( !isfinite(iw[i]) )
+                iw[i] = 0;
+        }
+    }
+    sw_setup_plane( tri->invw, x, y, iw[0], iw[1], iw[2], inv_det );
+
+    for( j=0; j<SW_ATTR_COUNT; j++ ) {
+        const float *a0 = &v[0].u, *a1 = &v[1].u, *a2 = &v[2].u;
+        /* attributes are u,v then (skipping r,tex_mode,x,y,z,w) rgba, offset */
+        int k = j < SW_ATTR_RGBA ? j : j + 6;
+        if( tri->affine ) {
+            sw_setup_plane( tri->attr[j], x, y, a0[k], a1[k], a2[k], inv_det );
+        } else {
+            sw_setup_plane( tri->attr[j], x, y, a0[k]*iw[0], a1[k]*iw[1], a2[k]*iw[2], inv_det );
+        }
+    }
+    memcpy( tri->flat, v[2].rgba, 4*sizeof(float) );
+    memcpy( tri->flat+4, v[2].offset_rgba, 3*sizeof(float) );
+    tri->tex_mode = v[0].tex_mode;
+    return TRUE;
+}
+
+/**
+ * Evaluate coverage and 1/w for the 4 pixels starting at (x,y).
+ * @return a mask of the covered pixels (bit 0 = x)
+ */
+#ifdef __SSE__
+static inline int sw_coverage4( const struct sw_triangle *tri, int x, int y, float *invw )
+{
+    __m128 px = _mm_add_ps( _mm_set1_ps((float)x), _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f ) );
+    __m128 py = _mm_set1_ps( y + 0.5f );
+    __m128 zero = _mm_setzero_ps();
+    __m128 inside = _mm_cmpeq_ps( zero, zero );
+    int i;
+
+    for( i=0; i<3; i++ ) {
+        __m128 e = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps(tri->edge[i][0]), px ),
+                                           _mm_mul_ps( _mm_set1_ps(tri->edge[i][1]), py ) ),
+                               _mm_set1_ps(tri->edge[i][2]) );
+        inside = _mm_and_ps( inside, tri->inclusive[i] ? _mm_cmpge_ps( e, zero ) : _mm_cmpgt_ps( e, zero ) );
+    }
+    _mm_storeu_ps( invw, _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps(tri->invw[0]), px ),
+                                                 _mm_mul_ps( _mm_set1_ps(tri->invw[1]), py ) ),
+                                     _mm_set1_ps(tri->invw[2]) ) );
+    return _mm_movemask_ps( inside );
+}
+#else
+static inline int sw_coverage4( const struct sw_triangle *tri, int x, int y, float *invw )
+{
+    float py = y + 0.5f;
+    int i, j, mask = 0;
+
+    for( j=0; j<4; j++ ) {
+        float px = x + j + 0.5f;
+        int inside = 1;
+        for( i=0; i<3; i++ ) {
+            float e = tri->edge[i][0]*px + tri->edge[i][1]*py + tri->edge[i][2];
+            inside &= tri->inclusive[i] ? e >= 0 : e > 0;
+        }
+        mask |= inside << j;
+        invw[j] = tri->invw[0]*px + tri->invw[1]*py + tri->invw[2];
+    }
+    return mask;
+}
+#endif
+
+static inline gboolean sw_depth_test( int mode, float invw, float depth )
+{
+    switch( mode ) {
+    case 0: return FALSE;
+    case 1: return invw < depth;
+    case 2: return invw == depth;
+    case 3: return invw <= depth;
+    case 4: return invw > depth;
+    case 5: return invw != depth;
+    case 6: return invw >= depth;
+    default: return TRUE;
+    }
+}
+
+/**
+ * Compute a blend factor.
+ * @param other the colour used by the DST_COLOR/SRC_COLOR modes (ie the dest
+ * colour for the source factor, and vice versa)
+ */
+static inline void sw_blend_factor( int mode, const float *other, const float *src,
+                                    const float *dest, float *factor )
+{
+    int i;
+    float f;
+    switch( mode ) {
+    case 0: f = 0; break;
+    case 1: f = 1; break;
+    case 2:
+        memcpy( factor, other, 4*sizeof(float) );
+        return;
+    case 3:
+        for( i=0; i<4; i++ )
+            factor[i] = 1 - other[i];
+        return;
+    case 4: f = src[3]; break;
+    case 5: f = 1 - src[3]; break;
+    case 6: f = dest[3]; break;
+    default: f = 1 - dest[3]; break;
+    }
+    factor[0] = factor[1] = factor[2] = factor[3] = f;
+}
+
+static inline float sw_clamp( float f )
+{
+    return f < 0 ? 0 : (f > 1 ? 1 : f);
+}
+
+/**
+ * Shade and blend one pixel that has passed the stencil and depth tests.
+ * @return FALSE if the pixel was discarded by the alpha test.
+ */
+static gboolean sw_shade_pixel( float *dest, const struct sw_triangle *tri,
+                                const struct sw_context *ctx, float px, float py, float invw )
+{
+    float attr[SW_ATTR_COUNT];
+    float src[4], tex[4], sf[4], df[4];
+    float w = tri->affine ? 1.0f : 1.0f/invw;
+    float fog;
+    const float *fog_colour;
+    int i;
+
+    for( i=0; i<SW_ATTR_COUNT; i++ ) {
+        attr[i] = (tri->attr[i][0]*px + tri->attr[i][1]*py + tri->attr[i][2]) * w;
+    }
+    if( !ctx->gouraud ) {
+        memcpy( &attr[SW_ATTR_RGBA], tri->flat, sizeof(tri->flat) );
+    }
+
+    if( ctx->texture == NULL || tri->tex_mode >= 1.5f ) {
+        memcpy( src, &attr[SW_ATTR_RGBA], 4*sizeof(float) );
+    } else {
+        sw_sample_texture( ctx, attr[SW_ATTR_U], attr[SW_ATTR_V], tex );
+        if( tri->tex_mode == 0 ) { /* Modulate */
+            for( i=0; i<3; i++ )
+                src[i] = attr[SW_ATTR_RGBA+i] * tex[i] + attr[SW_ATTR_OFFSET+i];
+            src[3] = attr[SW_ATTR_RGBA+3] * tex[3];
+        } else { /* Decal */
+            for( i=0; i<3; i++ )
+                src[i] = attr[SW_ATTR_RGBA+i] + (tex[i] - attr[SW_ATTR_RGBA+i])*tex[3] +
+                         attr[SW_ATTR_OFFSET+i];
+            src[3] = attr[SW_ATTR_RGBA+3];
+        }
+    }
+
+    if( src[3] < ctx->alpha_ref )
+        return FALSE;
+
+    fog = attr[SW_ATTR_FOG];
+    fog_colour = ctx->fog_colour;
+    if( fog < 0 ) {
+        fog = -fog;
+        fog_colour = pvr2_scene.fog_lut_colour;
+    }
+    for( i=0; i<3; i++ ) {
+        src[i] = sw_clamp( src[i] + (fog_colour[i] - src[i])*fog );
+    }
+    src[3] = sw_clamp( src[3] );
+
+    sw_blend_factor( ctx->src_blend, dest, src, dest, sf );
+    sw_blend_factor( ctx->dest_blend, src, src, dest, df );
+    for( i=0; i<4; i++ ) {
+        dest[i] = sw_clamp( src[i]*sf[i] + dest[i]*df[i] );
+    }
+    return TRUE;
+}
+
+static void sw_draw_triangle( struct sw_tile *tile, const struct sw_triangle *tri,
+                              const struct sw_context *ctx )
+{
+    int x, y, i;
+
+    for( y = tri->y1; y < tri->y2; y++ ) {
+        int row = (y - tile->y) * SW_TILE_SIZE - tile->x;
+        for( x = tri->x1 & ~3; x < tri->x2; x += 4 ) {
+            float invw[4];
+            int mask = sw_coverage4( tri, x, y, invw );
+            if( x < tri->x1 )
+                mask &= 0x0F << (tri->x1 - x);
+            if( x + 4 > tri->x2 )
+                mask &= 0x0F >> (x + 4 - tri->x2);
+            for( i=0; mask != 0; i++, mask >>= 1 ) {
+                int idx = row + x + i;
+                if( !(mask & 1) )
+                    continue;
+                if( ctx->stencil != SW_STENCIL_ANY && (tile->stencil[idx] & 0x02) != ctx->stencil )
+                    continue;
+                if( ctx->depth_test && !sw_depth_test( ctx->depth_mode, invw[i], tile->depth[idx] ) )
+                    continue;
+                switch( ctx->mode ) {
+                case SW_DRAW_VOLUME:
+                    tile->stencil[idx] ^= 0x01;
+                    break;
+                case SW_DRAW_DEPTH:
+                    if( ctx->depth_write )
+                        tile->depth[idx] = invw[i];
+                    break;
+                default:
+                    if( sw_shade_pixel( tile->colour[idx], tri, ctx, x + i + 0.5f, y + 0.5f, invw[i] ) &&
+                            ctx->depth_write && ctx->depth_test )
+                        tile->depth[idx] = invw[i];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Draw a triangle strip, starting from the given vertex index.
+ */
+static void sw_draw_strip( struct sw_tile *tile, int vertex_index, int vertex_count,
+                           const struct sw_context *ctx, const uint32_t *bounds )
+{
+    struct vertex_struct *vertexes = &pvr2_scene.vertex_array[vertex_index];
+    struct sw_triangle tri;
+    int i;
+
+    for( i=0; i+2 < vertex_count; i++ ) {
+        if( sw_setup_triangle( &tri, &vertexes[i], bounds ) ) {
+            sw_draw_triangle( tile, &tri, ctx );
+        }
+    }
+}
+
+static void sw_draw_vertexes( struct sw_tile *tile, struct polygon_struct *poly,
+                              gboolean modified, const struct sw_context *ctx, const uint32_t *bounds )
+{
+    do {
+        sw_draw_strip( tile, modified ? poly->mod_vertex_index : poly->vertex_index,
+                       poly->vertex_count, ctx, bounds );
+        poly = poly->sub_next;
+    } while( poly != NULL );
+}
+
+/****************************** Tile lists *****************************/
+
+/**
+ * Draw a polygon, including its modified version (if any).
+ * @param depth_mode depth compare mode, or -1 to use the polygon's own
+ */
+static void sw_render_poly( struct sw_tile *tile, struct polygon_struct *poly,
+                            int depth_mode, float alpha_ref )
+{
+    struct sw_context ctx;
+
+    if( poly->vertex_count == 0 )
+        return; /* Culled */
+
+    if( poly->mod_vertex_index == -1 ) {
+        sw_set_context( &ctx, SW_DRAW_COLOUR, poly->context[0], poly->context[1],
+                        poly->tex_id, depth_mode, SW_STENCIL_ANY );
+        ctx.alpha_ref = alpha_ref;
+        sw_draw_vertexes( tile, poly, FALSE, &ctx, tile->bounds );
+    } else {
+        sw_set_context( &ctx, SW_DRAW_COLOUR, poly->context[0], poly->context[1],
+                        poly->tex_id, depth_mode, SW_STENCIL_UNSHADOWED );
+        ctx.alpha_ref = alpha_ref;
+        sw_draw_vertexes( tile, poly, FALSE, &ctx, tile->bounds );
+
+        if( pvr2_scene.shadow_mode == SHADOW_FULL ) {
+            sw_set_context( &ctx, SW_DRAW_COLOUR, poly->context[0], poly->context[3],
+                            poly->mod_tex_id, depth_mode, SW_STENCIL_SHADOWED );
+            ctx.alpha_ref = alpha_ref;
+        } else {
+            ctx.stencil = SW_STENCIL_SHADOWED;
+        }
+        sw_draw_vertexes( tile, poly, TRUE, &ctx, tile->bounds );
+    }
+}
+
+static void sw_render_tilelist( struct sw_tile *tile, pvraddr_t tile_entry,
+                                int depth_mode, float alpha_ref )
+{
+    tileentryiter list;
+
+    FOREACH_TILEENTRY(list, tile_entry) {
+        struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[TILEENTRYITER_POLYADDR(list)];
+        if( poly != NULL ) {
+            do {
+                sw_render_poly( tile, poly, depth_mode, alpha_ref );
+                poly = poly->next;
+            } while( list.strip_count-- > 0 );
+        }
+    }
+}
+
+static void sw_render_tilelist_depthonly( struct sw_tile *tile, pvraddr_t tile_entry )
+{
+    tileentryiter list;
+    struct sw_context ctx;
+
+    FOREACH_TILEENTRY(list, tile_entry) {
+        struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[TILEENTRYITER_POLYADDR(list)];
+        if( poly != NULL ) {
+            do {
+                if( poly->vertex_count != 0 ) {
+                    sw_set_context( &ctx, SW_DRAW_DEPTH, poly->context[0], poly->context[1],
+                                    0, -1, SW_STENCIL_ANY );
+                    sw_draw_vertexes( tile, poly, FALSE, &ctx, tile->bounds );
+                }
+                poly = poly->next;
+            } while( list.strip_count-- > 0 );
+        }
+    }
+}
+
+/**
+ * Draw the modifier volumes into the stencil. As in the GL renderer, bit 0
+ * is toggled by each volume polygon, and at the end of a volume bit 1 is
+ * updated from it (and bit 0 cleared).
+ */
+static void sw_render_modifier_tilelist( struct sw_tile *tile, pvraddr_t tile_entry )
+{
+    tileentryiter list;
+    struct sw_context ctx;
+    int x, y;
+
+    FOREACH_TILEENTRY(list, tile_entry) {
+        struct polygon_struct *poly = pvr2_scene.buf_to_poly_map[TILEENTRYITER_POLYADDR(list)];
+        if( poly != NULL ) {
+            do {
+                if( poly->vertex_count != 0 ) {
+                    int poly_type = POLY1_VOLUME_MODE(poly->context[0]);
+                    sw_set_context( &ctx, SW_DRAW_VOLUME, poly->context[0], poly->context[1],
+                                    0, SW_DEPTH_LEQUAL, SW_STENCIL_ANY );
+                    sw_draw_vertexes( tile, poly, FALSE, &ctx, tile->bounds );
+
+                    if( poly_type == PVR2_VOLUME_REGION0 || poly_type == PVR2_VOLUME_REGION1 ) {
+                        for( y = tile->bounds[2]; y < tile->bounds[3]; y++ ) {
+                            uint8_t *s = &tile->stencil[(y - tile->y)*SW_TILE_SIZE - tile->x];
+                            for( x = tile->bounds[0]; x < tile->bounds[1]; x++ ) {
+                                if( poly_type == PVR2_VOLUME_REGION0 ) { /* AND */
+                                    s[x] = s[x] == 2 ? 2 : 0;
+                                } else { /* OR */
+                                    s[x] = s[x] == 0 ? 0 : 2;
+                                }
+                            }
+                        }
+                    }
+                }
+                poly = poly->next;
+            } while( list.strip_count-- > 0 );
+        }
+    }
+}
+
+static void sw_render_sorted_triangle( struct polygon_struct *poly, int triangle, void *data )
+{
+    struct sw_tile *tile = data;
+    struct sw_context ctx;
+    sw_set_context( &ctx, SW_DRAW_COLOUR, poly->context[0], poly->context[1],
+                    poly->tex_id, SW_DEPTH_GEQUAL, SW_STENCIL_ANY );
+    ctx.depth_write = FALSE;
+    sw_draw_strip( tile, poly->vertex_index + triangle, 3, &ctx, tile->bounds );
+}
+
+static void sw_render_background( struct sw_tile *tile )
+{
+    struct polygon_struct *poly = pvr2_scene.bkgnd_poly;
+    struct sw_context ctx;
+    uint32_t bounds[4] = { tile->x, tile->x + SW_TILE_SIZE, tile->y, tile->y + SW_TILE_SIZE };
+
+    sw_set_context( &ctx, SW_DRAW_COLOUR, poly->context[0], poly->context[1],
+                    poly->tex_id, -1, SW_STENCIL_ANY );
+    ctx.depth_test = FALSE;
+    ctx.src_blend = 1;  /* ONE */
+    ctx.dest_blend = 0; /* ZERO */
+    sw_draw_vertexes( tile, poly, FALSE, &ctx, bounds );
+}
+
+#define FOREACH_TILE_SEGMENT(segment, tile_index) \
+    for( seg = swr.tile_segment[tile_index]; seg != -1 && (segment = &pvr2_scene.segment_list[seg]); seg = swr.next_segment[seg] )
+
+static void sw_render_tile( void *data, unsigned int item, unsigned int thread )
+{
+    struct sw_tile *tile = &sw_tiles[thread];
+    struct tile_segment *segment;
+    uint32_t *dest;
+    int seg, x, y, width, height;
+    gboolean have_modifiers = FALSE;
+
+    tile->x = (item % swr.tiles_x) * SW_TILE_SIZE;
+    tile->y = (item / swr.tiles_x) * SW_TILE_SIZE;
+    tile->bounds[0] = MAX( tile->x, swr.clip_bounds[0] );
+    tile->bounds[1] = MIN( tile->x + SW_TILE_SIZE, swr.clip_bounds[1] );
+    tile->bounds[2] = MAX( tile->y, swr.clip_bounds[2] );
+    tile->bounds[3] = MIN( tile->y + SW_TILE_SIZE, swr.clip_bounds[3] );
+    tile->clipped = tile->bounds[0] >= tile->bounds[1] || tile->bounds[2] >= tile->bounds[3];
+
+    memset( tile->colour, 0, sizeof(tile->colour) );
+    memset( tile->depth, 0, sizeof(tile->depth) );
+    memset( tile->stencil, 0, sizeof(tile->stencil) );
+
+    sw_render_background( tile );
+
+    if( !tile->clipped ) {
+        /* Build up the opaque stencil map */
+        FOREACH_TILE_SEGMENT(segment, item) {
+            if( IS_NONEMPTY_TILE_LIST(segment->opaquemod_ptr) ) {
+                sw_render_tilelist_depthonly( tile, segment->opaque_ptr );
+                have_modifiers = TRUE;
+            }
+        }
+        if( have_modifiers ) {
+            FOREACH_TILE_SEGMENT(segment, item) {
+                if( IS_NONEMPTY_TILE_LIST(segment->opaquemod_ptr) ) {
+                    sw_render_modifier_tilelist( tile, segment->opaquemod_ptr );
+                }
+            }
+            memset( tile->depth, 0, sizeof(tile->depth) );
+        }
+
+        /* Opaque polygons */
+        FOREACH_TILE_SEGMENT(segment, item) {
+            sw_render_tilelist( tile, segment->opaque_ptr, -1, 0 );
+        }
+
+        /* Punch-out polygons */
+        FOREACH_TILE_SEGMENT(segment, item) {
+            sw_render_tilelist( tile, segment->punchout_ptr, SW_DEPTH_GEQUAL, swr.alpha_ref );
+        }
+
+        /* Translucent polygons */
+        FOREACH_TILE_SEGMENT(segment, item) {
+            if( IS_NONEMPTY_TILE_LIST(segment->trans_ptr) ) {
+                if( pvr2_scene.sort_mode == SORT_NEVER ||
+                        (pvr2_scene.sort_mode == SORT_TILEFLAG && (segment->control&SEGMENT_SORT_TRANS))) {
+                    sw_render_tilelist( tile, segment->trans_ptr, -1, 0 );
+                } else {
+                    render_sort_tile_triangles( segment->trans_ptr, thread, sw_render_sorted_triangle, tile );
+                }
+            }
+        }
+    }
+
+    /* Write the tile out to the buffer as ARGB8888. Tiles on the right and
+     * bottom edges may hang over the end of the buffer */
+    width = MIN( SW_TILE_SIZE, swr.width - tile->x );
+    height = MIN( SW_TILE_SIZE, swr.height - tile->y );
+    for( y=0; y<height; y++ ) {
+        dest = swr.buffer->pixels + (tile->y + y)*swr.buffer->width + tile->x;
+        for( x=0; x<width; x++ ) {
+            float *c = tile->colour[y*SW_TILE_SIZE + x];
+            *dest++ = (((uint32_t)(c[3]*255.0f + 0.5f)) << 24) |
+                      (((uint32_t)(c[0]*255.0f + 0.5f)) << 16) |
+                      (((uint32_t)(c[1]*255.0f + 0.5f)) << 8) |
+                      ((uint32_t)(c[2]*255.0f + 0.5f));
+        }
+    }
+}
+
+/**
+ * Sort the segments into per-tile lists, preserving their order.
+ */
+static void sw_build_tile_lists( void )
+{
+    struct tile_segment *segment = pvr2_scene.segment_list;
+    unsigned int tiles = swr.tiles_x * swr.tiles_y, segments = 0;
+    int i;
+
+    do {
+        segments++;
+    } while( !IS_LAST_SEGMENT(segment++) );
+
+    if( tiles > swr.tiles_alloc ) {
+        swr.tile_segment = g_realloc( swr.tile_segment, tiles * sizeof(int) );
+        swr.tiles_alloc = tiles;
+    }
+    if( segments > swr.segments_alloc ) {
+        swr.next_segment = g_realloc( swr.next_segment, segments * sizeof(int) );
+        swr.segments_alloc = segments;
+    }
+    for( i=0; i<tiles; i++ ) {
+        swr.tile_segment[i] = -1;
+    }
+    for( i=segments-1; i>=0; i-- ) {
+        uint32_t control = pvr2_scene.segment_list[i].control;
+        unsigned int tilex = SEGMENT_X(control), tiley = SEGMENT_Y(control);
+        swr.next_segment[i] = -1;
+        if( tilex < swr.tiles_x && tiley < swr.tiles_y ) {
+            unsigned int tile = tiley * swr.tiles_x + tilex;
+            swr.next_segment[i] = swr.tile_segment[tile];
+            swr.tile_segment[tile] = i;
+        }
+    }
+}
+
+void pvr2_scene_render_soft( render_buffer_t buffer )
+{
+    struct timeval start_tv, tex_tv, end_tv;
+    int i;
+
+    gettimeofday(&start_tv, NULL);
+    pvr2_check_palette_changed();
+    sw_load_textures();
+
+    gettimeofday( &tex_tv, NULL );
+    uint32_t ms = (tex_tv.tv_sec - start_tv.tv_sec) * 1000 +
+    (tex_tv.tv_usec - start_tv.tv_usec)/1000;
+    DEBUG( "Texture decode in %dms", ms );
+
+    swr.buffer = buffer;
+    swr.alpha_ref = ((float)(MMIO_READ(PVR2, RENDER_ALPHA_REF)&0xFF)+1)/256.0;
+    for( i=0; i<4; i++ ) {
+        swr.clip_bounds[i] = (uint32_t)pvr2_scene.bounds[i];
+    }
+    swr.width = MIN(buffer->width, pvr2_scene.buffer_width);
+    swr.height = MIN(buffer->height, pvr2_scene.buffer_height);
+    swr.tiles_x = (swr.width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    swr.tiles_y = (swr.height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    sw_build_tile_lists();
+
+    workpool_run( sw_render_tile, NULL, swr.tiles_x * swr.tiles_y );
+
+    sw_free_textures();
+    pvr2_scene_finished();
+
+    gettimeofday( &end_tv, NULL );
+    ms = (end_tv.tv_sec - tex_tv.tv_sec) * 1000 +
+    (end_tv.tv_usec - tex_tv.tv_usec)/1000;
+    DEBUG( "Scene render in %dms", ms );
+}
@@ -22,6 +22,10 @@
 #include "asic.h"
 #include "dream.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define STATE_IDLE                 0
 #define STATE_IN_LIST              1
 #define STATE_IN_POLYGON           2
@@ -162,6 +166,28 @@ static struct pvr2_ta_status ta_status;
 
 static int tilematrix_sizes[4] = {0,8,16,32};
 
+#define TA_NO_ALLOC 0xFFFFFFFF
+
+/**
+ * End of each tile's list in the current tile matrix, so that adding an entry
+ * doesn't need to walk the whole list. These are only hints - they're checked
+ * before use, and recomputed from the list if stale - so they're not part of
+ * the saved state.
+ */
+struct ta_tile_tail {
+    uint32_t addr;   /* Address of the end-of-list marker, or TA_NO_ALLOC if unknown */
+    uint32_t offset; /* Word offset of the marker in its block */
+};
+
+#define TA_MAX_TILE_TAILS 4096
+static struct ta_tile_tail ta_tile_tails[TA_MAX_TILE_TAILS];
+static gboolean ta_tile_tails_valid;
+
+static void ta_reset_tile_tails() {
+    memset( ta_tile_tails, 0xFF, sizeof(ta_tile_tails) );
+    ta_tile_tails_valid = TRUE;
+}
+
 /**
  * Convenience union - ta data is either 32-bit integer or 32-bit float.
  */
@@ -185,6 +211,7 @@ int pvr2_ta_load_state( FILE *f )
 {
     if( fread( &ta_status, sizeof(ta_status), 1, f ) != 1 )
         return 1;
+    ta_reset_tile_tails();
     return 0;
 }
 
@@ -220,9 +247,33 @@ void pvr2_ta_init() {
     MMIO_WRITE( PVR2, TA_LISTPOS, plistpos );
     ta_status.tilelist_start = plistpos;
     ta_status.polybuf_start = MMIO_READ( PVR2, TA_POLYBASE ) & 0x00F00000;
+    ta_reset_tile_tails();
 }
 
-static uint32_t parse_float_colour( float a, float r, float g, float b ) {
+/**
+ * Convert a floating point colour to packed ARGB.
+ * @param data the colour as 4 floats, in the order a,r,g,b
+ */
+#ifdef __SSE2__
+static uint32_t parse_float_colour( const union ta_data *data ) {
+    __m128 colour = _mm_loadu_ps( &data[0].f );
+    /* Reverse to b,g,r,a so that the packed bytes come out as ARGB */
+    colour = _mm_shuffle_ps( colour, colour, _MM_SHUFFLE(0,1,2,3) );
+    __m128i inf = _mm_cmpeq_epi32( _mm_and_si128( _mm_castps_si128(colour), _mm_set1_epi32(0xFF800000) ),
+                                   _mm_set1_epi32(0x7F800000) );
+    /* Note max returns the second operand (0) for a NaN, as the scalar
+     * version does for the (negative) NaNs that aren't treated as INF */
+    colour = _mm_min_ps( _mm_max_ps( colour, _mm_setzero_ps() ), _mm_set1_ps(1.0) );
+    __m128i value = _mm_cvttps_epi32( _mm_sub_ps( _mm_mul_ps( colour, _mm_set1_ps(256.0) ), _mm_set1_ps(1.0) ) );
+    value = _mm_andnot_si128( _mm_srai_epi32( value, 31 ), value );
+    value = _mm_or_si128( _mm_andnot_si128( inf, value ), _mm_and_si128( inf, _mm_set1_epi32(255) ) );
+    value = _mm_packs_epi32( value, value );
+    value = _mm_packus_epi16( value, value );
+    return _mm_cvtsi128_si32( value );
+}
+#else
+static uint32_t parse_float_colour( const union ta_data *data ) {
+    float a = data[0].f, r = data[1].f, g = data[2].f, b = data[3].f;
     int ai,ri,gi,bi;
 
     if( TA_IS_INF(a) ) {
@@ -251,6 +302,7 @@ static uint32_t parse_float_colour( float a, float r, float g, float b ) {
     }
     return (ai << 24) | (ri << 16) | (gi << 8) | bi;
 }
+#endif
 
 static uint32_t parse_intensity_colour( uint32_t base, float intensity )
 {
@@ -304,6 +356,7 @@ static void ta_init_list( unsigned int listtype ) {
     if( tile_matrix == list_end ) {
         ta_status.current_tile_size = 0;
     }
+    ta_reset_tile_tails();
 
     ta_status.state = STATE_IN_LIST;
     ta_status.current_list_type = listtype;
@@ -358,8 +411,6 @@ static int ta_write_polygon_buffer( uint32_t *data, int length )
     return rv;
 }
 
-#define TA_NO_ALLOC 0xFFFFFFFF
-
 /**
  * Allocate a new tile list block from the grow space and update the
  * word at reference to be a link to the new block.
@@ -408,15 +459,105 @@ static uint32_t ta_alloc_tilelist( uint32_t reference ) {
 }
 
 /**
- * Write a tile entry out to the matrix.
+ * Find the end-of-list marker of the tile list starting at tile: either at
+ * the start of the (empty) list, or the first one found after the first word
+ * of a block, following the link in the last word of each full block.
+ * @return FALSE if the list doesn't have an end (ie it's corrupt)
  */
-static void ta_write_tile_entry( int x, int y, uint32_t tile_entry ) {
-    uint32_t tile = TILESLOT(x,y);
+static gboolean ta_find_tile_tail( uint32_t tile, struct ta_tile_tail *tail ) {
     uint32_t tilestart = tile;
     uint32_t value;
-    uint32_t lasttri = 0;
     int i;
 
+    if( PVRRAM(tile) == 0xF0000000 ) {
+        tail->addr = tile;
+        tail->offset = 0;
+        return TRUE;
+    }
+
+    while(1) {
+        for( i=1; i<ta_status.current_tile_size; i++ ) {
+            if( PVRRAM(tile + (i<<2)) == 0xF0000000 ) {
+                tail->addr = tile + (i<<2);
+                tail->offset = i;
+                return TRUE;
+            }
+        }
+
+        value = PVRRAM(tile + ((ta_status.current_tile_size-1)<<2));
+        if( (value & 0xFF000000) == 0xE0000000 ) {
+            value &= 0x00FFFFFF;
+            if( value == tilestart )
+                return FALSE; /* Loop */
+            tilestart = tile = value;
+        } else {
+            /* This should never happen */
+            return FALSE;
+        }
+    }
+}
+
+/**
+ * Add an entry to the end of a tile's list, allocating a new block if the
+ * current one is full.
+ * @param lasttri if non-zero, the entry may be merged into the last entry of
+ * the list if that has the same type/polygon bits (triangle stacking)
+ */
+static void ta_add_tile_entry( int x, int y, uint32_t tile_entry, uint32_t lasttri ) {
+    struct ta_tile_tail *tail, uncached;
+    uint32_t value;
+
+    if( ta_tile_tails_valid && y < ta_status.height && y * ta_status.width + x < TA_MAX_TILE_TAILS ) {
+        tail = &ta_tile_tails[y * ta_status.width + x];
+    } else {
+        tail = &uncached;
+        tail->addr = TA_NO_ALLOC;
+    }
+    if( tail->addr == TA_NO_ALLOC || PVRRAM(tail->addr) != 0xF0000000 ) {
+        if( !ta_find_tile_tail( TILESLOT(x,y), tail ) ) {
+            tail->addr = TA_NO_ALLOC;
+            return;
+        }
+    }
+
+    if( tail->offset != 0 ) {
+        value = PVRRAM(tail->addr - 4);
+        if( lasttri != 0 && lasttri == (value&0xE1E00000) ) {
+            int count = (value & 0x1E000000) + 0x02000000;
+            if( count < 0x20000000 ) {
+                PVRRAM(tail->addr - 4) = (value & 0xE1FFFFFF) | count;
+                return;
+            }
+        }
+        if( tail->offset == ta_status.current_tile_size-1 ) {
+            uint32_t posn = MMIO_READ( PVR2, TA_LISTPOS );
+            uint32_t tile = ta_alloc_tilelist(tail->addr);
+            if( MMIO_READ( PVR2, TA_LISTPOS ) == posn ) {
+                /* Out of list space - from here on the same block can be
+                 * handed out to several tiles, so walk the lists instead */
+                ta_tile_tails_valid = FALSE;
+            }
+            if( tile == TA_NO_ALLOC ) {
+                tail->addr = TA_NO_ALLOC;
+                return;
+            }
+            tail->addr = tile;
+            tail->offset = 0;
+        }
+    }
+
+    PVRRAM(tail->addr) = tile_entry;
+    PVRRAM(tail->addr+4) = 0xF0000000;
+    tail->addr += 4;
+    tail->offset++;
+}
+
+/**
+ * Write a tile entry out to the matrix.
+ */
+static void ta_write_tile_entry( int x, int y, uint32_t tile_entry ) {
+    uint32_t lasttri = 0;
+
     if( ta_status.clip_mode == TA_POLYCMD_CLIP_OUTSIDE &&
             x >= ta_status.clip.x1 && x <= ta_status.clip.x2 &&
             y >= ta_status.clip.y1 && y <= ta_status.clip.y2 ) {
@@ -434,50 +575,29 @@ static void ta_write_tile_entry( int x, int y, uint32_t tile_entry ) {
         lasttri = tile_entry & 0xE1E00000;
     }
 
+    ta_add_tile_entry( x, y, tile_entry, lasttri );
+}
 
-    if( PVRRAM(tile) == 0xF0000000 ) {
-        PVRRAM(tile) = tile_entry;
-        PVRRAM(tile+4) = 0xF0000000;
-        return;
-    }
-
-    while(1) {
-        value = PVRRAM(tile);
-        for( i=1; i<ta_status.current_tile_size; i++ ) {
-            tile += 4;
-            uint32_t nextval = PVRRAM(tile);
-            if( nextval == 0xF0000000 ) {
-                if( lasttri != 0 && lasttri == (value&0xE1E00000) ) {
-                    int count = (value & 0x1E000000) + 0x02000000;
-                    if( count < 0x20000000 ) {
-                        PVRRAM(tile-4) = (value & 0xE1FFFFFF) | count;
-                        return;
-                    }
-                }
-                if( i < ta_status.current_tile_size-1 ) {
-                    PVRRAM(tile) = tile_entry;
-                    PVRRAM(tile+4) = 0xF0000000;
-                    return;
-                }
-            }
-            value = nextval;
-        }
-
-        if( value == 0xF0000000 ) {
-            tile = ta_alloc_tilelist(tile);
-            if( tile != TA_NO_ALLOC ) {
-                PVRRAM(tile) = tile_entry;
-                PVRRAM(tile+4) = 0xF0000000;
+/**
+ * Write the same triangle or sprite tile entry to every tile in the bounds.
+ * Equivalent to calling ta_write_tile_entry for each tile, but with the clip
+ * and stacking tests done a row at a time.
+ */
+static void ta_write_tile_entries( struct tile_bounds *bounds, uint32_t tile_entry ) {
+    struct tile_bounds *last = &ta_status.last_triangle_bounds;
+    uint32_t lasttri = tile_entry & 0xE1E00000;
+    int x, y;
+
+    for( y=bounds->y1; y<=bounds->y2; y++ ) {
+        gboolean clip_row = ta_status.clip_mode == TA_POLYCMD_CLIP_OUTSIDE &&
+                y >= ta_status.clip.y1 && y <= ta_status.clip.y2;
+        gboolean stack_row = last->x1 != -1 && y >= last->y1 && y <= last->y2;
+        for( x=bounds->x1; x<=bounds->x2; x++ ) {
+            if( clip_row && x >= ta_status.clip.x1 && x <= ta_status.clip.x2 ) {
+                continue; /* Tile clipped out */
             }
-            return;
-        } else if( (value & 0xFF000000) == 0xE0000000 ) {
-            value &= 0x00FFFFFF;
-            if( value == tilestart )
-                return; /* Loop */
-            tilestart = tile = value;
-        } else {
-            /* This should never happen */
-            return;
+            ta_add_tile_entry( x, y, tile_entry,
+                    (stack_row && x >= last->x1 && x <= last->x2) ? lasttri : 0 );
         }
     }
 }
@@ -544,7 +664,7 @@ static void ta_commit_polygon( ) {
     if( polygon_bound.x1 < 0 ) polygon_bound.x1 = 0;
     if( polygon_bound.x2 >= ta_status.width ) polygon_bound.x2 = ta_status.width-1;
     if( polygon_bound.y1 < 0 ) polygon_bound.y1 = 0;
-    if( polygon_bound.y2 >= ta_status.width ) polygon_bound.y2 = ta_status.height-1;
+    if( polygon_bound.y2 >= ta_status.height ) polygon_bound.y2 = ta_status.height-1;
 
     /* Set the "single tile" flag if it's entirely contained in 1 tile */
     if( polygon_bound.x1 == polygon_bound.x2 &&
@@ -601,24 +721,14 @@ static void ta_commit_polygon( ) {
 
     /* And now the tile entries. Triangles are different from everything else */
     if( ta_status.vertex_count == 3 ) {
-        tile_entry |= 0x80000000;
-        for( y=polygon_bound.y1; y<=polygon_bound.y2; y++ ) {
-            for( x=polygon_bound.x1; x<=polygon_bound.x2; x++ ) {
-                ta_write_tile_entry( x,y,tile_entry );
-            }
-        }
+        ta_write_tile_entries( &polygon_bound, tile_entry | 0x80000000 );
         ta_status.last_triangle_bounds.x1 = polygon_bound.x1;
         ta_status.last_triangle_bounds.y1 = polygon_bound.y1;
         ta_status.last_triangle_bounds.x2 = polygon_bound.x2;
         ta_status.last_triangle_bounds.y2 = polygon_bound.y2;
     } else if( ta_status.current_vertex_type == TA_VERTEX_SPRITE ||
             ta_status.current_vertex_type == TA_VERTEX_TEX_SPRITE ) {
-        tile_entry |= 0xA0000000;
-        for( y=polygon_bound.y1; y<=polygon_bound.y2; y++ ) {
-            for( x=polygon_bound.x1; x<=polygon_bound.x2; x++ ) {
-                ta_write_tile_entry( x,y,tile_entry );
-            }
-        }
+        ta_write_tile_entries( &polygon_bound, tile_entry | 0xA0000000 );
         ta_status.last_triangle_bounds.x1 = polygon_bound.x1;
         ta_status.last_triangle_bounds.y1 = polygon_bound.y1;
         ta_status.last_triangle_bounds.x2 = polygon_bound.x2;
@@ -736,7 +846,7 @@ static void ta_parse_polygon_context( union ta_data *data ) {
             ta_status.state = STATE_EXPECT_POLY_BLOCK2;
         } else {
             ta_status.intensity1 = 
-                parse_float_colour( data[4].f, data[5].f, data[6].f, data[7].f );
+                parse_float_colour( &data[4] );
         }
     } else if( colourfmt == TA_POLYCMD_COLOURFMT_LASTINT ) {
         colourfmt = TA_POLYCMD_COLOURFMT_INTENSITY;
@@ -825,7 +935,7 @@ static void ta_parse_vertex( union ta_data *data ) {
         vertex->detail[0] = data[6].i;
         break;
     case TA_VERTEX_FLOAT:
-        vertex->detail[0] = parse_float_colour( data[4].f, data[5].f, data[6].f, data[7].f );
+        vertex->detail[0] = parse_float_colour( &data[4] );
         break;
     case TA_VERTEX_INTENSITY:
         vertex->detail[0] = parse_intensity_colour( ta_status.intensity1, data[6].f );
@@ -942,16 +1052,16 @@ static void ta_parse_vertex_block2( union ta_data *data ) {
 
     switch( ta_status.current_vertex_type ) {
     case TA_VERTEX_TEX_SPEC_FLOAT:
-        vertex->detail[3] = parse_float_colour( data[4].f, data[5].f, data[6].f, data[7].f );
+        vertex->detail[3] = parse_float_colour( &data[4] );
         /* Fallthrough */
     case TA_VERTEX_TEX_FLOAT:
-        vertex->detail[2] = parse_float_colour( data[0].f, data[1].f, data[2].f, data[3].f );
+        vertex->detail[2] = parse_float_colour( &data[0] );
         break;
     case TA_VERTEX_TEX_UV16_SPEC_FLOAT:
-        vertex->detail[2] = parse_float_colour( data[4].f, data[5].f, data[6].f, data[7].f );
+        vertex->detail[2] = parse_float_colour( &data[4] );
         /* Fallthrough */
     case TA_VERTEX_TEX_UV16_FLOAT:
-        vertex->detail[1] = parse_float_colour( data[0].f, data[1].f, data[2].f, data[3].f );
+        vertex->detail[1] = parse_float_colour( &data[0] );
         break;
     case TA_VERTEX_TEX_PACKED_MOD:
         vertex->detail[3] = data[0].i; /* U1 */
@@ -1032,6 +1142,64 @@ static void ta_parse_vertex_block2( union ta_data *data ) {
     ta_status.state = STATE_IN_POLYGON;
 }
 
+/**
+ * Complete the current polygon on receipt of its last vertex.
+ */
+static void ta_end_polygon() {
+    if( ta_status.vertex_count < 3 ) {
+        ta_bad_input_error();
+    } else {
+        ta_commit_polygon();
+    }
+    ta_status.vertex_count = 0;
+    ta_status.poly_parity = 0;
+    ta_status.state = STATE_IN_LIST;
+}
+
+/**
+ * Parse a run of vertex parameters for the current polygon context, starting
+ * at the first of the given blocks. This does the same as feeding the blocks
+ * through pvr2_ta_process_block one at a time, but without re-dispatching on
+ * the state for each block, and with both halves of a 64-byte vertex parsed
+ * together.
+ * @return the number of blocks consumed, which is 0 if the first block
+ * isn't a vertex that can be handled here.
+ */
+static uint32_t ta_parse_vertex_run( union ta_data *data, uint32_t blocks ) {
+    uint32_t done = 0;
+
+    if( ta_status.state != STATE_IN_LIST && ta_status.state != STATE_IN_POLYGON ) {
+        return 0;
+    }
+
+    while( done < blocks && TA_CMD(data[0].i) == TA_CMD_VERTEX ) {
+        gboolean end = TA_IS_END_VERTEX(data[0].i);
+        ta_status.state = STATE_IN_POLYGON;
+        ta_parse_vertex( data );
+        if( ta_status.state == STATE_EXPECT_VERTEX_BLOCK2 ) {
+            if( done + 1 == blocks ) {
+                /* Second half comes in the next write */
+                if( end ) {
+                    ta_status.state = STATE_EXPECT_END_VERTEX_BLOCK2;
+                }
+                return done + 1;
+            }
+            data += 8;
+            done++;
+            ta_parse_vertex_block2( data );
+        }
+
+        if( end ) {
+            ta_end_polygon();
+        } else if( ta_status.vertex_count == ta_status.max_vertex ) {
+            ta_split_polygon();
+        }
+        data += 8;
+        done++;
+    }
+    return done;
+}
+
 /**
  * Process 1 32-byte block of ta data
  */
@@ -1046,9 +1214,9 @@ void pvr2_ta_process_block( unsigned char *input ) {
     case STATE_EXPECT_POLY_BLOCK2:
         /* This is always a pair of floating-point colours */
         ta_status.intensity1 = 
-            parse_float_colour( data[0].f, data[1].f, data[2].f, data[3].f );
+            parse_float_colour( &data[0] );
         ta_status.intensity2 =
-            parse_float_colour( data[4].f, data[5].f, data[6].f, data[7].f );
+            parse_float_colour( &data[4] );
         ta_status.state = STATE_IN_LIST;
         break;
 
@@ -1061,14 +1229,7 @@ void pvr2_ta_process_block( unsigned char *input ) {
 
     case STATE_EXPECT_END_VERTEX_BLOCK2:
         ta_parse_vertex_block2( data );
-        if( ta_status.vertex_count < 3 ) {
-            ta_bad_input_error();
-        } else {
-            ta_commit_polygon();
-        }
-        ta_status.vertex_count = 0;
-        ta_status.poly_parity = 0;
-        ta_status.state = STATE_IN_LIST;
+        ta_end_polygon();
         break;
     case STATE_IN_LIST:
     case STATE_IN_POLYGON:
@@ -1136,14 +1297,7 @@ void pvr2_ta_process_block( unsigned char *input ) {
                     ta_status.state = STATE_EXPECT_END_VERTEX_BLOCK2;
                 }
             } else if( TA_IS_END_VERTEX(data->i) ) {
-                if( ta_status.vertex_count < 3 ) {
-                    ta_bad_input_error();
-                } else {
-                    ta_commit_polygon();
-                }
-                ta_status.vertex_count = 0;
-                ta_status.poly_parity = 0;
-                ta_status.state = STATE_IN_LIST;
+                ta_end_polygon();
             } else if( ta_status.vertex_count == ta_status.max_vertex ) {
                 ta_split_polygon();
             }
@@ -1190,9 +1344,16 @@ void pvr2_ta_write( unsigned char *buf, uint32_t length )
         fwrite_dump32( (uint32_t *)buf, length, stderr );
     }
 
-    for( ; length >=32; length -= 32 ) {
-        pvr2_ta_process_block( buf );
-        buf += 32;
+    union ta_data *data = (union ta_data *)buf;
+    uint32_t blocks = length >> 5;
+    while( blocks > 0 ) {
+        uint32_t done = ta_parse_vertex_run( data, blocks );
+        if( done == 0 ) {
+            pvr2_ta_process_block( (unsigned char *)data );
+            done = 1;
+        }
+        data += done << 3;
+        blocks -= done;
     }
 }
 
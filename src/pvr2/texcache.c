@@ -19,68 +19,155 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 #include "pvr2/pvr2.h"
 #include "pvr2/pvr2mmio.h"
 #include "pvr2/glutil.h"
+#include "pvr2/texdec.h"
+#include "workpool.h"
 
-/** Specifies the maximum number of OpenGL
- * textures we're willing to have open at a time. If more are
- * needed, textures will be evicted in LRU order.
+/** Default number of OpenGL textures we're willing to have open at a time.
+ * If more are needed, textures will be evicted in LRU order. The actual
+ * limit (and an optional limit on texture memory) can be changed at runtime
+ * by texcache_set_limits.
  */
-#define MAX_TEXTURES 256
+#define DEFAULT_TEXTURES 256
+#define MIN_TEXTURES 16
+#define MAX_TEXTURES 65536
 
 /**
  * Data structure:
  *
- * Main operations:
- *    find entry by texture_addr
+ * Each slot is on exactly one of the free list or the active lists. Active
+ * slots are linked on three lists at once:
+ *    page list - all textures starting in a given 4K VRAM page (for invalidation)
+ *    hash chain - all textures with the same hash of (texture word, poly2 mode)
+ *    lru list - all active textures, least recently used first
+ *
+ * Main operations (all O(1) apart from the chain walks):
+ *    find entry by texture word + poly2 mode
  *    add new entry
  *    move entry to tail of lru list
  *    remove entry
  */
 
-typedef signed short texcache_entry_index;
+typedef int32_t texcache_entry_index;
 #define EMPTY_ENTRY -1
 
-static texcache_entry_index texcache_free_ptr = 0;
-static GLuint texcache_free_list[MAX_TEXTURES];
-
 typedef struct texcache_entry {
     uint32_t texture_addr;
     uint32_t poly2_mode, tex_mode;
     GLuint texture_id;
     render_buffer_t buffer;
-    texcache_entry_index next;
-    uint32_t lru_count;
+    texcache_entry_index next;      /* Next entry on the same page */
+    texcache_entry_index hash_next; /* Next entry in the same hash bucket */
+    texcache_entry_index lru_prev, lru_next;
+    uint32_t size;                  /* Texture memory used (estimated), in bytes */
+    uint32_t scene;                 /* Last scene to use the texture */
+    gboolean suspect;               /* Page written since the texture was loaded */
+    uint64_t data_hash;             /* Hash of the source data when loaded */
+    uint64_t palette_banks;         /* Palette banks the texels were looked up in */
 } *texcache_entry_t;
 
 static texcache_entry_index texcache_page_lookup[PVR2_RAM_PAGES];
-static uint32_t texcache_ref_counter;
-static struct texcache_entry texcache_active_list[MAX_TEXTURES];
+/* TRUE if all textures on the page are already marked as suspect, so that
+ * repeated writes to the page can return immediately */
+static gboolean texcache_page_suspect[PVR2_RAM_PAGES];
+static struct texcache_entry *texcache_active_list = NULL;
+static texcache_entry_index *texcache_free_list = NULL;
+static texcache_entry_index texcache_free_ptr = 0;
+static texcache_entry_index *texcache_hash_table = NULL;
+static uint32_t texcache_hash_mask;
+static texcache_entry_index texcache_lru_head, texcache_lru_tail;
+static unsigned int texcache_size = 0;      /* Number of slots */
+static unsigned int texcache_want_size = DEFAULT_TEXTURES;
+static size_t texcache_max_bytes = 0;       /* 0 = no limit */
+static size_t texcache_bytes;               /* Texture memory in use */
+static uint32_t texcache_scene;
+static gboolean texcache_have_gl = FALSE;
 static uint32_t texcache_palette_mode;
 static uint32_t texcache_stride_width;
 static gboolean texcache_have_palette_shader;
-static gboolean texcache_palette_valid;
+static uint64_t texcache_palette_dirty; /* Banks to upload to the palette texture */
 static GLuint texcache_palette_texid;
 
+/* Counters for the current scene */
+static struct {
+    unsigned int hits, misses, evictions;
+    unsigned int revalidated, reloaded; /* Suspect textures found unchanged/changed */
+    unsigned int prefetched; /* Loads that used a prefetched image */
+} texcache_stats;
+
+static void texcache_release_staged( void );
+
+static inline uint32_t texcache_hash( uint32_t poly2_mode, uint32_t tex_mode )
+{
+    uint32_t h = (tex_mode * 0x9E3779B1) ^ poly2_mode;
+    h ^= h >> 15;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    return h & texcache_hash_mask;
+}
+
 /**
- * Initialize the texture cache.
+ * Reset all cache structures to empty (without touching the GL textures)
  */
-void texcache_init( )
+static void texcache_reset_lists( )
 {
     int i;
     for( i=0; i<PVR2_RAM_PAGES; i++ ) {
         texcache_page_lookup[i] = EMPTY_ENTRY;
+        texcache_page_suspect[i] = FALSE;
+    }
+    for( i=0; i<=texcache_hash_mask; i++ ) {
+        texcache_hash_table[i] = EMPTY_ENTRY;
     }
-    for( i=0; i<MAX_TEXTURES; i++ ) {
+    for( i=0; i<texcache_size; i++ ) {
         texcache_free_list[i] = i;
         texcache_active_list[i].texture_addr = -1;
-        texcache_active_list[i].buffer = NULL;
         texcache_active_list[i].next = EMPTY_ENTRY;
+        texcache_active_list[i].hash_next = EMPTY_ENTRY;
+        texcache_active_list[i].lru_prev = texcache_active_list[i].lru_next = EMPTY_ENTRY;
     }
     texcache_free_ptr = 0;
-    texcache_ref_counter = 0;
+    texcache_lru_head = texcache_lru_tail = EMPTY_ENTRY;
+    texcache_bytes = 0;
+}
+
+/**
+ * (Re)allocate the cache for the given number of slots. The cache must be
+ * empty, and must not have any GL textures allocated.
+ */
+static void texcache_alloc( unsigned int size )
+{
+    unsigned int i, hash_size = 1;
+    while( hash_size < size*2 ) {
+        hash_size <<= 1;
+    }
+
+    g_free( texcache_active_list );
+    g_free( texcache_free_list );
+    g_free( texcache_hash_table );
+    texcache_active_list = g_malloc0( size * sizeof(struct texcache_entry) );
+    texcache_free_list = g_malloc( size * sizeof(texcache_entry_index) );
+    texcache_hash_table = g_malloc( hash_size * sizeof(texcache_entry_index) );
+    texcache_hash_mask = hash_size - 1;
+    texcache_size = size;
+    for( i=0; i<size; i++ ) {
+        texcache_active_list[i].buffer = NULL;
+        texcache_active_list[i].texture_id = -1;
+    }
+    texcache_reset_lists();
+}
+
+/**
+ * Initialize the texture cache.
+ */
+void texcache_init( )
+{
+    texcache_alloc( texcache_want_size );
+    texcache_scene = 0;
     texcache_palette_mode = -1;
     texcache_stride_width = 0;
 }
@@ -99,21 +186,13 @@ void texcache_release_render_buffer( render_buffer_t buffer )
 void texcache_flush( )
 {
     int i;
-    /* clear structures */
-    for( i=0; i<PVR2_RAM_PAGES; i++ ) {
-        texcache_page_lookup[i] = EMPTY_ENTRY;
-    }
-    for( i=0; i<MAX_TEXTURES; i++ ) {
-        texcache_free_list[i] = i;
-        texcache_active_list[i].next = EMPTY_ENTRY;
-        texcache_active_list[i].texture_addr = -1;
+    for( i=0; i<texcache_size; i++ ) {
         if( texcache_active_list[i].buffer != NULL ) {
             texcache_release_render_buffer(texcache_active_list[i].buffer);
             texcache_active_list[i].buffer = NULL;
         }
     }
-    texcache_free_ptr = 0;
-    texcache_ref_counter = 0;
+    texcache_reset_lists();
 }
 
 /**
@@ -123,11 +202,11 @@ void texcache_flush( )
 void texcache_gl_init( )
 {
     int i;
-    GLuint texids[MAX_TEXTURES];
+    GLuint *texids = g_malloc( texcache_size * sizeof(GLuint) );
 
     if( display_driver->capabilities.has_sl ) {
         texcache_have_palette_shader = TRUE;
-        texcache_palette_valid = FALSE;
+        texcache_palette_dirty = PVR2_PALETTE_ALL_BANKS;
         glGenTextures(1, &texcache_palette_texid );
 
         /* Bind the texture and set the params */
@@ -142,12 +221,14 @@ void texcache_gl_init( )
         texcache_have_palette_shader = FALSE;
     }
 
-    glGenTextures( MAX_TEXTURES, texids );
-    for( i=0; i<MAX_TEXTURES; i++ ) {
+    glGenTextures( texcache_size, texids );
+    for( i=0; i<texcache_size; i++ ) {
         texcache_active_list[i].texture_id = texids[i];
     }
-    INFO( "Texcache initialized (%s, %s)", (texcache_have_palette_shader ? "Palette shader" : "No palette support"),
-            (display_driver->capabilities.has_bgra ? "BGRA" : "RGBA") );
+    g_free( texids );
+    texcache_have_gl = TRUE;
+    INFO( "Texcache initialized (%s, %s, %d textures)", (texcache_have_palette_shader ? "Palette shader" : "No palette support"),
+            (display_driver->capabilities.has_bgra ? "BGRA" : "RGBA"), texcache_size );
 }
 
 /**
@@ -157,7 +238,7 @@ void texcache_gl_init( )
  */    
 void texcache_gl_shutdown( )
 {
-    GLuint texids[MAX_TEXTURES];
+    GLuint *texids = g_malloc( texcache_size * sizeof(GLuint) );
     int i;
     texcache_flush();
 
@@ -166,103 +247,265 @@ void texcache_gl_shutdown( )
         texcache_palette_texid = -1;
     }
 
-    for( i=0; i<MAX_TEXTURES; i++ ) {
+    for( i=0; i<texcache_size; i++ ) {
         texids[i] = texcache_active_list[i].texture_id;
         texcache_active_list[i].texture_id = -1;
     }
-    glDeleteTextures( MAX_TEXTURES, texids );
+    glDeleteTextures( texcache_size, texids );
+    g_free( texids );
+    texcache_have_gl = FALSE;
 }
 
-static void texcache_evict( int slot )
+/**
+ * Set the maximum number of textures, and the maximum amount of texture
+ * memory (in bytes, 0 for no limit) that the cache will use. A change in
+ * the number of textures flushes the cache, and takes effect at the start
+ * of the next scene if the GL textures have already been allocated.
+ */
+void texcache_set_limits( unsigned int max_textures, size_t max_bytes )
 {
-    /* Remove the selected slot from the lookup table */
-    assert( texcache_active_list[slot].texture_addr != -1 );
-    uint32_t evict_page = texcache_active_list[slot].texture_addr >> 12;
-    texcache_entry_index replace_next = texcache_active_list[slot].next;
-    texcache_active_list[slot].texture_addr = -1;
-    texcache_active_list[slot].next = EMPTY_ENTRY; /* Just for safety */
-    if( texcache_active_list[slot].buffer != NULL ) {
-        texcache_release_render_buffer(texcache_active_list[slot].buffer);
-        texcache_active_list[slot].buffer = NULL;
-    }
-    if( texcache_page_lookup[evict_page] == slot ) {
-        texcache_page_lookup[evict_page] = replace_next;
+    if( max_textures < MIN_TEXTURES ) {
+        max_textures = MIN_TEXTURES;
+    } else if( max_textures > MAX_TEXTURES ) {
+        max_textures = MAX_TEXTURES;
+    }
+    texcache_want_size = max_textures;
+    texcache_max_bytes = max_bytes;
+    if( !texcache_have_gl && texcache_active_list != NULL &&
+            texcache_want_size != texcache_size ) {
+        texcache_flush();
+        texcache_alloc( texcache_want_size );
+    }
+}
+
+static void texcache_lru_unlink( texcache_entry_index slot )
+{
+    texcache_entry_t entry = &texcache_active_list[slot];
+    if( entry->lru_prev == EMPTY_ENTRY ) {
+        texcache_lru_head = entry->lru_next;
     } else {
-        texcache_entry_index idx = texcache_page_lookup[evict_page];
+        texcache_active_list[entry->lru_prev].lru_next = entry->lru_next;
+    }
+    if( entry->lru_next == EMPTY_ENTRY ) {
+        texcache_lru_tail = entry->lru_prev;
+    } else {
+        texcache_active_list[entry->lru_next].lru_prev = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = EMPTY_ENTRY;
+}
+
+static void texcache_lru_append( texcache_entry_index slot )
+{
+    texcache_entry_t entry = &texcache_active_list[slot];
+    entry->lru_prev = texcache_lru_tail;
+    entry->lru_next = EMPTY_ENTRY;
+    if( texcache_lru_tail == EMPTY_ENTRY ) {
+        texcache_lru_head = slot;
+    } else {
+        texcache_active_list[texcache_lru_tail].lru_next = slot;
+    }
+    texcache_lru_tail = slot;
+}
+
+/**
+ * Remove the entry from the singly-linked chain starting at *head, where
+ * the links are given by the field at link_offset in each entry.
+ */
+static void texcache_chain_remove( texcache_entry_index *head, texcache_entry_index slot,
+                                   size_t link_offset )
+{
+#define CHAIN_NEXT(idx) (*(texcache_entry_index *)(((char *)&texcache_active_list[idx]) + link_offset))
+    texcache_entry_index replace_next = CHAIN_NEXT(slot);
+    if( *head == slot ) {
+        *head = replace_next;
+    } else {
+        texcache_entry_index idx = *head;
         texcache_entry_index next;
         do {
-            next = texcache_active_list[idx].next;
+            next = CHAIN_NEXT(idx);
             if( next == slot ) {
                 assert( idx != replace_next );
-                texcache_active_list[idx].next = replace_next;
+                CHAIN_NEXT(idx) = replace_next;
                 break;
             }
             idx = next;
         } while( next != EMPTY_ENTRY );
     }
+    CHAIN_NEXT(slot) = EMPTY_ENTRY; /* Just for safety */
+#undef CHAIN_NEXT
+}
+
+/**
+ * Remove the selected slot from all lookup tables. The caller is responsible
+ * for either reusing the slot or returning it to the free list.
+ */
+static void texcache_evict( int slot )
+{
+    texcache_entry_t entry = &texcache_active_list[slot];
+    assert( entry->texture_addr != -1 );
+    texcache_chain_remove( &texcache_page_lookup[entry->texture_addr >> 12], slot,
+                           offsetof(struct texcache_entry, next) );
+    texcache_chain_remove( &texcache_hash_table[texcache_hash(entry->poly2_mode, entry->tex_mode)],
+                           slot, offsetof(struct texcache_entry, hash_next) );
+    texcache_lru_unlink( slot );
+    entry->texture_addr = -1;
+    texcache_bytes -= entry->size;
+    if( entry->buffer != NULL ) {
+        texcache_release_render_buffer(entry->buffer);
+        entry->buffer = NULL;
+    }
+}
+
+static void texcache_free_slot( int slot )
+{
+    assert( texcache_free_ptr > 0 );
+    texcache_free_ptr--;
+    texcache_free_list[texcache_free_ptr] = slot;
 }
 
 /**
- * Evict a single texture from the cache.
+ * Evict the least recently used texture from the cache.
  * @return the slot of the evicted texture.
  */
 static texcache_entry_index texcache_evict_lru( void )
 {
-    /* Full table scan - take over the entry with the lowest lru value */
-    texcache_entry_index slot = 0;
-    int lru_value = texcache_active_list[0].lru_count;
-    int i;
-    for( i=1; i<MAX_TEXTURES; i++ ) {
-        /* FIXME: account for rollover */
-        if( texcache_active_list[i].lru_count < lru_value ) {
-            slot = i;
-            lru_value = texcache_active_list[i].lru_count;
-        }
-    }
+    texcache_entry_index slot = texcache_lru_head;
+    assert( slot != EMPTY_ENTRY );
     texcache_evict(slot);
-
+    texcache_stats.evictions++;
     return slot;
 }
 
 /**
- * Evict all textures contained in the page identified by a texture address.
+ * Evict textures in LRU order until the texture memory in use is within the
+ * configured limit. Textures used by the current scene are never evicted
+ * here, as their ids may already have been handed out for this scene.
+ */
+static void texcache_evict_to_limit( void )
+{
+    if( texcache_max_bytes != 0 ) {
+        while( texcache_bytes > texcache_max_bytes && texcache_lru_head != EMPTY_ENTRY &&
+                texcache_active_list[texcache_lru_head].scene != texcache_scene ) {
+            texcache_free_slot( texcache_evict_lru() );
+        }
+    }
+}
+
+/**
+ * Mark all textures contained in the page identified by a texture address as
+ * suspect. They'll be checked against the hash of their source data the next
+ * time they're used, and only reloaded if it has actually changed. Render
+ * buffers are evicted immediately, as before.
  */
 void texcache_invalidate_page( uint32_t texture_addr ) {
     uint32_t texture_page = texture_addr >> 12;
-    texcache_entry_index idx = texcache_page_lookup[texture_page];
-    if( idx == EMPTY_ENTRY )
+    texcache_entry_index idx, next;
+    if( texcache_page_suspect[texture_page] )
         return;
-    assert( texcache_free_ptr >= 0 );
-    do {
+    for( idx = texcache_page_lookup[texture_page]; idx != EMPTY_ENTRY; idx = next ) {
         texcache_entry_t entry = &texcache_active_list[idx];
-        entry->texture_addr = -1;
+        next = entry->next;
         if( entry->buffer != NULL ) {
-            texcache_release_render_buffer(entry->buffer);
-            entry->buffer = NULL;
+            texcache_evict( idx );
+            texcache_free_slot( idx );
+        } else {
+            entry->suspect = TRUE;
         }
-        /* release entry */
-        texcache_free_ptr--;
-        texcache_free_list[texcache_free_ptr] = idx;
-        idx = entry->next;
-        entry->next = EMPTY_ENTRY;
-    } while( idx != EMPTY_ENTRY );
-    texcache_page_lookup[texture_page] = EMPTY_ENTRY;
+    }
+    texcache_page_suspect[texture_page] = TRUE;
+}
+
+/**
+ * Hash count words of one VRAM bank
+ */
+static uint64_t texcache_hash_words( uint64_t hash, const uint32_t *data, uint32_t count )
+{
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    for( ; count >= 2; count -= 2, data += 2 ) {
+        uint64_t word = ((uint64_t)data[1] << 32) | data[0];
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    if( count ) {
+        hash = (hash ^ *data) * prime;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/**
+ * Hash the (64-bit) VRAM region [addr, addr+length). The two 32-bit banks
+ * are hashed separately, rounding out to whole 64-bit words, so this may
+ * cover a few bytes either side of the region.
+ */
+static uint64_t texcache_hash_vram( uint32_t addr, uint32_t length )
+{
+    uint32_t start, end;
+    if( addr + length > PVR2_RAM_SIZE ) {
+        length = PVR2_RAM_SIZE - addr;
+    }
+    start = addr >> 3;
+    end = (addr + length + 7) >> 3;
+    const uint32_t *bank0 = ((uint32_t *)pvr2_main_ram) + start;
+    uint64_t hash = texcache_hash_words( length, bank0, end - start );
+    return texcache_hash_words( hash, bank0 + (PVR2_RAM_SIZE>>3), end - start );
+}
+
+/**
+ * @return the 16-entry palette banks that a texture's texels are looked up
+ * in, or 0 if it isn't a palette texture.
+ */
+static uint64_t texcache_palette_banks( uint32_t tex_mode )
+{
+    switch( tex_mode & PVR2_TEX_FORMAT_MASK ) {
+    case PVR2_TEX_FORMAT_IDX4:
+        return ((uint64_t)1) << ((tex_mode >> 21) & 0x3F);
+    case PVR2_TEX_FORMAT_IDX8:
+        return ((uint64_t)0xFFFF) << (((tex_mode >> 25) & 0x03) << 4);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @return the texture word as used to identify the texture in the cache.
+ * With the palette shader, palette textures hold raw indexes and so can be
+ * shared between palette banks; otherwise the bank is part of the texture.
+ */
+static inline uint32_t texcache_lookup_word( uint32_t texture_word )
+{
+    if( texcache_have_palette_shader && PVR2_TEX_IS_PALETTE(texture_word) ) {
+        return texture_word & 0xF81FFFFF; /* Mask out the bank bits */
+    }
+    return texture_word;
 }
 
 /**
  * Load the palette into 4 textures of 256 entries each. This mirrors the
  * banking done by the PVR2 for 8-bit textures, and also ensures that we
- * can use 8-bit paletted textures ourselves.
+ * can use 8-bit paletted textures ourselves. Unless the format has changed,
+ * only the span of entries covering the dirty banks is uploaded.
  */
 static void texcache_load_palette_texture( gboolean format_changed )
 {
     GLint format, type, intFormat = GL_RGBA;
-    unsigned i;
+    unsigned i, first = 0, count = 1024;
     int bpp = 2;
     uint32_t *palette = (uint32_t *)mmio_region_PVR2PAL.mem;
     uint16_t packed_palette[1024];
     unsigned char *data = (unsigned char *)palette;
 
+    if( !format_changed ) {
+        unsigned last = 63;
+        while( !(texcache_palette_dirty & (((uint64_t)1) << (first >> 4))) ) {
+            first += 16;
+        }
+        while( !(texcache_palette_dirty & (((uint64_t)1) << last)) ) {
+            last--;
+        }
+        count = ((last + 1) << 4) - first;
+    }
+
     switch( texcache_palette_mode ) {
     case 0: /* ARGB1555 */
         format = GL_BGRA;
@@ -287,7 +530,7 @@ static void texcache_load_palette_texture( gboolean format_changed )
     }
 
     if( bpp == 2 ) {
-        for( i=0; i<1024; i++ ) {
+        for( i=first; i<first+count; i++ ) {
             packed_palette[i] = (uint16_t)palette[i];
         }
         data = (unsigned char *)packed_palette;
@@ -297,29 +540,29 @@ static void texcache_load_palette_texture( gboolean format_changed )
     if( format_changed )
         glTexImage2DBGRA(0, intFormat, 1024, 1, format, type, data, data == (unsigned char *)palette );
     else
-        glTexSubImage2DBGRA(0, 0, 0, 1024, 1, format, type, data, data == (unsigned char *)palette);
+        glTexSubImage2DBGRA(0, first, 0, count, 1, format, type, data + first*bpp,
+                            data == (unsigned char *)palette);
     glActiveTexture(GL_TEXTURE0);
-    texcache_palette_valid = TRUE;
+    texcache_palette_dirty = 0;
 }
 
 
 /**
- * Mark the palette as having changed. If we have palette support (via shaders)
- * we just flag the palette, otherwise we have to invalidate all palette
- * textures.
+ * Mark palette banks as having changed. If we have palette support (via
+ * shaders) we just flag the banks for upload, otherwise we have to
+ * invalidate the textures that were decoded with any of them.
  */
-void texcache_invalidate_palette( )
+void texcache_invalidate_palette( uint64_t banks )
 {
     if( texcache_have_palette_shader ) {
-        texcache_palette_valid = FALSE;
+        texcache_palette_dirty |= banks;
     } else {
         int i;
-        for( i=0; i<MAX_TEXTURES; i++ ) {
+        for( i=0; i<texcache_size; i++ ) {
             if( texcache_active_list[i].texture_addr != -1 &&
-                    PVR2_TEX_IS_PALETTE(texcache_active_list[i].tex_mode) ) {
+                    (texcache_active_list[i].palette_banks & banks) != 0 ) {
                 texcache_evict( i );
-                texcache_free_ptr--;
-                texcache_free_list[texcache_free_ptr] = i;
+                texcache_free_slot( i );
             }
         }
     }
@@ -331,12 +574,11 @@ void texcache_invalidate_palette( )
 void texcache_invalidate_stride( )
 {
     int i;
-    for( i=0; i<MAX_TEXTURES; i++ ) {
+    for( i=0; i<texcache_size; i++ ) {
         if( texcache_active_list[i].texture_addr != -1 &&
                 PVR2_TEX_IS_STRIDE(texcache_active_list[i].tex_mode) ) {
             texcache_evict( i );
-            texcache_free_ptr--;
-            texcache_free_list[texcache_free_ptr] = i;
+            texcache_free_slot( i );
         }
     }
 }
@@ -344,8 +586,26 @@ void texcache_invalidate_stride( )
 void texcache_begin_scene( uint32_t palette_mode, uint32_t stride )
 {
     gboolean format_changed = FALSE;
+
+    if( texcache_stats.hits + texcache_stats.misses != 0 ) {
+        DEBUG( "Texcache: %u hits (%u revalidated, %u changed), %u misses, %u evictions, %u prefetched (%d/%u textures, %uKB)",
+               texcache_stats.hits, texcache_stats.revalidated, texcache_stats.reloaded,
+               texcache_stats.misses, texcache_stats.evictions, texcache_stats.prefetched,
+               texcache_size - texcache_free_ptr, texcache_size, (unsigned)(texcache_bytes >> 10) );
+    }
+    memset( &texcache_stats, 0, sizeof(texcache_stats) );
+    texcache_scene++;
+    texcache_release_staged();
+
+    if( texcache_want_size != texcache_size && texcache_have_gl ) {
+        /* Resize requested - reallocate everything */
+        texcache_gl_shutdown();
+        texcache_alloc( texcache_want_size );
+        texcache_gl_init();
+        format_changed = TRUE;
+    }
     if( palette_mode != texcache_palette_mode ) {
-        texcache_invalidate_palette();
+        texcache_invalidate_palette( PVR2_PALETTE_ALL_BANKS );
         format_changed = TRUE;
     }
     if( stride != texcache_stride_width )
@@ -354,7 +614,7 @@ void texcache_begin_scene( uint32_t palette_mode, uint32_t stride )
     texcache_palette_mode = palette_mode;
     texcache_stride_width = stride;
 
-    if( !texcache_palette_valid && texcache_have_palette_shader )
+    if( texcache_palette_dirty != 0 && texcache_have_palette_shader )
         texcache_load_palette_texture(format_changed);
 }
 
@@ -426,22 +686,6 @@ static void vq_get_codebook( struct vq_codebook *codebook,
     }
 }    
 
-static void vq_decode( uint16_t *output, unsigned char *input, int width, int height, 
-                       struct vq_codebook *codebook ) {
-    int i,j;
-
-    uint8_t *c = (uint8_t *)input;
-    for( j=0; j<height; j+=2 ) {
-        for( i=0; i<width; i+=2 ) {
-            uint8_t code = *c++;
-            output[i + j*width] = codebook->quad[code][0];
-            output[i + 1 + j*width] = codebook->quad[code][1];
-            output[i + (j+1)*width] = codebook->quad[code][2];
-            output[i + 1 + (j+1)*width] = codebook->quad[code][3];
-        }
-    }
-}
-
 static inline uint32_t yuv_to_rgb32( float y, float u, float v )
 {
     u -= 128;
@@ -480,11 +724,76 @@ static void yuv_decode( uint32_t *output, uint32_t *input, int width, int height
 }
 
 /**
- * Load texture data from the given address and parameters into the currently
- * bound OpenGL texture.
+ * Mipmapped textures are stored smallest level first.
+ * @return the offset in bytes from the start of the texture data (after any
+ * VQ codebook) to the top (width x width) level.
  */
-static void texcache_load_texture( uint32_t texture_addr, int width, int height,
-                                   int mode ) {
+static uint32_t texcache_mipmap_offset( int mode, int width )
+{
+    int tex_format = mode & PVR2_TEX_FORMAT_MASK;
+    uint32_t src_offset = 0;
+    int level = 0;
+    while( (1<<level) < width ) {
+        level++;
+        src_offset += ((width>>level)*(width>>level));
+    }
+    if( width != 1 ) {
+        src_offset += 3;
+    }
+    if( PVR2_TEX_IS_COMPRESSED(mode) ) {
+        src_offset >>= 2;
+    } else if( tex_format == PVR2_TEX_FORMAT_IDX4 ) {
+        src_offset >>= 1;
+    } else if( tex_format != PVR2_TEX_FORMAT_IDX8 ) {
+        src_offset <<= 1; /* 16-bit texels (including YUV) */
+    }
+    return src_offset;
+}
+
+#define TEXCACHE_MAX_LEVELS 11 /* 1024x1024 down to 1x1 */
+
+/**
+ * A texture decoded into system RAM, ready to be passed to GL.
+ */
+struct texcache_image {
+    GLint intFormat, format, type;
+    GLint min_filter, max_filter;
+    int level_count;
+    struct {
+        int width, height;
+        size_t offset; /* of the level's texels in data */
+    } level[TEXCACHE_MAX_LEVELS];
+    unsigned char *data; /* Decoded texels, followed by scratch space */
+    size_t data_size;    /* Allocated size of data */
+};
+
+/**
+ * Ensure the image buffer has room for at least size bytes. The buffer is
+ * kept between uses, so this only allocates when a larger texture is seen.
+ */
+static void texcache_image_reserve( struct texcache_image *image, size_t size )
+{
+    if( image->data_size < size ) {
+        g_free( image->data );
+        image->data = g_malloc( size );
+        image->data_size = size;
+    }
+}
+
+static void texcache_image_release( struct texcache_image *image )
+{
+    g_free( image->data );
+    image->data = NULL;
+    image->data_size = 0;
+}
+
+/**
+ * Decode texture data from the given address and parameters into image.
+ * Doesn't call GL, so this may be run from any thread.
+ * @return FALSE if the texture format isn't supported.
+ */
+static gboolean texcache_decode_image( struct texcache_image *image, uint32_t texture_addr,
+                                       int width, int height, int mode ) {
     int bpp_shift = 1; /* bytes per (output) pixel as a power of 2 */
     GLint intFormat = GL_RGBA, format, type;
     int tex_format = mode & PVR2_TEX_FORMAT_MASK;
@@ -528,7 +837,7 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
                 bpp_shift = 2;
                 break;
             default:
-                return; /* Can't happen, but it makes gcc stop complaining */
+                return FALSE; /* Can't happen, but it makes gcc stop complaining */
             }
         }
         break;
@@ -557,63 +866,67 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
             break;
         case PVR2_TEX_FORMAT_BUMPMAP:
             WARN( "Bumpmap not supported" );
-            return;
+            return FALSE;
     }
 
+    image->intFormat = intFormat;
+    image->format = format;
+    image->type = type;
+    image->max_filter = max_filter;
+    if( PVR2_TEX_IS_MIPMAPPED(mode) ) {
+        height = width; /* Mipmapped textures are always square */
+    }
+
+    /* Room for all levels (which total less than twice the top level), plus
+     * scratch space for the largest source level (at most 16 bits/texel) */
+    size_t dest_total = ((width*height) << (bpp_shift+1)) + (16 << bpp_shift);
+    texcache_image_reserve( image, dest_total + ((width*height) << 1) );
+    unsigned char *tmp = image->data + dest_total;
+
     if( PVR2_TEX_IS_STRIDE(mode) && tex_format != PVR2_TEX_FORMAT_IDX4 &&
             tex_format != PVR2_TEX_FORMAT_IDX8 ) {
         /* Stride textures cannot be mip-mapped, compressed, indexed or twiddled */
-        unsigned char data[(width*height) << bpp_shift];
+        unsigned char *data = image->data;
         if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
-            unsigned char tmp[(width*height)<<1];
             pvr2_vram64_read_stride( tmp, width<<1, texture_addr, texcache_stride_width<<1, height );
             yuv_decode( (uint32_t *)data, (uint32_t *)tmp, width, height );
         } else {
             pvr2_vram64_read_stride( data, width<<bpp_shift, texture_addr, texcache_stride_width<<bpp_shift, height );
         }
-        glTexImage2DBGRA( 0, intFormat, width, height, format, type, data, FALSE );
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, max_filter);
-        return;
+        image->level_count = 1;
+        image->level[0].width = width;
+        image->level[0].height = height;
+        image->level[0].offset = 0;
+        image->min_filter = min_filter;
+        return TRUE;
     } 
 
     if( PVR2_TEX_IS_COMPRESSED(mode) ) {
-        uint16_t tmp[VQ_CODEBOOK_SIZE];
-        pvr2_vram64_read( (unsigned char *)tmp, texture_addr, VQ_CODEBOOK_SIZE );
+        uint16_t cb[VQ_CODEBOOK_SIZE];
+        pvr2_vram64_read( (unsigned char *)cb, texture_addr, VQ_CODEBOOK_SIZE );
         texture_addr += VQ_CODEBOOK_SIZE;
-        vq_get_codebook( &codebook, tmp );
+        vq_get_codebook( &codebook, cb );
     }
 
     int level=0, last_level = 0, mip_width = width, mip_height = height, src_bytes, dest_bytes;
+    size_t offset = 0;
     if( PVR2_TEX_IS_MIPMAPPED(mode) ) {
-        uint32_t src_offset = 0;
         min_filter = mipmapfilter;
         mip_height = height = width;
         while( (1<<last_level) < width ) {
             last_level++;
-            src_offset += ((width>>last_level)*(width>>last_level));
-        }
-        if( width != 1 ) {
-            src_offset += 3;
         }
-        if( PVR2_TEX_IS_COMPRESSED(mode) ) {
-            src_offset >>= 2;
-        } else if( tex_format == PVR2_TEX_FORMAT_IDX4 ) {
-            src_offset >>= 1;
-        } else if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
-            src_offset <<= 1;
-        } else if( tex_format != PVR2_TEX_FORMAT_IDX8 ) {
-            src_offset <<= bpp_shift;
-        }
-        texture_addr += src_offset;
+        texture_addr += texcache_mipmap_offset( mode, width );
     }
+    image->min_filter = min_filter;
+    image->level_count = last_level + 1;
 
 
     dest_bytes = (mip_width * mip_height) << bpp_shift;
     src_bytes = dest_bytes; // Modes will change this (below)
 
     for( level=0; level<= last_level; level++ ) {
-        unsigned char data[dest_bytes];
+        unsigned char *data = image->data + offset;
         /* load data from image, detwiddling/uncompressing as required */
         if( tex_format == PVR2_TEX_FORMAT_IDX8 ) {
             if( texcache_have_palette_shader ) {
@@ -622,7 +935,6 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
                 src_bytes = (mip_width * mip_height);
                 int bank = (mode >> 25) &0x03;
                 uint32_t *palette = ((uint32_t *)mmio_region_PVR2PAL.mem) + (bank<<8);
-                unsigned char tmp[src_bytes];
                 pvr2_vram64_read_twiddled_8( tmp, texture_addr, mip_width, mip_height );
                 if( bpp_shift == 2 ) {
                     decode_pal8_to_32( (uint32_t *)data, tmp, src_bytes, palette );
@@ -632,7 +944,6 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
             }
         } else if( tex_format == PVR2_TEX_FORMAT_IDX4 ) {
             src_bytes = (mip_width * mip_height) >> 1;
-            unsigned char tmp[src_bytes];
             if( texcache_have_palette_shader ) {
                 pvr2_vram64_read_twiddled_4( tmp, texture_addr, mip_width, mip_height );
                 decode_pal4_to_pal8( data, tmp, src_bytes );
@@ -648,7 +959,6 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
             }
         } else if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
             src_bytes = ((mip_width*mip_height)<<1);
-            unsigned char tmp[src_bytes];
             if( PVR2_TEX_IS_TWIDDLED(mode) ) {
                 pvr2_vram64_read_twiddled_16( tmp, texture_addr, mip_width, mip_height );
             } else {
@@ -657,25 +967,26 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
             yuv_decode( (uint32_t *)data, (uint32_t *)tmp, mip_width, mip_height );
         } else if( PVR2_TEX_IS_COMPRESSED(mode) ) {
             src_bytes = ((mip_width*mip_height) >> 2);
-            unsigned char tmp[src_bytes];
             if( PVR2_TEX_IS_TWIDDLED(mode) ) {
                 pvr2_vram64_read_twiddled_8( tmp, texture_addr, mip_width>>1, mip_height>>1 );
             } else {
                 pvr2_vram64_read( tmp, texture_addr, src_bytes );
             }
-            vq_decode( (uint16_t *)data, tmp, mip_width, mip_height, &codebook );
+            pvr2_texture_decoder->vq_decode( (uint16_t *)data, tmp, mip_width, mip_height, codebook.quad );
         } else if( PVR2_TEX_IS_TWIDDLED(mode) ) {
             pvr2_vram64_read_twiddled_16( data, texture_addr, mip_width, mip_height );
         } else {
             pvr2_vram64_read( data, texture_addr, src_bytes );
         }
 
-        /* Pass to GL */
         if( level == last_level && level != 0 ) { /* 1x1 stored within a 2x2 */
-            glTexImage2DBGRA( level, intFormat, 1, 1, format, type,
-                    data + (3 << bpp_shift), FALSE );
+            image->level[level].width = image->level[level].height = 1;
+            image->level[level].offset = offset + (3 << bpp_shift);
         } else {
-            glTexImage2DBGRA( level, intFormat, mip_width, mip_height, format, type, data, FALSE );
+            image->level[level].width = mip_width;
+            image->level[level].height = mip_height;
+            image->level[level].offset = offset;
+            offset += dest_bytes;
             if( mip_width > 2 ) {
                 mip_width >>= 1;
                 mip_height >>= 1;
@@ -685,62 +996,473 @@ static void texcache_load_texture( uint32_t texture_addr, int width, int height,
             texture_addr -= src_bytes;
         }
     }
+    return TRUE;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, max_filter);
+/**
+ * Load a decoded image into the currently bound OpenGL texture.
+ */
+static void texcache_upload_image( struct texcache_image *image )
+{
+    int level;
+    for( level=0; level < image->level_count; level++ ) {
+        glTexImage2DBGRA( level, image->intFormat, image->level[level].width, image->level[level].height,
+                image->format, image->type, image->data + image->level[level].offset, FALSE );
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image->min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, image->max_filter);
 }
 
-static int texcache_find_texture_slot( uint32_t poly2_masked_word, uint32_t texture_word )
+/**
+ * Load texture data from the given address and parameters into the currently
+ * bound OpenGL texture.
+ */
+static void texcache_load_texture( uint32_t texture_addr, int width, int height,
+                                   int mode ) {
+    static struct texcache_image image;
+    if( texcache_decode_image( &image, texture_addr, width, height, mode ) ) {
+        texcache_upload_image( &image );
+    }
+}
+
+static inline uint32_t argb1555_to_argb8888( uint16_t v )
+{
+    uint32_t r = (v >> 10) & 0x1F, g = (v >> 5) & 0x1F, b = v & 0x1F;
+    return ((v & 0x8000) ? 0xFF000000 : 0) | (((r << 3) | (r >> 2)) << 16) |
+           (((g << 3) | (g >> 2)) << 8) | ((b << 3) | (b >> 2));
+}
+
+static inline uint32_t rgb565_to_argb8888( uint16_t v )
+{
+    uint32_t r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+    return 0xFF000000 | (((r << 3) | (r >> 2)) << 16) |
+           (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+}
+
+static inline uint32_t argb4444_to_argb8888( uint16_t v )
+{
+    return ((v & 0xF000) * 0x11000) | ((v & 0x0F00) * 0x1100) |
+           ((v & 0x00F0) * 0x110) | ((v & 0x000F) * 0x11);
+}
+
+/**
+ * Expand 16-bit texels (in one of the 16-bit texture formats) to 32-bit ARGB
+ */
+static void decode_16_to_argb( uint32_t *out, uint16_t *in, int count, int tex_format )
+{
+    int i;
+    switch( tex_format ) {
+    case PVR2_TEX_FORMAT_RGB565:
+        for( i=0; i<count; i++ )
+            *out++ = rgb565_to_argb8888( *in++ );
+        break;
+    case PVR2_TEX_FORMAT_ARGB4444:
+        for( i=0; i<count; i++ )
+            *out++ = argb4444_to_argb8888( *in++ );
+        break;
+    default:
+        for( i=0; i<count; i++ )
+            *out++ = argb1555_to_argb8888( *in++ );
+        break;
+    }
+}
+
+/**
+ * yuv_decode produces RGBA (for GL) - swap it around to ARGB
+ */
+static void yuv_decode_argb( uint32_t *output, uint32_t *input, int width, int height )
+{
+    int i, count = width*height;
+    yuv_decode( output, input, width, height );
+    for( i=0; i<count; i++ ) {
+        uint32_t v = output[i];
+        output[i] = (v & 0xFF00FF00) | ((v >> 16) & 0xFF) | ((v & 0xFF) << 16);
+    }
+}
+
+/**
+ * Convert the palette entries starting at first to 32-bit ARGB, according to
+ * the current palette mode.
+ */
+static void texcache_get_argb_palette( uint32_t *out, int first, int count )
+{
+    uint32_t *palette = ((uint32_t *)mmio_region_PVR2PAL.mem) + first;
+    int i;
+    for( i=0; i<count; i++ ) {
+        switch( texcache_palette_mode ) {
+        case 0: out[i] = argb1555_to_argb8888( (uint16_t)palette[i] ); break;
+        case 1: out[i] = rgb565_to_argb8888( (uint16_t)palette[i] ); break;
+        case 2: out[i] = argb4444_to_argb8888( (uint16_t)palette[i] ); break;
+        default: out[i] = palette[i]; break;
+        }
+    }
+}
+
+/**
+ * Decode a texture into 32-bit ARGB texels (ie BGRA8888 in memory), for
+ * rendering without GL. Only the top level of a mipmapped texture is decoded.
+ * Palette lookups use the palette and palette mode as at the last
+ * texcache_begin_scene().
+ * @param dest buffer for width*height texels. Note that mipmapped textures
+ * are always square (ie height == width).
+ */
+void texcache_decode_texture( uint32_t *dest, uint32_t texture_word, int width, int height )
 {
     uint32_t texture_addr = (texture_word & 0x000FFFFF)<<3;
-    uint32_t texture_page = texture_addr >> 12;
-    texcache_entry_index idx = texcache_page_lookup[texture_page];
+    int tex_format = texture_word & PVR2_TEX_FORMAT_MASK;
+    int count = width*height;
+    struct vq_codebook codebook;
+    uint32_t palette[256];
+    unsigned char *tmp;
+    int i;
+
+    if( tex_format == PVR2_TEX_FORMAT_BUMPMAP ) {
+        WARN( "Bumpmap not supported" );
+        for( i=0; i<count; i++ ) {
+            dest[i] = 0xFFFFFFFF;
+        }
+        return;
+    }
+
+    tmp = g_malloc( count << 1 ); /* Large enough for any source format */
+    if( PVR2_TEX_IS_STRIDE(texture_word) && !PVR2_TEX_IS_PALETTE(texture_word) ) {
+        pvr2_vram64_read_stride( tmp, width<<1, texture_addr, texcache_stride_width<<1, height );
+        if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
+            yuv_decode_argb( dest, (uint32_t *)tmp, width, height );
+        } else {
+            decode_16_to_argb( dest, (uint16_t *)tmp, count, tex_format );
+        }
+        g_free( tmp );
+        return;
+    }
+
+    if( PVR2_TEX_IS_COMPRESSED(texture_word) ) {
+        uint16_t cb[VQ_CODEBOOK_SIZE>>1];
+        pvr2_vram64_read( (unsigned char *)cb, texture_addr, VQ_CODEBOOK_SIZE );
+        texture_addr += VQ_CODEBOOK_SIZE;
+        vq_get_codebook( &codebook, cb );
+    }
+    if( PVR2_TEX_IS_MIPMAPPED(texture_word) ) {
+        texture_addr += texcache_mipmap_offset( texture_word, width );
+    }
+
+    if( tex_format == PVR2_TEX_FORMAT_IDX8 ) {
+        texcache_get_argb_palette( palette, ((texture_word >> 25) & 0x03) << 8, 256 );
+        pvr2_vram64_read_twiddled_8( tmp, texture_addr, width, height );
+        for( i=0; i<count; i++ ) {
+            dest[i] = palette[tmp[i]];
+        }
+    } else if( tex_format == PVR2_TEX_FORMAT_IDX4 ) {
+        texcache_get_argb_palette( palette, ((texture_word >> 21) & 0x3F) << 4, 16 );
+        pvr2_vram64_read_twiddled_4( tmp, texture_addr, width, height );
+        for( i=0; i<(count>>1); i++ ) {
+            *dest++ = palette[tmp[i] & 0x0F];
+            *dest++ = palette[tmp[i] >> 4];
+        }
+    } else if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
+        if( PVR2_TEX_IS_TWIDDLED(texture_word) ) {
+            pvr2_vram64_read_twiddled_16( tmp, texture_addr, width, height );
+        } else {
+            pvr2_vram64_read( tmp, texture_addr, count<<1 );
+        }
+        yuv_decode_argb( dest, (uint32_t *)tmp, width, height );
+    } else if( PVR2_TEX_IS_COMPRESSED(texture_word) ) {
+        uint16_t *texels = g_malloc( count << 1 );
+        if( PVR2_TEX_IS_TWIDDLED(texture_word) ) {
+            pvr2_vram64_read_twiddled_8( tmp, texture_addr, width>>1, height>>1 );
+        } else {
+            pvr2_vram64_read( tmp, texture_addr, count>>2 );
+        }
+        pvr2_texture_decoder->vq_decode( texels, tmp, width, height, codebook.quad );
+        decode_16_to_argb( dest, texels, count, tex_format );
+        g_free( texels );
+    } else {
+        if( PVR2_TEX_IS_TWIDDLED(texture_word) ) {
+            pvr2_vram64_read_twiddled_16( tmp, texture_addr, width, height );
+        } else {
+            pvr2_vram64_read( tmp, texture_addr, count<<1 );
+        }
+        decode_16_to_argb( dest, (uint16_t *)tmp, count, tex_format );
+    }
+    g_free( tmp );
+}
+
+/**
+ * Find the slot holding a texture, without marking it as used.
+ */
+static int texcache_lookup_texture_slot( uint32_t poly2_masked_word, uint32_t texture_word )
+{
+    texcache_entry_index idx = texcache_hash_table[texcache_hash(poly2_masked_word, texture_word)];
     while( idx != EMPTY_ENTRY ) {
         texcache_entry_t entry = &texcache_active_list[idx];
         if( entry->tex_mode == texture_word &&
                 entry->poly2_mode == poly2_masked_word ) {
-            entry->lru_count = texcache_ref_counter++;
             return idx;
         }
-        idx = entry->next;
+        idx = entry->hash_next;
     }
     return -1;
 }
 
+static int texcache_find_texture_slot( uint32_t poly2_masked_word, uint32_t texture_word )
+{
+    int idx = texcache_lookup_texture_slot( poly2_masked_word, texture_word );
+    if( idx != -1 ) {
+        if( idx != texcache_lru_tail ) {
+            texcache_lru_unlink( idx );
+            texcache_lru_append( idx );
+        }
+        texcache_active_list[idx].scene = texcache_scene;
+    }
+    return idx;
+}
+
 static int texcache_alloc_texture_slot( uint32_t poly2_word, uint32_t texture_word )
 {
     uint32_t texture_addr = (texture_word & 0x000FFFFF)<<3;
     uint32_t texture_page = texture_addr >> 12;
+    uint32_t hash = texcache_hash(poly2_word, texture_word);
     texcache_entry_index slot = 0;
 
-    if( texcache_free_ptr < MAX_TEXTURES ) {
+    if( texcache_free_ptr < texcache_size ) {
         slot = texcache_free_list[texcache_free_ptr++];
     } else {
         slot = texcache_evict_lru();
     }
 
     /* Construct new entry */
-    assert( texcache_active_list[slot].texture_addr == -1 );
-    texcache_active_list[slot].texture_addr = texture_addr;
-    texcache_active_list[slot].tex_mode = texture_word;
-    texcache_active_list[slot].poly2_mode = poly2_word;
-    texcache_active_list[slot].lru_count = texcache_ref_counter++;
-
-    /* Add entry to the lookup table */
-    int next = texcache_page_lookup[texture_page];
-    if( next == slot ) {
-        int i;
-        fprintf( stderr, "Active list: " );
-        for( i=0; i<MAX_TEXTURES; i++ ) {
-            fprintf( stderr, "%d, ", texcache_active_list[i].next );
+    texcache_entry_t entry = &texcache_active_list[slot];
+    assert( entry->texture_addr == -1 );
+    entry->texture_addr = texture_addr;
+    entry->tex_mode = texture_word;
+    entry->poly2_mode = poly2_word;
+    entry->scene = texcache_scene;
+    entry->size = 0;
+    entry->suspect = FALSE;
+    entry->palette_banks = texcache_have_palette_shader ? 0 : texcache_palette_banks( texture_word );
+
+    /* Add entry to the lookup tables */
+    assert( texcache_page_lookup[texture_page] != slot );
+    entry->next = texcache_page_lookup[texture_page];
+    texcache_page_lookup[texture_page] = slot;
+    texcache_page_suspect[texture_page] = FALSE;
+    entry->hash_next = texcache_hash_table[hash];
+    texcache_hash_table[hash] = slot;
+    texcache_lru_append( slot );
+    return slot;
+}
+
+/**
+ * @return the number of bytes of (64-bit) VRAM read by texcache_load_texture
+ * for the given texture.
+ */
+static uint32_t texcache_source_size( int width, int height, int mode )
+{
+    int tex_format = mode & PVR2_TEX_FORMAT_MASK;
+    uint32_t size = 0, texels;
+
+    if( PVR2_TEX_IS_STRIDE(mode) && tex_format != PVR2_TEX_FORMAT_IDX4 &&
+            tex_format != PVR2_TEX_FORMAT_IDX8 ) {
+        return ((texcache_stride_width * (height-1)) + width) << 1;
+    }
+    if( PVR2_TEX_IS_COMPRESSED(mode) ) {
+        size += VQ_CODEBOOK_SIZE;
+    }
+    if( PVR2_TEX_IS_MIPMAPPED(mode) ) {
+        height = width;
+        size += texcache_mipmap_offset( mode, width );
+    }
+    texels = width * height;
+    if( PVR2_TEX_IS_COMPRESSED(mode) ) {
+        size += texels >> 2;
+    } else if( tex_format == PVR2_TEX_FORMAT_IDX4 ) {
+        size += texels >> 1;
+    } else if( tex_format == PVR2_TEX_FORMAT_IDX8 ) {
+        size += texels;
+    } else {
+        size += texels << 1;
+    }
+    return size;
+}
+
+/**
+ * Estimate the amount of texture memory used by a texture, as loaded by
+ * texcache_load_texture
+ */
+static uint32_t texcache_texture_size( int width, int height, int mode )
+{
+    int tex_format = mode & PVR2_TEX_FORMAT_MASK;
+    uint32_t size = width * height;
+
+    if( tex_format == PVR2_TEX_FORMAT_IDX4 || tex_format == PVR2_TEX_FORMAT_IDX8 ) {
+        if( !texcache_have_palette_shader ) {
+            size <<= (texcache_palette_mode == 3 ? 2 : 1);
         }
-        fprintf( stderr, "\n" );
-        assert( next != slot );
+    } else if( tex_format == PVR2_TEX_FORMAT_YUV422 ) {
+        size <<= 2;
+    } else {
+        size <<= 1;
+    }
+    if( PVR2_TEX_IS_MIPMAPPED(mode) && !PVR2_TEX_IS_STRIDE(mode) ) {
+        size += size/3;
+    }
+    return size;
+}
+
+/**
+ * Textures decoded ahead of use by texcache_prefetch_textures, sorted by key
+ * (masked texture word and poly2 word). The image buffers are kept between
+ * scenes for reuse.
+ */
+struct texcache_staged {
+    uint64_t key;
+    uint32_t texture_word;  /* Unmasked texture word */
+    gboolean have_old_hash; /* A suspect copy of the texture was in the cache */
+    uint64_t old_hash;
+    uint64_t data_hash;
+    gboolean decoded;
+    struct texcache_image image;
+};
+
+/* Maximum (estimated) size of the textures decoded by one prefetch - any
+ * more will be decoded on demand instead */
+#define TEXCACHE_PREFETCH_MAX_BYTES (64*1024*1024)
+/* Maximum size of the staging buffers kept between scenes */
+#define TEXCACHE_STAGING_KEEP_BYTES (32*1024*1024)
+
+static struct texcache_staged *texcache_staged = NULL;
+static unsigned int texcache_staged_count = 0;
+static unsigned int texcache_staged_size = 0;
+
+struct texcache_prefetch_key {
+    uint64_t key;
+    unsigned int order;
+    uint32_t texture_word;
+};
+
+static inline uint64_t texcache_key( uint32_t poly2_masked_word, uint32_t texture_lookup )
+{
+    return (((uint64_t)texture_lookup) << 32) | poly2_masked_word;
+}
 
+static int texcache_prefetch_key_compare( const void *a, const void *b )
+{
+    const struct texcache_prefetch_key *ka = a, *kb = b;
+    if( ka->key != kb->key ) {
+        return ka->key < kb->key ? -1 : 1;
     }
-    texcache_active_list[slot].next = next;
-    texcache_page_lookup[texture_page] = slot;
-    return slot;
+    return ka->order < kb->order ? -1 : (ka->order > kb->order);
+}
+
+/**
+ * Finish with the staged textures of the last scene, and trim the staging
+ * buffers if they've grown too large.
+ */
+static void texcache_release_staged( void )
+{
+    size_t total = 0;
+    unsigned int i;
+    texcache_staged_count = 0;
+    for( i=0; i<texcache_staged_size; i++ ) {
+        total += texcache_staged[i].image.data_size;
+        if( total > TEXCACHE_STAGING_KEEP_BYTES ) {
+            texcache_image_release( &texcache_staged[i].image );
+        }
+    }
+}
+
+static struct texcache_staged *texcache_find_staged( uint32_t poly2_masked_word, uint32_t texture_lookup )
+{
+    uint64_t key = texcache_key( poly2_masked_word, texture_lookup );
+    unsigned int lo = 0, hi = texcache_staged_count;
+    while( lo < hi ) {
+        unsigned int mid = (lo + hi) >> 1;
+        if( texcache_staged[mid].key < key ) {
+            lo = mid + 1;
+        } else if( texcache_staged[mid].key > key ) {
+            hi = mid;
+        } else {
+            return &texcache_staged[mid];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Work item for prefetching: hash one staged texture, and decode it unless
+ * it's a suspect texture that turns out to be unchanged.
+ */
+static void texcache_prefetch_texture( void *data, unsigned int item, unsigned int thread )
+{
+    struct texcache_staged *staged = &texcache_staged[item];
+    uint32_t poly2_word = (uint32_t)staged->key;
+    uint32_t texture_word = staged->texture_word;
+    uint32_t texture_addr = (texture_word & 0x000FFFFF)<<3;
+    unsigned width = POLY2_TEX_WIDTH(poly2_word);
+    unsigned height = POLY2_TEX_HEIGHT(poly2_word);
+
+    staged->data_hash = texcache_hash_vram( texture_addr, texcache_source_size( width, height, texture_word ) );
+    if( staged->have_old_hash && staged->old_hash == staged->data_hash ) {
+        staged->decoded = FALSE;
+    } else {
+        staged->decoded = texcache_decode_image( &staged->image, texture_addr, width, height, texture_word );
+    }
+}
+
+void texcache_prefetch_textures( const uint32_t *words, unsigned int count )
+{
+    struct texcache_prefetch_key *keys;
+    size_t total_bytes = 0;
+    unsigned int i;
+
+    texcache_release_staged();
+    if( count == 0 )
+        return;
+
+    keys = g_malloc( count * sizeof(struct texcache_prefetch_key) );
+    for( i=0; i<count; i++ ) {
+        uint32_t poly2_word = words[i<<1] & 0x000F803F;
+        uint32_t texture_lookup = texcache_lookup_word( words[(i<<1)+1] );
+        keys[i].key = texcache_key( poly2_word, texture_lookup );
+        keys[i].order = i;
+        keys[i].texture_word = words[(i<<1)+1];
+    }
+    /* Sorting by request order within each key keeps the first request for
+     * each texture, which is the one that would be loaded on demand */
+    qsort( keys, count, sizeof(struct texcache_prefetch_key), texcache_prefetch_key_compare );
+
+    for( i=0; i<count; i++ ) {
+        if( i > 0 && keys[i].key == keys[i-1].key )
+            continue;
+        uint32_t poly2_word = (uint32_t)keys[i].key;
+        uint32_t texture_lookup = (uint32_t)(keys[i].key >> 32);
+        int slot = texcache_lookup_texture_slot( poly2_word, texture_lookup );
+        if( slot != -1 && !texcache_active_list[slot].suspect )
+            continue; /* Already loaded */
+
+        unsigned width = POLY2_TEX_WIDTH(poly2_word);
+        unsigned height = POLY2_TEX_HEIGHT(poly2_word);
+        total_bytes += texcache_texture_size( width, height, keys[i].texture_word ) * 2 + ((width*height)<<1);
+        if( total_bytes > TEXCACHE_PREFETCH_MAX_BYTES )
+            break;
+
+        if( texcache_staged_count == texcache_staged_size ) {
+            unsigned int new_size = texcache_staged_size == 0 ? 64 : texcache_staged_size*2;
+            texcache_staged = g_realloc( texcache_staged, new_size * sizeof(struct texcache_staged) );
+            memset( &texcache_staged[texcache_staged_size], 0,
+                    (new_size - texcache_staged_size) * sizeof(struct texcache_staged) );
+            texcache_staged_size = new_size;
+        }
+        struct texcache_staged *staged = &texcache_staged[texcache_staged_count++];
+        staged->key = keys[i].key;
+        staged->texture_word = keys[i].texture_word;
+        staged->have_old_hash = (slot != -1);
+        staged->old_hash = slot == -1 ? 0 : texcache_active_list[slot].data_hash;
+        staged->decoded = FALSE;
+    }
+    g_free( keys );
+
+    workpool_run( texcache_prefetch_texture, NULL, texcache_staged_count );
 }
 
 /**
@@ -756,45 +1478,82 @@ static int texcache_alloc_texture_slot( uint32_t poly2_word, uint32_t texture_wo
 GLuint texcache_get_texture( uint32_t poly2_word, uint32_t texture_word )
 {
     poly2_word &= 0x000F803F; /* Get just the texture-relevant bits */
-    uint32_t texture_lookup = texture_word;
-    if( PVR2_TEX_IS_PALETTE(texture_lookup) ) {
-        texture_lookup &= 0xF81FFFFF; /* Mask out the bank bits */
-    }
+    uint32_t texture_lookup = texcache_lookup_word( texture_word );
     int slot = texcache_find_texture_slot( poly2_word, texture_lookup );
-
-    if( slot == -1 ) {
-        /* Not found - check the free list */
-        slot = texcache_alloc_texture_slot( poly2_word, texture_lookup );
-        
-        /* Construct the GL texture */
-        uint32_t texture_addr = (texture_word & 0x000FFFFF)<<3;
-        unsigned width = POLY2_TEX_WIDTH(poly2_word);
-        unsigned height = POLY2_TEX_HEIGHT(poly2_word);
-
-        glBindTexture( GL_TEXTURE_2D, texcache_active_list[slot].texture_id );
-        glGetError();
-        texcache_load_texture( texture_addr, width, height, texture_word );
-        INFO( "Loaded texture %d: %x %dx%d %x (%x)", texcache_active_list[slot].texture_id, texture_addr, width, height, texture_word,
-                glGetError() );
-
-        /* Set texture parameters from the poly2 word */
-        if( POLY2_TEX_CLAMP_U(poly2_word) ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-        } else if( POLY2_TEX_MIRROR_U(poly2_word) ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT );
+    uint32_t texture_addr = (texture_word & 0x000FFFFF)<<3;
+    unsigned width = POLY2_TEX_WIDTH(poly2_word);
+    unsigned height = POLY2_TEX_HEIGHT(poly2_word);
+    uint64_t data_hash;
+    struct texcache_staged *staged;
+
+    if( slot != -1 ) {
+        texcache_entry_t entry = &texcache_active_list[slot];
+        texcache_stats.hits++;
+        if( !entry->suspect ) {
+            return entry->texture_id;
+        }
+        /* The page was written - check whether the texture actually changed */
+        entry->suspect = FALSE;
+        texcache_page_suspect[texture_addr >> 12] = FALSE;
+        staged = texcache_find_staged( poly2_word, texture_lookup );
+        if( staged != NULL ) {
+            data_hash = staged->data_hash;
         } else {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+            data_hash = texcache_hash_vram( texture_addr, texcache_source_size( width, height, texture_word ) );
         }
-        if( POLY2_TEX_CLAMP_V(poly2_word) ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-        } else if( POLY2_TEX_MIRROR_V(poly2_word) ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT );
+        if( data_hash == entry->data_hash ) {
+            texcache_stats.revalidated++;
+            return entry->texture_id;
+        }
+        texcache_stats.reloaded++;
+        texcache_bytes -= entry->size;
+    } else {
+        /* Not found - check the free list */
+        slot = texcache_alloc_texture_slot( poly2_word, texture_lookup );
+        texcache_stats.misses++;
+        staged = texcache_find_staged( poly2_word, texture_lookup );
+        if( staged != NULL ) {
+            data_hash = staged->data_hash;
         } else {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+            data_hash = texcache_hash_vram( texture_addr, texcache_source_size( width, height, texture_word ) );
         }
     }
 
-    return texcache_active_list[slot].texture_id;
+    /* Construct the GL texture, from the prefetched image if we have it */
+    texcache_entry_t entry = &texcache_active_list[slot];
+    glBindTexture( GL_TEXTURE_2D, entry->texture_id );
+    glGetError();
+    if( staged != NULL && staged->decoded ) {
+        texcache_upload_image( &staged->image );
+        texcache_stats.prefetched++;
+    } else {
+        texcache_load_texture( texture_addr, width, height, texture_word );
+    }
+    INFO( "Loaded texture %d: %x %dx%d %x (%x)", entry->texture_id, texture_addr, width, height, texture_word,
+            glGetError() );
+
+    /* Set texture parameters from the poly2 word */
+    if( POLY2_TEX_CLAMP_U(poly2_word) ) {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    } else if( POLY2_TEX_MIRROR_U(poly2_word) ) {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT );
+    } else {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+    }
+    if( POLY2_TEX_CLAMP_V(poly2_word) ) {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    } else if( POLY2_TEX_MIRROR_V(poly2_word) ) {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT );
+    } else {
+        glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    }
+
+    entry->data_hash = data_hash;
+    entry->size = texcache_texture_size( width, height, texture_word );
+    texcache_bytes += entry->size;
+    texcache_evict_to_limit();
+
+    return entry->texture_id;
 }
 
 #if 0
@@ -844,18 +1603,19 @@ render_buffer_t texcache_get_render_buffer( uint32_t texture_addr, int mode, int
 /**
  * Check the integrity of the texcache. Verifies that every cache slot
  * appears exactly once on either the free list or one page list. For 
- * active slots, the texture address must also match the page it appears on.
+ * active slots, the texture address must also match the page it appears on,
+ * and the slot must be on the matching hash chain and the lru list.
  * 
  */
 void texcache_integrity_check()
 {
     int i;
-    int slot_found[MAX_TEXTURES];
-
-    memset( slot_found, 0, sizeof(slot_found) );
+    int *slot_found = g_malloc0( texcache_size * sizeof(int) );
+    int active = 0, lru_count = 0;
+    size_t bytes = 0;
 
     /* Check entries on the free list */
-    for( i= texcache_free_ptr; i< MAX_TEXTURES; i++ ) {
+    for( i= texcache_free_ptr; i< texcache_size; i++ ) {
         int slot = texcache_free_list[i];
         assert( slot_found[slot] == 0 );
         assert( texcache_active_list[slot].next == EMPTY_ENTRY );
@@ -866,17 +1626,37 @@ void texcache_integrity_check()
     for( i=0; i< PVR2_RAM_PAGES; i++ ) {
         int slot = texcache_page_lookup[i];
         while( slot != EMPTY_ENTRY ) {
+            texcache_entry_t entry = &texcache_active_list[slot];
+            texcache_entry_index idx = texcache_hash_table[texcache_hash(entry->poly2_mode, entry->tex_mode)];
             assert( slot_found[slot] == 0 );
-            assert( (texcache_active_list[slot].texture_addr >> 12) == i );
+            assert( (entry->texture_addr >> 12) == i );
+            while( idx != slot ) {
+                assert( idx != EMPTY_ENTRY );
+                idx = texcache_active_list[idx].hash_next;
+            }
             slot_found[slot] = 2;
-            slot = texcache_active_list[slot].next;
+            bytes += entry->size;
+            active++;
+            slot = entry->next;
         }
     }
+    assert( active == texcache_free_ptr );
+    assert( bytes == texcache_bytes );
+
+    /* Check the lru list covers exactly the active entries */
+    for( i=texcache_lru_head; i != EMPTY_ENTRY; i = texcache_active_list[i].lru_next ) {
+        assert( slot_found[i] == 2 );
+        assert( texcache_active_list[i].lru_next != EMPTY_ENTRY ||
+                i == texcache_lru_tail );
+        lru_count++;
+    }
+    assert( lru_count == active );
 
     /* Make sure we didn't miss any entries */
-    for( i=0; i<MAX_TEXTURES; i++ ) {
+    for( i=0; i<texcache_size; i++ ) {
         assert( slot_found[i] != 0 );
     }
+    g_free( slot_found );
 }
 
 /**
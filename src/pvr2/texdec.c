@@ -0,0 +1,747 @@
+/**
+ * $Id$
+ *
+ * PVR2 texture decoding kernels. The scalar decoder is the original
+ * recursive implementation, and is kept as the reference for the others.
+ *
+ * Twiddled textures store the texel at (x,y) of a square power-of-2 block
+ * at the index formed by interleaving the bits of x and y (with y in the
+ * low bit); rectangular textures are a sequence of such blocks along the
+ * longer dimension. The table-driven decoder splits that index into
+ * per-column and per-row parts, which can be added together since their
+ * bits never overlap. The 64-bit address space puts bit 2 of the address
+ * into the bank select and shifts the higher bits down by one, which also
+ * acts on each bit independently - so for a texture starting on a 64-bit
+ * boundary the VRAM offset of each texel is also just the sum of a column
+ * and a row offset.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "pvr2/texdec.h"
+
+/* As for the vertex decoders, the SIMD kernels use per-function target
+ * attributes so that they can be built regardless of the compiler's default
+ * target and selected at runtime. */
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define TEXDEC_X86 1
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+#define VRAM_BANK_SIZE 0x400000 /* Each of the two 32-bit banks */
+
+texture_decoder_t pvr2_texture_decoder = &texture_decoder_scalar;
+
+/*************************** Scalar implementation ***************************/
+
+/**
+ * @param dest Destination image buffer
+ * @param banks Source data expressed as two bank pointers
+ * @param offset Offset into banks[0] specifying where the next byte
+ *  to read is (0..3)
+ * @param x1,y1 Destination coordinates
+ * @param width Width of current destination block
+ * @param stride Total width of image (ie stride) in bytes
+ */
+static void scalar_detwiddle_4( uint8_t *dest, const uint8_t *banks[2], int offset,
+                                int x1, int y1, int width, int stride )
+{
+    if( width == 2 ) {
+        x1 = x1 >> 1;
+        uint8_t t1 = *banks[offset<4?0:1]++;
+        uint8_t t2 = *banks[offset<3?0:1]++;
+        dest[y1*stride + x1] = (t1 & 0x0F) | (t2<<4);
+        dest[(y1+1)*stride + x1] = (t1>>4) | (t2&0xF0);
+    } else if( width == 4 ) {
+        scalar_detwiddle_4( dest, banks, offset, x1, y1, 2, stride );
+        scalar_detwiddle_4( dest, banks, offset+2, x1, y1+2, 2, stride );
+        scalar_detwiddle_4( dest, banks, offset+4, x1+2, y1, 2, stride );
+        scalar_detwiddle_4( dest, banks, offset+6, x1+2, y1+2, 2, stride );
+
+    } else {
+        int subdivide = width >> 1;
+        scalar_detwiddle_4( dest, banks, offset, x1, y1, subdivide, stride );
+        scalar_detwiddle_4( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
+        scalar_detwiddle_4( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
+        scalar_detwiddle_4( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
+    }
+}
+
+/**
+ * @param dest Destination image buffer
+ * @param banks Source data expressed as two bank pointers
+ * @param offset Offset into banks[0] specifying where the next byte
+ *  to read is (0..3)
+ * @param x1,y1 Destination coordinates
+ * @param width Width of current destination block
+ * @param stride Total width of image (ie stride)
+ */
+static void scalar_detwiddle_8( uint8_t *dest, const uint8_t *banks[2], int offset,
+                                int x1, int y1, int width, int stride )
+{
+    if( width == 2 ) {
+        dest[y1*stride + x1] = *banks[0]++;
+        dest[(y1+1)*stride + x1] = *banks[offset<3?0:1]++;
+        dest[y1*stride + x1 + 1] = *banks[offset<2?0:1]++;
+        dest[(y1+1)*stride + x1 + 1] = *banks[offset==0?0:1]++;
+        const uint8_t *tmp = banks[0]; /* swap banks */
+        banks[0] = banks[1];
+        banks[1] = tmp;
+    } else {
+        int subdivide = width >> 1;
+        scalar_detwiddle_8( dest, banks, offset, x1, y1, subdivide, stride );
+        scalar_detwiddle_8( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
+        scalar_detwiddle_8( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
+        scalar_detwiddle_8( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
+    }
+}
+
+/**
+ * @param dest Destination image buffer
+ * @param banks Source data expressed as two bank pointers
+ * @param offset Offset into banks[0] specifying where the next word
+ *  to read is (0 or 1)
+ * @param x1,y1 Destination coordinates
+ * @param width Width of current destination block
+ * @param stride Total width of image (ie stride)
+ */
+static void scalar_detwiddle_16( uint16_t *dest, const uint16_t *banks[2], int offset,
+                                 int x1, int y1, int width, int stride )
+{
+    if( width == 2 ) {
+        dest[y1*stride + x1] = *banks[0]++;
+        dest[(y1+1)*stride + x1] = *banks[offset]++;
+        dest[y1*stride + x1 + 1] = *banks[1]++;
+        dest[(y1+1)*stride + x1 + 1] = *banks[offset^1]++;
+    } else {
+        int subdivide = width >> 1;
+        scalar_detwiddle_16( dest, banks, offset, x1, y1, subdivide, stride );
+        scalar_detwiddle_16( dest, banks, offset, x1, y1+subdivide, subdivide, stride );
+        scalar_detwiddle_16( dest, banks, offset, x1+subdivide, y1, subdivide, stride );
+        scalar_detwiddle_16( dest, banks, offset, x1+subdivide, y1+subdivide, subdivide, stride );
+    }
+}
+
+static gboolean texture_decoder_scalar_is_supported( void )
+{
+    return TRUE;
+}
+
+static void scalar_read_twiddled_4( unsigned char *dest, const unsigned char *vram,
+                                    uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    int offset_flag = (srcaddr & 0x07);
+    const uint8_t *banks[2];
+    uint8_t *wdest = (uint8_t*)dest;
+    uint32_t stride = width >> 1;
+    int i;
+
+    srcaddr = srcaddr & 0x7FFFF8;
+
+    banks[0] = (const uint8_t *)(vram + (srcaddr>>1));
+    banks[1] = banks[0] + VRAM_BANK_SIZE;
+    if( offset_flag & 0x04 ) { // If source is not 64-bit aligned, swap the banks
+        const uint8_t *tmp = banks[0];
+        banks[0] = banks[1];
+        banks[1] = tmp + 4;
+        offset_flag &= 0x03;
+    }
+    banks[0] += offset_flag;
+
+    if( width > height ) {
+        for( i=0; i<width; i+=height ) {
+            scalar_detwiddle_4( wdest, banks, offset_flag, i, 0, height, stride );
+        }
+    } else if( height > width ) {
+        for( i=0; i<height; i+=width ) {
+            scalar_detwiddle_4( wdest, banks, offset_flag, 0, i, width, stride );
+        }
+    } else if( width == 1 ) {
+        *wdest = *banks[0];
+    } else {
+        scalar_detwiddle_4( wdest, banks, offset_flag, 0, 0, width, stride );
+    }
+}
+
+static void scalar_read_twiddled_8( unsigned char *dest, const unsigned char *vram,
+                                    uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    int offset_flag = (srcaddr & 0x07);
+    const uint8_t *banks[2];
+    uint8_t *wdest = (uint8_t*)dest;
+    int i;
+
+    srcaddr = srcaddr & 0x7FFFF8;
+
+    banks[0] = (const uint8_t *)(vram + (srcaddr>>1));
+    banks[1] = banks[0] + VRAM_BANK_SIZE;
+    if( offset_flag & 0x04 ) { // If source is not 64-bit aligned, swap the banks
+        const uint8_t *tmp = banks[0];
+        banks[0] = banks[1];
+        banks[1] = tmp + 4;
+        offset_flag &= 0x03;
+    }
+    banks[0] += offset_flag;
+
+    if( width > height ) {
+        for( i=0; i<width; i+=height ) {
+            scalar_detwiddle_8( wdest, banks, offset_flag, i, 0, height, width );
+        }
+    } else if( height > width ) {
+        for( i=0; i<height; i+=width ) {
+            scalar_detwiddle_8( wdest, banks, offset_flag, 0, i, width, width );
+        }
+    } else if( width == 1 ) {
+        *wdest = *banks[0];
+    } else {
+        scalar_detwiddle_8( wdest, banks, offset_flag, 0, 0, width, width );
+    }
+}
+
+static void scalar_read_twiddled_16( unsigned char *dest, const unsigned char *vram,
+                                     uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    int offset_flag = (srcaddr & 0x06) >> 1;
+    const uint16_t *banks[2];
+    uint16_t *wdest = (uint16_t*)dest;
+    int i;
+
+    srcaddr = srcaddr & 0x7FFFF8;
+
+    banks[0] = (const uint16_t *)(vram + (srcaddr>>1));
+    banks[1] = banks[0] + (VRAM_BANK_SIZE>>1);
+    if( offset_flag & 0x02 ) { // If source is not 64-bit aligned, swap the banks
+        const uint16_t *tmp = banks[0];
+        banks[0] = banks[1];
+        banks[1] = tmp + 2;
+        offset_flag &= 0x01;
+    }
+    banks[0] += offset_flag;
+
+
+    if( width > height ) {
+        for( i=0; i<width; i+=height ) {
+            scalar_detwiddle_16( wdest, banks, offset_flag, i, 0, height, width );
+        }
+    } else if( height > width ) {
+        for( i=0; i<height; i+=width ) {
+            scalar_detwiddle_16( wdest, banks, offset_flag, 0, i, width, width );
+        }
+    } else if( width == 1 ) {
+        *wdest = *banks[0];
+    } else {
+        scalar_detwiddle_16( wdest, banks, offset_flag, 0, 0, width, width );
+    }
+}
+
+static void scalar_vq_decode( uint16_t *output, const unsigned char *input, int width, int height,
+                              uint16_t codebook[256][4] )
+{
+    int i,j;
+
+    const uint8_t *c = (const uint8_t *)input;
+    for( j=0; j<height; j+=2 ) {
+        for( i=0; i<width; i+=2 ) {
+            uint8_t code = *c++;
+            output[i + j*width] = codebook[code][0];
+            output[i + 1 + j*width] = codebook[code][1];
+            output[i + (j+1)*width] = codebook[code][2];
+            output[i + 1 + (j+1)*width] = codebook[code][3];
+        }
+    }
+}
+
+struct texture_decoder texture_decoder_scalar = {
+        "scalar", texture_decoder_scalar_is_supported,
+        scalar_read_twiddled_4, scalar_read_twiddled_8, scalar_read_twiddled_16,
+        scalar_vq_decode };
+
+/************************ Table-driven implementation ************************/
+
+/**
+ * Spread the low 16 bits of x out to the even bit positions.
+ */
+static inline uint32_t twiddle_spread( uint32_t x )
+{
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+/**
+ * Compute the twiddled index of each column and row of a width x height
+ * texture, such that texel (x,y) is at index xidx[x] + yidx[y].
+ */
+static void twiddle_index_tables( uint32_t *xidx, uint32_t *yidx, uint32_t width, uint32_t height )
+{
+    uint32_t size = MIN(width, height), mask = size - 1, i;
+    for( i=0; i<width; i++ ) {
+        xidx[i] = (twiddle_spread(i & mask) << 1) + (width > height ? (i & ~mask) * size : 0);
+    }
+    for( i=0; i<height; i++ ) {
+        yidx[i] = twiddle_spread(i & mask) + (height > width ? (i & ~mask) * size : 0);
+    }
+}
+
+/**
+ * Map a byte offset in the 64-bit address space from a 64-bit aligned
+ * address to the corresponding offset in VRAM.
+ */
+static inline uint32_t vram64_offset( uint32_t offset )
+{
+    return ((offset >> 1) & ~3) | (offset & 3) | ((offset & 4) ? VRAM_BANK_SIZE : 0);
+}
+
+/**
+ * @return the VRAM offset of an arbitrary 64-bit address
+ */
+static inline uint32_t vram64_addr( uint32_t addr )
+{
+    return vram64_offset( addr & 0x7FFFFF );
+}
+
+/**
+ * Convert index tables in place into VRAM offset tables for texels of
+ * (1<<shift) bytes.
+ */
+static void vram64_offset_table( uint32_t *table, uint32_t count, int shift )
+{
+    uint32_t i;
+    for( i=0; i<count; i++ ) {
+        table[i] = vram64_offset( table[i] << shift );
+    }
+}
+
+static gboolean texture_decoder_table_is_supported( void )
+{
+    return TRUE;
+}
+
+static void table_read_twiddled_4( unsigned char *dest, const unsigned char *vram,
+                                   uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE], yoff[TEXDEC_MAX_SIZE];
+    uint32_t x, y;
+
+    if( width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        scalar_read_twiddled_4( dest, vram, srcaddr, width, height );
+        return;
+    } else if( width == 1 ) {
+        /* Whole byte, as for the scalar version */
+        *dest = vram[vram64_addr(srcaddr)];
+        return;
+    }
+
+    twiddle_index_tables( xoff, yoff, width, height );
+    if( (srcaddr & 0x07) == 0 && height > 1 ) {
+        /* Column indexes are all even, so the byte offset splits as well */
+        const unsigned char *base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+        for( x=0; x<width; x++ ) {
+            xoff[x] = vram64_offset( xoff[x] >> 1 );
+        }
+        for( y=0; y<height; y++ ) {
+            const unsigned char *row = base + vram64_offset( yoff[y] >> 1 );
+            int shift = (yoff[y] & 1) << 2;
+            for( x=0; x<width; x+=2 ) {
+                *dest++ = ((row[xoff[x]] >> shift) & 0x0F) |
+                          (((row[xoff[x+1]] >> shift) & 0x0F) << 4);
+            }
+        }
+    } else {
+        for( y=0; y<height; y++ ) {
+            for( x=0; x<width; x+=2 ) {
+                uint32_t t0 = xoff[x] + yoff[y], t1 = xoff[x+1] + yoff[y];
+                uint8_t p0 = vram[vram64_addr(srcaddr + (t0>>1))] >> ((t0 & 1) << 2);
+                uint8_t p1 = vram[vram64_addr(srcaddr + (t1>>1))] >> ((t1 & 1) << 2);
+                *dest++ = (p0 & 0x0F) | ((p1 & 0x0F) << 4);
+            }
+        }
+    }
+}
+
+static void table_read_twiddled_8( unsigned char *dest, const unsigned char *vram,
+                                   uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE], yoff[TEXDEC_MAX_SIZE];
+    uint32_t x, y;
+
+    if( width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        scalar_read_twiddled_8( dest, vram, srcaddr, width, height );
+        return;
+    }
+
+    twiddle_index_tables( xoff, yoff, width, height );
+    if( (srcaddr & 0x07) == 0 ) {
+        const unsigned char *base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+        vram64_offset_table( xoff, width, 0 );
+        vram64_offset_table( yoff, height, 0 );
+        for( y=0; y<height; y++ ) {
+            const unsigned char *row = base + yoff[y];
+            for( x=0; x<width; x++ ) {
+                *dest++ = row[xoff[x]];
+            }
+        }
+    } else {
+        for( y=0; y<height; y++ ) {
+            for( x=0; x<width; x++ ) {
+                *dest++ = vram[vram64_addr(srcaddr + xoff[x] + yoff[y])];
+            }
+        }
+    }
+}
+
+static void table_read_twiddled_16( unsigned char *dest, const unsigned char *vram,
+                                    uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE], yoff[TEXDEC_MAX_SIZE];
+    uint16_t *wdest = (uint16_t *)dest;
+    uint32_t x, y;
+
+    if( width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        scalar_read_twiddled_16( dest, vram, srcaddr, width, height );
+        return;
+    }
+
+    twiddle_index_tables( xoff, yoff, width, height );
+    if( (srcaddr & 0x07) == 0 ) {
+        const unsigned char *base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+        vram64_offset_table( xoff, width, 1 );
+        vram64_offset_table( yoff, height, 1 );
+        for( y=0; y<height; y++ ) {
+            const unsigned char *row = base + yoff[y];
+            for( x=0; x<width; x++ ) {
+                *wdest++ = *(const uint16_t *)(row + xoff[x]);
+            }
+        }
+    } else {
+        for( y=0; y<height; y++ ) {
+            for( x=0; x<width; x++ ) {
+                *wdest++ = *(const uint16_t *)(vram + vram64_addr(srcaddr + ((xoff[x] + yoff[y])<<1)));
+            }
+        }
+    }
+}
+
+/**
+ * Copies each half of a quad as a 32-bit word.
+ */
+static void table_vq_decode( uint16_t *output, const unsigned char *input, int width, int height,
+                             uint16_t codebook[256][4] )
+{
+    int i,j;
+
+    for( j=0; j<height; j+=2 ) {
+        uint16_t *row0 = output + j*width, *row1 = row0 + width;
+        for( i=0; i<width; i+=2 ) {
+            const uint16_t *quad = codebook[*input++];
+            memcpy( row0 + i, quad, 2*sizeof(uint16_t) );
+            memcpy( row1 + i, quad + 2, 2*sizeof(uint16_t) );
+        }
+    }
+}
+
+struct texture_decoder texture_decoder_table = {
+        "table", texture_decoder_table_is_supported,
+        table_read_twiddled_4, table_read_twiddled_8, table_read_twiddled_16,
+        table_vq_decode };
+
+#ifdef TEXDEC_X86
+/**************************** SSSE3 implementation ***************************/
+
+/* The SSSE3 decoders work on 8x8 texel blocks, which are contiguous in the
+ * 64-bit address space, and so are a single run of bytes in each bank. */
+
+static gboolean texture_decoder_ssse3_is_supported( void )
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+/**
+ * Compute the VRAM offsets of the 8x8 blocks of a texture with texels of
+ * (1<<shift) nibbles, such that block (x,y) (in texels) starts at
+ * xoff[x>>3] + yoff[y>>3].
+ */
+static void ssse3_block_tables( uint32_t *xoff, uint32_t *yoff, uint32_t width, uint32_t height,
+                                int shift )
+{
+    uint32_t xidx[TEXDEC_MAX_SIZE], yidx[TEXDEC_MAX_SIZE], i;
+    twiddle_index_tables( xidx, yidx, width, height );
+    for( i=0; i<width; i+=8 ) {
+        xoff[i>>3] = vram64_offset( (xidx[i] << shift) >> 1 );
+    }
+    for( i=0; i<height; i+=8 ) {
+        yoff[i>>3] = vram64_offset( (yidx[i] << shift) >> 1 );
+    }
+}
+
+/**
+ * Transpose a twiddled 4x4 block of bytes into 4 rows of 4 bytes
+ */
+static inline TARGET_SSSE3 __m128i ssse3_detwiddle_4x4_8( __m128i block )
+{
+    return _mm_shuffle_epi8( block, _mm_setr_epi8( 0, 2, 8, 10, 1, 3, 9, 11,
+                                                   4, 6, 12, 14, 5, 7, 13, 15 ) );
+}
+
+/**
+ * Detwiddle 4 4x4 byte blocks in twiddled order, writing them out as an 8x8
+ * block.
+ */
+static inline TARGET_SSSE3 void ssse3_store_8x8_8( unsigned char *dest, uint32_t stride,
+                                                   __m128i d0, __m128i d1, __m128i d2, __m128i d3 )
+{
+    __m128i r01, r23, r45, r67;
+    d0 = ssse3_detwiddle_4x4_8( d0 );
+    d1 = ssse3_detwiddle_4x4_8( d1 );
+    d2 = ssse3_detwiddle_4x4_8( d2 );
+    d3 = ssse3_detwiddle_4x4_8( d3 );
+    r01 = _mm_unpacklo_epi32( d0, d2 );
+    r23 = _mm_unpackhi_epi32( d0, d2 );
+    r45 = _mm_unpacklo_epi32( d1, d3 );
+    r67 = _mm_unpackhi_epi32( d1, d3 );
+    _mm_storel_epi64( (__m128i *)(dest), r01 );
+    _mm_storel_epi64( (__m128i *)(dest + stride), _mm_unpackhi_epi64( r01, r01 ) );
+    _mm_storel_epi64( (__m128i *)(dest + 2*stride), r23 );
+    _mm_storel_epi64( (__m128i *)(dest + 3*stride), _mm_unpackhi_epi64( r23, r23 ) );
+    _mm_storel_epi64( (__m128i *)(dest + 4*stride), r45 );
+    _mm_storel_epi64( (__m128i *)(dest + 5*stride), _mm_unpackhi_epi64( r45, r45 ) );
+    _mm_storel_epi64( (__m128i *)(dest + 6*stride), r67 );
+    _mm_storel_epi64( (__m128i *)(dest + 7*stride), _mm_unpackhi_epi64( r67, r67 ) );
+}
+
+/**
+ * Expand 16 bytes of packed 4-bit texels (low nibble first) to 32 bytes.
+ */
+static inline TARGET_SSSE3 void ssse3_unpack_nibbles( __m128i in, __m128i *lo, __m128i *hi )
+{
+    __m128i mask = _mm_set1_epi8( 0x0F );
+    __m128i even = _mm_and_si128( in, mask );
+    __m128i odd = _mm_and_si128( _mm_srli_epi16( in, 4 ), mask );
+    *lo = _mm_unpacklo_epi8( even, odd );
+    *hi = _mm_unpackhi_epi8( even, odd );
+}
+
+/**
+ * Pack 4 rows of 8 4-bit texels (one per byte) into 4 rows of 4 bytes,
+ * low nibble first.
+ */
+static inline TARGET_SSSE3 __m128i ssse3_pack_nibbles( __m128i r01, __m128i r23 )
+{
+    __m128i scale = _mm_set1_epi16( 0x1001 );
+    return _mm_packus_epi16( _mm_maddubs_epi16( r01, scale ), _mm_maddubs_epi16( r23, scale ) );
+}
+
+static inline TARGET_SSSE3 void store_32( unsigned char *dest, __m128i v )
+{
+    uint32_t tmp = _mm_cvtsi128_si32( v );
+    memcpy( dest, &tmp, sizeof(tmp) );
+}
+
+static TARGET_SSSE3 void ssse3_read_twiddled_4( unsigned char *dest, const unsigned char *vram,
+                                                uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE/8], yoff[TEXDEC_MAX_SIZE/8];
+    uint32_t stride = width >> 1, x, y;
+    const unsigned char *base;
+
+    if( (srcaddr & 0x07) != 0 || width < 8 || height < 8 ||
+            width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        table_read_twiddled_4( dest, vram, srcaddr, width, height );
+        return;
+    }
+
+    base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+    ssse3_block_tables( xoff, yoff, width, height, 0 );
+    for( y=0; y<height; y+=8 ) {
+        for( x=0; x<width; x+=8 ) {
+            const unsigned char *src = base + xoff[x>>3] + yoff[y>>3];
+            __m128i b0 = _mm_loadu_si128( (const __m128i *)src );
+            __m128i b1 = _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE) );
+            __m128i d0, d1, d2, d3, r01, r23, r45, r67, p0, p1;
+            unsigned char *out = dest + y*stride + (x>>1);
+
+            ssse3_unpack_nibbles( _mm_unpacklo_epi32( b0, b1 ), &d0, &d1 );
+            ssse3_unpack_nibbles( _mm_unpackhi_epi32( b0, b1 ), &d2, &d3 );
+            d0 = ssse3_detwiddle_4x4_8( d0 );
+            d1 = ssse3_detwiddle_4x4_8( d1 );
+            d2 = ssse3_detwiddle_4x4_8( d2 );
+            d3 = ssse3_detwiddle_4x4_8( d3 );
+            r01 = _mm_unpacklo_epi32( d0, d2 );
+            r23 = _mm_unpackhi_epi32( d0, d2 );
+            r45 = _mm_unpacklo_epi32( d1, d3 );
+            r67 = _mm_unpackhi_epi32( d1, d3 );
+            p0 = ssse3_pack_nibbles( r01, r23 );
+            p1 = ssse3_pack_nibbles( r45, r67 );
+            store_32( out, p0 );
+            store_32( out + stride, _mm_srli_si128( p0, 4 ) );
+            store_32( out + 2*stride, _mm_srli_si128( p0, 8 ) );
+            store_32( out + 3*stride, _mm_srli_si128( p0, 12 ) );
+            store_32( out + 4*stride, p1 );
+            store_32( out + 5*stride, _mm_srli_si128( p1, 4 ) );
+            store_32( out + 6*stride, _mm_srli_si128( p1, 8 ) );
+            store_32( out + 7*stride, _mm_srli_si128( p1, 12 ) );
+        }
+    }
+}
+
+static TARGET_SSSE3 void ssse3_read_twiddled_8( unsigned char *dest, const unsigned char *vram,
+                                                uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE/8], yoff[TEXDEC_MAX_SIZE/8];
+    uint32_t x, y;
+    const unsigned char *base;
+
+    if( (srcaddr & 0x07) != 0 || width < 8 || height < 8 ||
+            width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        table_read_twiddled_8( dest, vram, srcaddr, width, height );
+        return;
+    }
+
+    base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+    ssse3_block_tables( xoff, yoff, width, height, 1 );
+    for( y=0; y<height; y+=8 ) {
+        for( x=0; x<width; x+=8 ) {
+            const unsigned char *src = base + xoff[x>>3] + yoff[y>>3];
+            __m128i b0 = _mm_loadu_si128( (const __m128i *)src );
+            __m128i b1 = _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE) );
+            __m128i b2 = _mm_loadu_si128( (const __m128i *)(src + 16) );
+            __m128i b3 = _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE + 16) );
+            ssse3_store_8x8_8( dest + y*width + x, width,
+                               _mm_unpacklo_epi32( b0, b1 ), _mm_unpackhi_epi32( b0, b1 ),
+                               _mm_unpacklo_epi32( b2, b3 ), _mm_unpackhi_epi32( b2, b3 ) );
+        }
+    }
+}
+
+/**
+ * Detwiddle a 4x4 block of 16-bit texels (32 bytes in the 64-bit address
+ * space, given as the 16 bytes from each bank) into rows 0+1 and 2+3.
+ */
+static inline TARGET_SSSE3 void ssse3_detwiddle_4x4_16( __m128i b0, __m128i b1,
+                                                        __m128i *r01, __m128i *r23 )
+{
+    /* Swap the middle texels of each 2x2, giving 32-bit pairs of row 0..3 */
+    __m128i a = _mm_unpacklo_epi32( b0, b1 ), b = _mm_unpackhi_epi32( b0, b1 );
+    a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( a, 0xD8 ), 0xD8 );
+    b = _mm_shufflehi_epi16( _mm_shufflelo_epi16( b, 0xD8 ), 0xD8 );
+    *r01 = _mm_unpacklo_epi32( a, b );
+    *r23 = _mm_unpackhi_epi32( a, b );
+}
+
+static TARGET_SSSE3 void ssse3_read_twiddled_16( unsigned char *dest, const unsigned char *vram,
+                                                 uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    uint32_t xoff[TEXDEC_MAX_SIZE/8], yoff[TEXDEC_MAX_SIZE/8];
+    uint32_t stride = width << 1, x, y;
+    const unsigned char *base;
+
+    if( (srcaddr & 0x07) != 0 || width < 8 || height < 8 ||
+            width > TEXDEC_MAX_SIZE || height > TEXDEC_MAX_SIZE ) {
+        table_read_twiddled_16( dest, vram, srcaddr, width, height );
+        return;
+    }
+
+    base = vram + ((srcaddr & 0x7FFFF8) >> 1);
+    ssse3_block_tables( xoff, yoff, width, height, 2 );
+    for( y=0; y<height; y+=8 ) {
+        for( x=0; x<width; x+=8 ) {
+            const unsigned char *src = base + xoff[x>>3] + yoff[y>>3];
+            unsigned char *out = dest + y*stride + (x<<1);
+            __m128i c0r01, c0r23, c1r01, c1r23, c2r01, c2r23, c3r01, c3r23;
+            /* 4x4 sub-blocks in twiddled order: top-left, bottom-left,
+             * top-right, bottom-right */
+            ssse3_detwiddle_4x4_16( _mm_loadu_si128( (const __m128i *)src ),
+                                    _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE) ),
+                                    &c0r01, &c0r23 );
+            ssse3_detwiddle_4x4_16( _mm_loadu_si128( (const __m128i *)(src + 16) ),
+                                    _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE + 16) ),
+                                    &c1r01, &c1r23 );
+            ssse3_detwiddle_4x4_16( _mm_loadu_si128( (const __m128i *)(src + 32) ),
+                                    _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE + 32) ),
+                                    &c2r01, &c2r23 );
+            ssse3_detwiddle_4x4_16( _mm_loadu_si128( (const __m128i *)(src + 48) ),
+                                    _mm_loadu_si128( (const __m128i *)(src + VRAM_BANK_SIZE + 48) ),
+                                    &c3r01, &c3r23 );
+            _mm_storeu_si128( (__m128i *)out, _mm_unpacklo_epi64( c0r01, c2r01 ) );
+            _mm_storeu_si128( (__m128i *)(out + stride), _mm_unpackhi_epi64( c0r01, c2r01 ) );
+            _mm_storeu_si128( (__m128i *)(out + 2*stride), _mm_unpacklo_epi64( c0r23, c2r23 ) );
+            _mm_storeu_si128( (__m128i *)(out + 3*stride), _mm_unpackhi_epi64( c0r23, c2r23 ) );
+            _mm_storeu_si128( (__m128i *)(out + 4*stride), _mm_unpacklo_epi64( c1r01, c3r01 ) );
+            _mm_storeu_si128( (__m128i *)(out + 5*stride), _mm_unpackhi_epi64( c1r01, c3r01 ) );
+            _mm_storeu_si128( (__m128i *)(out + 6*stride), _mm_unpacklo_epi64( c1r23, c3r23 ) );
+            _mm_storeu_si128( (__m128i *)(out + 7*stride), _mm_unpackhi_epi64( c1r23, c3r23 ) );
+        }
+    }
+}
+
+/**
+ * Expands 4 codes at a time, splitting the quads into their top and bottom
+ * halves with a single shuffle each.
+ */
+static TARGET_SSSE3 void ssse3_vq_decode( uint16_t *output, const unsigned char *input,
+                                          int width, int height, uint16_t codebook[256][4] )
+{
+    int i,j;
+
+    if( width < 8 ) {
+        table_vq_decode( output, input, width, height, codebook );
+        return;
+    }
+
+    for( j=0; j<height; j+=2 ) {
+        uint16_t *row0 = output + j*width, *row1 = row0 + width;
+        for( i=0; i<width; i+=8 ) {
+            __m128 q01 = _mm_castsi128_ps( _mm_unpacklo_epi64(
+                    _mm_loadl_epi64( (const __m128i *)codebook[input[0]] ),
+                    _mm_loadl_epi64( (const __m128i *)codebook[input[1]] ) ) );
+            __m128 q23 = _mm_castsi128_ps( _mm_unpacklo_epi64(
+                    _mm_loadl_epi64( (const __m128i *)codebook[input[2]] ),
+                    _mm_loadl_epi64( (const __m128i *)codebook[input[3]] ) ) );
+            input += 4;
+            _mm_storeu_ps( (float *)(row0 + i), _mm_shuffle_ps( q01, q23, _MM_SHUFFLE(2,0,2,0) ) );
+            _mm_storeu_ps( (float *)(row1 + i), _mm_shuffle_ps( q01, q23, _MM_SHUFFLE(3,1,3,1) ) );
+        }
+    }
+}
+
+struct texture_decoder texture_decoder_ssse3 = {
+        "ssse3", texture_decoder_ssse3_is_supported,
+        ssse3_read_twiddled_4, ssse3_read_twiddled_8, ssse3_read_twiddled_16,
+        ssse3_vq_decode };
+
+#endif /* TEXDEC_X86 */
+
+texture_decoder_t texture_decoder_list[] = {
+#ifdef TEXDEC_X86
+        &texture_decoder_ssse3,
+#endif
+        &texture_decoder_table,
+        &texture_decoder_scalar,
+        NULL };
+
+texture_decoder_t texture_decoder_select( void )
+{
+    int i;
+    for( i=0; texture_decoder_list[i] != NULL; i++ ) {
+        if( texture_decoder_list[i]->is_supported() ) {
+            return texture_decoder_list[i];
+        }
+    }
+    return &texture_decoder_scalar;
+}
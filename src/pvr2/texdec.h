@@ -0,0 +1,92 @@
+/**
+ * $Id$
+ *
+ * PVR2 texture decoding kernels (pvr2-private). These read twiddled textures
+ * out of the 64-bit (interleaved) VRAM address space and expand VQ
+ * compressed textures - the expensive parts of loading a texture.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_texdec_H
+#define lxdream_texdec_H 1
+
+#include <stdint.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Largest texture dimension handled by the table-driven decoders */
+#define TEXDEC_MAX_SIZE 1024
+
+/**
+ * Read a twiddled image from the 64-bit address space, writing it to the
+ * destination in detwiddled (row-major) form.
+ * @param dest destination buffer
+ * @param vram base of VRAM (ie the 32-bit address space, 8MB)
+ * @param srcaddr source address in the 64-bit address space
+ * @param width image width (power of 2)
+ * @param height image height (power of 2)
+ */
+typedef void (*texture_read_twiddled_fn_t)( unsigned char *dest, const unsigned char *vram,
+                                            uint32_t srcaddr, uint32_t width, uint32_t height );
+
+/**
+ * Expand a VQ compressed image, with one code per 2x2 block of output
+ * texels.
+ * @param output width x height 16-bit texels
+ * @param input (width/2) x (height/2) codes, in row-major order
+ * @param codebook the 256 quads, each as top-left, top-right, bottom-left,
+ *        bottom-right.
+ */
+typedef void (*texture_vq_decode_fn_t)( uint16_t *output, const unsigned char *input,
+                                        int width, int height, uint16_t codebook[256][4] );
+
+typedef struct texture_decoder {
+    const char *name;
+    /**
+     * @return TRUE if the decoder can be used on the host CPU
+     */
+    gboolean (*is_supported)(void);
+    texture_read_twiddled_fn_t read_twiddled_4;  /* 4-bit texels, packed low nibble first */
+    texture_read_twiddled_fn_t read_twiddled_8;
+    texture_read_twiddled_fn_t read_twiddled_16; /* srcaddr must be 16-bit aligned */
+    texture_vq_decode_fn_t vq_decode;
+} *texture_decoder_t;
+
+extern struct texture_decoder texture_decoder_scalar;
+
+/**
+ * NULL-terminated list of decoders, in order of preference. The last entry
+ * (scalar) is the reference implementation, and is always supported.
+ */
+extern texture_decoder_t texture_decoder_list[];
+
+/**
+ * @return the first supported decoder from texture_decoder_list
+ */
+texture_decoder_t texture_decoder_select( void );
+
+/**
+ * Decoder used by the pvr2_vram64_read_twiddled_* functions and the texture
+ * cache.
+ */
+extern texture_decoder_t pvr2_texture_decoder;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_texdec_H */
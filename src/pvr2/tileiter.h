@@ -31,6 +31,9 @@
 extern "C" {
 #endif
 
+/* True if the tile list pointer is valid and the list has at least one entry */
+#define IS_NONEMPTY_TILE_LIST(p) (IS_TILE_PTR(p) && ((*((uint32_t *)(pvr2_main_ram+(p))) >> 28) != 0x0F))
+
 
 /**
  * tileiter: iterator over individual polygons in a tile list.
@@ -0,0 +1,575 @@
+/**
+ * $Id$
+ *
+ * PVR2 vertex decoding kernels. The scalar decoder is the reference
+ * implementation - the SIMD versions must produce bit-identical results
+ * (which they do, as every operation involved is either exact or a single
+ * correctly-rounded IEEE operation in both).
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "pvr2/pvr2.h"
+#include "pvr2/vertexdec.h"
+
+/* The SIMD decoders need per-function target attributes and
+ * __builtin_cpu_supports, so that they can be built regardless of the
+ * compiler's default target and selected at runtime. */
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define VERTEXDEC_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static float vertex_palette_offset( uint32_t tex )
+{
+    uint32_t fmt = (tex & PVR2_TEX_FORMAT_MASK);
+    if( fmt == PVR2_TEX_FORMAT_IDX4 ) {
+        return ((float)((tex & 0x07E00000) >> 17))/1024.0 + 0.0002;
+    } else if( fmt == PVR2_TEX_FORMAT_IDX8 ) {
+        return ((float)((tex & 0x06000000) >> 17))/1024.0 + 0.0002;
+    } else {
+        return -1.0;
+    }
+}
+
+void vertex_format_init( struct vertex_format *fmt, uint32_t poly1, uint32_t poly2,
+                         uint32_t tex, int modify_offset )
+{
+    fmt->textured = POLY1_TEXTURED(poly1) ? TRUE : FALSE;
+    fmt->uv16 = POLY1_UV16(poly1) ? TRUE : FALSE;
+    fmt->specular = POLY1_SPECULAR(poly1) ? TRUE : FALSE;
+    fmt->replace = FALSE;
+    fmt->force_alpha = !POLY2_ALPHA_ENABLE(poly2);
+    fmt->modify_offset = modify_offset;
+    if( fmt->textured ) {
+        switch( POLY2_TEX_BLEND(poly2) ) {
+        case 0: /* Convert replace => modulate by setting colour values to 1.0 */
+            fmt->replace = TRUE;
+            fmt->tex_mode = 0.0;
+            break;
+        case 2: /* Decal */
+            fmt->tex_mode = 1.0;
+            break;
+        case 1:
+            fmt->force_alpha = TRUE;
+            /* fall-through */
+        default:
+            fmt->tex_mode = 0.0;
+            break;
+        }
+        fmt->palette_offset = vertex_palette_offset(tex);
+    } else {
+        fmt->tex_mode = 2.0;
+        fmt->palette_offset = -1.0;
+    }
+}
+
+/**
+ * Update the z bounds for a decoded vertex. Note that z == 0 is used for
+ * invalid/infinite depths, so doesn't count towards the near bound.
+ */
+static inline void vertex_update_zbounds( float z, float *zbounds )
+{
+    if( z > zbounds[1] ) {
+        zbounds[1] = z;
+    } else if( z < zbounds[0] && z != 0 ) {
+        zbounds[0] = z;
+    }
+}
+
+/*************************** Scalar implementation ***************************/
+
+static void unpack_bgra(uint32_t bgra, float *rgba)
+{
+    rgba[0] = ((float)(((bgra&0x00FF0000)>>16) + 1)) / 256.0;
+    rgba[1] = ((float)(((bgra&0x0000FF00)>>8) + 1)) / 256.0;
+    rgba[2] = ((float)((bgra&0x000000FF) + 1)) / 256.0;
+    rgba[3] = ((float)(((bgra&0xFF000000)>>24) + 1)) / 256.0;
+}
+
+/**
+ * Convert a half-float (16-bit) FP number to a regular 32-bit float.
+ * Source is 1-bit sign, 5-bit exponent, 10-bit mantissa.
+ * TODO: Check the correctness of this.
+ */
+static float halftofloat( uint16_t half )
+{
+    union {
+        float f;
+        uint32_t i;
+    } temp;
+    temp.i = ((uint32_t)half)<<16;
+    return temp.f;
+}
+
+static gboolean vertex_decoder_scalar_is_supported( void )
+{
+    return TRUE;
+}
+
+static void vertex_decode_scalar( struct vertex_struct *out, const uint32_t *data,
+                                  unsigned int count, unsigned int stride,
+                                  const struct vertex_format *fmt, float *zbounds )
+{
+    unsigned int i;
+    union pvr2_data_type {
+        const uint32_t *ival;
+        const float *fval;
+    } ptr;
+
+    for( i=0; i<count; i++, out++, data += stride ) {
+        ptr.ival = data;
+        out->x = *ptr.fval++;
+        out->y = *ptr.fval++;
+
+        float z = *ptr.fval++;
+        if( !isfinite(z) ) {
+            z = 0;
+        } else if( z != 0 ) {
+            z = 1/z;
+        }
+        vertex_update_zbounds( z, zbounds );
+        out->z = z;
+        out->w = 0.0;
+        ptr.ival += fmt->modify_offset;
+
+        if( fmt->textured ) {
+            if( fmt->uv16 ) {
+                out->u = halftofloat( *ptr.ival>>16 );
+                out->v = halftofloat( *ptr.ival );
+                ptr.ival++;
+            } else {
+                out->u = *ptr.fval++;
+                out->v = *ptr.fval++;
+            }
+        } else {
+            out->u = out->v = 0.0;
+        }
+        out->r = fmt->palette_offset;
+        out->tex_mode = fmt->tex_mode;
+
+        if( fmt->replace ) {
+            out->rgba[0] = out->rgba[1] = out->rgba[2] = out->rgba[3] = 1.0;
+            ptr.ival++; /* Skip the colour word */
+        } else {
+            unpack_bgra(*ptr.ival++, out->rgba);
+        }
+
+        if( fmt->specular ) {
+            unpack_bgra(*ptr.ival++, out->offset_rgba);
+        } else {
+            out->offset_rgba[0] = 0.0;
+            out->offset_rgba[1] = 0.0;
+            out->offset_rgba[2] = 0.0;
+            out->offset_rgba[3] = 0.0;
+        }
+
+        if( fmt->force_alpha ) {
+            out->rgba[3] = 1.0;
+        }
+    }
+}
+
+static void vertex_compute_scalar( struct vertex_struct *result, unsigned int count,
+                                   const struct vertex_struct *input,
+                                   gboolean is_solid_shaded, float *zbounds )
+{
+    unsigned int i,j;
+    float sx = input[2].x - input[1].x;
+    float sy = input[2].y - input[1].y;
+    float tx = input[0].x - input[1].x;
+    float ty = input[0].y - input[1].y;
+
+    float detxy = ((sy) * (tx)) - ((ty) * (sx));
+    if( detxy == 0 ) {
+        // If the input points fall on a line, they don't define a usable
+        // polygon - the PVR2 takes the last input point as the result in
+        // this case.
+        for( i=0; i<count; i++ ) {
+            float x = result[i].x;
+            float y = result[i].y;
+            memcpy( &result[i], &input[2], sizeof(struct vertex_struct) );
+            result[i].x = x;
+            result[i].y = y;
+        }
+        return;
+    }
+    float sz = input[2].z - input[1].z;
+    float tz = input[0].z - input[1].z;
+    float su = input[2].u - input[1].u;
+    float tu = input[0].u - input[1].u;
+    float sv = input[2].v - input[1].v;
+    float tv = input[0].v - input[1].v;
+
+    for( i=0; i<count; i++ ) {
+        float t = ((result[i].x - input[1].x) * sy -
+                (result[i].y - input[1].y) * sx) / detxy;
+        float s = ((result[i].y - input[1].y) * tx -
+                (result[i].x - input[1].x) * ty) / detxy;
+
+        float rz = input[1].z + (t*tz) + (s*sz);
+        if( rz > zbounds[1] ) {
+            zbounds[1] = rz;
+        } else if( rz < zbounds[0] ) {
+            zbounds[0] = rz;
+        }
+        result[i].z = rz;
+        result[i].u = input[1].u + (t*tu) + (s*su);
+        result[i].v = input[1].v + (t*tv) + (s*sv);
+        result[i].r = input[1].r; /* Last two components are flat */
+        result[i].tex_mode = input[1].tex_mode;
+
+        if( is_solid_shaded ) {
+            memcpy( result[i].rgba, input[2].rgba, sizeof(result[i].rgba) );
+            memcpy( result[i].offset_rgba, input[2].offset_rgba, sizeof(result[i].offset_rgba) );
+        } else {
+            const float *rgba0 = input[0].rgba;
+            const float *rgba1 = input[1].rgba;
+            const float *rgba2 = input[2].rgba;
+            float *rgba3 = result[i].rgba;
+            for( j=0; j<8; j++ ) {
+                float tc = *rgba0++ - *rgba1;
+                float sc = *rgba2++ - *rgba1;
+                float rc = *rgba1++ + (t*tc) + (s*sc);
+                *rgba3++ = rc;
+            }
+        }
+    }
+}
+
+struct vertex_decoder vertex_decoder_scalar = {
+        "scalar", vertex_decoder_scalar_is_supported,
+        vertex_decode_scalar, vertex_compute_scalar };
+
+#ifdef VERTEXDEC_X86
+/**************************** SSE2 implementation ****************************/
+
+static gboolean vertex_decoder_sse2_is_supported( void )
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+/**
+ * Compute 1/z for 4 raw z values, where non-finite values give 0 and zero
+ * is left unchanged.
+ */
+static inline TARGET_SSE2 __m128 sse2_recip_z( __m128i zi )
+{
+    __m128i expmask = _mm_set1_epi32(0x7F800000);
+    __m128 z = _mm_castsi128_ps(zi);
+    __m128 zero = _mm_cmpeq_ps( z, _mm_setzero_ps() );
+    __m128 nonfinite = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128(zi, expmask), expmask ) );
+    __m128 r = _mm_div_ps( _mm_set1_ps(1.0f), z );
+    r = _mm_or_ps( _mm_and_ps(zero, z), _mm_andnot_ps(zero, r) );
+    return _mm_andnot_ps( nonfinite, r );
+}
+
+/**
+ * Gather the z words of up to 4 vertexes (unused lanes are 0).
+ */
+static inline TARGET_SSE2 __m128i sse2_gather_z( const uint32_t *data, unsigned int n, unsigned int stride )
+{
+    uint32_t z[4] = { 0, 0, 0, 0 };
+    unsigned int i;
+    for( i=0; i<n; i++ ) {
+        z[i] = data[i*stride+2];
+    }
+    return _mm_loadu_si128( (const __m128i *)z );
+}
+
+static inline TARGET_SSE2 __m128 sse2_unpack_bgra( uint32_t bgra )
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i c = _mm_cvtsi32_si128( bgra );
+    c = _mm_unpacklo_epi8( c, zero );
+    c = _mm_unpacklo_epi16( c, zero );
+    c = _mm_shuffle_epi32( c, _MM_SHUFFLE(3,0,1,2) ); /* BGRA => RGBA */
+    c = _mm_add_epi32( c, _mm_set1_epi32(1) );
+    return _mm_mul_ps( _mm_cvtepi32_ps(c), _mm_set1_ps(1.0f/256.0f) );
+}
+
+static TARGET_SSE2 void vertex_decode_sse2( struct vertex_struct *out, const uint32_t *data,
+                                            unsigned int count, unsigned int stride,
+                                            const struct vertex_format *fmt, float *zbounds )
+{
+    unsigned int i, j;
+    __m128 tex_flat = _mm_setr_ps( fmt->palette_offset, fmt->tex_mode, 0, 0 );
+    /* Colour components fixed by the format are applied with keep/set masks */
+    __m128 rgba_keep = _mm_castsi128_ps( _mm_setr_epi32( fmt->replace ? 0 : -1, fmt->replace ? 0 : -1,
+            fmt->replace ? 0 : -1, (fmt->replace || fmt->force_alpha) ? 0 : -1 ) );
+    __m128 rgba_set = _mm_setr_ps( fmt->replace ? 1.0 : 0.0, fmt->replace ? 1.0 : 0.0,
+            fmt->replace ? 1.0 : 0.0, (fmt->replace || fmt->force_alpha) ? 1.0 : 0.0 );
+    unsigned int colour_offset = 3 + fmt->modify_offset + (fmt->textured ? (fmt->uv16 ? 1 : 2) : 0);
+
+    for( i=0; i<count; i+=4 ) {
+        unsigned int n = count - i < 4 ? count - i : 4;
+        float z[4];
+        _mm_storeu_ps( z, sse2_recip_z( sse2_gather_z( data, n, stride ) ) );
+        for( j=0; j<n; j++, out++, data += stride ) {
+            const uint32_t *tex = data + 3 + fmt->modify_offset;
+            __m128 uv, rgba, offset;
+            vertex_update_zbounds( z[j], zbounds );
+
+            __m128 xy = _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i *)data ) );
+            _mm_storeu_ps( &out->x, _mm_movelh_ps( xy, _mm_set_ss(z[j]) ) );
+
+            if( !fmt->textured ) {
+                uv = _mm_setzero_ps();
+            } else if( fmt->uv16 ) {
+                uv = _mm_castsi128_ps( _mm_setr_epi32( tex[0] & 0xFFFF0000, tex[0] << 16, 0, 0 ) );
+            } else {
+                uv = _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i *)tex ) );
+            }
+            _mm_storeu_ps( &out->u, _mm_movelh_ps( uv, tex_flat ) );
+
+            rgba = sse2_unpack_bgra( data[colour_offset] );
+            rgba = _mm_or_ps( _mm_and_ps( rgba, rgba_keep ), rgba_set );
+            _mm_storeu_ps( out->rgba, rgba );
+
+            offset = fmt->specular ? sse2_unpack_bgra( data[colour_offset+1] ) : _mm_setzero_ps();
+            _mm_storeu_ps( out->offset_rgba, offset );
+        }
+    }
+}
+
+static TARGET_SSE2 void vertex_compute_sse2( struct vertex_struct *result, unsigned int count,
+                                             const struct vertex_struct *input,
+                                             gboolean is_solid_shaded, float *zbounds )
+{
+    unsigned int i;
+    float sx = input[2].x - input[1].x;
+    float sy = input[2].y - input[1].y;
+    float tx = input[0].x - input[1].x;
+    float ty = input[0].y - input[1].y;
+
+    float detxy = ((sy) * (tx)) - ((ty) * (sx));
+    if( detxy == 0 ) {
+        vertex_compute_scalar( result, count, input, is_solid_shaded, zbounds );
+        return;
+    }
+    float sz = input[2].z - input[1].z;
+    float tz = input[0].z - input[1].z;
+    float su = input[2].u - input[1].u;
+    float tu = input[0].u - input[1].u;
+    float sv = input[2].v - input[1].v;
+    float tv = input[0].v - input[1].v;
+
+    __m128 base0 = _mm_loadu_ps( input[1].rgba );
+    __m128 base1 = _mm_loadu_ps( input[1].offset_rgba );
+    __m128 tc0 = _mm_sub_ps( _mm_loadu_ps( input[0].rgba ), base0 );
+    __m128 tc1 = _mm_sub_ps( _mm_loadu_ps( input[0].offset_rgba ), base1 );
+    __m128 sc0 = _mm_sub_ps( _mm_loadu_ps( input[2].rgba ), base0 );
+    __m128 sc1 = _mm_sub_ps( _mm_loadu_ps( input[2].offset_rgba ), base1 );
+
+    for( i=0; i<count; i++ ) {
+        float t = ((result[i].x - input[1].x) * sy -
+                (result[i].y - input[1].y) * sx) / detxy;
+        float s = ((result[i].y - input[1].y) * tx -
+                (result[i].x - input[1].x) * ty) / detxy;
+
+        float rz = input[1].z + (t*tz) + (s*sz);
+        if( rz > zbounds[1] ) {
+            zbounds[1] = rz;
+        } else if( rz < zbounds[0] ) {
+            zbounds[0] = rz;
+        }
+        result[i].z = rz;
+        result[i].u = input[1].u + (t*tu) + (s*su);
+        result[i].v = input[1].v + (t*tv) + (s*sv);
+        result[i].r = input[1].r;
+        result[i].tex_mode = input[1].tex_mode;
+
+        if( is_solid_shaded ) {
+            _mm_storeu_ps( result[i].rgba, _mm_loadu_ps( input[2].rgba ) );
+            _mm_storeu_ps( result[i].offset_rgba, _mm_loadu_ps( input[2].offset_rgba ) );
+        } else {
+            __m128 tv4 = _mm_set1_ps(t), sv4 = _mm_set1_ps(s);
+            _mm_storeu_ps( result[i].rgba,
+                    _mm_add_ps( _mm_add_ps( base0, _mm_mul_ps(tv4, tc0) ), _mm_mul_ps(sv4, sc0) ) );
+            _mm_storeu_ps( result[i].offset_rgba,
+                    _mm_add_ps( _mm_add_ps( base1, _mm_mul_ps(tv4, tc1) ), _mm_mul_ps(sv4, sc1) ) );
+        }
+    }
+}
+
+struct vertex_decoder vertex_decoder_sse2 = {
+        "sse2", vertex_decoder_sse2_is_supported,
+        vertex_decode_sse2, vertex_compute_sse2 };
+
+/**************************** AVX2 implementation ****************************/
+
+static gboolean vertex_decoder_avx2_is_supported( void )
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+/**
+ * Compute 1/z for 8 raw z values, as per sse2_recip_z.
+ */
+static inline TARGET_AVX2 __m256 avx2_recip_z( __m256i zi )
+{
+    __m256i expmask = _mm256_set1_epi32(0x7F800000);
+    __m256 z = _mm256_castsi256_ps(zi);
+    __m256 zero = _mm256_cmp_ps( z, _mm256_setzero_ps(), _CMP_EQ_OQ );
+    __m256 nonfinite = _mm256_castsi256_ps( _mm256_cmpeq_epi32( _mm256_and_si256(zi, expmask), expmask ) );
+    __m256 r = _mm256_div_ps( _mm256_set1_ps(1.0f), z );
+    r = _mm256_blendv_ps( r, z, zero );
+    return _mm256_andnot_ps( nonfinite, r );
+}
+
+/**
+ * Unpack a colour and an offset colour together.
+ * @return rgba in the low half and offset_rgba in the high half
+ */
+static inline TARGET_AVX2 __m256 avx2_unpack_bgra2( uint32_t bgra, uint32_t offset_bgra )
+{
+    __m256i c = _mm256_cvtepu8_epi32( _mm_unpacklo_epi32( _mm_cvtsi32_si128(bgra), _mm_cvtsi32_si128(offset_bgra) ) );
+    c = _mm256_shuffle_epi32( c, _MM_SHUFFLE(3,0,1,2) ); /* BGRA => RGBA (in each half) */
+    c = _mm256_add_epi32( c, _mm256_set1_epi32(1) );
+    return _mm256_mul_ps( _mm256_cvtepi32_ps(c), _mm256_set1_ps(1.0f/256.0f) );
+}
+
+static TARGET_AVX2 void vertex_decode_avx2( struct vertex_struct *out, const uint32_t *data,
+                                            unsigned int count, unsigned int stride,
+                                            const struct vertex_format *fmt, float *zbounds )
+{
+    unsigned int i, j;
+    __m128 tex_flat = _mm_setr_ps( fmt->palette_offset, fmt->tex_mode, 0, 0 );
+    /* rgba in the low half, offset_rgba in the high half */
+    __m256 colour_keep = _mm256_castsi256_ps( _mm256_setr_epi32(
+            fmt->replace ? 0 : -1, fmt->replace ? 0 : -1, fmt->replace ? 0 : -1,
+            (fmt->replace || fmt->force_alpha) ? 0 : -1,
+            fmt->specular ? -1 : 0, fmt->specular ? -1 : 0, fmt->specular ? -1 : 0, fmt->specular ? -1 : 0 ) );
+    __m256 colour_set = _mm256_setr_ps( fmt->replace ? 1.0 : 0.0, fmt->replace ? 1.0 : 0.0,
+            fmt->replace ? 1.0 : 0.0, (fmt->replace || fmt->force_alpha) ? 1.0 : 0.0, 0, 0, 0, 0 );
+    unsigned int colour_offset = 3 + fmt->modify_offset + (fmt->textured ? (fmt->uv16 ? 1 : 2) : 0);
+
+    for( i=0; i<count; i+=8 ) {
+        unsigned int n = count - i < 8 ? count - i : 8;
+        uint32_t zw[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        float z[8];
+        for( j=0; j<n; j++ ) {
+            zw[j] = data[j*stride+2];
+        }
+        _mm256_storeu_ps( z, avx2_recip_z( _mm256_loadu_si256( (const __m256i *)zw ) ) );
+        for( j=0; j<n; j++, out++, data += stride ) {
+            const uint32_t *tex = data + 3 + fmt->modify_offset;
+            __m128 uv;
+            vertex_update_zbounds( z[j], zbounds );
+
+            if( !fmt->textured ) {
+                uv = _mm_setzero_ps();
+            } else if( fmt->uv16 ) {
+                uv = _mm_castsi128_ps( _mm_setr_epi32( tex[0] & 0xFFFF0000, tex[0] << 16, 0, 0 ) );
+            } else {
+                uv = _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i *)tex ) );
+            }
+            __m128 xy = _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i *)data ) );
+            __m256 head = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_movelh_ps( uv, tex_flat ) ),
+                    _mm_movelh_ps( xy, _mm_set_ss(z[j]) ), 1 );
+            _mm256_storeu_ps( &out->u, head );
+
+            __m256 colour = avx2_unpack_bgra2( data[colour_offset],
+                    fmt->specular ? data[colour_offset+1] : 0 );
+            colour = _mm256_or_ps( _mm256_and_ps( colour, colour_keep ), colour_set );
+            _mm256_storeu_ps( out->rgba, colour );
+        }
+    }
+}
+
+static TARGET_AVX2 void vertex_compute_avx2( struct vertex_struct *result, unsigned int count,
+                                             const struct vertex_struct *input,
+                                             gboolean is_solid_shaded, float *zbounds )
+{
+    unsigned int i;
+    float sx = input[2].x - input[1].x;
+    float sy = input[2].y - input[1].y;
+    float tx = input[0].x - input[1].x;
+    float ty = input[0].y - input[1].y;
+
+    float detxy = ((sy) * (tx)) - ((ty) * (sx));
+    if( detxy == 0 ) {
+        vertex_compute_scalar( result, count, input, is_solid_shaded, zbounds );
+        return;
+    }
+    float sz = input[2].z - input[1].z;
+    float tz = input[0].z - input[1].z;
+    float su = input[2].u - input[1].u;
+    float tu = input[0].u - input[1].u;
+    float sv = input[2].v - input[1].v;
+    float tv = input[0].v - input[1].v;
+
+    /* rgba and offset_rgba are adjacent, so handle all 8 colour components together */
+    __m256 base = _mm256_loadu_ps( input[1].rgba );
+    __m256 tc = _mm256_sub_ps( _mm256_loadu_ps( input[0].rgba ), base );
+    __m256 sc = _mm256_sub_ps( _mm256_loadu_ps( input[2].rgba ), base );
+
+    for( i=0; i<count; i++ ) {
+        float t = ((result[i].x - input[1].x) * sy -
+                (result[i].y - input[1].y) * sx) / detxy;
+        float s = ((result[i].y - input[1].y) * tx -
+                (result[i].x - input[1].x) * ty) / detxy;
+
+        float rz = input[1].z + (t*tz) + (s*sz);
+        if( rz > zbounds[1] ) {
+            zbounds[1] = rz;
+        } else if( rz < zbounds[0] ) {
+            zbounds[0] = rz;
+        }
+        result[i].z = rz;
+        result[i].u = input[1].u + (t*tu) + (s*su);
+        result[i].v = input[1].v + (t*tv) + (s*sv);
+        result[i].r = input[1].r;
+        result[i].tex_mode = input[1].tex_mode;
+
+        if( is_solid_shaded ) {
+            _mm256_storeu_ps( result[i].rgba, _mm256_loadu_ps( input[2].rgba ) );
+        } else {
+            _mm256_storeu_ps( result[i].rgba,
+                    _mm256_add_ps( _mm256_add_ps( base, _mm256_mul_ps( _mm256_set1_ps(t), tc ) ),
+                            _mm256_mul_ps( _mm256_set1_ps(s), sc ) ) );
+        }
+    }
+}
+
+struct vertex_decoder vertex_decoder_avx2 = {
+        "avx2", vertex_decoder_avx2_is_supported,
+        vertex_decode_avx2, vertex_compute_avx2 };
+
+#endif /* VERTEXDEC_X86 */
+
+vertex_decoder_t vertex_decoder_list[] = {
+#ifdef VERTEXDEC_X86
+        &vertex_decoder_avx2,
+        &vertex_decoder_sse2,
+#endif
+        &vertex_decoder_scalar,
+        NULL };
+
+vertex_decoder_t vertex_decoder_select( void )
+{
+    int i;
+    for( i=0; vertex_decoder_list[i] != NULL; i++ ) {
+        if( vertex_decoder_list[i]->is_supported() ) {
+            return vertex_decoder_list[i];
+        }
+    }
+    return &vertex_decoder_scalar;
+}
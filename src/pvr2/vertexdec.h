@@ -0,0 +1,106 @@
+/**
+ * $Id$
+ *
+ * PVR2 vertex decoding kernels (pvr2-private). These convert the raw vertex
+ * data found in the polygon buffer into the expanded vertex_struct format
+ * used by the renderers, a batch of vertexes (of the same polygon) at a time.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_vertexdec_H
+#define lxdream_vertexdec_H 1
+
+#include <stdint.h>
+#include <glib.h>
+#include "display.h"
+#include "pvr2/scene.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Vertex format of a polygon, as determined by its context words. All
+ * vertexes of a polygon share the same format.
+ */
+struct vertex_format {
+    gboolean textured;
+    gboolean uv16;         /* 16-bit (packed) texture coordinates */
+    gboolean specular;     /* Vertexes include an offset colour */
+    gboolean replace;      /* Replace texture mode - colour word is ignored */
+    gboolean force_alpha;  /* Force vertex alpha to 1.0 */
+    int modify_offset;     /* Offset in words from the z coordinate to the tex/colour data */
+    float tex_mode;
+    float palette_offset;
+};
+
+/**
+ * Setup a vertex format from the polygon context.
+ * @param poly1 First word of polygon context
+ * @param poly2 Second word of polygon context (or fourth for modified vertexes)
+ * @param tex Texture word of polygon context (or fifth for modified vertexes)
+ * @param modify_offset Offset in 32-bit words to the tex/color data. 0 for
+ *        the normal vertex, half the vertex length for the modified vertex.
+ */
+void vertex_format_init( struct vertex_format *fmt, uint32_t poly1, uint32_t poly2,
+                         uint32_t tex, int modify_offset );
+
+/**
+ * Decode count vertexes.
+ * @param out output vertexes. All fields are written.
+ * @param data raw vertex data of the first vertex (in VRAM)
+ * @param stride distance between vertexes in 32-bit words
+ * @param zbounds near and far z bounds, updated to include the vertexes
+ */
+typedef void (*vertex_decode_fn_t)( struct vertex_struct *out, const uint32_t *data,
+                                    unsigned int count, unsigned int stride,
+                                    const struct vertex_format *fmt, float *zbounds );
+
+/**
+ * Compute texture, colour, and z values for 1 or more result points by
+ * interpolating from a set of 3 input points. The result point(s) must
+ * define their x,y.
+ */
+typedef void (*vertex_compute_fn_t)( struct vertex_struct *result, unsigned int count,
+                                     const struct vertex_struct *input,
+                                     gboolean is_solid_shaded, float *zbounds );
+
+typedef struct vertex_decoder {
+    const char *name;
+    /**
+     * @return TRUE if the decoder can be used on the host CPU
+     */
+    gboolean (*is_supported)(void);
+    vertex_decode_fn_t decode;
+    vertex_compute_fn_t compute;
+} *vertex_decoder_t;
+
+extern struct vertex_decoder vertex_decoder_scalar;
+
+/**
+ * NULL-terminated list of decoders, in order of preference. The last entry
+ * (scalar) is always supported.
+ */
+extern vertex_decoder_t vertex_decoder_list[];
+
+/**
+ * @return the first supported decoder from vertex_decoder_list
+ */
+vertex_decoder_t vertex_decoder_select( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_vertexdec_H */
@@ -0,0 +1,412 @@
+/**
+ * $Id$
+ *
+ * Input recording and replay.
+ *
+ * The file is a REPLAY_MAGIC header and version, followed by records of
+ *     uint32 type, uint32 length, uint64 time, length bytes of data
+ * where time is in emulated nanoseconds from the start of the recording:
+ *   MAPLE  the responses for one maple DMA, as a list of
+ *          (uint32 address, uint32 length, length bytes)
+ *   RESET  a machine reset
+ *   DISC   a disc change, with the name of the new disc (empty if none)
+ *   END    the end of the recording, with the CRC32 of main RAM
+ *
+ * External events (resets and disc changes) come from the UI, in between the
+ * modules' time slices, so they're recorded at the end of the slice in which
+ * they happened, and replayed at the start of the next one. Replay shortens
+ * time slices so that they end exactly at the next event.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <zlib.h>
+#include "lxdream.h"
+#include "dreamcast.h"
+#include "mem.h"
+#include "replay.h"
+#include "gdrom/gdrom.h"
+#include "sh4/sh4.h"
+
+#define REPLAY_MAPLE 1
+#define REPLAY_RESET 2
+#define REPLAY_DISC  3
+#define REPLAY_END   4
+
+#define MAIN_RAM_SIZE (16 MB)
+
+typedef enum { REPLAY_IDLE=0, REPLAY_RECORDING, REPLAY_PLAYING } replay_mode_t;
+
+struct replay_record {
+    uint32_t type;
+    uint32_t length;
+    uint64_t time;
+};
+
+struct replay_event {
+    uint32_t type;
+    gchar *data;
+};
+
+static struct {
+    replay_mode_t mode;
+    FILE *f;
+    gchar *filename;
+    uint64_t time;              /* Emulated time at the start of the slice */
+    GByteArray *maple;          /* Responses for the current DMA (recording) */
+    GList *pending;             /* Events waiting for the end of the slice (recording) */
+    struct replay_record next;  /* Next record (playing) */
+    unsigned char *next_data;
+    gboolean diverged;
+    gboolean hook_registered;
+} replay;
+
+static uint32_t replay_ram_crc( void )
+{
+    return crc32( 0L, dc_main_ram, MAIN_RAM_SIZE );
+}
+
+static uint64_t replay_get_time( void )
+{
+    if( dreamcast_is_running() )
+        return replay.time + sh4r.slice_cycle;
+    return replay.time;
+}
+
+/**
+ * Note that the replay no longer matches the recording. The replay carries
+ * on regardless, but only the first difference is reported.
+ */
+static void replay_diverge( const char *what )
+{
+    if( !replay.diverged ) {
+        WARN( "Replay diverged from recording at %" G_GUINT64_FORMAT "ns: %s",
+                (guint64)replay_get_time(), what );
+        replay.diverged = TRUE;
+    }
+}
+
+/*************************** Recording ***************************/
+
+static void replay_write_record( uint32_t type, uint64_t time, const void *data, uint32_t length )
+{
+    struct replay_record rec;
+    if( replay.f == NULL )
+        return; /* Already failed */
+    rec.type = type;
+    rec.length = length;
+    rec.time = time;
+    if( fwrite( &rec, sizeof(rec), 1, replay.f ) != 1 ||
+            (length != 0 && fwrite( data, length, 1, replay.f ) != 1) ) {
+        ERROR( "Unable to write input recording to %s, recording stopped", replay.filename );
+        fclose( replay.f );
+        replay.f = NULL;
+    }
+}
+
+static void replay_queue_event( uint32_t type, const gchar *data )
+{
+    struct replay_event *event = g_malloc( sizeof(struct replay_event) );
+    event->type = type;
+    event->data = g_strdup( data == NULL ? "" : data );
+    replay.pending = g_list_append( replay.pending, event );
+    if( !dreamcast_is_running() ) {
+        replay_end_time_slice( 0 );
+    }
+}
+
+static gboolean replay_disc_changed( cdrom_disc_t disc, const gchar *disc_name, void *user_data )
+{
+    if( replay.mode == REPLAY_RECORDING ) {
+        replay_queue_event( REPLAY_DISC, disc_name );
+    }
+    return TRUE;
+}
+
+gboolean replay_record_start( const gchar *filename )
+{
+    uint32_t version = REPLAY_VERSION;
+
+    if( replay.mode != REPLAY_IDLE )
+        return FALSE;
+    replay.f = fopen( filename, "wb" );
+    if( replay.f == NULL ) {
+        ERROR( "Unable to open %s to record input", filename );
+        return FALSE;
+    }
+    fwrite( REPLAY_MAGIC, 16, 1, replay.f );
+    fwrite( &version, sizeof(version), 1, replay.f );
+    replay.filename = g_strdup( filename );
+    replay.time = 0;
+    replay.maple = g_byte_array_new();
+    replay.pending = NULL;
+    if( !replay.hook_registered ) {
+        register_gdrom_disc_change_hook( replay_disc_changed, NULL );
+        replay.hook_registered = TRUE;
+    }
+    replay.mode = REPLAY_RECORDING;
+    return TRUE;
+}
+
+void replay_record_reset( void )
+{
+    replay_queue_event( REPLAY_RESET, NULL );
+}
+
+void replay_maple_response( uint32_t addr, unsigned char *buf, uint32_t length )
+{
+    g_byte_array_append( replay.maple, (guint8 *)&addr, sizeof(addr) );
+    g_byte_array_append( replay.maple, (guint8 *)&length, sizeof(length) );
+    g_byte_array_append( replay.maple, buf, length );
+}
+
+void replay_maple_end( void )
+{
+    replay_write_record( REPLAY_MAPLE, replay_get_time(), replay.maple->data, replay.maple->len );
+    g_byte_array_set_size( replay.maple, 0 );
+}
+
+void replay_end_time_slice( uint32_t nanosecs )
+{
+    replay.time += nanosecs;
+    while( replay.pending != NULL ) {
+        struct replay_event *event = replay.pending->data;
+        replay.pending = g_list_remove( replay.pending, event );
+        replay_write_record( event->type, replay.time, event->data, strlen(event->data) );
+        g_free( event->data );
+        g_free( event );
+    }
+}
+
+/*************************** Replaying ***************************/
+
+/**
+ * Read the next record into replay.next. A truncated file is treated as if
+ * it ended there (without a checksum).
+ */
+static void replay_read_next( void )
+{
+    g_free( replay.next_data );
+    replay.next_data = NULL;
+    if( fread( &replay.next, sizeof(replay.next), 1, replay.f ) != 1 ) {
+        WARN( "Input recording %s is truncated", replay.filename );
+        replay.next.type = REPLAY_END;
+        replay.next.length = 0;
+        replay.next.time = 0;
+        return;
+    }
+    if( replay.next.length > MAIN_RAM_SIZE ) {
+        WARN( "Input recording %s is corrupt", replay.filename );
+        replay.next.type = REPLAY_END;
+        replay.next.length = 0;
+    }
+    replay.next_data = g_malloc( replay.next.length + 1 );
+    if( replay.next.length != 0 && fread( replay.next_data, replay.next.length, 1, replay.f ) != 1 ) {
+        WARN( "Input recording %s is truncated", replay.filename );
+        replay.next.type = REPLAY_END;
+        replay.next.length = 0;
+    }
+    replay.next_data[replay.next.length] = '\0';
+}
+
+gboolean replay_play_start( const gchar *filename )
+{
+    char magic[16];
+    uint32_t version;
+
+    if( replay.mode != REPLAY_IDLE )
+        return FALSE;
+    replay.f = fopen( filename, "rb" );
+    if( replay.f == NULL ) {
+        ERROR( "Unable to open input recording %s", filename );
+        return FALSE;
+    }
+    if( fread( magic, 16, 1, replay.f ) != 1 || memcmp( magic, REPLAY_MAGIC, 16 ) != 0 ||
+            fread( &version, sizeof(version), 1, replay.f ) != 1 || version != REPLAY_VERSION ) {
+        ERROR( "%s is not an input recording, or is from an incompatible version", filename );
+        fclose( replay.f );
+        replay.f = NULL;
+        return FALSE;
+    }
+    replay.filename = g_strdup( filename );
+    replay.time = 0;
+    replay.diverged = FALSE;
+    replay.mode = REPLAY_PLAYING;
+    replay_read_next();
+    return TRUE;
+}
+
+/**
+ * Check that every block of a maple record fits in the record and lies
+ * entirely within one memory region.
+ */
+static gboolean replay_maple_is_valid( unsigned char *p, unsigned char *end )
+{
+    while( p != end ) {
+        uint32_t addr, length;
+        sh4ptr_t dest;
+        if( end - p < 8 )
+            return FALSE;
+        addr = *(uint32_t *)p;
+        length = *(uint32_t *)(p+4);
+        p += 8;
+        if( length > end - p )
+            return FALSE;
+        if( length != 0 ) {
+            dest = mem_get_region( addr );
+            if( dest == NULL || addr + length - 1 < addr ||
+                    mem_get_region( addr + length - 1 ) != dest + (length - 1) )
+                return FALSE;
+        }
+        p += length;
+    }
+    return TRUE;
+}
+
+gboolean replay_maple_apply( void )
+{
+    unsigned char *p, *end;
+
+    if( replay.next.type != REPLAY_MAPLE ) {
+        replay_diverge( "maple DMA not in recording" );
+        return FALSE;
+    }
+    if( replay.next.time != replay_get_time() ) {
+        replay_diverge( "maple DMA at a different time" );
+    }
+    p = replay.next_data;
+    end = p + replay.next.length;
+    if( !replay_maple_is_valid( p, end ) ) {
+        replay_diverge( "corrupt maple DMA record" );
+        replay_read_next();
+        return TRUE;
+    }
+    while( p != end ) {
+        uint32_t addr = *(uint32_t *)p;
+        uint32_t length = *(uint32_t *)(p+4);
+        p += 8;
+        if( length != 0 ) {
+            memcpy( mem_get_region( addr ), p, length );
+        }
+        p += length;
+    }
+    replay_read_next();
+    return TRUE;
+}
+
+/**
+ * Apply an external event (anything but a maple DMA) from the recording.
+ */
+static void replay_apply_event( void )
+{
+    uint32_t crc;
+    ERROR err;
+
+    switch( replay.next.type ) {
+    case REPLAY_RESET:
+        dreamcast_reset();
+        break;
+    case REPLAY_DISC:
+        if( replay.next.length == 0 ) {
+            gdrom_unmount_disc();
+        } else if( !gdrom_mount_image( (gchar *)replay.next_data, &err ) ) {
+            replay_diverge( "unable to mount recorded disc" );
+        }
+        break;
+    case REPLAY_END:
+        if( replay.next.length == sizeof(crc) ) {
+            memcpy( &crc, replay.next_data, sizeof(crc) );
+            if( crc != replay_ram_crc() ) {
+                replay_diverge( "memory differs at end of recording" );
+            }
+        }
+        if( replay.diverged ) {
+            WARN( "Replay of %s finished, but did not match the recording", replay.filename );
+        } else {
+            INFO( "Replay of %s finished", replay.filename );
+        }
+        replay_stop();
+        dreamcast_stop();
+        return;
+    default:
+        WARN( "Unknown record type %d in input recording", replay.next.type );
+        break;
+    }
+    replay_read_next();
+}
+
+uint32_t replay_next_slice( uint32_t nanosecs )
+{
+    while( replay.mode == REPLAY_PLAYING ) {
+        if( replay.next.type == REPLAY_MAPLE ) {
+            if( replay.next.time >= replay.time )
+                break;
+            /* Should have happened in an earlier slice */
+            replay_diverge( "recorded maple DMA did not occur" );
+            replay_read_next();
+        } else if( replay.next.time <= replay.time ) {
+            replay_apply_event();
+        } else {
+            if( replay.next.time - replay.time < nanosecs )
+                nanosecs = (uint32_t)(replay.next.time - replay.time);
+            break;
+        }
+    }
+    return nanosecs;
+}
+
+/*************************** Common ***************************/
+
+gboolean replay_is_recording( void )
+{
+    return replay.mode == REPLAY_RECORDING;
+}
+
+gboolean replay_is_playing( void )
+{
+    return replay.mode == REPLAY_PLAYING;
+}
+
+gboolean replay_diverged( void )
+{
+    return replay.diverged;
+}
+
+void replay_stop( void )
+{
+    if( replay.mode == REPLAY_IDLE )
+        return;
+    if( replay.mode == REPLAY_RECORDING ) {
+        uint32_t crc = replay_ram_crc();
+        replay_end_time_slice( 0 );
+        replay_write_record( REPLAY_END, replay.time, &crc, sizeof(crc) );
+        if( replay.f != NULL )
+            INFO( "Input recorded to %s", replay.filename );
+    }
+    replay.mode = REPLAY_IDLE;
+    if( replay.f != NULL ) {
+        fclose( replay.f );
+        replay.f = NULL;
+    }
+    if( replay.maple != NULL ) {
+        g_byte_array_free( replay.maple, TRUE );
+        replay.maple = NULL;
+    }
+    g_free( replay.next_data );
+    replay.next_data = NULL;
+    g_free( replay.filename );
+    replay.filename = NULL;
+}
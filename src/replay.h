@@ -0,0 +1,107 @@
+/**
+ * $Id$
+ *
+ * Input recording and replay. Recording logs everything that enters the
+ * machine from outside - the responses to each maple DMA, resets and disc
+ * changes - against the emulated time. Replaying feeds the same input back
+ * at the same emulated times, without real-time pacing, so that a session
+ * can be re-run deterministically (eg as a benchmark or regression test).
+ *
+ * A replay must start from the same state as the recording, ie with the
+ * same command line (disc, program or save state).
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_replay_H
+#define lxdream_replay_H 1
+
+#include <stdint.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPLAY_MAGIC "%!-lxDream!Input"
+#define REPLAY_VERSION 0x00010000
+
+/**
+ * Start recording input to the given file, from the current machine state.
+ * @return TRUE on success.
+ */
+gboolean replay_record_start( const gchar *filename );
+
+/**
+ * Start replaying the input from the given file, from the current machine
+ * state. The machine is stopped when the end of the recording is reached.
+ * @return TRUE on success.
+ */
+gboolean replay_play_start( const gchar *filename );
+
+/**
+ * Stop recording or replaying. A recording is finished off with a checksum
+ * of main RAM, which the replay compares against when it reaches the end.
+ */
+void replay_stop( void );
+
+gboolean replay_is_recording( void );
+gboolean replay_is_playing( void );
+
+/**
+ * @return TRUE if the last replay didn't match the recording.
+ */
+gboolean replay_diverged( void );
+
+/**
+ * Called at the start of each time slice while replaying. Applies any
+ * external events that are now due.
+ * @return the length of the time slice to run, which is shortened so that
+ * it ends at the next event.
+ */
+uint32_t replay_next_slice( uint32_t nanosecs );
+
+/**
+ * Called at the end of each time slice, with its actual length.
+ */
+void replay_end_time_slice( uint32_t nanosecs );
+
+/**
+ * Record a machine reset (while recording).
+ */
+void replay_record_reset( void );
+
+/**
+ * Record the response that maple has written for one packet of the current
+ * DMA (while recording).
+ */
+void replay_maple_response( uint32_t addr, unsigned char *buf, uint32_t length );
+
+/**
+ * Finish the record of the current maple DMA (while recording).
+ */
+void replay_maple_end( void );
+
+/**
+ * Write the recorded responses for the current maple DMA into memory (while
+ * replaying).
+ * @return TRUE if the responses were written, or FALSE if the recording has
+ * no matching DMA (in which case the replay has diverged).
+ */
+gboolean replay_maple_apply( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_replay_H */
@@ -17,12 +17,15 @@
  */
 #define MODULE sh4_module
 
+#include <string.h>
 #include "dream.h"
+#include "eventq.h"
 #include "mem.h"
 #include "sh4/sh4core.h"
 #include "sh4/sh4mmio.h"
 #include "sh4/intc.h"
 #include "sh4/dmac.h"
+#include "pvr2/pvr2.h"
 
 static int DMAC_xfer_size[8] = {8, 1, 2, 4, 32, 1, 1, 1};
 
@@ -58,10 +61,81 @@ static int DMAC_xfer_size[8] = {8, 1, 2, 4, 32, 1, 1, 1};
 #define DMARES_MEMORY_TO_PERIPH_TMU 0x0D
 #define DMARES_PERIPH_TO_MEMORY_TMU 0x0E
 
+/* Bus timing used to estimate how long a transfer takes: each unit is a
+ * read and a write cycle on the 64-bit, 100MHz external bus */
+#define DMAC_BUS_PERIOD 10 /* ns */
+#define DMAC_UNIT_TIME(size) (2 * DMAC_BUS_PERIOD * (1 + (((size)+7)>>3)))
+
+/* Transfers are staged through a buffer of this size */
+#define DMAC_CHUNK_SIZE 4096
+
+static void DMAC_event_callback( int eventid );
+static void DMAC_update_channel( uint32_t channel );
+void DMAC_run_channel( uint32_t channel, uint32_t run_count );
+
+void DMAC_init( void )
+{
+    register_event_callback( EVENT_DMAC0, DMAC_event_callback );
+    register_event_callback( EVENT_DMAC1, DMAC_event_callback );
+    register_event_callback( EVENT_DMAC2, DMAC_event_callback );
+    register_event_callback( EVENT_DMAC3, DMAC_event_callback );
+}
+
+/**
+ * @return the number of units an auto-request transfer performs in each
+ * step (one staging buffer's worth)
+ */
+static uint32_t DMAC_step_count( uint32_t control )
+{
+    return DMAC_CHUNK_SIZE / DMAC_xfer_size[(control >> 4)&0x07];
+}
+
+/**
+ * Schedule the next step of an auto-request (memory-to-memory) transfer on
+ * the channel. The transfer is performed one staging buffer at a time, each
+ * after the time it would take on the bus, so that SAR, DAR and DMATCR
+ * show the progress of the transfer while it runs.
+ */
+static void DMAC_start_channel( uint32_t channel )
+{
+    uint32_t control = DMA_CONTROL(channel);
+    uint32_t count = DMA_COUNT(channel);
+    uint32_t step = DMAC_step_count( control );
+    if( count == 0 )
+        count = 0x01000000;
+    if( count > step )
+        count = step;
+    event_schedule( EVENT_DMAC0 + channel,
+            count * DMAC_UNIT_TIME(DMAC_xfer_size[(control >> 4)&0x07]) );
+}
+
+static void DMAC_event_callback( int eventid )
+{
+    uint32_t channel = eventid - EVENT_DMAC0;
+    DMAC_run_channel( channel, DMAC_step_count( DMA_CONTROL(channel) ) );
+    if( DMA_COUNT(channel) != 0 ) {
+        DMAC_update_channel( channel );
+    }
+}
+
+/**
+ * Update the channel state after an enable bit has changed - start or halt
+ * an auto-request transfer as required.
+ */
+static void DMAC_update_channel( uint32_t channel )
+{
+    uint32_t control = DMA_CONTROL(channel);
+    if( IS_DMAC_ENABLED() && IS_CHANNEL_ENABLED(control) && IS_AUTO_REQUEST(control) ) {
+        DMAC_start_channel( channel );
+    } else {
+        /* Halted - nothing is transferred until the channel is restarted */
+        event_cancel( EVENT_DMAC0 + channel );
+    }
+}
+
 void DMAC_set_control( uint32_t channel, uint32_t val ) 
 {
     uint32_t oldval = DMA_CONTROL(channel);
-    int resource;
     MMIO_WRITE( DMAC, CHCR0 + (channel<<4), val );
 
     /* If TE or IE are cleared, clear the interrupt request */
@@ -69,12 +143,9 @@ void DMAC_set_control( uint32_t channel, uint32_t val )
             !IS_CHANNEL_IRQ_ACTIVE(val) )
         intc_clear_interrupt( INT_DMA_DMTE0+channel );
 
-    resource = CHANNEL_RESOURCE(val);
-    if( IS_CHANNEL_ENABLED(val) ) {
-        if( resource >= DMARES_MEMORY_TO_MEMORY_AUTO && 
-                resource < DMARES_SCI_TRANSMIT_EMPTY ) {
-            /* Autorun */
-        }
+    if( IS_CHANNEL_ENABLED(val) != IS_CHANNEL_ENABLED(oldval) ||
+            CHANNEL_RESOURCE(val) != CHANNEL_RESOURCE(oldval) ) {
+        DMAC_update_channel( channel );
     }
 
     /* Everything else we don't need to care about until we actually try to
@@ -82,6 +153,18 @@ void DMAC_set_control( uint32_t channel, uint32_t val )
      */
 }
 
+static void DMAC_set_operation( uint32_t val )
+{
+    gboolean was_enabled = IS_DMAC_ENABLED();
+    int i;
+    MMIO_WRITE( DMAC, DMAOR, val );
+    if( was_enabled != IS_DMAC_ENABLED() ) {
+        for( i=0; i<4; i++ ) {
+            DMAC_update_channel( i );
+        }
+    }
+}
+
 MMIO_REGION_READ_FN( DMAC, reg )
 {
     return MMIO_READ( DMAC, reg&0xFFF );
@@ -92,9 +175,7 @@ MMIO_REGION_WRITE_FN( DMAC, reg, val )
 {
     reg &= 0xFFF;
     switch( reg ) {
-    case DMAOR:
-        MMIO_WRITE( DMAC, reg, val );
-        break;
+    case DMAOR: DMAC_set_operation( val ); break;
     case CHCR0: DMAC_set_control( 0, val ); break;
     case CHCR1: DMAC_set_control( 1, val ); break;
     case CHCR2: DMAC_set_control( 2, val ); break;
@@ -104,6 +185,137 @@ MMIO_REGION_WRITE_FN( DMAC, reg, val )
     }
 }
 
+/**
+ * @return the address increment for the given SM/DM mode bits, or
+ * DMAC_STEP_ILLEGAL.
+ */
+#define DMAC_STEP_ILLEGAL 0x7FFFFFFF
+static int DMAC_get_step( int mode, uint32_t size )
+{
+    switch( mode ) {
+    case 0: return 0;
+    case 1: return size;
+    case 2: return -size;
+    default: return DMAC_STEP_ILLEGAL;
+    }
+}
+
+/**
+ * @return TRUE if the address range can be copied in one go by
+ * mem_copy_from_sh4/mem_copy_to_sh4, ie it's all within RAM, or within one
+ * of the video RAM areas.
+ */
+static gboolean DMAC_is_bulk_range( sh4addr_t addr, uint32_t length, gboolean write )
+{
+    sh4addr_t end = addr + length - 1;
+    sh4ptr_t mem;
+
+    if( (addr & 0x1F800000) == 0x04000000 ) {
+        return (end & 0x1F800000) == 0x04000000;
+    } else if( write && addr >= 0x10000000 && end < 0x14000000 ) {
+        return TRUE; /* TA/YUV/VRAM DMA area */
+    }
+    mem = mem_get_region( addr );
+    return mem != NULL && mem_get_region( end ) == mem + (length - 1);
+}
+
+static void DMAC_read_unit( unsigned char *buf, sh4addr_t addr, uint32_t size )
+{
+    mem_region_fn_t fn = ext_address_space[addr>>12];
+    switch( size ) {
+    case 1: *buf = (uint8_t)fn->read_byte(addr); break;
+    case 2: *(uint16_t *)buf = (uint16_t)fn->read_word(addr); break;
+    case 4: *(uint32_t *)buf = fn->read_long(addr); break;
+    case 8:
+        *(uint32_t *)buf = fn->read_long(addr);
+        *(uint32_t *)(buf+4) = fn->read_long(addr+4);
+        break;
+    default: fn->read_burst(buf, addr); break;
+    }
+}
+
+static void DMAC_write_unit( sh4addr_t addr, unsigned char *buf, uint32_t size )
+{
+    mem_region_fn_t fn = ext_address_space[addr>>12];
+    switch( size ) {
+    case 1: fn->write_byte(addr, *buf); break;
+    case 2: fn->write_word(addr, *(uint16_t *)buf); break;
+    case 4: fn->write_long(addr, *(uint32_t *)buf); break;
+    case 8:
+        fn->write_long(addr, *(uint32_t *)buf);
+        fn->write_long(addr+4, *(uint32_t *)(buf+4));
+        break;
+    default: fn->write_burst(addr, buf); break;
+    }
+}
+
+/**
+ * Read count units from addr (stepping by step) into buf. Memory is read as a
+ * single block wherever possible, falling back to per-unit reads for MMIO
+ * and other special regions.
+ */
+static void DMAC_read_units( unsigned char *buf, sh4addr_t addr, int step, uint32_t size, uint32_t count )
+{
+    uint32_t i;
+    addr &= 0x1FFFFFFF;
+    if( step == (int)size && DMAC_is_bulk_range( addr, size*count, FALSE ) ) {
+        mem_copy_from_sh4( buf, addr, size*count );
+    } else if( step == 0 && DMAC_is_bulk_range( addr, size, FALSE ) ) {
+        mem_copy_from_sh4( buf, addr, size );
+        for( i=1; i<count; i++ ) {
+            memcpy( buf + i*size, buf, size );
+        }
+    } else {
+        for( i=0; i<count; i++ ) {
+            DMAC_read_unit( buf, (addr + i*step) & 0x1FFFFFFF, size );
+            buf += size;
+        }
+    }
+}
+
+/**
+ * Write count units from buf to addr (stepping by step), as for
+ * DMAC_read_units.
+ */
+static void DMAC_write_units( sh4addr_t addr, int step, unsigned char *buf, uint32_t size, uint32_t count )
+{
+    uint32_t i;
+    addr &= 0x1FFFFFFF;
+    if( step == (int)size && DMAC_is_bulk_range( addr, size*count, TRUE ) ) {
+        mem_copy_to_sh4( addr, buf, size*count );
+    } else if( step == 0 && addr >= 0x10000000 && addr < 0x14000000 ) {
+        /* The TA/YUV FIFOs don't care about the address within the area */
+        mem_copy_to_sh4( addr, buf, size*count );
+    } else if( step == 0 && DMAC_is_bulk_range( addr, size, TRUE ) ) {
+        /* Only the last unit is left in memory */
+        mem_copy_to_sh4( addr, buf + (count-1)*size, size );
+    } else {
+        for( i=0; i<count; i++ ) {
+            DMAC_write_unit( (addr + i*step) & 0x1FFFFFFF, buf, size );
+            buf += size;
+        }
+    }
+    if( (addr & 0x1F800000) == 0x05000000 ) {
+        /* Neither path above tells the texture cache about 32-bit VRAM
+         * writes, so mark everything the transfer touched. */
+        sh4addr_t start = step < 0 ? addr + step * (int)(count-1) : addr;
+        uint32_t span = (step < 0 ? -step : step) * (count-1) + size;
+        pvr2_vram32_invalidate_textures( start, span );
+    }
+}
+
+/**
+ * Mark the channel's transfer as complete, and raise the interrupt if
+ * enabled.
+ */
+static void DMAC_transfer_end( int channel, uint32_t control )
+{
+    control |= CHCR_TE;
+    if( IS_CHANNEL_IRQ_ENABLED(control) )
+        intc_raise_interrupt( INT_DMA_DMTE0 + channel );
+    MMIO_WRITE( DMAC, CHCR0 + (channel<<4), control );
+}
+
 /**
  * Execute up to run_count transfers on the specified channel. Assumes the
  * trigger for the channel has been received.
@@ -114,54 +326,52 @@ MMIO_REGION_WRITE_FN( DMAC, reg, val )
  */
 void DMAC_run_channel( uint32_t channel, uint32_t run_count )
 {
-
-#if 0 /* Should really finish this */
-    char burst[32]; /* Transfer burst */
+    unsigned char buf[DMAC_CHUNK_SIZE];
     uint32_t control = DMA_CONTROL(channel);
+    uint32_t source, dest, count, size, chunk_count;
+    int source_step, dest_step, resource;
 
-    if( IS_CHANNEL_ENABLED(control) ) {
-        uint32_t source = DMA_SOURCE(channel);
-        uint32_t dest = DMA_DEST(channel);
-        uint32_t count = DMA_COUNT( channel );
-        if( count == 0 )
-            count = 0x01000000;
-        if( run_count == 0 || run_count > count )
-            run_count = count;
-        uint32_t xfersize = DMAC_xfer_size[ (control >> 4)&0x07 ];
-        int source_step, dest_step;
-        int resource = (control >> 8) & 0x0F;
-        switch( (control >> 14) & 0x03 ) {
-        case 0: dest_step = 0; break;
-        case 1: dest_step = xfersize; break;
-        case 2: dest_step = -xfersize; break;
-        case 3: dest_step = 0; break; /* Illegal */
-        }
-        switch( (control >> 12) & 0x03 ) {
-        case 0: source_step = 0; break;
-        case 1: source_step = xfersize; break;
-        case 2: source_step = -xfersize; break;
-        case 3: source_step = 0; break; /* Illegal */
-        }
+    if( !IS_CHANNEL_ENABLED(control) || !IS_DMAC_ENABLED() )
+        return;
+    resource = CHANNEL_RESOURCE(control);
+    if( resource == DMARES_MEMORY_TO_DEVICE || resource == DMARES_DEVICE_TO_MEMORY ) {
+        /* Single-address - driven by the device through DMAC_get_buffer/put_buffer */
+        return;
+    }
 
-        while( run_count > 0 ) {
-            /* Origin */
-            if( (resource & 0x02) == 0 ) {
-                /* Source is a normal memory address */
+    source = DMA_SOURCE(channel);
+    dest = DMA_DEST(channel);
+    count = DMA_COUNT(channel);
+    if( count == 0 )
+        count = 0x01000000;
+    if( run_count == 0 || run_count > count )
+        run_count = count;
+    size = DMAC_xfer_size[ (control >> 4)&0x07 ];
+    source_step = DMAC_get_step( (control >> 12) & 0x03, size );
+    dest_step = DMAC_get_step( (control >> 14) & 0x03, size );
+    if( source_step == DMAC_STEP_ILLEGAL || dest_step == DMAC_STEP_ILLEGAL ) {
+        WARN( "DMAC channel %d: illegal address mode (CHCR=%08X)", channel, control );
+        return;
+    }
 
-            } else {
-                /* Device */
-            }
+    count -= run_count;
+    chunk_count = DMAC_CHUNK_SIZE / size;
+    while( run_count > 0 ) {
+        uint32_t n = run_count < chunk_count ? run_count : chunk_count;
+        DMAC_read_units( buf, source, source_step, size, n );
+        DMAC_write_units( dest, dest_step, buf, size, n );
+        source += source_step * (int)n;
+        dest += dest_step * (int)n;
+        run_count -= n;
+    }
 
-            /* Destination */
-            if( (resource & 0x01) == 0 ) {
-                /* Destination is a normal memory address */
-            } else {
-            }
-            run_count--; 
-            count--;
-        }
+    /* Update the channel registers */
+    MMIO_WRITE( DMAC, SAR0 + (channel<<4), source );
+    MMIO_WRITE( DMAC, DAR0 + (channel<<4), dest );
+    MMIO_WRITE( DMAC, DMATCR0 + (channel<<4), count );
+    if( count == 0 ) {
+        DMAC_transfer_end( channel, control );
     }
-#endif
 }
 
 /**
@@ -175,8 +385,8 @@ void DMAC_run_channel( uint32_t channel, uint32_t run_count )
 uint32_t DMAC_get_buffer( int channel, sh4ptr_t buf, uint32_t numBytes )
 {
     uint32_t control = DMA_CONTROL(channel);
-    uint32_t source, count, run_count, size, i;
-    char tmp[32];
+    uint32_t source, count, run_count, size;
+    int step;
 
     if( !IS_CHANNEL_ENABLED(control) || !IS_DMAC_ENABLED() )
         return 0;
@@ -196,42 +406,18 @@ uint32_t DMAC_get_buffer( int channel, sh4ptr_t buf, uint32_t numBytes )
     if( run_count > count || run_count == 0 )
         run_count = count;
 
-    /* Do copy - FIXME: doesn't work when crossing regions */
-    sh4ptr_t region = mem_get_region( source );
-    switch( (control >> 12) & 0x03 ) {
-    case 0: 
-        memcpy( tmp, region, size );
-        for( i=0; i<run_count; i++ ) {
-            memcpy( buf, tmp, size );
-            buf += size;
-        }
-        break;
-    case 1: 
-        i = run_count * size;
-        memcpy( buf, region, i );
-        source += i;
-        break;
-    case 2: 
-        for( i=0; i<run_count; i++ ) {
-            memcpy( buf, region, size );
-            buf += size;
-            region -= size;
-        }
-        source -= (run_count * size);
-        break;
-    default:
-        return 0; /* Illegal */
-    }
+    step = DMAC_get_step( (control >> 12) & 0x03, size );
+    if( step == DMAC_STEP_ILLEGAL )
+        return 0;
+    DMAC_read_units( buf, source, step, size, run_count );
+    source += step * (int)run_count;
 
     /* Update the channel registers */
     count -= run_count;
     MMIO_WRITE( DMAC, SAR0 + (channel<<4), source );
     MMIO_WRITE( DMAC, DMATCR0 + (channel<<4), count );
     if( count == 0 ) {
-        control |= CHCR_TE; 
-        if( IS_CHANNEL_IRQ_ENABLED(control) )
-            intc_raise_interrupt( INT_DMA_DMTE0 + channel );
-        MMIO_WRITE( DMAC, CHCR0 + (channel<<4), control );
+        DMAC_transfer_end( channel, control );
     }
 
     return run_count * size;
@@ -240,7 +426,8 @@ uint32_t DMAC_get_buffer( int channel, sh4ptr_t buf, uint32_t numBytes )
 uint32_t DMAC_put_buffer( int channel, sh4ptr_t buf, uint32_t numBytes )
 {
     uint32_t control = DMA_CONTROL(channel);
-    uint32_t dest, count, run_count, size, i;
+    uint32_t dest, count, run_count, size;
+    int step;
 
     if( !IS_CHANNEL_ENABLED(control) || !IS_DMAC_ENABLED() )
         return 0;
@@ -259,51 +446,32 @@ uint32_t DMAC_put_buffer( int channel, sh4ptr_t buf, uint32_t numBytes )
     if( run_count > count || run_count == 0 )
         run_count = count;
 
-    /* Do copy - FIXME: doesn't work when crossing regions */
-    sh4ptr_t region = mem_get_region( dest );
-    switch( (control >> 12) & 0x03 ) {
-    case 0: 
-        for( i=0; i<run_count; i++ ) { 
-            /* Doesn't make a whole lot of sense, but hey... */
-            memcpy( region, buf, size );
-            buf += size;
-        }
-        break;
-    case 1: 
-        i = run_count * size;
-        memcpy( region, buf, i );
-        dest += i;
-        break;
-    case 2: 
-        for( i=0; i<run_count; i++ ) {
-            memcpy( region, buf, size );
-            buf += size;
-            region -= size;
-        }
-        dest -= (run_count * size);
-        break;
-    default:
-        return 0; /* Illegal */
-    }
+    step = DMAC_get_step( (control >> 14) & 0x03, size );
+    if( step == DMAC_STEP_ILLEGAL )
+        return 0;
+    DMAC_write_units( dest, step, buf, size, run_count );
+    dest += step * (int)run_count;
 
     /* Update the channel registers */
     count -= run_count;
     MMIO_WRITE( DMAC, DAR0 + (channel<<4), dest );
     MMIO_WRITE( DMAC, DMATCR0 + (channel<<4), count );
     if( count == 0 ) {
-        control |= CHCR_TE; 
-        if( IS_CHANNEL_IRQ_ENABLED(control) )
-            intc_raise_interrupt( INT_DMA_DMTE0 + channel );
-        MMIO_WRITE( DMAC, CHCR0 + (channel<<4), control );
+        DMAC_transfer_end( channel, control );
     }
     return run_count * size;
 }
 
 void DMAC_reset( void )
 {
-
+    int i;
+    for( i=0; i<4; i++ ) {
+        event_cancel( EVENT_DMAC0 + i );
+    }
 }
 
+/* Transfers in progress are held entirely in the channel registers and the
+ * event queue, so there's no other state to save */
 void DMAC_save_state( FILE *F ) 
 {
 
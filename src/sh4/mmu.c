@@ -42,6 +42,7 @@ static mem_region_fn_t *sh4_ext_address_space;
 uint32_t mmu_urc;
 uint32_t mmu_urb;
 static gboolean mmu_urc_overflow; /* If true, urc was set >= urb */  
+static gboolean mmu_tlb_mapped; /* If true, the address space is currently mapped through the TLB */
 
 /* Module globals */
 static struct itlb_entry mmu_itlb[ITLB_ENTRY_COUNT];
@@ -179,6 +180,16 @@ void MMU_save_state( FILE *f )
     fwrite( &mmu_asid, sizeof(mmu_asid), 1, f );
 }
 
+/**
+ * @return TRUE if the address space is currently mapped through the TLB.
+ * This reflects the last MMUCR.AT setting actually applied, which may differ
+ * from the MMUCR register while a saved state is being restored.
+ */
+gboolean MMU_is_tlb_mapped( void )
+{
+    return mmu_tlb_mapped;
+}
+
 int MMU_load_state( FILE *f )
 {
     if( fread( &mmu_itlb, sizeof(mmu_itlb), 1, f ) != 1 ) {
@@ -308,10 +319,13 @@ MMIO_REGION_WRITE_FN( MMU, reg, val )
         val &= 0x0000001C;
         break;
     case PMCR1:
+        /* Store the register first, as the write may exit the current block */
+        MMIO_WRITE( MMU, PMCR1, val & 0x0000C13F );
         PMM_write_control(0, val);
         val &= 0x0000C13F;
         break;
     case PMCR2:
+        MMIO_WRITE( MMU, PMCR2, val & 0x0000C13F );
         PMM_write_control(1, val);
         val &= 0x0000C13F;
         break;
@@ -428,6 +442,8 @@ static void mmu_set_tlb_enabled( int tlb_on )
     mem_region_fn_t *ptr;
     int i;
     
+    mmu_tlb_mapped = tlb_on ? TRUE : FALSE;
+
     /* Reset the storequeue area */
 
     if( tlb_on ) {
@@ -18,12 +18,17 @@
 
 #include "sh4/sh4mmio.h"
 #include "sh4/sh4core.h"
+#include "sh4/sh4trans.h"
 #include "clock.h"
 
 /*
  * Performance counter list from Paul Mundt's OProfile patch
- * Currently only 0x23 is actually supported, since it doesn't require any
- * actual instrumentation
+ * 0x23 is counted from the elapsed time. The events that can be determined
+ * statically from the instructions (0x01, 0x02, 0x09, 0x0e, 0x10, 0x12, 0x13,
+ * 0x15 and 0x18) are counted by the translator, which adds each block's count
+ * to pmm_event_count[] on entry to the block - but only while a counter is
+ * actually running in one of those modes. All other events are unsupported
+ * and always read as 0; the interpreter counts none of the instruction events.
  * 
  *     0x01            Operand read access
  *     0x02            Operand write access
@@ -67,6 +72,159 @@ struct PMM_counter_struct {
 
 static struct PMM_counter_struct PMM_counter[2] = {{0,0},{0,0}};
 
+uint32_t pmm_event_count[2] = {0,0};
+
+struct PMM_events {
+    uint32_t reads, writes, branches, calls, fpu, trapa;
+};
+
+/**
+ * Accumulate the events that the given instruction will generate, as far as
+ * they can be determined without executing it.
+ */
+static void PMM_classify( uint16_t ir, struct PMM_events *ev )
+{
+    switch( ir >> 12 ) {
+    case 0x0:
+        switch( ir & 0x000F ) {
+        case 0x3:
+            if( (ir & 0x00F0) == 0x0000 ) { /* BSRF */
+                ev->branches++;
+                ev->calls++;
+            } else if( (ir & 0x00F0) == 0x0020 ) { /* BRAF */
+                ev->branches++;
+            } else if( (ir & 0x00F0) == 0x00C0 ) { /* MOVCA.L */
+                ev->writes++;
+            }
+            break;
+        case 0x4: case 0x5: case 0x6: /* MOV.x Rm, @(R0,Rn) */
+            ev->writes++;
+            break;
+        case 0xB:
+            if( ir == 0x000B || ir == 0x002B ) /* RTS, RTE */
+                ev->branches++;
+            break;
+        case 0xC: case 0xD: case 0xE: /* MOV.x @(R0,Rm), Rn */
+            ev->reads++;
+            break;
+        case 0xF: /* MAC.L */
+            ev->reads += 2;
+            break;
+        }
+        break;
+    case 0x1: /* MOV.L Rm, @(disp,Rn) */
+        ev->writes++;
+        break;
+    case 0x2:
+        if( (ir & 0x000F) <= 0x2 || ((ir & 0x000F) >= 0x4 && (ir & 0x000F) <= 0x6) )
+            ev->writes++;
+        break;
+    case 0x4:
+        switch( ir & 0x000F ) {
+        case 0x2: case 0x3: /* STS.L, STC.L */
+            ev->writes++;
+            break;
+        case 0x6: case 0x7: /* LDS.L, LDC.L */
+            ev->reads++;
+            break;
+        case 0xB:
+            if( (ir & 0x00F0) == 0x0000 ) { /* JSR */
+                ev->branches++;
+                ev->calls++;
+            } else if( (ir & 0x00F0) == 0x0010 ) { /* TAS.B */
+                ev->reads++;
+                ev->writes++;
+            } else if( (ir & 0x00F0) == 0x0020 ) { /* JMP */
+                ev->branches++;
+            }
+            break;
+        case 0xF: /* MAC.W */
+            ev->reads += 2;
+            break;
+        }
+        break;
+    case 0x5: /* MOV.L @(disp,Rm), Rn */
+    case 0x9: /* MOV.W @(disp,PC), Rn */
+    case 0xD: /* MOV.L @(disp,PC), Rn */
+        ev->reads++;
+        break;
+    case 0x6:
+        if( (ir & 0x000F) <= 0x2 || ((ir & 0x000F) >= 0x4 && (ir & 0x000F) <= 0x6) )
+            ev->reads++;
+        break;
+    case 0x8:
+        switch( (ir >> 8) & 0x0F ) {
+        case 0x0: case 0x1: ev->writes++; break;
+        case 0x4: case 0x5: ev->reads++; break;
+        case 0x9: case 0xB: case 0xD: case 0xF: ev->branches++; break;
+        }
+        break;
+    case 0xA: /* BRA */
+        ev->branches++;
+        break;
+    case 0xB: /* BSR */
+        ev->branches++;
+        ev->calls++;
+        break;
+    case 0xC:
+        switch( (ir >> 8) & 0x0F ) {
+        case 0x0: case 0x1: case 0x2: ev->writes++; break;
+        case 0x3: ev->trapa++; break;
+        case 0x4: case 0x5: case 0x6: case 0xC: ev->reads++; break;
+        case 0xD: case 0xE: case 0xF: ev->reads++; ev->writes++; break;
+        }
+        break;
+    case 0xF:
+        ev->fpu++;
+        switch( ir & 0x000F ) {
+        case 0x6: case 0x8: case 0x9: ev->reads++; break;
+        case 0x7: case 0xA: case 0xB: ev->writes++; break;
+        }
+        break;
+    }
+}
+
+/**
+ * @return TRUE if the mode is counted by instrumenting translated code.
+ */
+static gboolean PMM_is_instrumented_mode( uint32_t mode )
+{
+    switch( mode ) {
+    case 0x01: case 0x02: case 0x09: case 0x0e: case 0x10:
+    case 0x12: case 0x13: case 0x15: case 0x18:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+gboolean PMM_is_instrumented( int ctr )
+{
+    return PMM_is_instrumented_mode( PMM_counter[ctr].mode );
+}
+
+uint32_t PMM_count_block_events( int ctr, sh4addr_t start, sh4addr_t end )
+{
+    struct PMM_events ev = {0,0,0,0,0,0};
+    sh4addr_t pc;
+
+    for( pc = start; pc < end; pc += 2 ) {
+        PMM_classify( *(uint16_t *)GET_ICACHE_PTR(pc), &ev );
+    }
+
+    switch( PMM_counter[ctr].mode ) {
+    case 0x01: return ev.reads;
+    case 0x02: return ev.writes;
+    case 0x09: case 0x0e: return ev.reads + ev.writes;
+    case 0x10: return ev.branches;
+    case 0x12: return ev.calls;
+    case 0x13: return (end - start) >> 1;
+    case 0x15: return ev.fpu;
+    case 0x18: return ev.trapa;
+    default: return 0;
+    }
+}
+
 void PMM_reset(void)
 {
     PMM_counter[0].count = 0;
@@ -75,6 +233,7 @@ void PMM_reset(void)
     PMM_counter[1].count = 0;
     PMM_counter[1].mode = 0;
     PMM_counter[1].runfor = 0;
+    pmm_event_count[0] = pmm_event_count[1] = 0;
 }
 
 void PMM_save_state( FILE *f ) {
@@ -84,6 +243,7 @@ void PMM_save_state( FILE *f ) {
 int PMM_load_state( FILE *f ) 
 {
     fread( &PMM_counter, sizeof(PMM_counter), 1, f );
+    pmm_event_count[0] = pmm_event_count[1] = 0;
     return 0;
 }
 
@@ -96,8 +256,10 @@ void PMM_count( int ctr, uint32_t runfor )
         PMM_counter[ctr].count += (delta / (1000/SH4_BASE_RATE)); 
         break;
     default:
+        PMM_counter[ctr].count += pmm_event_count[ctr];
         break;
     }
+    pmm_event_count[ctr] = 0;
     
     PMM_counter[ctr].runfor = runfor;
 }
@@ -119,15 +281,18 @@ void PMM_write_control( int ctr, uint32_t val )
     if( PMM_counter[ctr].mode == 0 && (val & PMCR_PMCLR) != 0 ) {
         PMM_counter[ctr].count = 0;
     }
-    if( is_running ) {
-        int mode = val & 0x3F;
-        if( mode != PMM_counter[ctr].mode ) {
-            /* Instrumentation setup goes here */
-            PMM_counter[ctr].mode = mode;
+    int mode = is_running ? (val & 0x3F) : 0;
+    if( mode != PMM_counter[ctr].mode ) {
+        gboolean retranslate = PMM_is_instrumented_mode(mode) ||
+            PMM_is_instrumented_mode(PMM_counter[ctr].mode);
+        PMM_counter[ctr].mode = mode;
+        if( retranslate ) {
+            /* Existing blocks have the wrong instrumentation (or none) */
+            sh4_core_exit( CORE_EXIT_FLUSH_ICACHE );
+            if( sh4_translate_is_enabled() ) {
+                xlat_flush_cache(); // If we're not running, flush the cache anyway
+            }
         }
-    } else if( PMM_counter[ctr].mode != 0 ) {
-        /* Instrumentation removal goes here */
-        PMM_counter[ctr].mode = 0;
     }
 }
 
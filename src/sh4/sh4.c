@@ -21,6 +21,9 @@
 #include <math.h>
 #include <setjmp.h>
 #include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include "lxdream.h"
 #include "dreamcast.h"
 #include "cpu.h"
@@ -34,6 +37,7 @@
 #include "sh4/sh4dasm.h"
 #include "sh4/sh4mmio.h"
 #include "sh4/sh4stat.h"
+#include "sh4/sh4trace.h"
 #include "sh4/sh4trans.h"
 #include "xlat/xltcache.h"
 
@@ -47,6 +51,9 @@ void sh4_start( void );
 void sh4_stop( void );
 void sh4_save_state( FILE *f );
 int sh4_load_state( FILE *f );
+static int sh4_load_snapshot( FILE *f );
+static gboolean sh4_set_watchpoint( uint32_t addr, size_t length, int flags );
+static gboolean sh4_clear_watchpoint( uint32_t addr, size_t length, int flags );
 size_t sh4_debug_read_phys( unsigned char *buf, uint32_t addr, size_t length );
 size_t sh4_debug_write_phys( uint32_t addr, unsigned char *buf, size_t length );
 size_t sh4_debug_read_vma( unsigned char *buf, uint32_t addr, size_t length );
@@ -137,14 +144,16 @@ const struct cpu_desc_struct sh4_cpu_desc =
             sh4_execute_instruction, 
       sh4_set_breakpoint, sh4_clear_breakpoint, sh4_get_breakpoint, 2,
       (char *)&sh4r, sizeof(sh4r), sh4_reg_map, 23, 59,
-      &sh4r.pc };
+      &sh4r.pc, sh4_set_conditional_breakpoint, sh4_set_watchpoint,
+      sh4_clear_watchpoint, mem_get_watch_hit };
 
 struct dreamcast_module sh4_module = { "SH4", sh4_init, sh4_poweron_reset, 
         sh4_start, sh4_run_slice, sh4_stop,
-        sh4_save_state, sh4_load_state };
+        sh4_save_state, sh4_load_state, NULL, sh4_load_snapshot };
 
 struct sh4_registers sh4r __attribute__((aligned(16)));
 struct breakpoint_struct sh4_breakpoints[MAX_BREAKPOINTS];
+struct sh4_breakpoint_cond sh4_breakpoint_conds[MAX_BREAKPOINTS];
 int sh4_breakpoint_count = 0;
 
 gboolean sh4_starting = FALSE;
@@ -188,6 +197,7 @@ void sh4_init(void)
     register_event_callback( EVENT_ENDTIMESLICE, sh4_dummy_event );
     MMU_init();
     TMU_init();
+    DMAC_init();
     xlat_cache_init();
     sh4_poweron_reset();
 #ifdef ENABLE_SH4STATS
@@ -222,6 +232,7 @@ void sh4_poweron_reset(void)
 
     /* Peripheral modules */
     CPG_reset();
+    DMAC_reset();
     INTC_reset();
     PMM_reset();
     TMU_reset();
@@ -257,6 +268,7 @@ uint32_t sh4_run_slice( uint32_t nanosecs )
         sh4_clear_breakpoint( sh4r.pc, BREAK_ONESHOT );
         /* fallthrough */
     case CORE_EXIT_HALT:
+        sh4_trace_slice_end();
         if( sh4r.sh4_state != SH4_STATE_STANDBY ) {
             TMU_run_slice( sh4r.slice_cycle );
             SCIF_run_slice( sh4r.slice_cycle );
@@ -295,6 +307,7 @@ uint32_t sh4_run_slice( uint32_t nanosecs )
 
     sh4_running = FALSE;
     sh4_starting = FALSE;
+    sh4_trace_slice_end();
     sh4r.slice_cycle = nanosecs;
     if( sh4r.sh4_state != SH4_STATE_STANDBY ) {
         TMU_run_slice( nanosecs );
@@ -348,9 +361,25 @@ int sh4_load_state( FILE * f )
     if(	sh4_use_translator ) {
         xlat_flush_cache();
     }
+    return sh4_load_snapshot( f );
+}
+
+/**
+ * Snapshot restores flush the pages they change from the translation cache
+ * individually, so the cache only needs to be flushed here if translated
+ * code may depend on the TLB - ie if it was enabled either before or after
+ * the restore. (MMUCR itself has already been restored along with the other
+ * MMIO registers by this point, so the prior state comes from the MMU)
+ */
+static int sh4_load_snapshot( FILE *f )
+{
+    gboolean tlb_was_mapped = MMU_is_tlb_mapped();
     fread( &sh4r, offsetof(struct sh4_registers, xlat_sh4_mode), 1, f );
     sh4r.xlat_sh4_mode = (sh4r.sr & SR_MD) | (sh4r.fpscr & (FPSCR_SZ|FPSCR_PR));
     MMU_load_state( f );
+    if( sh4_use_translator && (tlb_was_mapped || MMU_is_tlb_mapped()) ) {
+        xlat_flush_cache();
+    }
     CCN_load_state( f );
     PMM_load_state( f );
     INTC_load_state( f );
@@ -358,14 +387,154 @@ int sh4_load_state( FILE * f )
     return SCIF_load_state( f );
 }
 
-void sh4_set_breakpoint( uint32_t pc, breakpoint_type_t type )
+static gboolean sh4_add_breakpoint( uint32_t pc, breakpoint_type_t type, const struct sh4_breakpoint_cond *cond )
 {
+    if( sh4_breakpoint_count == MAX_BREAKPOINTS ) {
+        WARN( "Too many breakpoints (maximum is %d)", MAX_BREAKPOINTS );
+        return FALSE;
+    }
     sh4_breakpoints[sh4_breakpoint_count].address = pc;
     sh4_breakpoints[sh4_breakpoint_count].type = type;
+    sh4_breakpoint_conds[sh4_breakpoint_count] = *cond;
     if( sh4_use_translator ) {
         xlat_invalidate_word( pc );
     }
     sh4_breakpoint_count++;
+    return TRUE;
+}
+
+void sh4_set_breakpoint( uint32_t pc, breakpoint_type_t type )
+{
+    struct sh4_breakpoint_cond always = { BREAK_COND_ALWAYS, -1, NULL, 0, 0 };
+    sh4_add_breakpoint( pc, type, &always );
+}
+
+static const struct {
+    const char *name;
+    int offset;
+} sh4_breakpoint_regs[] = {
+    { "r0", offsetof(struct sh4_registers, r[0]) }, { "r1", offsetof(struct sh4_registers, r[1]) },
+    { "r2", offsetof(struct sh4_registers, r[2]) }, { "r3", offsetof(struct sh4_registers, r[3]) },
+    { "r4", offsetof(struct sh4_registers, r[4]) }, { "r5", offsetof(struct sh4_registers, r[5]) },
+    { "r6", offsetof(struct sh4_registers, r[6]) }, { "r7", offsetof(struct sh4_registers, r[7]) },
+    { "r8", offsetof(struct sh4_registers, r[8]) }, { "r9", offsetof(struct sh4_registers, r[9]) },
+    { "r10", offsetof(struct sh4_registers, r[10]) }, { "r11", offsetof(struct sh4_registers, r[11]) },
+    { "r12", offsetof(struct sh4_registers, r[12]) }, { "r13", offsetof(struct sh4_registers, r[13]) },
+    { "r14", offsetof(struct sh4_registers, r[14]) }, { "r15", offsetof(struct sh4_registers, r[15]) },
+    { "pr", offsetof(struct sh4_registers, pr) }, { "t", offsetof(struct sh4_registers, t) },
+    { "fpul", offsetof(struct sh4_registers, fpul) }, { "fpscr", offsetof(struct sh4_registers, fpscr) },
+    { "macl", offsetof(struct sh4_registers, mac) }, { "mach", offsetof(struct sh4_registers, mac)+4 },
+    { "gbr", offsetof(struct sh4_registers, gbr) }, { "vbr", offsetof(struct sh4_registers, vbr) },
+    { "ssr", offsetof(struct sh4_registers, ssr) }, { "spc", offsetof(struct sh4_registers, spc) },
+    { "sgr", offsetof(struct sh4_registers, sgr) }, { "dbr", offsetof(struct sh4_registers, dbr) },
+    { NULL, 0 } };
+
+static const struct {
+    const char *name;
+    breakpoint_cond_op_t op;
+} sh4_breakpoint_ops[] = {
+    { "==", BREAK_COND_EQ }, { "!=", BREAK_COND_NE }, { "<=", BREAK_COND_LE },
+    { ">=", BREAK_COND_GE }, { "<", BREAK_COND_LT }, { ">", BREAK_COND_GT }, { NULL, 0 } };
+
+static gboolean sh4_parse_breakpoint_cond( const char *str, struct sh4_breakpoint_cond *cond )
+{
+    const char *p = str;
+    char *end;
+    int i;
+
+    cond->mask = 0xFFFFFFFF;
+    while( *p == ' ' ) p++;
+    if( *p == '[' ) {
+        uint32_t addr = strtoul( p+1, &end, 0 );
+        sh4ptr_t mem = mem_get_region( addr & 0x1FFFFFFC );
+        if( end == p+1 || *end != ']' || mem == NULL )
+            return FALSE;
+        cond->reg_offset = -1;
+        cond->mem = (uint32_t *)mem;
+        p = end+1;
+    } else {
+        for( i=0; sh4_breakpoint_regs[i].name != NULL; i++ ) {
+            size_t len = strlen(sh4_breakpoint_regs[i].name);
+            if( strncasecmp( p, sh4_breakpoint_regs[i].name, len ) == 0 &&
+                    !isalnum(p[len]) ) {
+                break;
+            }
+        }
+        if( sh4_breakpoint_regs[i].name == NULL )
+            return FALSE;
+        cond->reg_offset = sh4_breakpoint_regs[i].offset;
+        cond->mem = NULL;
+        p += strlen(sh4_breakpoint_regs[i].name);
+    }
+
+    while( *p == ' ' ) p++;
+    if( *p == '&' ) {
+        cond->mask = strtoul( p+1, &end, 0 );
+        if( end == p+1 )
+            return FALSE;
+        p = end;
+        while( *p == ' ' ) p++;
+    }
+    for( i=0; sh4_breakpoint_ops[i].name != NULL; i++ ) {
+        size_t len = strlen(sh4_breakpoint_ops[i].name);
+        if( strncmp( p, sh4_breakpoint_ops[i].name, len ) == 0 ) {
+            break;
+        }
+    }
+    if( sh4_breakpoint_ops[i].name == NULL )
+        return FALSE;
+    cond->op = sh4_breakpoint_ops[i].op;
+    p += strlen(sh4_breakpoint_ops[i].name);
+    cond->value = strtoul( p, &end, 0 );
+    if( end == p )
+        return FALSE;
+    while( *end == ' ' ) end++;
+    return *end == '\0';
+}
+
+gboolean sh4_set_conditional_breakpoint( uint32_t pc, breakpoint_type_t type, const char *condition )
+{
+    struct sh4_breakpoint_cond cond;
+    if( !sh4_parse_breakpoint_cond( condition, &cond ) ) {
+        return FALSE;
+    }
+    return sh4_add_breakpoint( pc, type, &cond );
+}
+
+gboolean sh4_breakpoint_cond_test( const struct sh4_breakpoint_cond *cond )
+{
+    uint32_t val;
+    if( cond->op == BREAK_COND_ALWAYS )
+        return TRUE;
+    if( cond->reg_offset == -1 ) {
+        val = *cond->mem;
+    } else {
+        val = *(uint32_t *)(((char *)&sh4r) + cond->reg_offset);
+    }
+    val &= cond->mask;
+    switch( cond->op ) {
+    case BREAK_COND_EQ: return val == cond->value;
+    case BREAK_COND_NE: return val != cond->value;
+    case BREAK_COND_LT: return val < cond->value;
+    case BREAK_COND_LE: return val <= cond->value;
+    case BREAK_COND_GT: return val > cond->value;
+    case BREAK_COND_GE: return val >= cond->value;
+    default: return TRUE;
+    }
+}
+
+static gboolean sh4_set_watchpoint( uint32_t addr, size_t length, int flags )
+{
+    return mem_new_watch( addr, addr+length-1, flags ) != NULL;
+}
+
+static gboolean sh4_clear_watchpoint( uint32_t addr, size_t length, int flags )
+{
+    watch_point_t watch = mem_find_watch( addr, addr+length-1, flags );
+    if( watch == NULL )
+        return FALSE;
+    mem_delete_watch( watch );
+    return TRUE;
 }
 
 gboolean sh4_clear_breakpoint( uint32_t pc, breakpoint_type_t type )
@@ -378,6 +547,7 @@ gboolean sh4_clear_breakpoint( uint32_t pc, breakpoint_type_t type )
             while( ++i < sh4_breakpoint_count ) {
                 sh4_breakpoints[i-1].address = sh4_breakpoints[i].address;
                 sh4_breakpoints[i-1].type = sh4_breakpoints[i].type;
+                sh4_breakpoint_conds[i-1] = sh4_breakpoint_conds[i];
             }
             if( sh4_use_translator ) {
                 xlat_invalidate_word( pc );
@@ -495,6 +665,7 @@ uint32_t FASTCALL sh4_read_sr( void )
  */
 void FASTCALL sh4_raise_reset( int code )
 {
+    sh4_trace_event( code, SH4_TRACE_EVENT_RESET );
     MMIO_WRITE(MMU,EXPEVT,code);
     sh4r.vbr = 0x00000000;
     sh4r.pc = 0xA0000000;
@@ -524,6 +695,7 @@ void FASTCALL sh4_raise_exception( int code )
     if( sh4r.sr & SR_BL ) {
         sh4_raise_reset( EXC_MANUAL_RESET );
     } else {
+        sh4_trace_event( code, SH4_TRACE_EVENT_EXCEPTION );
         sh4r.spc = sh4r.pc;
         sh4r.ssr = sh4_read_sr();
         sh4r.sgr = sh4r.r[15];
@@ -537,6 +709,7 @@ void FASTCALL sh4_raise_exception( int code )
 
 void FASTCALL sh4_raise_trap( int trap )
 {
+    sh4_trace_event( EXC_TRAP, SH4_TRACE_EVENT_EXCEPTION );
     MMIO_WRITE( MMU, TRA, trap<<2 );
     MMIO_WRITE( MMU, EXPEVT, EXC_TRAP );
     sh4r.spc = sh4r.pc;
@@ -553,6 +726,7 @@ void FASTCALL sh4_raise_tlb_exception( int code, sh4vma_t vpn )
     MMIO_WRITE( MMU, TEA, vpn );
     MMIO_WRITE( MMU, PTEH, ((MMIO_READ(MMU, PTEH) & 0x000003FF) | (vpn&0xFFFFFC00)) );
     MMIO_WRITE( MMU, EXPEVT, code );
+    sh4_trace_event( code, SH4_TRACE_EVENT_EXCEPTION );
     sh4r.spc = sh4r.pc;
     sh4r.ssr = sh4_read_sr();
     sh4r.sgr = sh4r.r[15];
@@ -564,6 +738,7 @@ void FASTCALL sh4_raise_tlb_exception( int code, sh4vma_t vpn )
 
 void FASTCALL sh4_reraise_exception( sh4addr_t exception_pc )
 {
+    sh4_trace_event( MMIO_READ( MMU, EXPEVT ), SH4_TRACE_EVENT_EXCEPTION );
     sh4r.spc = sh4r.pc;
     sh4r.ssr = sh4_read_sr();
     sh4r.sgr = sh4r.r[15];
@@ -576,6 +751,7 @@ void FASTCALL sh4_reraise_exception( sh4addr_t exception_pc )
 void FASTCALL sh4_accept_interrupt( void )
 {
     uint32_t code = intc_accept_interrupt();
+    sh4_trace_event( code, SH4_TRACE_EVENT_INTERRUPT );
     MMIO_WRITE( MMU, INTEVT, code );
     sh4r.ssr = sh4_read_sr();
     sh4r.spc = sh4r.pc;
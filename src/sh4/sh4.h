@@ -145,6 +145,16 @@ void sh4_set_breakpoint( uint32_t pc, breakpoint_type_t type );
 gboolean sh4_clear_breakpoint( uint32_t pc, breakpoint_type_t type );
 int sh4_get_breakpoint( uint32_t pc );
 
+/**
+ * Set a breakpoint that only stops when the condition holds. The condition
+ * has the form "<operand> [& <mask>] <op> <value>", where operand is a
+ * register name (eg r4, pr, fpul) or [<address>] for a long word of RAM, and
+ * op is one of == != < <= > >= (unsigned). Eg "r4 == 0x10" or
+ * "[0x8c010000] & 0xff != 0".
+ * @return FALSE if the condition is invalid.
+ */
+gboolean sh4_set_conditional_breakpoint( uint32_t pc, breakpoint_type_t type, const char *condition );
+
 /** Dump current SH4 core state (for crashdump purposes) */
 void sh4_crashdump();
 
@@ -161,6 +171,48 @@ void sh4_set_profile_blocks( gboolean flag );
  */
 gboolean sh4_get_profile_blocks();
 
+#define SH4_PROFILE_DEFAULT_RATE 1000
+
+/**
+ * Start the sampling profiler, recording the SH4 PC and call stack at the
+ * given rate (in samples per second of host CPU time). Must be called from
+ * the thread that runs the SH4.
+ * @param filename file to write the profile to when it's stopped.
+ */
+gboolean sh4_profiler_start( const gchar *filename, unsigned int rate );
+
+/**
+ * Stop the sampling profiler, and write out the profile in folded stack
+ * format (as used by flame graph tools).
+ */
+void sh4_profiler_stop( void );
+
+gboolean sh4_profiler_is_running( void );
+
+/**
+ * Move samples from the profiler's buffer into the profile. Should be called
+ * regularly (ie between time slices) while the profiler is running.
+ */
+void sh4_profiler_collect( void );
+
+#define SH4_TRACE_MEMORY 1 /* Record memory operations as well as blocks */
+#define SH4_TRACE_DEFAULT_LIMIT (256*1024*1024)
+
+/**
+ * Start recording a binary execution trace (see sh4trace.h for the format).
+ * Requires the translator, and must be called while the SH4 is stopped.
+ * @param flags SH4_TRACE_MEMORY to record memory operations
+ * @param file_limit size at which to rotate the trace file, or 0 for no limit
+ */
+gboolean sh4_trace_start( const gchar *filename, int flags, uint64_t file_limit );
+
+/**
+ * Stop recording, flushing the trace out to the file.
+ */
+void sh4_trace_stop( void );
+
+gboolean sh4_trace_is_running( void );
+
 struct sh4_symbol {
 	const char *name;
 	sh4addr_t address;
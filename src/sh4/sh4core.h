@@ -32,6 +32,31 @@ extern "C" {
 /* Breakpoint data structure */
 extern struct breakpoint_struct sh4_breakpoints[MAX_BREAKPOINTS];
 extern int sh4_breakpoint_count;
+
+/**
+ * Breakpoint conditions - a conditional breakpoint only stops if
+ *   (operand & mask) <op> value
+ * where the operand is either a register or a long word of RAM. Comparisons
+ * are unsigned. Unconditional breakpoints have op == BREAK_COND_ALWAYS.
+ */
+typedef enum { BREAK_COND_ALWAYS = 0, BREAK_COND_EQ, BREAK_COND_NE, BREAK_COND_LT,
+    BREAK_COND_LE, BREAK_COND_GT, BREAK_COND_GE } breakpoint_cond_op_t;
+
+struct sh4_breakpoint_cond {
+    breakpoint_cond_op_t op;
+    int reg_offset;   /* Offset of the register in sh4r, or -1 for memory */
+    uint32_t *mem;    /* Host pointer to the memory operand */
+    uint32_t mask;
+    uint32_t value;
+};
+
+/* Condition of each breakpoint in sh4_breakpoints */
+extern struct sh4_breakpoint_cond sh4_breakpoint_conds[MAX_BREAKPOINTS];
+
+/**
+ * @return TRUE if the breakpoint condition currently holds.
+ */
+gboolean sh4_breakpoint_cond_test( const struct sh4_breakpoint_cond *cond );
 extern gboolean sh4_starting;
 extern gboolean sh4_profile_blocks;
 
@@ -143,6 +168,7 @@ void sh4_flush_icache();
 
 /* SH4 peripheral module functions */
 void CPG_reset( void );
+void DMAC_init( void );
 void DMAC_reset( void );
 void DMAC_run_slice( uint32_t );
 void DMAC_save_state( FILE * );
@@ -154,6 +180,7 @@ void MMU_init( void );
 void MMU_reset( void );
 void MMU_save_state( FILE *f );
 int MMU_load_state( FILE *f );
+gboolean MMU_is_tlb_mapped( void );
 void MMU_ldtlb();
 void CCN_reset();
 void CCN_set_cache_control( int reg );
@@ -175,6 +202,18 @@ void PMM_write_control( int, uint32_t );
 void PMM_save_state( FILE * );
 int PMM_load_state( FILE * );
 uint32_t PMM_run_slice( uint32_t );
+/**
+ * Performance counter instrumentation - translated blocks add their event
+ * count for each instrumented counter to pmm_event_count[ctr] on entry.
+ */
+extern uint32_t pmm_event_count[2];
+gboolean PMM_is_instrumented( int ctr );
+uint32_t PMM_count_block_events( int ctr, sh4addr_t start, sh4addr_t end );
+
+/* Execution trace hooks */
+void sh4_trace_event( uint32_t code, int kind );
+void sh4_trace_block_translated( sh4vma_t start, sh4vma_t end );
+void sh4_trace_slice_end( void );
 uint32_t sh4_translate_run_slice(uint32_t);
 uint32_t sh4_emulate_run_slice(uint32_t);
 
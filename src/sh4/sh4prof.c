@@ -0,0 +1,356 @@
+/**
+ * $Id$
+ *
+ * Sampling profiler for guest (SH4) code. A profiling timer signal records
+ * the current SH4 PC and a guess at the call stack into a small ring buffer,
+ * which is drained between time slices into a table of stack counts. On
+ * stop, the table is written out in the "folded stack" format used by flame
+ * graph tools, one stack per line:
+ *     outer;inner;leaf count
+ * symbolised with the current symbol table (ie from an ELF program).
+ *
+ * When the translator is running, sh4r.pc holds the start of the current
+ * block, so the host PC is mapped back to the exact instruction through the
+ * block's recovery table. If the host is outside translated code (eg in a
+ * memory access helper), the sample is charged to the start of the block.
+ *
+ * The call stack is recovered heuristically, as SH4 code is normally built
+ * without frame pointers: PR gives the caller of a leaf function, and the
+ * stack is scanned upwards from R15 for words that look like return
+ * addresses (ie that follow a JSR, BSR or BSRF).
+ *
+ * On Linux the sampling timer runs on the CPU clock of the SH4 thread and
+ * signals that thread directly, so time spent in other threads (workers,
+ * GUI) isn't sampled at all. Elsewhere it falls back to the process-wide
+ * ITIMER_PROF, and samples that land on other threads are counted as
+ * missed.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PROFILE_THREAD_TIMER 1
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+#include <glib.h>
+#include "lxdream.h"
+#include "dreamcast.h"
+#include "sh4/sh4.h"
+#include "sh4/sh4core.h"
+#include "sh4/sh4dasm.h"
+#include "xlat/xltcache.h"
+
+#define PROFILE_MAX_DEPTH 16
+#define PROFILE_RING_SIZE 4096 /* Must be a power of 2 */
+#define PROFILE_STACK_SCAN_WORDS 512
+
+struct profile_sample {
+    uint32_t depth;
+    sh4addr_t frames[PROFILE_MAX_DEPTH]; /* Innermost first */
+};
+
+static struct {
+    gboolean running;
+    gchar *filename;
+    unsigned int rate;
+    pthread_t thread;          /* Thread running the SH4 */
+#ifdef PROFILE_THREAD_TIMER
+    timer_t timer;
+#endif
+    struct sigaction old_action;
+    /* Ring buffer - head is only written by the signal handler, tail only
+     * by sh4_profiler_collect() */
+    struct profile_sample *ring;
+    volatile uint32_t head, tail;
+    uint32_t dropped;          /* Samples lost to a full ring */
+    uint32_t missed;           /* Samples taken on some other thread */
+    GHashTable *stacks;        /* Raw stack key -> count */
+    uint32_t sample_count;
+} profiler;
+
+#define MAIN_RAM_WORD(addr) (*(uint32_t *)(dc_main_ram + ((addr) & 0x00FFFFFC)))
+#define MAIN_RAM_HALF(addr) (*(uint16_t *)(dc_main_ram + ((addr) & 0x00FFFFFE)))
+#define IS_MAIN_RAM(addr) (((addr) & 0x1C000000) == 0x0C000000)
+
+/**
+ * @return TRUE if addr looks like a return address, ie the instruction
+ * before the delay slot is a call.
+ */
+static gboolean is_return_address( sh4addr_t addr )
+{
+    uint16_t op;
+    if( (addr & 1) || !IS_MAIN_RAM(addr) || !IS_MAIN_RAM(addr-4) )
+        return FALSE;
+    op = MAIN_RAM_HALF(addr-4);
+    return (op & 0xF000) == 0xB000 ||   /* BSR disp */
+            (op & 0xF0FF) == 0x400B ||  /* JSR @Rn */
+            (op & 0xF0FF) == 0x0003;    /* BSRF Rn */
+}
+
+static void *host_pc_from_context( void *context )
+{
+    ucontext_t *uc = context;
+#if defined(__APPLE__) && defined(__x86_64__)
+    return (void *)uc->uc_mcontext->__ss.__rip;
+#elif defined(__APPLE__) && defined(__i386__)
+    return (void *)uc->uc_mcontext->__ss.__eip;
+#elif defined(__linux__) && defined(__x86_64__)
+    return (void *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__i386__)
+    return (void *)uc->uc_mcontext.gregs[REG_EIP];
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * @return the SH4 PC at the point of the sample.
+ */
+static sh4addr_t profile_get_pc( void *context )
+{
+    sh4addr_t pc = sh4r.pc;
+    if( sh4_translate_is_enabled() && IS_IN_ICACHE(pc) ) {
+        void *code = xlat_get_code( GET_ICACHE_PHYS(pc) );
+        uint8_t *host_pc = host_pc_from_context( context );
+        /* Only trust the block if we're actually executing inside it - in
+         * which case it can't be in the middle of being modified */
+        if( code != NULL && host_pc >= (uint8_t *)code &&
+                host_pc < ((uint8_t *)code) + xlat_get_code_size(code) ) {
+            xlat_recovery_record_t recovery = xlat_get_pre_recovery( code, host_pc );
+            if( recovery != NULL )
+                pc += recovery->sh4_icount << 1;
+        }
+    }
+    return pc;
+}
+
+static void profile_signal_handler( int signo, siginfo_t *info, void *context )
+{
+    struct profile_sample *sample;
+    uint32_t head = profiler.head;
+    sh4addr_t sp;
+    int i;
+
+    if( !pthread_equal( pthread_self(), profiler.thread ) ) {
+        profiler.missed++;
+        return;
+    }
+    if( !dreamcast_is_running() )
+        return;
+    if( head - profiler.tail >= PROFILE_RING_SIZE ) {
+        profiler.dropped++;
+        return;
+    }
+    sample = &profiler.ring[head & (PROFILE_RING_SIZE-1)];
+    sample->frames[0] = profile_get_pc( context );
+    sample->depth = 1;
+    if( is_return_address( sh4r.pr ) )
+        sample->frames[sample->depth++] = sh4r.pr;
+
+    sp = sh4r.r[15] & 0xFFFFFFFC;
+    for( i=0; i<PROFILE_STACK_SCAN_WORDS && sample->depth < PROFILE_MAX_DEPTH && IS_MAIN_RAM(sp); i++, sp += 4 ) {
+        sh4addr_t addr = MAIN_RAM_WORD(sp);
+        if( addr != sample->frames[sample->depth-1] && is_return_address(addr) )
+            sample->frames[sample->depth++] = addr;
+    }
+    profiler.head = head + 1;
+}
+
+/**
+ * Start the sampling timer for the calling thread.
+ */
+static gboolean profile_start_timer( void )
+{
+#ifdef PROFILE_THREAD_TIMER
+    struct sigevent sev;
+    struct itimerspec spec;
+    clockid_t clock;
+
+    if( pthread_getcpuclockid( pthread_self(), &clock ) != 0 )
+        return FALSE;
+    memset( &sev, 0, sizeof(sev) );
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = syscall( SYS_gettid );
+    if( timer_create( clock, &sev, &profiler.timer ) != 0 )
+        return FALSE;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = profiler.rate >= 1000000000 ? 1 : 1000000000 / profiler.rate;
+    spec.it_value = spec.it_interval;
+    if( timer_settime( profiler.timer, 0, &spec, NULL ) != 0 ) {
+        timer_delete( profiler.timer );
+        return FALSE;
+    }
+    return TRUE;
+#else
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = profiler.rate >= 1000000 ? 1 : 1000000 / profiler.rate;
+    timer.it_value = timer.it_interval;
+    return setitimer( ITIMER_PROF, &timer, NULL ) == 0;
+#endif
+}
+
+static void profile_stop_timer( void )
+{
+#ifdef PROFILE_THREAD_TIMER
+    timer_delete( profiler.timer );
+#else
+    struct itimerval timer;
+    memset( &timer, 0, sizeof(timer) );
+    setitimer( ITIMER_PROF, &timer, NULL );
+#endif
+}
+
+void sh4_profiler_collect( void )
+{
+    if( !pthread_equal( pthread_self(), profiler.thread ) ) {
+        /* The SH4 has moved to a different thread since we started */
+        profiler.thread = pthread_self();
+#ifdef PROFILE_THREAD_TIMER
+        profile_stop_timer();
+        if( !profile_start_timer() ) {
+            ERROR( "Unable to restart profiling timer" );
+        }
+#endif
+    }
+    while( profiler.tail != profiler.head ) {
+        struct profile_sample *sample = &profiler.ring[profiler.tail & (PROFILE_RING_SIZE-1)];
+        gchar *key = g_malloc( sample->depth * 9 );
+        unsigned int count;
+        int i;
+
+        /* Key is the raw frame list, in hex */
+        for( i=0; i<sample->depth; i++ ) {
+            sprintf( key + i*9, "%08x;", sample->frames[i] );
+        }
+        key[sample->depth*9 - 1] = '\0';
+        /* If the stack is already present, the table frees the new key */
+        count = GPOINTER_TO_UINT( g_hash_table_lookup( profiler.stacks, key ) );
+        g_hash_table_insert( profiler.stacks, key, GUINT_TO_POINTER(count+1) );
+        profiler.sample_count++;
+        profiler.tail++;
+    }
+}
+
+gboolean sh4_profiler_is_running( void )
+{
+    return profiler.running;
+}
+
+gboolean sh4_profiler_start( const gchar *filename, unsigned int rate )
+{
+    struct sigaction sa;
+
+    if( profiler.running || rate == 0 )
+        return FALSE;
+    profiler.ring = g_malloc( PROFILE_RING_SIZE * sizeof(struct profile_sample) );
+    profiler.head = profiler.tail = 0;
+    profiler.dropped = profiler.missed = profiler.sample_count = 0;
+    profiler.rate = rate;
+    profiler.stacks = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, NULL );
+    profiler.filename = g_strdup( filename );
+    profiler.thread = pthread_self();
+
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_sigaction = profile_signal_handler;
+    sigemptyset( &sa.sa_mask );
+    sa.sa_flags = SA_SIGINFO|SA_RESTART;
+    sigaction( SIGPROF, &sa, &profiler.old_action );
+
+    if( !profile_start_timer() ) {
+        ERROR( "Unable to start profiling timer" );
+        sigaction( SIGPROF, &profiler.old_action, NULL );
+        g_hash_table_destroy( profiler.stacks );
+        g_free( profiler.ring );
+        g_free( profiler.filename );
+        profiler.stacks = NULL;
+        profiler.ring = NULL;
+        profiler.filename = NULL;
+        return FALSE;
+    }
+    profiler.running = TRUE;
+    return TRUE;
+}
+
+/**
+ * Convert a raw stack key (innermost first, hex addresses separated by ;)
+ * into a symbolised folded stack (outermost first).
+ */
+static void profile_write_stack( FILE *f, const gchar *key, unsigned int count )
+{
+    gchar **frames = g_strsplit( key, ";", 0 );
+    const char *last = NULL;
+    int i, n = g_strv_length( frames );
+
+    for( i=n-1; i>=0; i-- ) {
+        sh4addr_t addr = strtoul( frames[i], NULL, 16 );
+        const char *sym = sh4_disasm_get_function( addr );
+        char buf[16];
+        if( sym == NULL ) {
+            snprintf( buf, sizeof(buf), "0x%08x", addr );
+            sym = buf;
+        } else if( last != NULL && strcmp( last, sym ) == 0 ) {
+            /* Collapse repeats (eg PR pointing back into the same function) */
+            continue;
+        }
+        fprintf( f, "%s%s", i == n-1 ? "" : ";", sym );
+        last = sym == buf ? NULL : sym;
+    }
+    fprintf( f, " %u\n", count );
+    g_strfreev( frames );
+}
+
+void sh4_profiler_stop( void )
+{
+    GHashTableIter iter;
+    gpointer key, count;
+    FILE *f;
+
+    if( !profiler.running )
+        return;
+    profile_stop_timer();
+    sigaction( SIGPROF, &profiler.old_action, NULL );
+    profiler.running = FALSE;
+    sh4_profiler_collect();
+
+    f = fopen( profiler.filename, "w" );
+    if( f == NULL ) {
+        ERROR( "Unable to write profile to %s", profiler.filename );
+    } else {
+        g_hash_table_iter_init( &iter, profiler.stacks );
+        while( g_hash_table_iter_next( &iter, &key, &count ) ) {
+            profile_write_stack( f, key, GPOINTER_TO_UINT(count) );
+        }
+        fclose( f );
+        INFO( "Profile of %u samples written to %s (%u dropped, %u missed on other threads)",
+                profiler.sample_count, profiler.filename, profiler.dropped, profiler.missed );
+    }
+    g_hash_table_destroy( profiler.stacks );
+    g_free( profiler.ring );
+    g_free( profiler.filename );
+    profiler.stacks = NULL;
+    profiler.ring = NULL;
+    profiler.filename = NULL;
+}
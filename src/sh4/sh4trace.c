@@ -0,0 +1,586 @@
+/**
+ * $Id$
+ *
+ * Binary execution trace recorder. Translated blocks call back into the
+ * recorder on entry, which logs the block's PC (and any exception or
+ * interrupt taken since the last block) into a lock-free ring buffer. The
+ * number of instructions the previous block actually ran is worked out from
+ * the advance in sh4r.slice_cycle since it was entered, and logged with it. A
+ * writer thread drains the ring, encoding the records compactly (see
+ * sh4trace.h), so the cost to the emulation thread is a few stores per block.
+ * Memory operations can optionally be logged as well, by interposing on the
+ * external address space (as the shadow core does).
+ *
+ * To bound the disk usage of a long run, the trace is rotated when it reaches
+ * the size limit: the current file is renamed to <file>.old and a new one is
+ * started. Each file starts with the code of every block seen so far, so it
+ * can be decoded on its own.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "clock.h"
+#include "mem.h"
+#include "mmio.h"
+#include "sh4/sh4.h"
+#include "sh4/sh4core.h"
+#include "sh4/sh4trace.h"
+#include "sh4/mmu.h"
+#include "xlat/xltcache.h"
+#ifdef SH4_TRANSLATOR
+#include "sh4/sh4trans.h"
+#endif
+
+#define TRACE_RING_SIZE 65536 /* Must be a power of 2 */
+#define TRACE_RING_MASK (TRACE_RING_SIZE-1)
+#define TRACE_IDLE_USECS 1000
+
+/* Ring entries - the low 8 bits of type hold the record type, the rest hold
+ * the size of a memory operation or the instruction count of a block. */
+struct trace_entry {
+    uint32_t type;
+    uint32_t data[3];
+};
+
+/* Instructions per CODE entry, after the first (which also holds the pc) */
+#define TRACE_CODE_PER_ENTRY 6
+
+struct trace_code {
+    uint32_t pc;
+    uint32_t count;
+    uint16_t insns[];
+};
+
+static struct {
+    volatile gboolean running;
+    int flags;
+    struct trace_entry *ring;
+    volatile uint32_t head, tail;
+    uint32_t write_head;       /* Producer's unpublished head */
+    uint32_t lost;             /* Records dropped since the last LOST record */
+    gboolean event_pending;
+    uint32_t event_code;
+    int event_kind;
+    uint32_t event_pc;         /* PC at the time of a reset */
+    gboolean block_open;       /* Set from block entry until its exit is known */
+    uint32_t block_cycle;      /* slice_cycle when the open block was entered */
+    uint32_t block_exit;       /* Exit field for the next record (see sh4trace.h) */
+    GHashTable *missing_code;  /* Block pc -> end pc, for dropped CODE records */
+
+    /* Writer thread state */
+    pthread_t writer;
+    volatile gboolean stopping;
+    gchar *filename;
+    uint64_t file_limit;
+    FILE *f;
+    uint64_t file_size;
+    uint32_t last_pc, last_mem_addr;
+    GHashTable *code;          /* Block pc -> struct trace_code */
+    struct trace_code *partial_code; /* Block being reassembled from entries */
+    uint32_t partial_posn;
+
+    mem_region_fn_t *real_address_space;
+} trace;
+
+static mem_region_fn_t *trace_address_space = NULL;
+
+/******************************* Producer side ********************************/
+
+/**
+ * Check there's room for a record of n entries. If not, the record is
+ * dropped (and counted). Note that the ring is never waited on, so that
+ * tracing can't stall the emulation.
+ */
+static inline gboolean trace_begin( uint32_t n )
+{
+    if( trace.write_head - trace.tail + n + (trace.lost != 0) > TRACE_RING_SIZE ) {
+        trace.lost++;
+        return FALSE;
+    }
+    if( trace.lost != 0 ) {
+        struct trace_entry *ent = &trace.ring[trace.write_head++ & TRACE_RING_MASK];
+        ent->type = SH4_TRACE_LOST;
+        ent->data[0] = trace.lost;
+        trace.lost = 0;
+    }
+    return TRUE;
+}
+
+static inline void trace_put( uint32_t type, uint32_t a, uint32_t b, uint32_t c )
+{
+    struct trace_entry *ent = &trace.ring[trace.write_head++ & TRACE_RING_MASK];
+    ent->type = type;
+    ent->data[0] = a;
+    ent->data[1] = b;
+    ent->data[2] = c;
+}
+
+/**
+ * Make the new entries visible to the writer.
+ */
+static inline void trace_publish( void )
+{
+    __sync_synchronize();
+    trace.head = trace.write_head;
+}
+
+/**
+ * Note the exit of the open block, given that it's left at the current
+ * slice_cycle.
+ */
+static inline void trace_close_block( void )
+{
+    if( trace.block_open ) {
+        trace.block_exit = (sh4r.slice_cycle - trace.block_cycle) / sh4_cpu_period + 1;
+        trace.block_open = FALSE;
+    }
+}
+
+/**
+ * Write the CODE record for the given block, which must be in the icache.
+ * @return FALSE if there wasn't room for it.
+ */
+static gboolean trace_put_code( sh4vma_t start, sh4vma_t end )
+{
+    uint32_t count = (end - start) >> 1, entries, i;
+    uint32_t w[TRACE_CODE_PER_ENTRY/2 + 1];
+    uint16_t *insns;
+
+    entries = 1;
+    if( count > 4 ) {
+        entries += (count - 4 + TRACE_CODE_PER_ENTRY - 1) / TRACE_CODE_PER_ENTRY;
+    }
+    if( !trace_begin( entries ) )
+        return FALSE;
+
+    insns = (uint16_t *)GET_ICACHE_PTR(start);
+    memset( w, 0, sizeof(w) );
+    for( i=0; i<4 && i<count; i++ ) {
+        w[i>>1] |= ((uint32_t)insns[i]) << ((i&1)*16);
+    }
+    trace_put( SH4_TRACE_CODE | (count << 8), start, w[0], w[1] );
+    for( i=4; i<count; i += TRACE_CODE_PER_ENTRY ) {
+        int j;
+        memset( w, 0, sizeof(w) );
+        for( j=0; j<TRACE_CODE_PER_ENTRY && i+j < count; j++ ) {
+            w[j>>1] |= ((uint32_t)insns[i+j]) << ((j&1)*16);
+        }
+        trace_put( SH4_TRACE_CODE, w[0], w[1], w[2] );
+    }
+    return TRUE;
+}
+
+/**
+ * Translated block entry callback
+ */
+static void sh4_trace_block_begin( void )
+{
+    uint32_t exit;
+
+    trace_close_block();
+    exit = trace.block_exit;
+    trace.block_exit = 0;
+    if( trace.event_pending ) {
+        /* SPC is only final once the exception exit has run */
+        uint32_t pc = trace.event_kind == SH4_TRACE_EVENT_RESET ? trace.event_pc : sh4r.spc;
+        trace.event_pending = FALSE;
+        if( trace_begin(1) ) {
+            trace_put( SH4_TRACE_EVENT, (trace.event_code << SH4_TRACE_EVENT_KIND_BITS) | trace.event_kind,
+                       pc, exit );
+        }
+        exit = 0;
+    }
+    if( g_hash_table_size( trace.missing_code ) != 0 ) {
+        /* Retry the CODE record if it was dropped when the block was translated */
+        gpointer end;
+        if( g_hash_table_lookup_extended( trace.missing_code, GUINT_TO_POINTER(sh4r.pc), NULL, &end ) &&
+                IS_IN_ICACHE(sh4r.pc) && trace_put_code( sh4r.pc, GPOINTER_TO_UINT(end) ) ) {
+            g_hash_table_remove( trace.missing_code, GUINT_TO_POINTER(sh4r.pc) );
+        }
+    }
+    if( trace_begin(1) ) {
+        trace_put( SH4_TRACE_BLOCK, sh4r.pc, exit, 0 );
+    }
+    trace_publish();
+    trace.block_open = TRUE;
+    trace.block_cycle = sh4r.slice_cycle;
+}
+
+void sh4_trace_event( uint32_t code, int kind )
+{
+    if( trace.running ) {
+        /* Logged at the start of the next block, once SPC is known */
+        trace.event_pending = TRUE;
+        trace.event_code = code;
+        trace.event_kind = kind;
+        trace.event_pc = sh4r.pc;
+    }
+}
+
+void sh4_trace_slice_end( void )
+{
+    /* slice_cycle is about to be reset, so the exit has to be taken now */
+    if( trace.running ) {
+        trace_close_block();
+    }
+}
+
+void sh4_trace_block_translated( sh4vma_t start, sh4vma_t end )
+{
+    if( !trace.running || end == start )
+        return;
+    /* Block was just translated, so it must be in the icache */
+    if( trace_put_code( start, end ) ) {
+        g_hash_table_remove( trace.missing_code, GUINT_TO_POINTER(start) );
+        trace_publish();
+    } else {
+        g_hash_table_insert( trace.missing_code, GUINT_TO_POINTER(start), GUINT_TO_POINTER(end) );
+    }
+}
+
+static inline void trace_mem( int type, int size, sh4addr_t addr, uint32_t val )
+{
+    if( trace_begin(1) ) {
+        trace_put( type | (size << 8), addr, val, 0 );
+        trace_publish();
+    }
+}
+
+#define REAL_FN(addr) trace.real_address_space[((addr)&0x1FFFFFFF)>>LXDREAM_PAGE_BITS]
+
+static int32_t FASTCALL trace_read_long( sh4addr_t addr )
+{
+    int32_t val = REAL_FN(addr)->read_long(addr);
+    trace_mem( SH4_TRACE_READ, 4, addr, val );
+    return val;
+}
+
+static int32_t FASTCALL trace_read_word( sh4addr_t addr )
+{
+    int32_t val = REAL_FN(addr)->read_word(addr);
+    trace_mem( SH4_TRACE_READ, 2, addr, val );
+    return val;
+}
+
+static int32_t FASTCALL trace_read_byte( sh4addr_t addr )
+{
+    int32_t val = REAL_FN(addr)->read_byte(addr);
+    trace_mem( SH4_TRACE_READ, 1, addr, val );
+    return val;
+}
+
+static int32_t FASTCALL trace_read_byte_for_write( sh4addr_t addr )
+{
+    int32_t val = REAL_FN(addr)->read_byte_for_write(addr);
+    trace_mem( SH4_TRACE_READ, 1, addr, val );
+    return val;
+}
+
+static void FASTCALL trace_write_long( sh4addr_t addr, uint32_t val )
+{
+    trace_mem( SH4_TRACE_WRITE, 4, addr, val );
+    REAL_FN(addr)->write_long(addr, val);
+}
+
+static void FASTCALL trace_write_word( sh4addr_t addr, uint32_t val )
+{
+    trace_mem( SH4_TRACE_WRITE, 2, addr, val );
+    REAL_FN(addr)->write_word(addr, val);
+}
+
+static void FASTCALL trace_write_byte( sh4addr_t addr, uint32_t val )
+{
+    trace_mem( SH4_TRACE_WRITE, 1, addr, val );
+    REAL_FN(addr)->write_byte(addr, val);
+}
+
+static void FASTCALL trace_read_burst( unsigned char *dest, sh4addr_t addr )
+{
+    trace_mem( SH4_TRACE_READ, 32, addr, 0 );
+    REAL_FN(addr)->read_burst(dest, addr);
+}
+
+static void FASTCALL trace_write_burst( sh4addr_t addr, unsigned char *src )
+{
+    trace_mem( SH4_TRACE_WRITE, 32, addr, 0 );
+    REAL_FN(addr)->write_burst(addr, src);
+}
+
+static void FASTCALL trace_prefetch( sh4addr_t addr )
+{
+    REAL_FN(addr)->prefetch(addr);
+}
+
+static struct mem_region_fn trace_fns = {
+        trace_read_long, trace_write_long, trace_read_word, trace_write_word,
+        trace_read_byte, trace_write_byte, trace_read_burst, trace_write_burst,
+        trace_prefetch, trace_read_byte_for_write };
+
+/******************************** Writer side *********************************/
+
+static void trace_write( const uint8_t *buf, size_t len )
+{
+    if( fwrite( buf, len, 1, trace.f ) != 1 ) {
+        /* Keep draining the ring regardless, so the SH4 isn't affected */
+        return;
+    }
+    trace.file_size += len;
+}
+
+static void trace_write_code( const struct trace_code *code )
+{
+    uint8_t buf[2*SH4_TRACE_MAX_VARINT];
+    uint8_t insns[code->count*2];
+    int len, i;
+
+    len = sh4_trace_put_varint( buf, ((uint64_t)code->count << SH4_TRACE_TYPE_BITS) | SH4_TRACE_CODE );
+    len += sh4_trace_put_varint( buf+len, code->pc );
+    trace_write( buf, len );
+    for( i=0; i<code->count; i++ ) {
+        insns[i*2] = code->insns[i] & 0xFF;
+        insns[i*2+1] = code->insns[i] >> 8;
+    }
+    trace_write( insns, code->count*2 );
+}
+
+static gboolean trace_open_file( void )
+{
+    GHashTableIter iter;
+    gpointer key, code;
+
+    trace.f = fopen( trace.filename, "wb" );
+    if( trace.f == NULL ) {
+        ERROR( "Unable to open trace file %s: %s", trace.filename, strerror(errno) );
+        return FALSE;
+    }
+    trace.file_size = 0;
+    trace.last_pc = trace.last_mem_addr = 0;
+    trace_write( (const uint8_t *)SH4_TRACE_MAGIC, SH4_TRACE_MAGIC_LENGTH );
+    g_hash_table_iter_init( &iter, trace.code );
+    while( g_hash_table_iter_next( &iter, &key, &code ) ) {
+        trace_write_code( code );
+    }
+    return TRUE;
+}
+
+/**
+ * Start a new file once the current one reaches the size limit
+ */
+static void trace_rotate_file( void )
+{
+    gchar *oldname = g_strdup_printf( "%s.old", trace.filename );
+    fclose( trace.f );
+    rename( trace.filename, oldname );
+    g_free( oldname );
+    if( !trace_open_file() ) {
+        /* Nowhere to write - discard from here on */
+        trace.f = fopen( "/dev/null", "wb" );
+    }
+}
+
+static void trace_encode( const struct trace_entry *ent )
+{
+    uint8_t buf[3*SH4_TRACE_MAX_VARINT];
+    uint32_t type = ent->type & 0xFF, aux = ent->type >> 8;
+    int len = 0;
+
+    if( trace.partial_code != NULL ) {
+        /* Continuation of a CODE record */
+        int j;
+        for( j=0; j<TRACE_CODE_PER_ENTRY && trace.partial_posn < trace.partial_code->count; j++ ) {
+            uint32_t w = ent->data[j>>1];
+            trace.partial_code->insns[trace.partial_posn++] = (j&1) ? (w >> 16) : (w & 0xFFFF);
+        }
+        if( trace.partial_posn == trace.partial_code->count ) {
+            trace_write_code( trace.partial_code );
+            g_hash_table_insert( trace.code, GUINT_TO_POINTER(trace.partial_code->pc), trace.partial_code );
+            trace.partial_code = NULL;
+        }
+        return;
+    }
+
+    switch( type ) {
+    case SH4_TRACE_BLOCK:
+        len = sh4_trace_put_varint( buf, (sh4_trace_zigzag(ent->data[0] - trace.last_pc) << SH4_TRACE_TYPE_BITS) | type );
+        len += sh4_trace_put_varint( buf+len, ent->data[1] );
+        trace.last_pc = ent->data[0];
+        break;
+    case SH4_TRACE_CODE: {
+        struct trace_code *code = g_malloc( sizeof(struct trace_code) + aux*sizeof(uint16_t) );
+        int j;
+        code->pc = ent->data[0];
+        code->count = aux;
+        for( j=0; j<4 && j<aux; j++ ) {
+            uint32_t w = ent->data[1 + (j>>1)];
+            code->insns[j] = (j&1) ? (w >> 16) : (w & 0xFFFF);
+        }
+        if( aux <= 4 ) {
+            trace_write_code( code );
+            g_hash_table_insert( trace.code, GUINT_TO_POINTER(code->pc), code );
+        } else {
+            trace.partial_code = code;
+            trace.partial_posn = 4;
+        }
+        return;
+    }
+    case SH4_TRACE_EVENT:
+        len = sh4_trace_put_varint( buf, ((uint64_t)ent->data[0] << SH4_TRACE_TYPE_BITS) | type );
+        len += sh4_trace_put_varint( buf+len, ent->data[1] );
+        len += sh4_trace_put_varint( buf+len, ent->data[2] );
+        break;
+    case SH4_TRACE_READ:
+    case SH4_TRACE_WRITE:
+        len = sh4_trace_put_varint( buf, ((uint64_t)aux << SH4_TRACE_TYPE_BITS) | type );
+        len += sh4_trace_put_varint( buf+len, sh4_trace_zigzag(ent->data[0] - trace.last_mem_addr) );
+        len += sh4_trace_put_varint( buf+len, ent->data[1] );
+        trace.last_mem_addr = ent->data[0];
+        break;
+    case SH4_TRACE_LOST:
+        len = sh4_trace_put_varint( buf, ((uint64_t)ent->data[0] << SH4_TRACE_TYPE_BITS) | type );
+        break;
+    }
+    trace_write( buf, len );
+    if( trace.file_limit != 0 && trace.file_size >= trace.file_limit ) {
+        trace_rotate_file();
+    }
+}
+
+static void *trace_writer_thread( void *arg )
+{
+    gboolean flushed = TRUE;
+    for(;;) {
+        uint32_t head = trace.head;
+        if( trace.tail == head ) {
+            if( trace.stopping )
+                break;
+            if( !flushed ) {
+                fflush( trace.f );
+                flushed = TRUE;
+            }
+            usleep( TRACE_IDLE_USECS );
+            continue;
+        }
+        __sync_synchronize();
+        while( trace.tail != head ) {
+            trace_encode( &trace.ring[trace.tail & TRACE_RING_MASK] );
+            trace.tail++;
+        }
+        flushed = FALSE;
+    }
+    return NULL;
+}
+
+/******************************** Control *************************************/
+
+gboolean sh4_trace_is_running( void )
+{
+    return trace.running;
+}
+
+gboolean sh4_trace_start( const gchar *filename, int flags, uint64_t file_limit )
+{
+#ifdef SH4_TRANSLATOR
+    if( trace.running )
+        return FALSE;
+    if( !sh4_translate_is_enabled() ) {
+        ERROR( "Execution tracing requires the SH4 translator" );
+        return FALSE;
+    }
+    trace.filename = g_strdup( filename );
+    trace.file_limit = file_limit;
+    trace.code = g_hash_table_new_full( g_direct_hash, g_direct_equal, NULL, g_free );
+    trace.partial_code = NULL;
+    if( !trace_open_file() ) {
+        g_hash_table_destroy( trace.code );
+        g_free( trace.filename );
+        return FALSE;
+    }
+    trace.ring = g_malloc( TRACE_RING_SIZE * sizeof(struct trace_entry) );
+    trace.head = trace.tail = trace.write_head = 0;
+    trace.lost = 0;
+    trace.event_pending = FALSE;
+    trace.block_open = FALSE;
+    trace.block_exit = 0;
+    trace.missing_code = g_hash_table_new( g_direct_hash, g_direct_equal );
+    trace.stopping = FALSE;
+    trace.flags = flags;
+
+    if( flags & SH4_TRACE_MEMORY ) {
+        int i;
+        if( trace_address_space == NULL ) {
+            trace_address_space = mem_alloc_pages( sizeof(mem_region_fn_t) * LXDREAM_PAGE_TABLE_ENTRIES / LXDREAM_PAGE_SIZE );
+            for( i=0; i<LXDREAM_PAGE_TABLE_ENTRIES; i++ ) {
+                trace_address_space[i] = &trace_fns;
+            }
+        }
+        trace.real_address_space = mmu_set_ext_address_space( trace_address_space );
+        /* Direct PC-relative loads would bypass the address space */
+        sh4_translate_set_fastmem( FALSE );
+    }
+
+    /* Existing blocks don't have the callback (or a CODE record) */
+    sh4_translate_set_callbacks( sh4_trace_block_begin, NULL );
+    xlat_flush_cache();
+    trace.running = TRUE;
+    if( pthread_create( &trace.writer, NULL, trace_writer_thread, NULL ) != 0 ) {
+        ERROR( "Unable to start trace writer thread" );
+        trace.stopping = TRUE;
+        sh4_trace_stop();
+        return FALSE;
+    }
+    INFO( "Recording execution trace to %s", filename );
+    return TRUE;
+#else
+    ERROR( "Execution tracing requires the SH4 translator" );
+    return FALSE;
+#endif
+}
+
+void sh4_trace_stop( void )
+{
+#ifdef SH4_TRANSLATOR
+    gboolean have_writer = !trace.stopping;
+    if( !trace.running )
+        return;
+    trace.running = FALSE;
+    sh4_translate_set_callbacks( NULL, NULL );
+    if( trace.flags & SH4_TRACE_MEMORY ) {
+        mmu_set_ext_address_space( trace.real_address_space );
+        sh4_translate_set_fastmem( TRUE );
+    }
+    xlat_flush_cache();
+
+    trace.stopping = TRUE;
+    if( have_writer ) {
+        pthread_join( trace.writer, NULL );
+    }
+    if( trace.lost != 0 ) {
+        WARN( "%u trace records were dropped", trace.lost );
+    }
+    fclose( trace.f );
+    g_free( trace.partial_code );
+    g_hash_table_destroy( trace.code );
+    g_hash_table_destroy( trace.missing_code );
+    g_free( trace.ring );
+    g_free( trace.filename );
+    trace.ring = NULL;
+    trace.filename = NULL;
+#endif
+}
@@ -0,0 +1,103 @@
+/**
+ * $Id$
+ *
+ * Binary SH4 execution trace format, shared between the recorder
+ * (sh4trace.c) and the offline decoder (tools/dectrace.c).
+ *
+ * A trace file starts with SH4_TRACE_MAGIC, followed by a sequence of
+ * records. Each record starts with a varint header of (payload << 3) | type,
+ * followed by type-specific varints:
+ *   BLOCK     payload = zigzag(pc - last block pc); exit
+ *   CODE      payload = instruction count; pc; count 16-bit instructions (LE)
+ *   EVENT     payload = (EXPEVT/INTEVT code << 2) | kind; pc; exit
+ *   READ      payload = size; zigzag(addr - last memory addr); value
+ *   WRITE     payload = size; zigzag(addr - last memory addr); value
+ *   LOST      payload = number of records dropped by the recorder
+ * Varints are little-endian base 128 (as in protocol buffers).
+ *
+ * CODE records give the instructions of each translated block, so that the
+ * decoder can expand the BLOCK records into the full instruction stream
+ * without needing the memory image. A block can be left part way through
+ * (eg a breakpoint, or an exception), so the exit field of a BLOCK or EVENT
+ * record gives the number of instructions of the previous block that
+ * actually ran, plus 1 (0 if not known).
+ *
+ * An EVENT record (exception, interrupt or reset) is written before the
+ * first block of the handler. For an exception, pc is the SPC, ie the
+ * instruction that raised it, which didn't complete. For an interrupt it's
+ * the SPC of the next instruction to run, and for a reset it's the PC at the
+ * time of the reset.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_sh4trace_H
+#define lxdream_sh4trace_H 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SH4_TRACE_MAGIC "LXTRACE2"
+#define SH4_TRACE_MAGIC_LENGTH 8
+
+#define SH4_TRACE_BLOCK 0
+#define SH4_TRACE_CODE  1
+#define SH4_TRACE_EVENT 2
+#define SH4_TRACE_READ  3
+#define SH4_TRACE_WRITE 4
+#define SH4_TRACE_LOST  5
+
+#define SH4_TRACE_TYPE_BITS 3
+
+/* EVENT record kinds */
+#define SH4_TRACE_EVENT_EXCEPTION 0
+#define SH4_TRACE_EVENT_INTERRUPT 1
+#define SH4_TRACE_EVENT_RESET     2
+#define SH4_TRACE_EVENT_KIND_BITS 2
+
+/* Longest possible encoding of a 64-bit varint */
+#define SH4_TRACE_MAX_VARINT 10
+
+static inline uint64_t sh4_trace_zigzag( int32_t val )
+{
+    return (uint32_t)(((uint32_t)val << 1) ^ (uint32_t)(val >> 31));
+}
+
+static inline int32_t sh4_trace_unzigzag( uint64_t val )
+{
+    return (int32_t)((val >> 1) ^ -(val & 1));
+}
+
+/**
+ * Encode a varint into buf.
+ * @return the number of bytes written.
+ */
+static inline int sh4_trace_put_varint( uint8_t *buf, uint64_t val )
+{
+    int n = 0;
+    while( val >= 0x80 ) {
+        buf[n++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    buf[n++] = (uint8_t)val;
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_sh4trace_H */
@@ -139,6 +139,7 @@ void * sh4_translate_basic_block( sh4addr_t start )
     }	
     sh4_translate_end_block(pc);
     assert( xlat_output <= (xlat_current_block->code + xlat_current_block->size - recovery_size) );
+    sh4_trace_block_translated( start, pc );
 
     /* Write the recovery records onto the end of the code block */
     memcpy( xlat_output, xlat_recovery, recovery_size);
@@ -98,7 +98,8 @@ void sh4_translate_begin_block( sh4addr_t pc );
 uint32_t sh4_translate_instruction( sh4addr_t pc );
 void sh4_translate_end_block( sh4addr_t pc );
 uint32_t sh4_translate_end_block_size();
-void sh4_translate_emit_breakpoint( sh4vma_t pc );
+struct sh4_breakpoint_cond;
+void sh4_translate_emit_breakpoint( sh4vma_t pc, const struct sh4_breakpoint_cond *cond );
 void sh4_translate_crashdump();
 
 typedef void (*unwind_thunk_t)(void);
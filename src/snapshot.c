@@ -0,0 +1,297 @@
+/**
+ * $Id$
+ *
+ * In-memory machine snapshots, kept in a ring buffer for rewind and
+ * run-ahead.
+ *
+ * Module state is written into a per-snapshot buffer through the modules'
+ * snapshot save functions. RAM is stored incrementally: we keep a shadow
+ * copy of every RAM region as of the newest snapshot, and each new snapshot
+ * records only the pages that differ from the shadow, along with their
+ * previous contents. Restoring a snapshot then means putting back the
+ * shadow, and undoing the page changes of each newer snapshot in turn.
+ *
+ * Dirty pages are found by comparing against the shadow rather than by
+ * trapping writes - RAM is written from too many places (DMA, the ARM,
+ * the renderer, file loads) to track reliably, and a straight page compare
+ * is only a few milliseconds for the whole machine.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "dreamcast.h"
+#include "mem.h"
+#include "snapshot.h"
+#include "pvr2/pvr2.h"
+#include "sh4/sh4.h"
+#include "xlat/xltcache.h"
+
+#define SNAPSHOT_PAGE_BITS 12
+#define SNAPSHOT_PAGE_SIZE (1<<SNAPSHOT_PAGE_BITS)
+#define SNAPSHOT_INITIAL_PAGES 256
+#define SNAPSHOT_INITIAL_STATE_SIZE (64 KB)
+
+#define SNAPSHOT_PAGE_KEY(region,page) (((region)<<24)|(page))
+#define SNAPSHOT_KEY_REGION(key) ((key)>>24)
+#define SNAPSHOT_KEY_PAGE(key) ((key)&0x00FFFFFF)
+
+struct snapshot_region {
+    mem_region_t rgn;
+    unsigned char *shadow; /* Region contents as of the newest snapshot */
+    uint32_t page_count;
+};
+
+struct snapshot {
+    /* Module state, as written by dreamcast_save_snapshot_state() */
+    unsigned char *state;
+    size_t state_size;
+    size_t state_capacity;
+    /* Pages that changed between the previous snapshot and this one, with
+     * their contents as of the previous snapshot */
+    uint32_t *page_keys;
+    unsigned char *pages;
+    uint32_t page_count;
+    uint32_t page_capacity;
+};
+
+static struct snapshot *snapshot_ring = NULL;
+static unsigned int snapshot_ring_size = 0;
+static unsigned int snapshot_first = 0; /* Index of the oldest snapshot */
+static unsigned int snapshot_count = 0;
+
+static struct snapshot_region snapshot_regions[MAX_MEM_REGIONS];
+static unsigned int snapshot_region_count = 0;
+
+#define SNAPSHOT_INDEX(n) ((snapshot_first + (n)) % snapshot_ring_size)
+#define SNAPSHOT_NEWEST() (&snapshot_ring[SNAPSHOT_INDEX(snapshot_count-1)])
+
+static void snapshot_free( void )
+{
+    int i;
+    for( i=0; i<snapshot_ring_size; i++ ) {
+        g_free( snapshot_ring[i].state );
+        g_free( snapshot_ring[i].page_keys );
+        g_free( snapshot_ring[i].pages );
+    }
+    g_free( snapshot_ring );
+    for( i=0; i<snapshot_region_count; i++ ) {
+        g_free( snapshot_regions[i].shadow );
+    }
+    snapshot_ring = NULL;
+    snapshot_ring_size = 0;
+    snapshot_region_count = 0;
+    snapshot_first = snapshot_count = 0;
+}
+
+void snapshot_set_size( unsigned int count )
+{
+    int i;
+
+    if( count == snapshot_ring_size )
+        return;
+    snapshot_free();
+    if( count == 0 )
+        return;
+
+    /* Everything that mem_save() would write out */
+    for( i=0; i<num_mem_rgns; i++ ) {
+        if( mem_rgn[i].flags == MEM_FLAG_RAM && mem_rgn[i].mem != NULL ) {
+            struct snapshot_region *region = &snapshot_regions[snapshot_region_count++];
+            region->rgn = &mem_rgn[i];
+            region->shadow = g_malloc( mem_rgn[i].size );
+            region->page_count = mem_rgn[i].size >> SNAPSHOT_PAGE_BITS;
+        }
+    }
+
+    snapshot_ring = g_malloc0( count * sizeof(struct snapshot) );
+    snapshot_ring_size = count;
+    for( i=0; i<count; i++ ) {
+        struct snapshot *snap = &snapshot_ring[i];
+        snap->state_capacity = SNAPSHOT_INITIAL_STATE_SIZE;
+        snap->state = g_malloc( snap->state_capacity );
+        snap->page_capacity = SNAPSHOT_INITIAL_PAGES;
+        snap->page_keys = g_malloc( snap->page_capacity * sizeof(uint32_t) );
+        snap->pages = g_malloc( snap->page_capacity * SNAPSHOT_PAGE_SIZE );
+    }
+}
+
+unsigned int snapshot_get_size( void )
+{
+    return snapshot_ring_size;
+}
+
+unsigned int snapshot_get_count( void )
+{
+    return snapshot_count;
+}
+
+void snapshot_clear( void )
+{
+    snapshot_first = snapshot_count = 0;
+}
+
+/**
+ * Write the module state into the snapshot, growing the buffer if it turns
+ * out to be too small.
+ */
+static gboolean snapshot_save_state( struct snapshot *snap )
+{
+    for(;;) {
+        FILE *f = fmemopen( snap->state, snap->state_capacity, "w" );
+        if( f == NULL )
+            return FALSE;
+        dreamcast_save_snapshot_state( f );
+        fflush( f );
+        long size = ftell( f );
+        gboolean overflow = ferror( f ) || size < 0 || size >= snap->state_capacity;
+        fclose( f );
+        if( !overflow ) {
+            snap->state_size = size;
+            return TRUE;
+        }
+        snap->state_capacity <<= 1;
+        snap->state = g_realloc( snap->state, snap->state_capacity );
+    }
+}
+
+/**
+ * Record every page that differs from the shadow copy in the snapshot, and
+ * bring the shadow up to date.
+ */
+static void snapshot_save_pages( struct snapshot *snap )
+{
+    int i, page;
+
+    snap->page_count = 0;
+    for( i=0; i<snapshot_region_count; i++ ) {
+        struct snapshot_region *region = &snapshot_regions[i];
+        unsigned char *mem = region->rgn->mem;
+        unsigned char *shadow = region->shadow;
+        for( page=0; page<region->page_count; page++, mem += SNAPSHOT_PAGE_SIZE, shadow += SNAPSHOT_PAGE_SIZE ) {
+            if( memcmp( mem, shadow, SNAPSHOT_PAGE_SIZE ) != 0 ) {
+                if( snap->page_count == snap->page_capacity ) {
+                    snap->page_capacity <<= 1;
+                    snap->page_keys = g_realloc( snap->page_keys, snap->page_capacity * sizeof(uint32_t) );
+                    snap->pages = g_realloc( snap->pages, snap->page_capacity * SNAPSHOT_PAGE_SIZE );
+                }
+                snap->page_keys[snap->page_count] = SNAPSHOT_PAGE_KEY(i, page);
+                memcpy( snap->pages + (snap->page_count << SNAPSHOT_PAGE_BITS), shadow, SNAPSHOT_PAGE_SIZE );
+                memcpy( shadow, mem, SNAPSHOT_PAGE_SIZE );
+                snap->page_count++;
+            }
+        }
+    }
+}
+
+gboolean snapshot_save( void )
+{
+    int i;
+    struct snapshot *snap;
+
+    if( snapshot_ring_size == 0 )
+        return FALSE;
+
+    if( snapshot_count == snapshot_ring_size ) {
+        snapshot_first = SNAPSHOT_INDEX(1);
+        snapshot_count--;
+    }
+    snap = &snapshot_ring[SNAPSHOT_INDEX(snapshot_count)];
+
+    /* Module state goes first, as it may flush pending data out to RAM */
+    if( !snapshot_save_state( snap ) )
+        return FALSE;
+    if( snapshot_count == 0 ) {
+        for( i=0; i<snapshot_region_count; i++ ) {
+            memcpy( snapshot_regions[i].shadow, snapshot_regions[i].rgn->mem,
+                    snapshot_regions[i].rgn->size );
+        }
+        snap->page_count = 0;
+    } else {
+        snapshot_save_pages( snap );
+    }
+    snapshot_count++;
+
+    /* Nothing precedes the oldest snapshot, so its pages aren't needed */
+    snapshot_ring[snapshot_first].page_count = 0;
+    return TRUE;
+}
+
+/**
+ * Discard anything cached from a page that's just been overwritten by a
+ * restore (ordinary writes would have done this through the region's write
+ * functions).
+ */
+static void snapshot_page_restored( struct snapshot_region *region, uint32_t page )
+{
+    uint32_t offset = page << SNAPSHOT_PAGE_BITS;
+    if( region->rgn->mem == dc_main_ram ) {
+        if( sh4_translate_is_enabled() ) {
+            xlat_flush_page( region->rgn->base + offset );
+        }
+    } else if( region->rgn->mem == pvr2_main_ram ) {
+        /* Texture cache is indexed by 64-bit address - each 32-bit page
+         * covers 2 pages there */
+        uint32_t addr64 = (offset & 0x003FFFFF) << 1;
+        texcache_invalidate_page( addr64 );
+        texcache_invalidate_page( addr64 + SNAPSHOT_PAGE_SIZE );
+    }
+}
+
+gboolean snapshot_restore( unsigned int back )
+{
+    int i, page;
+    FILE *f;
+    gboolean ok;
+
+    if( back >= snapshot_count )
+        return FALSE;
+
+    /* Return RAM to the state of the newest snapshot */
+    for( i=0; i<snapshot_region_count; i++ ) {
+        struct snapshot_region *region = &snapshot_regions[i];
+        unsigned char *mem = region->rgn->mem;
+        unsigned char *shadow = region->shadow;
+        for( page=0; page<region->page_count; page++, mem += SNAPSHOT_PAGE_SIZE, shadow += SNAPSHOT_PAGE_SIZE ) {
+            if( memcmp( mem, shadow, SNAPSHOT_PAGE_SIZE ) != 0 ) {
+                memcpy( mem, shadow, SNAPSHOT_PAGE_SIZE );
+                snapshot_page_restored( region, page );
+            }
+        }
+    }
+
+    /* Then undo each newer snapshot in turn */
+    for( ; back > 0; back-- ) {
+        struct snapshot *snap = SNAPSHOT_NEWEST();
+        for( i=0; i<snap->page_count; i++ ) {
+            uint32_t key = snap->page_keys[i];
+            struct snapshot_region *region = &snapshot_regions[SNAPSHOT_KEY_REGION(key)];
+            uint32_t offset = SNAPSHOT_KEY_PAGE(key) << SNAPSHOT_PAGE_BITS;
+            unsigned char *data = snap->pages + (i << SNAPSHOT_PAGE_BITS);
+            memcpy( region->rgn->mem + offset, data, SNAPSHOT_PAGE_SIZE );
+            memcpy( region->shadow + offset, data, SNAPSHOT_PAGE_SIZE );
+            snapshot_page_restored( region, SNAPSHOT_KEY_PAGE(key) );
+        }
+        snapshot_count--;
+    }
+
+    f = fmemopen( SNAPSHOT_NEWEST()->state, SNAPSHOT_NEWEST()->state_size, "r" );
+    if( f == NULL )
+        return FALSE;
+    ok = dreamcast_load_snapshot_state( f );
+    fclose( f );
+    return ok;
+}
@@ -0,0 +1,74 @@
+/**
+ * $Id$
+ *
+ * In-memory machine snapshots, for rewind and run-ahead.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_snapshot_H
+#define lxdream_snapshot_H 1
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set the number of snapshots held in the ring buffer, and allocate the
+ * buffers for them. Any existing snapshots are discarded. A size of 0
+ * disables snapshots and releases all memory.
+ * Must be called after the memory map has been configured.
+ */
+void snapshot_set_size( unsigned int count );
+
+/**
+ * @return the maximum number of snapshots held (0 if disabled).
+ */
+unsigned int snapshot_get_size( void );
+
+/**
+ * @return the number of snapshots currently held.
+ */
+unsigned int snapshot_get_count( void );
+
+/**
+ * Capture the current machine state as the newest snapshot, discarding the
+ * oldest one if the ring is full. Must only be called between time slices.
+ * @return TRUE on success, FALSE if snapshots are disabled.
+ */
+gboolean snapshot_save( void );
+
+/**
+ * Restore the machine to a previous snapshot, and discard any snapshots
+ * newer than it. The restored snapshot itself is kept, so it may be
+ * restored repeatedly (eg for run-ahead). Must only be called between time
+ * slices.
+ * @param back the snapshot to restore, counting back from the newest
+ * (which is 0).
+ * @return TRUE on success, FALSE if there is no such snapshot or it could
+ * not be loaded.
+ */
+gboolean snapshot_restore( unsigned int back );
+
+/**
+ * Discard all snapshots (without releasing the buffers).
+ */
+void snapshot_clear( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_snapshot_H */
@@ -62,6 +62,13 @@ void bios_install( void );
 
 void bios_boot( uint32_t syscallid );
 
+/**
+ * Compute checksums of the bootstrap (IP.BIN) and initial program of the
+ * disc currently in the drive, without loading anything into the machine.
+ * @return TRUE on success, FALSE if there is no disc or it isn't bootable.
+ */
+gboolean bios_get_gdrom_disc_hash( uint32_t *bootstrap_crc, uint32_t *program_crc );
+
 /**
  * Install the DCLoad syscall hack
  */
@@ -35,6 +35,7 @@ struct mmio_region mmio_region_MMU;
 struct mmio_region mmio_region_PMM;
 struct breakpoint_struct sh4_breakpoints[MAX_BREAKPOINTS];
 int sh4_breakpoint_count = 0;
+struct sh4_breakpoint_cond sh4_breakpoint_conds[MAX_BREAKPOINTS];
 gboolean sh4_profile_blocks = FALSE;
 
 #define MAX_INS_SIZE 32
@@ -89,6 +90,10 @@ void event_execute() {}
 void TMU_run_slice( uint32_t nanos ) {}
 void CCN_set_cache_control( int val ) { }
 void PMM_write_control( int ctr, uint32_t val ) { }
+uint32_t pmm_event_count[2];
+gboolean PMM_is_instrumented( int ctr ) { return FALSE; }
+uint32_t PMM_count_block_events( int ctr, sh4addr_t start, sh4addr_t end ) { return 0; }
+void sh4_trace_block_translated( sh4vma_t start, sh4vma_t end ) { }
 void SCIF_run_slice( uint32_t nanos ) {}
 void FASTCALL sh4_write_fpscr( uint32_t val ) { }
 void FASTCALL sh4_write_sr( uint32_t val ) { }
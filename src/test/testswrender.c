@@ -0,0 +1,175 @@
+/**
+ * $Id$
+ *
+ * Smoke test for the software renderer: render a small hand-built scene
+ * whose size isn't a multiple of the tile size, and check the result
+ * against the expected framebuffer, including that nothing is written
+ * past the end of the buffer.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "display.h"
+#include "mmio.h"
+#include "pvr2/pvr2.h"
+#include "pvr2/scene.h"
+
+#define TEST_WIDTH 72
+#define TEST_HEIGHT 40
+#define TEST_TILES_X 3
+#define TEST_TILES_Y 2
+/* Room for the full tiles, so overhanging writes land in the guard area */
+#define TEST_PIXELS (TEST_TILES_X*32*TEST_TILES_Y*32)
+#define GUARD_PIXEL 0xDEADBEEF
+
+#define BACKGROUND_PIXEL 0xFF0000FF
+#define POLY_PIXEL 0xFFFF0000
+/* The opaque polygon covers the bottom-right corner, across 4 tiles */
+#define POLY_X1 48
+#define POLY_Y1 24
+
+#define TILE_LIST_ADDR 0x1000
+#define POLY_ADDR 1
+
+unsigned char pvr2_main_ram[8 MB];
+struct mmio_region mmio_region_PVR2;
+struct pvr2_scene_struct pvr2_scene;
+
+void log_message( void *ptr, int level, const gchar *source, const char *msg, ... ) { }
+void pvr2_check_palette_changed(void) { }
+void pvr2_scene_finished(void) { }
+void texcache_begin_scene( uint32_t palette_mode, uint32_t stride_width ) { }
+void texcache_decode_texture( uint32_t *dest, uint32_t texture_word, int width, int height ) { }
+void render_sort_tile_triangles( pvraddr_t tile_entry, unsigned int thread, sort_triangle_fn_t fn, void *data ) { }
+
+static char pvr2_regs[4096];
+static uint32_t bkgnd_context[3] = { 0, 0x20000000, 0 };
+static uint32_t poly_context[3] = { 0xC0000000, 0x20000000, 0 };
+static struct vertex_struct vertexes[8];
+static struct polygon_struct polys[2];
+static struct polygon_struct *poly_map[POLY_ADDR+1];
+static struct tile_segment segments[TEST_TILES_X*TEST_TILES_Y];
+
+static void set_quad( struct vertex_struct *v, float x1, float y1, float x2, float y2,
+                      float r, float g, float b )
+{
+    int i;
+    for( i=0; i<4; i++ ) {
+        memset( &v[i], 0, sizeof(struct vertex_struct) );
+        v[i].x = (i & 1) ? x2 : x1;
+        v[i].y = (i & 2) ? y2 : y1;
+        v[i].z = 1.0f;
+        v[i].tex_mode = 2.0f;
+        v[i].rgba[0] = r;
+        v[i].rgba[1] = g;
+        v[i].rgba[2] = b;
+        v[i].rgba[3] = 1.0f;
+    }
+}
+
+static void build_scene( void )
+{
+    uint32_t *tile_list = (uint32_t *)(pvr2_main_ram + TILE_LIST_ADDR);
+    int x, y, i = 0;
+
+    mmio_region_PVR2.mem = pvr2_regs;
+
+    set_quad( &vertexes[0], 0, 0, TEST_WIDTH, TEST_HEIGHT, 0, 0, 1 );
+    set_quad( &vertexes[4], POLY_X1, POLY_Y1, TEST_WIDTH, TEST_HEIGHT, 1, 0, 0 );
+
+    polys[0].context = poly_context;
+    polys[0].vertex_count = 4;
+    polys[0].vertex_index = 4;
+    polys[0].mod_vertex_index = -1;
+    polys[1].context = bkgnd_context;
+    polys[1].vertex_count = 4;
+    polys[1].vertex_index = 0;
+    polys[1].mod_vertex_index = -1;
+    poly_map[POLY_ADDR] = &polys[0];
+
+    tile_list[0] = POLY_ADDR;
+    tile_list[1] = 0xF0000000;
+
+    for( y=0; y<TEST_TILES_Y; y++ ) {
+        for( x=0; x<TEST_TILES_X; x++, i++ ) {
+            gboolean covered = (x+1)*32 > POLY_X1 && (y+1)*32 > POLY_Y1;
+            segments[i].control = (y << 8) | (x << 2);
+            segments[i].opaque_ptr = covered ? TILE_LIST_ADDR : NO_POINTER;
+            segments[i].opaquemod_ptr = NO_POINTER;
+            segments[i].trans_ptr = NO_POINTER;
+            segments[i].transmod_ptr = NO_POINTER;
+            segments[i].punchout_ptr = NO_POINTER;
+        }
+    }
+    segments[i-1].control |= SEGMENT_END;
+
+    pvr2_scene.vertex_array = vertexes;
+    pvr2_scene.vertex_count = 8;
+    pvr2_scene.poly_array = polys;
+    pvr2_scene.poly_count = 2;
+    pvr2_scene.bkgnd_poly = &polys[1];
+    pvr2_scene.bounds[0] = 0;
+    pvr2_scene.bounds[1] = TEST_WIDTH;
+    pvr2_scene.bounds[2] = 0;
+    pvr2_scene.bounds[3] = TEST_HEIGHT;
+    pvr2_scene.buffer_width = TEST_WIDTH;
+    pvr2_scene.buffer_height = TEST_HEIGHT;
+    pvr2_scene.sort_mode = SORT_NEVER;
+    pvr2_scene.shadow_mode = SHADOW_NONE;
+    pvr2_scene.segment_list = segments;
+    pvr2_scene.buf_to_poly_map = poly_map;
+}
+
+int main( int argc, char *argv[] )
+{
+    struct render_buffer buffer;
+    uint32_t pixels[TEST_PIXELS];
+    int x, y, i, failures = 0;
+
+    build_scene();
+    for( i=0; i<TEST_PIXELS; i++ ) {
+        pixels[i] = GUARD_PIXEL;
+    }
+    memset( &buffer, 0, sizeof(buffer) );
+    buffer.width = TEST_WIDTH;
+    buffer.height = TEST_HEIGHT;
+    buffer.rowstride = TEST_WIDTH * 4;
+    buffer.pixels = pixels;
+
+    pvr2_scene_render_soft( &buffer );
+
+    for( y=0; y<TEST_HEIGHT; y++ ) {
+        for( x=0; x<TEST_WIDTH; x++ ) {
+            uint32_t expect = (x >= POLY_X1 && y >= POLY_Y1) ? POLY_PIXEL : BACKGROUND_PIXEL;
+            uint32_t result = pixels[y*TEST_WIDTH + x];
+            if( result != expect ) {
+                if( failures++ < 10 ) {
+                    fprintf( stderr, "Pixel (%d,%d): expected %08X but was %08X\n", x, y, expect, result );
+                }
+            }
+        }
+    }
+    for( i=TEST_WIDTH*TEST_HEIGHT; i<TEST_PIXELS; i++ ) {
+        if( pixels[i] != GUARD_PIXEL ) {
+            fprintf( stderr, "Write past the end of the buffer at pixel %d\n", i );
+            failures++;
+            break;
+        }
+    }
+    printf( "swrender: %s (%d failures)\n", failures == 0 ? "OK" : "FAILED", failures );
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+/**
+ * $Id$
+ *
+ * Check the texture decoders against the scalar reference decoder over
+ * random VRAM contents. Run with "bench" as the argument to time each
+ * decoder instead.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <glib.h>
+#include "pvr2/texdec.h"
+
+#define VRAM_SIZE (8*1024*1024)
+#define MAX_TEXTURE_BYTES (TEXDEC_MAX_SIZE*TEXDEC_MAX_SIZE*2)
+#define GUARD_BYTES 64
+#define TEST_ITERATIONS 1000
+#define BENCH_SIZE 256
+#define BENCH_TIME_US 200000
+
+static unsigned char *vram;
+static uint16_t codebook[256][4];
+static unsigned char *expect, *result;
+
+static uint32_t random_word()
+{
+    return (((uint32_t)random()) << 16) ^ ((uint32_t)random());
+}
+
+static void random_fill( unsigned char *buf, unsigned int length )
+{
+    unsigned int i;
+    for( i=0; i<length; i++ ) {
+        buf[i] = random();
+    }
+}
+
+enum test_format { TEST_4BPP, TEST_8BPP, TEST_16BPP, TEST_VQ };
+static const char *format_names[] = { "twiddled 4bpp", "twiddled 8bpp", "twiddled 16bpp", "vq" };
+
+/**
+ * @return the size in bytes of the decoded output
+ */
+static unsigned int decode( texture_decoder_t decoder, enum test_format format, unsigned char *dest,
+                            uint32_t srcaddr, uint32_t width, uint32_t height )
+{
+    switch( format ) {
+    case TEST_4BPP:
+        decoder->read_twiddled_4( dest, vram, srcaddr, width, height );
+        return width == 1 ? 1 : (width*height) >> 1;
+    case TEST_8BPP:
+        decoder->read_twiddled_8( dest, vram, srcaddr, width, height );
+        return width*height;
+    case TEST_16BPP:
+        decoder->read_twiddled_16( dest, vram, srcaddr, width, height );
+        return (width*height) << 1;
+    default:
+        /* Codes are taken straight from VRAM */
+        decoder->vq_decode( (uint16_t *)dest, vram + (srcaddr & (VRAM_SIZE-1)), width, height, codebook );
+        return (width*height) << 1;
+    }
+}
+
+/**
+ * Pick a random texture size that the reference decoder can handle: square
+ * (down to 1x1 for the twiddled formats), or rectangular with neither side
+ * smaller than 2 (4 for 4-bit textures).
+ */
+static void random_size( enum test_format format, uint32_t *width, uint32_t *height )
+{
+    int min = (format == TEST_VQ ? 1 : 0), rect_min = (format == TEST_4BPP ? 2 : 1);
+    int w = min + (random() % (11 - min)), h;
+    if( w < rect_min || (random() & 1) ) {
+        h = w;
+    } else {
+        h = rect_min + (random() % (11 - rect_min));
+    }
+    *width = 1 << w;
+    *height = 1 << h;
+}
+
+/**
+ * Pick a random source address. 16-bit texels need 16-bit alignment, and
+ * the reference decoder only handles 4-bit textures that start on a 32-bit
+ * boundary (which is all that occur in practice).
+ */
+static uint32_t random_address( enum test_format format, unsigned int bytes )
+{
+    uint32_t addr = random_word() % (VRAM_SIZE - bytes);
+    switch( random() % 3 ) {
+    case 0: addr &= ~7; break;
+    case 1: addr &= ~3; break;
+    }
+    if( format == TEST_16BPP ) {
+        addr &= ~1;
+    } else if( format == TEST_4BPP ) {
+        addr &= ~3;
+    }
+    return addr;
+}
+
+gboolean test_decoder( texture_decoder_t decoder, enum test_format format )
+{
+    int i, fails = 0;
+
+    for( i=0; i<TEST_ITERATIONS; i++ ) {
+        uint32_t width, height, addr;
+        unsigned int bytes, check_bytes;
+        random_size( format, &width, &height );
+        check_bytes = width*height*2 + GUARD_BYTES;
+        addr = random_address( format, (width*height*2) );
+        if( (random() & 15) == 0 ) {
+            random_fill( (unsigned char *)codebook, sizeof(codebook) );
+        }
+        memset( expect, 0xA5, check_bytes );
+        memset( result, 0xA5, check_bytes );
+
+        bytes = decode( &texture_decoder_scalar, format, expect, addr, width, height );
+        decode( decoder, format, result, addr, width, height );
+        if( memcmp( expect, result, check_bytes ) != 0 ) {
+            if( fails++ == 0 ) {
+                int j;
+                for( j=0; expect[j] == result[j]; j++ );
+                printf( "%s %s mismatch for %dx%d at %08X (byte %d of %d)\n", decoder->name,
+                        format_names[format], width, height, addr, j, bytes );
+            }
+        }
+    }
+    printf( "%s %s: %d/%d (%s)\n", decoder->name, format_names[format],
+            TEST_ITERATIONS-fails, TEST_ITERATIONS, (fails == 0 ? "OK" : "ERROR") );
+    return fails == 0;
+}
+
+static double elapsed_us( struct timeval *start )
+{
+    struct timeval now;
+    gettimeofday( &now, NULL );
+    return (now.tv_sec - start->tv_sec) * 1000000.0 + (now.tv_usec - start->tv_usec);
+}
+
+/**
+ * Time decoding BENCH_SIZE x BENCH_SIZE textures from successive 64-bit
+ * aligned addresses, reporting texels per second.
+ */
+static void bench_decoder( texture_decoder_t decoder, enum test_format format )
+{
+    struct timeval start;
+    unsigned int count = 0;
+    uint32_t addr = 0;
+    double us;
+
+    gettimeofday( &start, NULL );
+    do {
+        int i;
+        for( i=0; i<16; i++ ) {
+            decode( decoder, format, result, addr, BENCH_SIZE, BENCH_SIZE );
+            addr = (addr + BENCH_SIZE*BENCH_SIZE*2) & (VRAM_SIZE/2 - 1);
+        }
+        count += 16;
+    } while( (us = elapsed_us( &start )) < BENCH_TIME_US );
+    printf( "%-8s %-16s %8.1f Mtexels/s\n", decoder->name, format_names[format],
+            ((double)count * BENCH_SIZE * BENCH_SIZE) / us );
+}
+
+int main( int argc, char *argv[] )
+{
+    gboolean result_ok = TRUE, bench = (argc > 1 && strcmp( argv[1], "bench" ) == 0);
+    int i, format;
+
+    vram = malloc( VRAM_SIZE );
+    expect = malloc( MAX_TEXTURE_BYTES + GUARD_BYTES );
+    result = malloc( MAX_TEXTURE_BYTES + GUARD_BYTES );
+    srandom(1);
+    random_fill( vram, VRAM_SIZE );
+    random_fill( (unsigned char *)codebook, sizeof(codebook) );
+
+    for( i=0; texture_decoder_list[i] != NULL; i++ ) {
+        texture_decoder_t decoder = texture_decoder_list[i];
+        if( !decoder->is_supported() ) {
+            printf( "%s: not supported on this CPU, skipped\n", decoder->name );
+        } else if( bench ) {
+            for( format = TEST_4BPP; format <= TEST_VQ; format++ ) {
+                bench_decoder( decoder, format );
+            }
+        } else if( decoder != &texture_decoder_scalar ) {
+            for( format = TEST_4BPP; format <= TEST_VQ; format++ ) {
+                result_ok = test_decoder( decoder, format ) && result_ok;
+            }
+        }
+    }
+    free( vram );
+    free( expect );
+    free( result );
+    return result_ok ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/**
+ * $Id$
+ *
+ * Round-trip test for the execution trace format: drive the recorder with a
+ * scripted run (including CODE records that span several ring entries, an
+ * exception, and enough blocks to overflow the ring so that records are
+ * lost), then decode the file with tools/dectrace and check the listing.
+ *
+ * The trace is written to a FIFO that isn't drained until the flood of
+ * blocks has been logged, which stalls the writer thread so the ring is
+ * guaranteed to fill.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "clock.h"
+#include "mem.h"
+#include "sh4/sh4.h"
+#include "sh4/sh4core.h"
+#include "sh4/sh4trace.h"
+#include "sh4/mmu.h"
+
+#define PAGE_VMA 0x8C010000
+#define BLOCK_A (PAGE_VMA)         /* 13 instructions - 3 CODE entries */
+#define BLOCK_A_LEN 13
+#define BLOCK_B (PAGE_VMA+0x300)   /* 8 instructions, CODE dropped at translation */
+#define BLOCK_B_LEN 8
+#define BLOCK_C (PAGE_VMA+0x100)   /* 10 instructions - exactly 2 CODE entries */
+#define BLOCK_C_LEN 10
+#define BLOCK_D (PAGE_VMA+0x200)   /* 3 instructions - 1 CODE entry */
+#define BLOCK_D_LEN 3
+
+/* Enough blocks to fill the ring and the pipe many times over */
+#define FLOOD_BLOCKS 400000
+#define RETRY_BLOCKS 500
+
+#define INSN(pc) ((uint16_t)(0x1000 + (((pc)-PAGE_VMA)>>1)))
+
+struct sh4_registers sh4r;
+struct sh4_icache_struct sh4_icache;
+uint32_t sh4_cpu_period = 5;
+
+static uint16_t code_page[2048];
+static void (*block_begin)() = NULL;
+static uint32_t blocks_entered;
+
+void log_message( void *ptr, int level, const gchar *source, const char *msg, ... ) { }
+gboolean sh4_translate_is_enabled() { return TRUE; }
+void sh4_translate_set_callbacks( void (*begin)(), void (*end)() ) { block_begin = begin; }
+void sh4_translate_set_fastmem( gboolean flag ) { }
+void xlat_flush_cache() { }
+mem_region_fn_t *mmu_set_ext_address_space( mem_region_fn_t *space ) { return NULL; }
+void *mem_alloc_pages( int n ) { return NULL; }
+
+static void enter_block( uint32_t pc )
+{
+    sh4r.pc = pc;
+    block_begin();
+    blocks_entered++;
+}
+
+static void execute( uint32_t insns )
+{
+    sh4r.slice_cycle += insns * sh4_cpu_period;
+}
+
+struct drain_args {
+    int fd;
+    FILE *out;
+};
+
+static void *drain_thread( void *arg )
+{
+    struct drain_args *args = arg;
+    char buf[4096];
+    ssize_t len;
+
+    fcntl( args->fd, F_SETFL, fcntl( args->fd, F_GETFL ) & ~O_NONBLOCK );
+    while( (len = read( args->fd, buf, sizeof(buf) )) > 0 ) {
+        fwrite( buf, len, 1, args->out );
+    }
+    return NULL;
+}
+
+static char *expected_listing( void )
+{
+    GString *s = g_string_new( "" );
+    int i;
+    for( i=0; i<BLOCK_A_LEN; i++ )
+        g_string_append_printf( s, "%08X: %04X\n", BLOCK_A + i*2, INSN(BLOCK_A + i*2) );
+    for( i=0; i<7; i++ )
+        g_string_append_printf( s, "%08X: %04X\n", BLOCK_C + i*2, INSN(BLOCK_C + i*2) );
+    for( i=0; i<BLOCK_D_LEN; i++ )
+        g_string_append_printf( s, "%08X: %04X\n", BLOCK_D + i*2, INSN(BLOCK_D + i*2) );
+    for( i=0; i<2; i++ )
+        g_string_append_printf( s, "%08X: %04X\n", BLOCK_A + i*2, INSN(BLOCK_A + i*2) );
+    g_string_append_printf( s, "*** Exception %03X, SPC=%08X\n", EXC_DATA_ADDR_READ, BLOCK_A+4 );
+    for( i=0; i<BLOCK_D_LEN; i++ )
+        g_string_append_printf( s, "%08X: %04X\n", BLOCK_D + i*2, INSN(BLOCK_D + i*2) );
+    return g_string_free( s, FALSE );
+}
+
+/**
+ * Check the decoded listing: it must start with the scripted run, every
+ * instruction must match the code page, and block B's code must have made it
+ * into the trace once the ring had room again.
+ */
+static int check_listing( const char *listing_file, const char *summary_file )
+{
+    char *listing, *expect, *line, *next;
+    unsigned long long blocks, insns, events, lost;
+    gboolean seen_b = FALSE, seen_lost = FALSE;
+    int fails = 0;
+    FILE *f;
+
+    if( !g_file_get_contents( listing_file, &listing, NULL, NULL ) ) {
+        fprintf( stderr, "Unable to read decoded trace %s\n", listing_file );
+        return 1;
+    }
+    expect = expected_listing();
+    if( strncmp( listing, expect, strlen(expect) ) != 0 ) {
+        fprintf( stderr, "Decoded trace doesn't start with the expected blocks\n" );
+        fails++;
+    }
+    g_free( expect );
+
+    for( line = listing; *line != '\0'; line = next ) {
+        unsigned int pc, op;
+        next = strchr( line, '\n' );
+        if( next == NULL )
+            next = line + strlen(line);
+        else
+            *next++ = '\0';
+        if( strstr( line, "????" ) != NULL ) {
+            fprintf( stderr, "Block without code: %s\n", line );
+            fails++;
+        } else if( strstr( line, "records lost" ) != NULL ) {
+            seen_lost = TRUE;
+        } else if( sscanf( line, "%08X: %04X", &pc, &op ) == 2 ) {
+            if( pc < PAGE_VMA || pc >= PAGE_VMA + sizeof(code_page) || op != INSN(pc) ) {
+                fprintf( stderr, "Wrong instruction: %s\n", line );
+                fails++;
+            }
+            if( pc == BLOCK_B )
+                seen_b = TRUE;
+        }
+    }
+    g_free( listing );
+    if( !seen_lost ) {
+        fprintf( stderr, "No LOST record in the trace\n" );
+        fails++;
+    }
+    if( !seen_b ) {
+        fprintf( stderr, "Dropped CODE record wasn't retried\n" );
+        fails++;
+    }
+
+    f = fopen( summary_file, "r" );
+    if( f == NULL || fscanf( f, "%llu blocks, %llu instructions, %llu events, %llu records lost",
+            &blocks, &insns, &events, &lost ) != 4 ) {
+        fprintf( stderr, "Unable to read the dectrace summary\n" );
+        fails++;
+    } else if( events != 1 || blocks + lost <= blocks_entered ) {
+        /* Every block was either logged or counted, as was B's CODE record */
+        fprintf( stderr, "Block count mismatch: %u entered, %llu decoded, %llu lost, %llu events\n",
+                blocks_entered, blocks, lost, events );
+        fails++;
+    }
+    if( f != NULL )
+        fclose( f );
+    return fails;
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *dectrace = getenv("DECTRACE");
+    char dir[] = "/tmp/testtraceXXXXXX";
+    gchar *fifo, *tracefile, *listing, *summary, *cmd;
+    struct drain_args drain;
+    pthread_t drainer;
+    int i, fails;
+
+    if( dectrace == NULL )
+        dectrace = "tools/dectrace";
+    if( mkdtemp( dir ) == NULL ) {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    fifo = g_strdup_printf( "%s/trace.fifo", dir );
+    tracefile = g_strdup_printf( "%s/trace.bin", dir );
+    listing = g_strdup_printf( "%s/trace.txt", dir );
+    summary = g_strdup_printf( "%s/summary.txt", dir );
+
+    for( i=0; i<sizeof(code_page)/2; i++ )
+        code_page[i] = INSN(PAGE_VMA + i*2);
+    sh4_icache.page = (sh4ptr_t)code_page;
+    sh4_icache.page_vma = PAGE_VMA;
+    sh4_icache.mask = ~(sizeof(code_page)-1);
+
+    if( mkfifo( fifo, 0600 ) != 0 ) {
+        perror( "mkfifo" );
+        return 1;
+    }
+    /* Hold the read end open (without reading) so the writer can open it */
+    drain.fd = open( fifo, O_RDONLY|O_NONBLOCK );
+    drain.out = fopen( tracefile, "wb" );
+    if( drain.fd == -1 || drain.out == NULL ) {
+        perror( "open" );
+        return 1;
+    }
+    if( !sh4_trace_start( fifo, 0, 0 ) ) {
+        printf( "Tracing not supported, skipping\n" );
+        return 77;
+    }
+
+    sh4_trace_block_translated( BLOCK_A, BLOCK_A + BLOCK_A_LEN*2 );
+    sh4_trace_block_translated( BLOCK_C, BLOCK_C + BLOCK_C_LEN*2 );
+    sh4_trace_block_translated( BLOCK_D, BLOCK_D + BLOCK_D_LEN*2 );
+    enter_block( BLOCK_A );
+    execute( BLOCK_A_LEN );
+    enter_block( BLOCK_C );
+    execute( 7 );  /* Branches out early */
+    enter_block( BLOCK_D );
+    execute( BLOCK_D_LEN );
+    enter_block( BLOCK_A );
+    execute( 2 );
+    sh4_trace_event( EXC_DATA_ADDR_READ, SH4_TRACE_EVENT_EXCEPTION );
+    sh4r.spc = BLOCK_A + 4;
+    enter_block( BLOCK_D );
+    execute( BLOCK_D_LEN );
+
+    /* Nothing is reading the FIFO yet, so this overflows the ring */
+    for( i=0; i<FLOOD_BLOCKS; i++ ) {
+        enter_block( BLOCK_A );
+        execute( BLOCK_A_LEN );
+    }
+    sh4_trace_block_translated( BLOCK_B, BLOCK_B + BLOCK_B_LEN*2 );
+
+    pthread_create( &drainer, NULL, drain_thread, &drain );
+    for( i=0; i<RETRY_BLOCKS; i++ ) {
+        enter_block( BLOCK_B );
+        execute( BLOCK_B_LEN );
+        usleep( 1000 );
+    }
+    enter_block( BLOCK_A );
+    sh4_trace_stop();
+    pthread_join( drainer, NULL );
+    close( drain.fd );
+    fclose( drain.out );
+
+    cmd = g_strdup_printf( "%s -o %s %s 2>%s", dectrace, listing, tracefile, summary );
+    if( system( cmd ) != 0 ) {
+        fprintf( stderr, "%s failed\n", cmd );
+        return 1;
+    }
+    g_free( cmd );
+    fails = check_listing( listing, summary );
+
+    unlink( fifo );
+    unlink( tracefile );
+    unlink( listing );
+    unlink( summary );
+    rmdir( dir );
+    if( fails == 0 ) {
+        printf( "Trace round-trip OK (%u blocks)\n", blocks_entered );
+    }
+    return fails == 0 ? 0 : 1;
+}
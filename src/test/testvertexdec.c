@@ -0,0 +1,179 @@
+/**
+ * $Id$
+ *
+ * Check the vertex decoders against the scalar reference decoder.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include "pvr2/pvr2.h"
+#include "pvr2/vertexdec.h"
+
+#define MAX_TEST_VERTEXES 37
+#define MAX_VERTEX_LENGTH 20
+#define TEST_ITERATIONS 2000
+
+/* Interesting z values, in addition to random ones */
+static uint32_t special_z[] = { 0x00000000, 0x80000000, 0x7F800000, 0xFF800000,
+        0x7FC00000, 0x00000001, 0x80400000, 0x3F800000, 0x7F7FFFFF, 0xBF000000 };
+
+static uint32_t random_word()
+{
+    return (((uint32_t)random()) << 16) ^ ((uint32_t)random());
+}
+
+static float random_float( float min, float max )
+{
+    return min + (max-min) * (random() / (float)RAND_MAX);
+}
+
+static uint32_t float_word( float f )
+{
+    uint32_t i;
+    memcpy( &i, &f, sizeof(i) );
+    return i;
+}
+
+static void random_vertex_data( uint32_t *data, unsigned int words )
+{
+    unsigned int i;
+    for( i=0; i<words; i++ ) {
+        switch( i % MAX_VERTEX_LENGTH ) {
+        case 0: case 1:
+            data[i] = float_word( random_float( -100, 740 ) );
+            break;
+        case 2:
+            if( (random() & 7) == 0 ) {
+                data[i] = special_z[random() % G_N_ELEMENTS(special_z)];
+            } else {
+                data[i] = float_word( random_float( -1.0, 16.0 ) );
+            }
+            break;
+        default:
+            data[i] = random_word();
+            break;
+        }
+    }
+}
+
+gboolean test_decode( vertex_decoder_t decoder )
+{
+    uint32_t data[MAX_TEST_VERTEXES * MAX_VERTEX_LENGTH];
+    struct vertex_struct expect[MAX_TEST_VERTEXES+1], result[MAX_TEST_VERTEXES+1];
+    int i, fails = 0;
+
+    for( i=0; i<TEST_ITERATIONS; i++ ) {
+        struct vertex_format fmt;
+        uint32_t poly1 = random_word(), poly2 = random_word(), tex = random_word();
+        unsigned int count = 1 + (random() % MAX_TEST_VERTEXES);
+        unsigned int stride = MAX_VERTEX_LENGTH - (random() % 4);
+        int modify_offset = (random() & 1) ? 0 : 7;
+        float expect_bounds[2], result_bounds[2];
+
+        vertex_format_init( &fmt, poly1, poly2, tex, modify_offset );
+        random_vertex_data( data, count * stride );
+        expect_bounds[0] = result_bounds[0] = expect_bounds[1] = result_bounds[1] = random_float( 0.0, 1.0 );
+        memset( expect, 0xA5, sizeof(expect) );
+        memset( result, 0x5A, sizeof(result) );
+
+        vertex_decoder_scalar.decode( expect, data, count, stride, &fmt, expect_bounds );
+        decoder->decode( result, data, count, stride, &fmt, result_bounds );
+        if( memcmp( expect, result, count * sizeof(struct vertex_struct) ) != 0 ||
+                memcmp( expect_bounds, result_bounds, sizeof(expect_bounds) ) != 0 ) {
+            if( fails++ == 0 ) {
+                printf( "%s decode mismatch for poly %08X %08X %08X, %d vertexes\n", decoder->name,
+                        poly1, poly2, tex, count );
+            }
+        } else if( memcmp( &expect[count], &result[count], sizeof(struct vertex_struct) ) == 0 ) {
+            if( fails++ == 0 ) {
+                printf( "%s decode wrote past the end of the output\n", decoder->name );
+            }
+        }
+    }
+    printf( "%s decode: %d/%d (%s)\n", decoder->name, TEST_ITERATIONS-fails, TEST_ITERATIONS,
+            (fails == 0 ? "OK" : "ERROR") );
+    return fails == 0;
+}
+
+gboolean test_compute( vertex_decoder_t decoder )
+{
+    uint32_t data[3 * MAX_VERTEX_LENGTH];
+    struct vertex_struct input[3], expect[4], result[4];
+    int i, j, fails = 0;
+
+    for( i=0; i<TEST_ITERATIONS; i++ ) {
+        struct vertex_format fmt;
+        gboolean solid = random() & 1;
+        float expect_bounds[2], result_bounds[2];
+        unsigned int count = (random() & 1) ? 1 : 4;
+
+        vertex_format_init( &fmt, random_word(), random_word(), random_word(), 0 );
+        random_vertex_data( data, 3 * MAX_VERTEX_LENGTH );
+        vertex_decoder_scalar.decode( input, data, 3, MAX_VERTEX_LENGTH, &fmt, expect_bounds );
+        expect_bounds[0] = result_bounds[0] = expect_bounds[1] = result_bounds[1] = 1.0;
+        for( j=0; j<3; j++ ) {
+            /* Keep the texture coordinates sane, as which NaN results from
+             * arithmetic on infinities isn't well defined */
+            input[j].u = random_float( -2.0, 2.0 );
+            input[j].v = random_float( -2.0, 2.0 );
+        }
+        if( (random() & 15) == 0 ) {
+            /* Colinear inputs */
+            input[2].x = input[1].x + (input[1].x - input[0].x);
+            input[2].y = input[1].y + (input[1].y - input[0].y);
+        }
+        memset( expect, 0, sizeof(expect) );
+        for( j=0; j<4; j++ ) {
+            expect[j].x = random_float( 0, 640 );
+            expect[j].y = random_float( 0, 480 );
+        }
+        memcpy( result, expect, sizeof(result) );
+
+        vertex_decoder_scalar.compute( expect, count, input, solid, expect_bounds );
+        decoder->compute( result, count, input, solid, result_bounds );
+        if( memcmp( expect, result, sizeof(expect) ) != 0 ||
+                memcmp( expect_bounds, result_bounds, sizeof(expect_bounds) ) != 0 ) {
+            if( fails++ == 0 ) {
+                printf( "%s compute mismatch (%s shaded, %d vertexes)\n", decoder->name,
+                        solid ? "solid" : "gouraud", count );
+            }
+        }
+    }
+    printf( "%s compute: %d/%d (%s)\n", decoder->name, TEST_ITERATIONS-fails, TEST_ITERATIONS,
+            (fails == 0 ? "OK" : "ERROR") );
+    return fails == 0;
+}
+
+int main()
+{
+    gboolean result = TRUE;
+    int i;
+
+    srandom(1);
+    for( i=0; vertex_decoder_list[i] != NULL; i++ ) {
+        vertex_decoder_t decoder = vertex_decoder_list[i];
+        if( decoder == &vertex_decoder_scalar ) {
+            continue;
+        } else if( !decoder->is_supported() ) {
+            printf( "%s: not supported on this CPU, skipped\n", decoder->name );
+        } else {
+            result = test_decode( decoder ) && result;
+            result = test_compute( decoder ) && result;
+        }
+    }
+    return result ? 0 : 1;
+}
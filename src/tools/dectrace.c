@@ -0,0 +1,330 @@
+/**
+ * $Id$
+ *
+ * Decoder for SH4 execution traces written by lxdream --record-trace. Expands
+ * the block records back into the stream of executed instructions, and
+ * writes it out as text, one instruction per line:
+ *     8C010000: 2F86
+ * with exceptions/interrupts and (if recorded) memory operations on their
+ * own lines. Memory operations are listed after the instructions of the
+ * block that performed them.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <glib.h>
+#include "sh4/sh4trace.h"
+
+struct trace_code {
+    uint32_t pc;
+    uint32_t count;
+    uint16_t *ops;
+};
+
+struct trace_memop {
+    int type;
+    int size;
+    uint32_t addr;
+    uint32_t value;
+};
+
+static struct {
+    FILE *in;
+    FILE *out;
+    gboolean blocks_only;
+    GHashTable *code;       /* pc -> struct trace_code */
+    uint32_t last_pc, last_mem_addr;
+    /* Block that's currently executing, printed when the next block starts */
+    gboolean block_pending;
+    uint32_t block_pc;
+    GArray *memops;
+    /* Statistics */
+    uint64_t blocks, instructions, events, lost;
+    uint32_t unknown_blocks;
+} dec;
+
+static struct option longopts[] = {
+        { "blocks", no_argument, NULL, 'b' },
+        { "help", no_argument, NULL, 'h' },
+        { "output", required_argument, NULL, 'o' },
+        { NULL, 0, 0, 0 } };
+static char shortopts[] = "bho:";
+
+static void usage()
+{
+    fprintf( stderr, "Usage: dectrace [options] <trace-file>\n" );
+    fprintf( stderr, "Options:\n" );
+    fprintf( stderr, "   -b, --blocks         Only list the start address of each block\n" );
+    fprintf( stderr, "   -h, --help           Print this help message\n" );
+    fprintf( stderr, "   -o, --output=FILE    Write the decoded trace to FILE (default stdout)\n" );
+}
+
+/**
+ * Read one varint from the trace.
+ * @return FALSE at end of file.
+ */
+static gboolean read_varint( uint64_t *val )
+{
+    int shift = 0, c;
+    *val = 0;
+    do {
+        if( (c = fgetc(dec.in)) == EOF || shift >= SH4_TRACE_MAX_VARINT*7 )
+            return FALSE;
+        *val |= ((uint64_t)(c & 0x7F)) << shift;
+        shift += 7;
+    } while( c & 0x80 );
+    return TRUE;
+}
+
+static const char *memop_size_name( int size )
+{
+    switch( size ) {
+    case 1: return "B";
+    case 2: return "W";
+    case 4: return "L";
+    default: return "Q";
+    }
+}
+
+/* Exit field value for a block whose exit point isn't known */
+#define EXIT_UNKNOWN 0
+
+/**
+ * Print the pending block, up to the point where it was left.
+ * @param exit_count the exit field from the following BLOCK or EVENT record, ie
+ * the number of instructions that ran plus 1, or EXIT_UNKNOWN.
+ * @param spc_valid If true, an exception was raised at spc - if that falls
+ * inside the block, the instruction at spc (and those after it) didn't run.
+ */
+static void flush_block( uint64_t exit_count, gboolean spc_valid, uint32_t spc )
+{
+    struct trace_code *code;
+    int i;
+
+    if( !dec.block_pending )
+        return;
+    dec.block_pending = FALSE;
+    dec.blocks++;
+    code = g_hash_table_lookup( dec.code, GUINT_TO_POINTER(dec.block_pc) );
+    if( dec.blocks_only || code == NULL ) {
+        if( code == NULL && !dec.blocks_only ) {
+            dec.unknown_blocks++;
+            fprintf( dec.out, "%08X: ????\n", dec.block_pc );
+        } else {
+            fprintf( dec.out, "%08X\n", dec.block_pc );
+        }
+    } else {
+        uint32_t count = code->count;
+        if( exit_count != EXIT_UNKNOWN && exit_count-1 < count )
+            count = (uint32_t)(exit_count-1);
+        if( spc_valid && spc >= code->pc && spc < code->pc + (count<<1) )
+            count = (spc - code->pc) >> 1;
+        for( i=0; i<count; i++ ) {
+            uint32_t pc = code->pc + (i<<1);
+            fprintf( dec.out, "%08X: %04X\n", pc, code->ops[i] );
+            dec.instructions++;
+        }
+    }
+    if( !dec.blocks_only ) {
+        for( i=0; i<dec.memops->len; i++ ) {
+            struct trace_memop *op = &g_array_index( dec.memops, struct trace_memop, i );
+            if( op->type == SH4_TRACE_READ ) {
+                fprintf( dec.out, "    read.%s  %08X -> %08X\n", memop_size_name(op->size), op->addr, op->value );
+            } else {
+                fprintf( dec.out, "    write.%s %08X <- %08X\n", memop_size_name(op->size), op->addr, op->value );
+            }
+        }
+    }
+    g_array_set_size( dec.memops, 0 );
+}
+
+static void truncated( void )
+{
+    flush_block( EXIT_UNKNOWN, FALSE, 0 );
+    fprintf( stderr, "Warning: trace file is truncated\n" );
+}
+
+static gboolean read_code( uint32_t count )
+{
+    struct trace_code *code;
+    uint64_t pc;
+    int i;
+
+    if( !read_varint( &pc ) )
+        return FALSE;
+    code = g_malloc( sizeof(struct trace_code) );
+    code->pc = (uint32_t)pc;
+    code->count = count;
+    code->ops = g_malloc( count * sizeof(uint16_t) + 1 );
+    for( i=0; i<count; i++ ) {
+        int lo = fgetc(dec.in), hi = fgetc(dec.in);
+        if( hi == EOF ) {
+            g_free( code->ops );
+            g_free( code );
+            return FALSE;
+        }
+        code->ops[i] = (uint16_t)(lo | (hi << 8));
+    }
+    /* A later translation of the same address replaces the old one */
+    g_hash_table_replace( dec.code, GUINT_TO_POINTER(code->pc), code );
+    return TRUE;
+}
+
+static void free_code( gpointer data )
+{
+    struct trace_code *code = data;
+    g_free( code->ops );
+    g_free( code );
+}
+
+static gboolean decode_trace( void )
+{
+    char magic[SH4_TRACE_MAGIC_LENGTH];
+    uint64_t header, a, b, exit_count;
+
+    if( fread( magic, SH4_TRACE_MAGIC_LENGTH, 1, dec.in ) != 1 ||
+            memcmp( magic, SH4_TRACE_MAGIC, SH4_TRACE_MAGIC_LENGTH ) != 0 ) {
+        fprintf( stderr, "Error: not an lxdream trace file\n" );
+        return FALSE;
+    }
+
+    while( read_varint( &header ) ) {
+        uint64_t payload = header >> SH4_TRACE_TYPE_BITS;
+        switch( header & ((1<<SH4_TRACE_TYPE_BITS)-1) ) {
+        case SH4_TRACE_BLOCK:
+            if( !read_varint( &exit_count ) ) {
+                truncated();
+                return TRUE;
+            }
+            flush_block( exit_count, FALSE, 0 );
+            dec.last_pc += sh4_trace_unzigzag( payload );
+            dec.block_pc = dec.last_pc;
+            dec.block_pending = TRUE;
+            break;
+        case SH4_TRACE_CODE:
+            if( !read_code( (uint32_t)payload ) ) {
+                truncated();
+                return TRUE;
+            }
+            break;
+        case SH4_TRACE_EVENT:
+            if( !read_varint( &a ) || !read_varint( &exit_count ) ) {
+                truncated();
+                return TRUE;
+            } else {
+                unsigned kind = payload & ((1<<SH4_TRACE_EVENT_KIND_BITS)-1);
+                unsigned event = (unsigned)(payload >> SH4_TRACE_EVENT_KIND_BITS);
+                flush_block( exit_count, kind == SH4_TRACE_EVENT_EXCEPTION, (uint32_t)a );
+                switch( kind ) {
+                case SH4_TRACE_EVENT_EXCEPTION:
+                    fprintf( dec.out, "*** Exception %03X, SPC=%08X\n", event, (uint32_t)a );
+                    break;
+                case SH4_TRACE_EVENT_INTERRUPT:
+                    fprintf( dec.out, "*** Interrupt %03X, SPC=%08X\n", event, (uint32_t)a );
+                    break;
+                default:
+                    fprintf( dec.out, "*** Reset %03X, PC=%08X\n", event, (uint32_t)a );
+                    break;
+                }
+                dec.events++;
+            }
+            break;
+        case SH4_TRACE_READ:
+        case SH4_TRACE_WRITE:
+            if( !read_varint( &a ) || !read_varint( &b ) ) {
+                truncated();
+                return TRUE;
+            } else {
+                struct trace_memop op;
+                op.type = header & ((1<<SH4_TRACE_TYPE_BITS)-1);
+                op.size = (int)payload;
+                op.addr = dec.last_mem_addr + sh4_trace_unzigzag( a );
+                op.value = (uint32_t)b;
+                dec.last_mem_addr = op.addr;
+                g_array_append_val( dec.memops, op );
+            }
+            break;
+        case SH4_TRACE_LOST:
+            flush_block( EXIT_UNKNOWN, FALSE, 0 );
+            fprintf( dec.out, "*** %" G_GUINT64_FORMAT " records lost\n", (guint64)payload );
+            dec.lost += payload;
+            break;
+        default:
+            fprintf( stderr, "Error: unknown record type %d at offset %ld\n",
+                    (int)(header & ((1<<SH4_TRACE_TYPE_BITS)-1)), ftell(dec.in) );
+            return FALSE;
+        }
+    }
+    flush_block( EXIT_UNKNOWN, FALSE, 0 );
+    return TRUE;
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *out_filename = NULL;
+    gboolean ok;
+    int opt;
+
+    while( (opt = getopt_long( argc, argv, shortopts, longopts, NULL )) != -1 ) {
+        switch( opt ) {
+        case 'b':
+            dec.blocks_only = TRUE;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        case 'o':
+            out_filename = optarg;
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if( optind != argc-1 ) {
+        usage();
+        exit(1);
+    }
+
+    dec.in = fopen( argv[optind], "rb" );
+    if( dec.in == NULL ) {
+        perror( argv[optind] );
+        exit(2);
+    }
+    if( out_filename == NULL ) {
+        dec.out = stdout;
+    } else if( (dec.out = fopen( out_filename, "w" )) == NULL ) {
+        perror( out_filename );
+        exit(2);
+    }
+    dec.code = g_hash_table_new_full( g_direct_hash, g_direct_equal, NULL, free_code );
+    dec.memops = g_array_new( FALSE, FALSE, sizeof(struct trace_memop) );
+
+    ok = decode_trace();
+
+    fclose( dec.in );
+    if( dec.out != stdout )
+        fclose( dec.out );
+    fprintf( stderr, "%" G_GUINT64_FORMAT " blocks, %" G_GUINT64_FORMAT " instructions, %"
+            G_GUINT64_FORMAT " events, %" G_GUINT64_FORMAT " records lost\n",
+            (guint64)dec.blocks, (guint64)dec.instructions, (guint64)dec.events, (guint64)dec.lost );
+    if( dec.unknown_blocks > 0 )
+        fprintf( stderr, "Warning: code for %u blocks was not in the trace\n", dec.unknown_blocks );
+    g_hash_table_destroy( dec.code );
+    g_array_free( dec.memops, TRUE );
+    return ok ? 0 : 3;
+}
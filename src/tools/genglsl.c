@@ -383,6 +383,8 @@ static void writeInterface( const char *filename, glsldata_t data )
                 if( strcmp(var->type,"vec4") == 0 ) { /* Special case */
                     fprintf( f, "void glsl_set_%s_%s_vec2_pointer(%s ptr, GLint stride); /* attribute %s %s */ \n", program->name, var->name, getCType(var->type,var->uniform), var->type, var->name);
                     fprintf( f, "void glsl_set_%s_%s_vec3_pointer(%s ptr, GLint stride); /* attribute %s %s */ \n", program->name, var->name, getCType(var->type,var->uniform), var->type, var->name);
+                    fprintf( f, "void glsl_set_%s_%s_unorm8_pointer(GLubyte *ptr, GLint stride); /* attribute %s %s */ \n", program->name, var->name, var->type, var->name);
+                    fprintf( f, "void glsl_set_%s_%s_ubyte_pointer(GLubyte *ptr, GLint stride); /* attribute %s %s */ \n", program->name, var->name, var->type, var->name);
                 }
             }
         }
@@ -476,6 +478,11 @@ static void writeSource( const char *filename, glsldata_t data )
                     fprintf( f, "    glsl_set_attrib_vec3(var_%s_%s_loc,stride, ptr);\n}\n", program->name, var->name );
                     fprintf( f, "void glsl_set_%s_%s_vec2_pointer(%s ptr, GLsizei stride){ /* attribute %s %s */ \n", program->name, var->name, getCType(var->type,var->uniform), var->type, var->name);
                     fprintf( f, "    glsl_set_attrib_vec2(var_%s_%s_loc,stride, ptr);\n}\n", program->name, var->name );
+                    /* And to load 4 bytes into a vec4, either normalised (colours) or not */
+                    fprintf( f, "void glsl_set_%s_%s_unorm8_pointer(GLubyte *ptr, GLsizei stride){ /* attribute %s %s */ \n", program->name, var->name, var->type, var->name);
+                    fprintf( f, "    glsl_set_attrib_unorm8(var_%s_%s_loc,stride, ptr);\n}\n", program->name, var->name );
+                    fprintf( f, "void glsl_set_%s_%s_ubyte_pointer(GLubyte *ptr, GLsizei stride){ /* attribute %s %s */ \n", program->name, var->name, var->type, var->name);
+                    fprintf( f, "    glsl_set_attrib_ubyte(var_%s_%s_loc,stride, ptr);\n}\n", program->name, var->name );
                 }
             }
         }
@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "mem.h"
+#include "mmio.h"
+#include "sh4/sh4core.h"
 
 struct watch_point {
     uint32_t start;
@@ -29,6 +31,18 @@ struct watch_point {
 struct watch_point *watch_arr = NULL;
 int watch_count = 0, watch_capacity = 0;
 
+/* Original vtable of each page with wrappers installed, or NULL */
+static mem_region_fn_t *watch_page_fn = NULL;
+#define WATCH_PAGE_FN(addr) watch_page_fn[((addr)&0x1FFFFFFF)>>LXDREAM_PAGE_BITS]
+
+static struct {
+    int op;
+    uint32_t addr;
+} watch_hit = { 0, 0 };
+static uint32_t watch_resume_addr = 0;
+
+static void watch_update_pages( uint32_t start, uint32_t end );
+
 
 watch_point_t mem_new_watch( uint32_t start, uint32_t end, int flags )
 {
@@ -55,6 +69,7 @@ watch_point_t mem_new_watch( uint32_t start, uint32_t end, int flags )
     watch_arr[num].end = end & 0x1FFFFFFF;
     watch_arr[num].flags = flags;
     watch_count++;
+    watch_update_pages( start, end );
     return &watch_arr[num];
 }
 
@@ -65,9 +80,11 @@ void mem_delete_watch( watch_point_t watch )
     int num = watch - watch_arr;
     if( num < 0 || num >= watch_capacity )
         return;
+    uint32_t start = watch->start, end = watch->end;
     watch->start = watch->end = 0;
     watch->flags = 0;
     watch_count--;
+    watch_update_pages( start, end );
 }
 
 
@@ -88,3 +105,134 @@ watch_point_t mem_is_watched( uint32_t addr, int size, int op )
     return NULL;
 }
 
+watch_point_t mem_find_watch( uint32_t start, uint32_t end, int flags )
+{
+    int i;
+    start &= 0x1FFFFFFF;
+    end &= 0x1FFFFFFF;
+    for( i=0; i<watch_capacity; i++ ) {
+        if( watch_arr[i].flags == flags && watch_arr[i].start == start &&
+                watch_arr[i].end == end ) {
+            return &watch_arr[i];
+        }
+    }
+    return NULL;
+}
+
+int mem_get_watch_hit( uint32_t *addr )
+{
+    int op = watch_hit.op;
+    *addr = watch_hit.addr;
+    watch_hit.op = 0;
+    return op;
+}
+
+/**
+ * Check an access to a watched page, and stop the machine if it hits a
+ * watch point. As with breakpoints, the instruction that hit the watch point
+ * is let through when execution resumes.
+ */
+static void watch_check( sh4addr_t addr, int size, int op )
+{
+    if( mem_is_watched( addr, size, op ) != NULL ) {
+        if( sh4_starting && sh4r.slice_cycle == 0 && addr == watch_resume_addr ) {
+            return;
+        }
+        watch_hit.op = op;
+        watch_hit.addr = watch_resume_addr = addr;
+        sh4_core_exit( CORE_EXIT_BREAKPOINT );
+        /* Only returns if the core isn't running (eg single-stepping) */
+        watch_hit.op = 0;
+    }
+}
+
+static int32_t FASTCALL watch_read_long( sh4addr_t addr )
+{
+    watch_check( addr, 4, WATCH_READ );
+    return WATCH_PAGE_FN(addr)->read_long(addr);
+}
+
+static int32_t FASTCALL watch_read_word( sh4addr_t addr )
+{
+    watch_check( addr, 2, WATCH_READ );
+    return WATCH_PAGE_FN(addr)->read_word(addr);
+}
+
+static int32_t FASTCALL watch_read_byte( sh4addr_t addr )
+{
+    watch_check( addr, 1, WATCH_READ );
+    return WATCH_PAGE_FN(addr)->read_byte(addr);
+}
+
+static int32_t FASTCALL watch_read_byte_for_write( sh4addr_t addr )
+{
+    watch_check( addr, 1, WATCH_READ );
+    return WATCH_PAGE_FN(addr)->read_byte_for_write(addr);
+}
+
+static void FASTCALL watch_write_long( sh4addr_t addr, uint32_t val )
+{
+    watch_check( addr, 4, WATCH_WRITE );
+    WATCH_PAGE_FN(addr)->write_long(addr, val);
+}
+
+static void FASTCALL watch_write_word( sh4addr_t addr, uint32_t val )
+{
+    watch_check( addr, 2, WATCH_WRITE );
+    WATCH_PAGE_FN(addr)->write_word(addr, val);
+}
+
+static void FASTCALL watch_write_byte( sh4addr_t addr, uint32_t val )
+{
+    watch_check( addr, 1, WATCH_WRITE );
+    WATCH_PAGE_FN(addr)->write_byte(addr, val);
+}
+
+static void FASTCALL watch_read_burst( unsigned char *dest, sh4addr_t addr )
+{
+    watch_check( addr, 32, WATCH_READ );
+    WATCH_PAGE_FN(addr)->read_burst(dest, addr);
+}
+
+static void FASTCALL watch_write_burst( sh4addr_t addr, unsigned char *src )
+{
+    watch_check( addr, 32, WATCH_WRITE );
+    WATCH_PAGE_FN(addr)->write_burst(addr, src);
+}
+
+static void FASTCALL watch_prefetch( sh4addr_t addr )
+{
+    WATCH_PAGE_FN(addr)->prefetch(addr);
+}
+
+static struct mem_region_fn mem_region_watched = {
+        watch_read_long, watch_write_long, watch_read_word, watch_write_word,
+        watch_read_byte, watch_write_byte, watch_read_burst, watch_write_burst,
+        watch_prefetch, watch_read_byte_for_write };
+
+/**
+ * Install or remove the checking wrappers on each page in the range,
+ * according to whether any watch point still covers it.
+ */
+static void watch_update_pages( uint32_t start, uint32_t end )
+{
+    uint32_t page;
+
+    start &= 0x1FFFFFFF;
+    end &= 0x1FFFFFFF;
+    if( watch_page_fn == NULL ) {
+        watch_page_fn = calloc( sizeof(mem_region_fn_t), LXDREAM_PAGE_TABLE_ENTRIES );
+    }
+    for( page = start & ~(LXDREAM_PAGE_SIZE-1); page <= end; page += LXDREAM_PAGE_SIZE ) {
+        mem_region_fn_t *orig = &WATCH_PAGE_FN(page);
+        if( mem_is_watched( page, LXDREAM_PAGE_SIZE, WATCH_READ|WATCH_WRITE ) != NULL ) {
+            if( *orig == NULL ) {
+                *orig = ext_address_space[page>>LXDREAM_PAGE_BITS];
+                mem_set_page_fn( page, &mem_region_watched );
+            }
+        } else if( *orig != NULL ) {
+            mem_set_page_fn( page, *orig );
+            *orig = NULL;
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/**
+ * $Id$
+ *
+ * Worker thread pool. Items of the current batch are handed out one at a
+ * time, under the pool lock, to whichever thread asks first.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "workpool.h"
+
+/* Items may use a fair amount of stack (eg the software rasteriser), so don't
+ * rely on the platform default, which can be quite small for secondary threads. */
+#define WORKPOOL_STACK_SIZE (4*1024*1024)
+
+static struct {
+    pthread_mutex_t run_lock;  /* Held for the duration of a batch */
+    pthread_mutex_t lock;
+    pthread_cond_t work_wait;  /* Signalled when a new batch is posted */
+    pthread_cond_t done_wait;  /* Signalled when the last item completes */
+    workpool_fn_t fn;          /* Current batch */
+    void *data;
+    unsigned int count;
+    unsigned int next_item;    /* Next item to be started */
+    unsigned int pending;      /* Items not yet completed */
+    unsigned int threads;      /* Including the caller */
+    gboolean started;
+} workpool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+        PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0, 1, FALSE };
+
+/**
+ * Take items from the current batch until there are none left. Called with
+ * the lock held.
+ */
+static void workpool_work( unsigned int thread )
+{
+    while( workpool.next_item < workpool.count ) {
+        unsigned int item = workpool.next_item++;
+        workpool_fn_t fn = workpool.fn;
+        void *data = workpool.data;
+        pthread_mutex_unlock( &workpool.lock );
+        fn( data, item, thread );
+        pthread_mutex_lock( &workpool.lock );
+        if( --workpool.pending == 0 )
+            pthread_cond_broadcast( &workpool.done_wait );
+    }
+}
+
+static void *workpool_thread( void *arg )
+{
+    unsigned int thread = GPOINTER_TO_UINT(arg);
+    pthread_mutex_lock( &workpool.lock );
+    for(;;) {
+        workpool_work( thread );
+        pthread_cond_wait( &workpool.work_wait, &workpool.lock );
+    }
+    return NULL;
+}
+
+/**
+ * Start the worker threads. Called with the lock held.
+ */
+static void workpool_start( void )
+{
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    int i, threads = cpus > 1 ? cpus - 1 : 0;
+    pthread_attr_t attr;
+    if( threads > WORKPOOL_MAX_THREADS-1 )
+        threads = WORKPOOL_MAX_THREADS-1;
+
+    pthread_attr_init( &attr );
+    pthread_attr_setstacksize( &attr, WORKPOOL_STACK_SIZE );
+    for( i=0; i<threads; i++ ) {
+        pthread_t thread;
+        if( pthread_create( &thread, &attr, workpool_thread, GUINT_TO_POINTER(workpool.threads) ) != 0 ) {
+            WARN( "Unable to start worker thread" );
+            break;
+        }
+        pthread_detach( thread );
+        workpool.threads++;
+    }
+    pthread_attr_destroy( &attr );
+    workpool.started = TRUE;
+}
+
+unsigned int workpool_thread_count( void )
+{
+    unsigned int threads;
+    pthread_mutex_lock( &workpool.lock );
+    if( !workpool.started )
+        workpool_start();
+    threads = workpool.threads;
+    pthread_mutex_unlock( &workpool.lock );
+    return threads;
+}
+
+void workpool_run( workpool_fn_t fn, void *data, unsigned int count )
+{
+    if( count == 0 )
+        return;
+    pthread_mutex_lock( &workpool.run_lock );
+    pthread_mutex_lock( &workpool.lock );
+    if( !workpool.started )
+        workpool_start();
+    workpool.fn = fn;
+    workpool.data = data;
+    workpool.count = count;
+    workpool.next_item = 0;
+    workpool.pending = count;
+    if( count > 1 )
+        pthread_cond_broadcast( &workpool.work_wait );
+    workpool_work( 0 );
+    while( workpool.pending != 0 ) {
+        pthread_cond_wait( &workpool.done_wait, &workpool.lock );
+    }
+    workpool.fn = NULL;
+    workpool.count = workpool.next_item = 0;
+    pthread_mutex_unlock( &workpool.lock );
+    pthread_mutex_unlock( &workpool.run_lock );
+}
@@ -0,0 +1,61 @@
+/**
+ * $Id$
+ *
+ * Small pool of worker threads for splitting a batch of independent work
+ * items (eg render tiles) across the available CPUs.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_workpool_H
+#define lxdream_workpool_H 1
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Upper bound on workpool_thread_count(), for sizing per-thread state */
+#define WORKPOOL_MAX_THREADS 16
+
+/**
+ * Function run for each item of a batch.
+ * @param data the data pointer given to workpool_run
+ * @param item the index of the item, from 0 to count-1
+ * @param thread the index of the thread running the item, from 0 to
+ * workpool_thread_count()-1, where 0 is the calling thread. No two items
+ * run at the same time with the same thread index, so it can be used to
+ * select per-thread scratch space.
+ */
+typedef void (*workpool_fn_t)( void *data, unsigned int item, unsigned int thread );
+
+/**
+ * @return the number of threads that can run items, including the caller.
+ * Starts the pool if it isn't already running.
+ */
+unsigned int workpool_thread_count( void );
+
+/**
+ * Run fn for each of count items, in no particular order, and wait for them
+ * all to complete. The calling thread takes part in the work. Batches
+ * from different threads are run one after the other. Not re-entrant (ie
+ * fn must not call workpool_run).
+ */
+void workpool_run( workpool_fn_t fn, void *data, unsigned int count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_workpool_H */
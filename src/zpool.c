@@ -0,0 +1,210 @@
+/**
+ * $Id$
+ *
+ * Parallel chunked compression of large memory blocks. The block is split
+ * into ZPOOL_CHUNK_SIZE chunks which are compressed independently, so that
+ * both compression and decompression can be spread across the shared worker
+ * pool (the calling thread works on the batch as well).
+ *
+ * Stream format:
+ *    uint32_t marker (ZPOOL_MARKER)
+ *    uint32_t chunk size (uncompressed)
+ *    uint32_t chunk count
+ *    uint32_t compressed size of each chunk
+ *    compressed chunk data, in order
+ * The marker can't be mistaken for the length word of an fwrite_gzip block,
+ * so fread_zpool accepts either.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <zlib.h>
+#include <glib.h>
+#include "lxdream.h"
+#include "workpool.h"
+#include "zpool.h"
+
+#define ZPOOL_MARKER 0xFFFFFFFF
+#define ZPOOL_MAX_CHUNK_SIZE (16*1024*1024)
+
+struct zpool_chunk {
+    unsigned char *src;
+    uLong src_len;
+    unsigned char *dest;
+    uLongf dest_len;  /* Capacity on entry, actual length on completion */
+    int status;
+};
+
+struct zpool_batch {
+    struct zpool_chunk *chunks;
+    gboolean compress;
+    int level;
+};
+
+static struct {
+    int level;
+    /* Buffers reused between calls */
+    unsigned char *buffer;
+    size_t buffer_size;
+    struct zpool_chunk *chunk_buf;
+    unsigned int chunk_buf_size;
+} zpool = { ZPOOL_LEVEL_DEFAULT, NULL, 0, NULL, 0 };
+
+static void zpool_run_chunk( void *data, unsigned int item, unsigned int thread )
+{
+    struct zpool_batch *batch = (struct zpool_batch *)data;
+    struct zpool_chunk *chunk = &batch->chunks[item];
+    uLongf expect = chunk->dest_len;
+    if( batch->compress ) {
+        chunk->status = compress2( chunk->dest, &chunk->dest_len, chunk->src, chunk->src_len, batch->level );
+    } else {
+        chunk->status = uncompress( chunk->dest, &chunk->dest_len, chunk->src, chunk->src_len );
+        if( chunk->status == Z_OK && chunk->dest_len != expect )
+            chunk->status = Z_DATA_ERROR;
+    }
+}
+
+/**
+ * Run a batch of chunks to completion.
+ * @return TRUE if every chunk succeeded.
+ */
+static gboolean zpool_run_batch( struct zpool_chunk *chunks, unsigned int count, gboolean compress )
+{
+    struct zpool_batch batch = { chunks, compress, zpool.level };
+    int i;
+
+    workpool_run( zpool_run_chunk, &batch, count );
+    for( i=0; i<count; i++ ) {
+        if( chunks[i].status != Z_OK )
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static unsigned char *zpool_get_buffer( size_t size )
+{
+    if( size > zpool.buffer_size ) {
+        zpool.buffer = g_realloc( zpool.buffer, size );
+        zpool.buffer_size = size;
+    }
+    return zpool.buffer;
+}
+
+static struct zpool_chunk *zpool_get_chunks( unsigned int count )
+{
+    if( count > zpool.chunk_buf_size ) {
+        zpool.chunk_buf = g_realloc( zpool.chunk_buf, count * sizeof(struct zpool_chunk) );
+        zpool.chunk_buf_size = count;
+    }
+    return zpool.chunk_buf;
+}
+
+void zpool_set_level( int level )
+{
+    zpool.level = level;
+}
+
+int zpool_get_level( void )
+{
+    return zpool.level;
+}
+
+int fwrite_zpool( void *p, size_t sz, size_t count, FILE *f )
+{
+    size_t size = sz*count;
+    uint32_t chunk_size = ZPOOL_CHUNK_SIZE;
+    uint32_t chunk_count = (size + chunk_size - 1) / chunk_size;
+    uint32_t marker = ZPOOL_MARKER;
+    uLong bound = compressBound( chunk_size );
+    unsigned char *buf = zpool_get_buffer( chunk_count * bound );
+    struct zpool_chunk *chunks = zpool_get_chunks( chunk_count );
+    int i;
+
+    for( i=0; i<chunk_count; i++ ) {
+        chunks[i].src = ((unsigned char *)p) + i*chunk_size;
+        chunks[i].src_len = MIN( chunk_size, size - i*chunk_size );
+        chunks[i].dest = buf + i*bound;
+        chunks[i].dest_len = bound;
+    }
+    if( !zpool_run_batch( chunks, chunk_count, TRUE ) )
+        return 0;
+
+    fwrite( &marker, sizeof(marker), 1, f );
+    fwrite( &chunk_size, sizeof(chunk_size), 1, f );
+    fwrite( &chunk_count, sizeof(chunk_count), 1, f );
+    for( i=0; i<chunk_count; i++ ) {
+        uint32_t csize = chunks[i].dest_len;
+        fwrite( &csize, sizeof(csize), 1, f );
+    }
+    for( i=0; i<chunk_count; i++ ) {
+        if( fwrite( chunks[i].dest, chunks[i].dest_len, 1, f ) != 1 )
+            return 0;
+    }
+    return count;
+}
+
+int fread_zpool( void *p, size_t sz, size_t count, FILE *f )
+{
+    size_t size = sz*count;
+    uint32_t marker, chunk_size, chunk_count, csize;
+    size_t total = 0;
+    unsigned char *buf;
+    struct zpool_chunk *chunks;
+    int i;
+
+    if( fread( &marker, sizeof(marker), 1, f ) != 1 )
+        return 0;
+    if( marker != ZPOOL_MARKER ) {
+        /* Single block from fwrite_gzip */
+        uLongf len = size;
+        if( marker > size*2 )
+            return 0;
+        buf = zpool_get_buffer( marker );
+        if( fread( buf, marker, 1, f ) != 1 ||
+                uncompress( p, &len, buf, marker ) != Z_OK ) {
+            ERROR( "Error reading compressed data" );
+            return 0;
+        }
+        return count;
+    }
+
+    if( fread( &chunk_size, sizeof(chunk_size), 1, f ) != 1 ||
+            fread( &chunk_count, sizeof(chunk_count), 1, f ) != 1 ||
+            chunk_size == 0 || chunk_size > ZPOOL_MAX_CHUNK_SIZE ||
+            chunk_count != (size + chunk_size - 1) / chunk_size ) {
+        ERROR( "Error reading compressed data (bad chunk header)" );
+        return 0;
+    }
+    chunks = zpool_get_chunks( chunk_count );
+    for( i=0; i<chunk_count; i++ ) {
+        if( fread( &csize, sizeof(csize), 1, f ) != 1 || csize > chunk_size*2 )
+            return 0;
+        chunks[i].src_len = csize;
+        chunks[i].dest = ((unsigned char *)p) + i*chunk_size;
+        chunks[i].dest_len = MIN( chunk_size, size - i*chunk_size );
+        total += csize;
+    }
+    buf = zpool_get_buffer( total );
+    if( fread( buf, total, 1, f ) != 1 )
+        return 0;
+    for( i=0; i<chunk_count; i++ ) {
+        chunks[i].src = buf;
+        buf += chunks[i].src_len;
+    }
+    if( !zpool_run_batch( chunks, chunk_count, FALSE ) ) {
+        ERROR( "Error reading compressed data" );
+        return 0;
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+/**
+ * $Id$
+ *
+ * Parallel chunked compression of large memory blocks (ie RAM in save
+ * states), using the shared worker pool.
+ *
+ * Copyright (c) 2026 lxdream contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef lxdream_zpool_H
+#define lxdream_zpool_H 1
+
+#include <stdio.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of each independently compressed chunk */
+#define ZPOOL_CHUNK_SIZE (256*1024)
+
+/** Compression levels (as for zlib) */
+#define ZPOOL_LEVEL_FAST 1
+#define ZPOOL_LEVEL_DEFAULT -1
+
+/**
+ * Set the compression level used by subsequent calls to fwrite_zpool.
+ * Defaults to ZPOOL_LEVEL_DEFAULT.
+ */
+void zpool_set_level( int level );
+
+/**
+ * @return the current compression level.
+ */
+int zpool_get_level( void );
+
+/**
+ * Compress the given block in fixed-size chunks, in parallel, and write it
+ * to the stream. Not re-entrant.
+ * @return count on success, otherwise 0.
+ */
+int fwrite_zpool( void *p, size_t size, size_t count, FILE *f );
+
+/**
+ * Read a block written by fwrite_zpool (or fwrite_gzip), decompressing the
+ * chunks in parallel. Not re-entrant.
+ * @return count on success, otherwise 0.
+ */
+int fread_zpool( void *p, size_t size, size_t count, FILE *f );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !lxdream_zpool_H */